@@ -104,6 +104,13 @@
 #define _PyObject_GC_IS_TRACKED(o)              \
         ((_Py_AS_GC(o))->gc.gc_refs != _PyGC_REFS_UNTRACKED)
 
+#ifndef _PyObject_GC_MAY_BE_TRACKED
+/* True if the object may be tracked by the GC now or in the future. */
+#define _PyObject_GC_MAY_BE_TRACKED(obj)                        \
+        (PyObject_IS_GC(obj) &&                                 \
+         (!PyTuple_CheckExact(obj) || _PyObject_GC_IS_TRACKED(obj)))
+#endif
+
 #if PY_MINOR_VERSION < 6
 /* Backward compatibility with Python 2.5 */
 #define PyUnicode_FromString PyString_FromString
@@ -130,16 +137,18 @@
 
 #define BLIST_PYAPI(type) static type
 
+/* An iterator holds no references into the tree, so that writing to
+ * the list while iterating over it does not force a copy of the path
+ * to the current leaf.  Instead it remembers node_epoch when it
+ * located its leaf, and finds its place again from the root whenever
+ * a node has been freed or copied since.
+ */
 typedef struct {
-        PyBList *lst;
-        int i;
-} point_t;
-
-typedef struct {
-        int depth;
-        PyBList *leaf;
-        int i;
-        point_t stack[MAX_HEIGHT];
+        PyBList *lst;           /* The list being iterated over */
+        PyBList *leaf;          /* Borrowed; NULL once exhausted */
+        int i;                  /* Index of the next item in leaf */
+        Py_ssize_t offset;      /* Index of leaf's first item in lst */
+        unsigned long epoch;    /* node_epoch when leaf was located */
 } iter_t;
 
 typedef struct {
@@ -158,6 +167,10 @@ static int num_free_ulists = 0;
 static blistiterobject *free_iters[MAXFREELISTS];
 static int num_free_iters = 0;
 
+/* Bumped whenever a non-root node is freed or replaced by a private
+ * copy, which is what an iter_t's borrowed leaf pointer depends on. */
+static unsigned long node_epoch = 0;
+
 typedef struct sortwrapperobject
 {
         union {
@@ -176,12 +189,43 @@ typedef struct sortwrapperobject
 #define PyBList_CheckExact(op) ((op)->ob_type == &PyBList_Type || (op)->ob_type == &PyRootBList_Type)
 #define PyBListIter_Check(op) (PyObject_TypeCheck((op), &PyBListIter_Type) || (PyObject_TypeCheck((op), &PyBListReverseIter_Type)))
 
+/* Typed blists keep a raw 64-bit value in each leaf slot and sort
+ * them with the 64-bit radix sort, so they need 64-bit pointers and
+ * IEEE doubles. */
+#if SIZEOF_VOID_P == 8 && defined(BLIST_FLOAT_RADIX_SORT)
+#define BLIST_TYPED 1
+#define PyTypedBList_Check(op) (PyObject_TypeCheck((op), &PyTypedBList_Type))
+#else
+#define PyTypedBList_Check(op) 0
+#endif
+
 #define INDEX_LENGTH(self) (((self)->n-1) / INDEX_FACTOR + 1)
 
 /************************************************************************
  * Utility functions for copying and moving children.
  */
 
+/* Internal nodes cache the running totals of their children's n in
+ * child_ends, so that blist_locate() can search one dense array
+ * instead of touching every child.  Only the first num_ends entries
+ * are valid.  Anything that moves the children of self, or changes
+ * the n of child k or later without fixing child_ends, must forget
+ * the entries from k onward.
+ */
+#define blist_forget_ends(self, k) \
+        do { if ((self)->num_ends > (k)) (self)->num_ends = (k); } while (0)
+
+/* True if the children of self are raw values rather than objects.
+ * Only leaves of typed blists are raw; the typecode of an internal
+ * node means nothing. */
+#define blist_raw(self) ((self)->leaf && (self)->typecode)
+
+/* Nodes below the root never change size, so their LIMIT children are
+ * stored inline, right after the PyBList header, and the node costs a
+ * single allocation.  Roots keep a separate array since they grow. */
+#define blist_inline_children(self) ((PyObject **) ((PyBList *) (self) + 1))
+#define blist_is_inline(self) (Py_TYPE(self) == &PyBList_Type)
+
 /* copy n children from index k2 of other to index k of self */
 BLIST_LOCAL(void)
 copy(PyBList *self, int k, PyBList *other, int k2, int n)
@@ -191,6 +235,7 @@ copy(PyBList *self, int k, PyBList *other, int k2, int n)
         PyObject **stop = &other->children[k2+n];
 
         assert(self != other);
+        blist_forget_ends(self, k);
 
         while (src < stop)
                 *dst++ = *src++;
@@ -203,6 +248,12 @@ copyref(PyBList *self, int k, PyBList *other, int k2,int n) {
         PyObject **restrict dst = &self->children[k];
         PyObject **stop = &src[n];
 
+        blist_forget_ends(self, k);
+        if (blist_raw(other)) {
+                while (src < stop)
+                        *dst++ = *src++;
+                return;
+        }
         while (src < stop) {
                 Py_INCREF(*src);
                 *dst++ = *src++;
@@ -216,6 +267,12 @@ xcopyref(PyBList *self, int k, PyBList *other,int k2,int n) {
         PyObject **restrict dst = &self->children[k];
         PyObject **stop = &src[n];
 
+        blist_forget_ends(self, k);
+        if (blist_raw(other)) {
+                while (src < stop)
+                        *dst++ = *src++;
+                return;
+        }
         while (src < stop) {
                 Py_XINCREF(*src);
                 *dst++ = *src++;
@@ -230,6 +287,7 @@ shift_right(PyBList *self, int k, int n)
         PyObject **dst = &self->children[self->num_children-1 + n];
         PyObject **stop = &self->children[k];
 
+        blist_forget_ends(self, k);
         if (self->num_children == 0)
                 return;
 
@@ -254,6 +312,7 @@ shift_left(PyBList *self, int k, int n)
         assert(k <= LIMIT);
         assert(self->num_children -n >= 0);
 
+        blist_forget_ends(self, k - n);
         while (src < stop)
                 *dst++ = *src++;
 
@@ -303,20 +362,20 @@ balance_leafs(PyBList *restrict leaf1, PyBList *restrict leaf2)
 
 /* Iteration over part of the list */
 #define ITER2(lst, item, start, stop, block) {\
-        iter_t _it; int _use_iter; \
         if (lst->leaf) { \
-                Py_ssize_t _i; _use_iter = 0; \
+                Py_ssize_t _i; \
                 for (_i = (start); _i < lst->num_children && _i < (stop); _i++) { \
                         item = lst->children[_i]; \
                         block; \
                 } \
         } else { \
                 Py_ssize_t _remaining = (stop) - (start);\
-                PyBList *_p; _use_iter = 1;\
+                iter_t _it; PyBList *_p; \
                 iter_init2(&_it, (lst), (start)); \
                 _p = _it.leaf; \
                 while (_p != NULL && _remaining--) { \
-                        if (_it.i < _p->num_children) { \
+                        if (_it.epoch == node_epoch \
+                            && _it.i < _p->num_children) { \
                                 item = _p->children[_it.i++]; \
                         } else { \
                                 item = iter_next(&_it); \
@@ -325,27 +384,24 @@ balance_leafs(PyBList *restrict leaf1, PyBList *restrict leaf2)
                         } \
                         block; \
                 } \
-                iter_cleanup(&_it); \
         } \
 }
 
 /* Iteration over the whole list */
 #define ITER(lst, item, block) {\
         if ((lst)->leaf) { \
-                iter_t _it; \
-                Py_ssize_t _i; const int _use_iter = 0;\
+                Py_ssize_t _i; \
                 for (_i = 0; _i < (lst)->num_children; _i++) { \
                         item = (lst)->children[_i]; \
                         block; \
-                } ITER_CLEANUP(); \
+                } \
         } else { \
-                iter_t _it; \
-                PyBList *_p; \
-                const int _use_iter = 1; \
+                iter_t _it; PyBList *_p; \
                 iter_init(&_it, (lst)); \
                 _p = _it.leaf; \
                 while (_p) { \
-                        if (_it.i < _p->num_children) { \
+                        if (_it.epoch == node_epoch \
+                            && _it.i < _p->num_children) { \
                                 item = _p->children[_it.i++]; \
                         } else { \
                                 item = iter_next(&_it); \
@@ -354,28 +410,81 @@ balance_leafs(PyBList *restrict leaf1, PyBList *restrict leaf2)
                         } \
                         block; \
                 } \
-                ITER_CLEANUP(); \
         } \
 }
 
-/* Call this before when leaving the ITER via return or goto. */
-#define ITER_CLEANUP() if (_use_iter) iter_cleanup(&_it)
-
 /* Forward declarations */
 PyTypeObject PyBList_Type;
 PyTypeObject PyRootBList_Type;
 PyTypeObject PyBListIter_Type;
 PyTypeObject PyBListReverseIter_Type;
+#ifdef BLIST_TYPED
+PyTypeObject PyTypedBList_Type;
+PyTypeObject PyTypedBListIter_Type;
+#endif
 static void ext_init(PyBListRoot *root);
+static void counts_init(PyBListRoot *root);
 static void ext_mark(PyBList *broot, Py_ssize_t offset, int value);
 static void ext_mark_set_dirty(PyBList *broot, Py_ssize_t i, Py_ssize_t j);
 static void ext_mark_set_dirty_all(PyBList *broot);
+static void ext_mark_inserted(PyBList *broot, Py_ssize_t i,
+                              Py_ssize_t lo, Py_ssize_t hi);
+static void ext_mark_popped(PyBList *broot);
+static void ext_share_index(PyBListRoot *copy, PyBListRoot *self);
 
 /* also hard-coded in blist.h */
 #define DIRTY (-1)
 #define CLEAN (-2)
 #define CLEAN_RW (-3) /* Only valid for dirty_root */
 
+/* Like CPython's tuples and dicts, nodes below the root are untracked
+ * by the garbage collector while nothing beneath them can be part of a
+ * reference cycle: a leaf whose items are all atomic, or an interior
+ * node whose children are all untracked.  A full collection then skips
+ * nearly all of a large list of numbers or strings.
+ *
+ * An untracked parent hides its children from the collector, so
+ * whoever stores a possible container into a node must track the node
+ * and all of its ancestors first.  blist_prepare_write() does so for
+ * writes that descend from the root.  Roots are always tracked.
+ */
+#define blist_gc_track(self) \
+        do { if (!_PyObject_GC_IS_TRACKED(self)) \
+                PyObject_GC_Track(self); } while (0)
+
+/* Untrack self if nothing beneath it can be part of a cycle */
+BLIST_LOCAL(void)
+blist_maybe_untrack(PyBList *self)
+{
+        int i;
+
+        if (!blist_is_inline(self) || !_PyObject_GC_IS_TRACKED(self))
+                return;
+
+        for (i = 0; i < self->num_children && !blist_raw(self); i++) {
+                PyObject *child = self->children[i];
+                if (self->leaf ? child && _PyObject_GC_MAY_BE_TRACKED(child)
+                    : _PyObject_GC_IS_TRACKED(child))
+                        return;
+        }
+
+        PyObject_GC_UnTrack(self);
+}
+
+/* blist_underflow(self, k) tracks the children it prepares for writing,
+ * even if it leaves them alone.  Give the last two children and then
+ * self a chance to be untracked again. */
+BLIST_LOCAL(void)
+blist_maybe_untrack_last(PyBList *self)
+{
+        int i;
+
+        for (i = self->num_children - 2; i < self->num_children; i++)
+                if (i >= 0 && !self->leaf)
+                        blist_maybe_untrack((PyBList *) self->children[i]);
+        blist_maybe_untrack(self);
+}
+
 static PyObject *_indexerr = NULL;
 void set_index_error(void)
 {
@@ -736,6 +845,11 @@ static void shift_left_decref(PyBList *self, int k, int n)
         register PyObject **dec;
         register PyObject **dst_stop = &self->children[k];
 
+        if (blist_raw(self)) {
+                shift_left(self, k, n);
+                return;
+        }
+
         if (decref_num + n > decref_max) {
                 while (decref_num + n > decref_max)
                         decref_max *= 2;
@@ -744,6 +858,7 @@ static void shift_left_decref(PyBList *self, int k, int n)
         }
 
         dec = &decref_list[decref_num];
+        blist_forget_ends(self, k - n);
 
         assert(n >= 0);
         assert(k - n >= 0);
@@ -786,6 +901,117 @@ static void shift_left_decref(PyBList *self, int k, int n)
         decref_num += dec - &decref_list[decref_num];
 }
 
+/************************************************************************
+ * Deferred destruction of large BLists
+ *
+ * Freeing a BList takes time proportional to its size, which can stall
+ * the program for a long time when a huge list is discarded.  If
+ * reclaim_threshold is non-negative, a root with at least that many
+ * items hands its children to the reclaim queue when it is deallocated
+ * or cleared.  The queue is drained a little at a time by each
+ * decref_flush(), or on request by reclaim().
+ *
+ * An interior node on the queue with no other owner is taken apart by
+ * moving its children onto the queue.  A leaf releases its items one
+ * at a time from the end.  Like decref_flush(), reclaim_some() must
+ * cope with any Py_DECREF() running arbitrary code.
+ */
+
+static PyObject **reclaim_list = NULL;
+static Py_ssize_t reclaim_max = 0;
+static Py_ssize_t reclaim_num = 0;
+static Py_ssize_t reclaim_threshold = -1;
+static int reclaim_busy = 0;
+
+#define RECLAIM_STEP (8*LIMIT) /* Objects released per decref_flush() */
+
+/* Make room for n more objects on the reclaim queue */
+static int reclaim_reserve(Py_ssize_t n)
+{
+        PyObject **tmp = reclaim_list;
+        Py_ssize_t max = reclaim_max ? reclaim_max : DECREF_BASE;
+
+        if (reclaim_num + n <= reclaim_max)
+                return 0;
+        while (reclaim_num + n > max)
+                max *= 2;
+        PyMem_Resize(tmp, PyObject *, max);
+        if (tmp == NULL)
+                return -1;
+        reclaim_list = tmp;
+        reclaim_max = max;
+        return 0;
+}
+
+/* If self is large enough, move all of its children to the reclaim
+ * queue.  Otherwise, or if there's no memory for the queue, leave self
+ * alone so that the caller frees the children right away. */
+static void reclaim_children_later(PyBList *self)
+{
+        if (reclaim_threshold < 0 || self->leaf
+            || self->n < reclaim_threshold
+            || reclaim_reserve(self->num_children) < 0)
+                return;
+
+        memcpy(&reclaim_list[reclaim_num], self->children,
+               self->num_children * sizeof(PyObject *));
+        reclaim_num += self->num_children;
+        self->num_children = 0;
+        blist_forget_ends(self, 0);
+}
+
+/* Release up to budget objects from the reclaim queue, or all of them
+ * if budget is negative.  Returns the number of objects released. */
+static Py_ssize_t reclaim_some(Py_ssize_t budget)
+{
+        Py_ssize_t done = 0;
+
+        /* A __del__ method that triggers another flush must not
+         * recurse into us */
+        if (reclaim_busy)
+                return 0;
+        reclaim_busy = 1;
+
+        while (reclaim_num && (budget < 0 || done < budget)) {
+                PyBList *p = (PyBList *) reclaim_list[reclaim_num - 1];
+                PyObject *ob;
+
+                if (!p->leaf && Py_REFCNT(p) == 1
+                    && reclaim_reserve(p->num_children - 1) == 0) {
+                        reclaim_num--;
+                        memcpy(&reclaim_list[reclaim_num], p->children,
+                               p->num_children * sizeof(PyObject *));
+                        reclaim_num += p->num_children;
+                        p->num_children = 0;
+                        p->n = 0;
+                        blist_forget_ends(p, 0);
+                        ob = (PyObject *) p;
+                } else if (p->leaf && Py_REFCNT(p) == 1 && !blist_raw(p)
+                           && p->num_children) {
+                        /* Leave p on the queue until it's empty */
+                        ob = p->children[--p->num_children];
+                        p->n = p->num_children;
+                } else {
+                        reclaim_num--;
+                        ob = (PyObject *) p;
+                }
+
+                done++;
+                DANGER_BEGIN;
+                Py_XDECREF(ob);
+                DANGER_END;
+        }
+
+        if (!reclaim_num && reclaim_max) {
+                PyMem_Free(reclaim_list);
+                reclaim_list = NULL;
+                reclaim_max = 0;
+        }
+
+        reclaim_busy = 0;
+        return done;
+}
+
 static void _decref_flush(void)
 {
         while (decref_num) {
@@ -817,6 +1043,9 @@ static void _decref_flush(void)
                 decref_max = DECREF_BASE;
                 PyMem_Resize(decref_list, PyObject *, decref_max);
         }
+
+        if (reclaim_num)
+                reclaim_some(RECLAIM_STEP);
 }
 
 /* Redefined in debug mode */
@@ -832,11 +1061,30 @@ static void _decref_flush(void)
 
 static void check_invariants(PyBList *self)
 {
+        assert(self->num_children <= self->allocated);
+        assert(self->allocated <= LIMIT);
+        assert(self->allocated == LIMIT
+               || (self->leaf && Py_TYPE(self) != &PyBList_Type));
+        assert(!blist_is_inline(self)
+               || self->children == blist_inline_children(self));
+        if (!blist_raw(self) && !_PyObject_GC_IS_TRACKED(self)
+            && blist_is_inline(self)) {
+                int i;
+
+                for (i = 0; i < self->num_children; i++) {
+                        PyObject *child = self->children[i];
+                        if (self->leaf)
+                                assert(!child
+                                       || !_PyObject_GC_MAY_BE_TRACKED(child));
+                        else
+                                assert(!_PyObject_GC_IS_TRACKED(child));
+                }
+        }
         if (self->leaf) {
                 assert(self->n == self->num_children);
                 int i;
 
-                for (i = 0; i < self->num_children; i++) {
+                for (i = 0; i < self->num_children && !self->typecode; i++) {
                         PyObject *child = self->children[i];
                         if (child != NULL)
                                 assert(Py_REFCNT(child) > 0);
@@ -846,6 +1094,7 @@ static void check_invariants(PyBList *self)
                 Py_ssize_t total = 0;
 
                 assert(self->num_children > 0);
+                assert(self->num_ends <= self->num_children);
 
                 for (i = 0; i < self->num_children; i++) {
                         assert(PyBList_Check(self->children[i]));
@@ -854,6 +1103,8 @@ static void check_invariants(PyBList *self)
                         PyBList *child = (PyBList *) self->children[i];
                         assert(child != self);
                         total += child->n;
+                        if (i < self->num_ends)
+                                assert(self->child_ends[i] == total);
                         assert(child->num_children <= LIMIT);
                         assert(HALF <= child->num_children);
                         /* check_invariants(child); */
@@ -886,7 +1137,7 @@ static void debug_setup(debug_t *debug)
         Py_INCREF(Py_None);
         blist_in_code++;
 
-        assert(PyBList_Check(debug->self));
+        assert(PyBList_Check(debug->self) || PyTypedBList_Check(debug->self));
 
         if (debug->options & VALID_DECREF) {
                 assert(blist_in_code == 1);
@@ -904,7 +1155,8 @@ static void debug_setup(debug_t *debug)
 
         if (debug->options & VALID_USER) {
                 debug->options |= VALID_ROOT;
-                assert(PyRootBList_Check(debug->self));
+                assert(PyRootBList_Check(debug->self)
+                       || PyTypedBList_Check(debug->self));
                 if (!debug->self->leaf)
                         assert(((PyBListRoot *)debug->self)->last_n
                                == debug->self->n);
@@ -1016,13 +1268,14 @@ static void safe_decref_check(PyBList *self)
 {
         int i;
 
-        assert(PyBList_Check((PyObject *) self));
+        assert(PyBList_Check((PyObject *) self)
+               || PyTypedBList_Check((PyObject *) self));
 
         if (Py_REFCNT(self) > 1)
                 return;
 
         if (self->leaf) {
-                for (i = 0; i < self->num_children; i++)
+                for (i = 0; i < self->num_children && !self->typecode; i++)
                         assert(self->children[i] == NULL
                                || Py_REFCNT(self->children[i]) > 1);
                 return;
@@ -1034,7 +1287,8 @@ static void safe_decref_check(PyBList *self)
 
 static void safe_decref(PyBList *self)
 {
-        assert(PyBList_Check((PyObject *) self));
+        assert(PyBList_Check((PyObject *) self)
+               || PyTypedBList_Check((PyObject *) self));
         safe_decref_check(self);
 
         DANGER_GC_BEGIN;
@@ -1123,17 +1377,16 @@ static PyBList *blist_new(void)
                 DANGER_GC_END;
                 if (self == NULL)
                         return NULL;
-                self->children = PyMem_New(PyObject *, LIMIT);
-                if (self->children == NULL) {
-                        PyObject_GC_Del(self);
-                        PyErr_NoMemory();
-                        return NULL;
-                }
+                self->children = blist_inline_children(self);
+                self->allocated = LIMIT;
+                self->child_ends = NULL;
         }
 
         self->leaf = 1; /* True */
         self->num_children = 0;
         self->n = 0;
+        self->num_ends = 0;
+        self->typecode = 0;
 
         PyObject_GC_Track(self);
 
@@ -1161,24 +1414,107 @@ static PyBList *blist_root_new(void)
                 DANGER_GC_END;
                 if (self == NULL)
                         return NULL;
-                self->children = PyMem_New(PyObject *, LIMIT);
-                if (self->children == NULL) {
-                        PyObject_GC_Del(self);
-                        PyErr_NoMemory();
-                        return NULL;
-                }
+                self->children = NULL;
+                self->allocated = 0;
+                self->child_ends = NULL;
         }
 
         self->leaf = 1; /* True */
         self->n = 0;
         self->num_children = 0;
+        self->num_ends = 0;
+        self->typecode = 0;
+
+        ((PyBListRoot *) self)->tail = NULL;
+        ext_init((PyBListRoot *) self);
+        counts_init((PyBListRoot *) self);
+
+        PyObject_GC_Track(self);
+
+        return self;
+}
+
+#ifdef BLIST_TYPED
+/* Creates a typed blist for user use */
+static PyBList *typed_root_new(char typecode)
+{
+        PyBList *self;
+
+        DANGER_GC_BEGIN;
+        self = (PyBList *) PyObject_GC_New(PyBListRoot, &PyTypedBList_Type);
+        DANGER_GC_END;
+        if (self == NULL)
+                return NULL;
+        self->children = NULL;
+        self->allocated = 0;
+        self->child_ends = NULL;
+
+        self->leaf = 1; /* True */
+        self->n = 0;
+        self->num_children = 0;
+        self->num_ends = 0;
+        self->typecode = typecode;
 
+        ((PyBListRoot *) self)->tail = NULL;
         ext_init((PyBListRoot *) self);
+        counts_init((PyBListRoot *) self);
 
         PyObject_GC_Track(self);
 
         return self;
 }
+#endif
+
+/* Creates an empty blist for user use, holding the same kind of
+ * values as self */
+static PyBList *blist_root_new_like(PyBList *self)
+{
+#ifdef BLIST_TYPED
+        if (self->typecode)
+                return typed_root_new(self->typecode);
+#endif
+        return blist_root_new();
+}
+
+/* Grow the children array of self to hold at least k children.
+ *
+ * Only a root that is a leaf may have fewer than LIMIT slots.  Like a
+ * list, it grows geometrically as items arrive, so that small blists
+ * do not pay for LIMIT slots up front.  Anything that turns a root
+ * into an internal node must first grow it to LIMIT.
+ */
+static int blist_grow(PyBList *self, int k)
+{
+        PyObject **children = self->children;
+        int allocated;
+
+        if (k > LIMIT) {
+                /* Full; the caller must split the node instead */
+                if (self->allocated == LIMIT)
+                        return 0;
+                k = LIMIT;
+        }
+        assert(k > self->allocated);
+        assert(self->leaf);
+        assert(!blist_is_inline(self));
+
+        allocated = k + (k >> 3) + (k < 9 ? 3 : 6);
+        if (allocated > LIMIT)
+                allocated = LIMIT;
+
+        PyMem_Resize(children, PyObject *, allocated);
+        if (children == NULL) {
+                PyErr_NoMemory();
+                return -1;
+        }
+        self->children = children;
+        self->allocated = allocated;
+        return 0;
+}
+
+/* Make sure self has room for k children */
+#define blist_reserve(self, k) \
+        ((k) <= (self)->allocated ? 0 : blist_grow((self), (k)))
 
 /* Remove links to some of our children, decrementing their refcounts */
 static void blist_forget_children2(PyBList *self, int i, int j)
@@ -1214,42 +1550,71 @@ static int blist_CLEAR(PyBList *self)
 }
 
 /* Make self into a copy of other */
-BLIST_LOCAL(void)
+BLIST_LOCAL(int)
 blist_become(PyBList *restrict self, PyBList *restrict other)
 {
         invariants(self, VALID_RW);
         assert(self != other);
 
+        if (blist_reserve(self, other->leaf ? other->num_children : LIMIT) < 0)
+                return _int(-1);
+
         Py_INCREF(other); /* "other" may be one of self's children */
         blist_forget_children(self);
         self->n = other->n;
         xcopyref(self, 0, other, 0, other->num_children);
         self->num_children = other->num_children;
         self->leaf = other->leaf;
+        if (other->leaf)
+                self->typecode = other->typecode;
 
         SAFE_DECREF(other);
-        _void();
+        return _int(0);
 }
 
-/* Make self into a copy of other and empty other */
+/* Make self into a copy of other and empty other.
+ *
+ * Two roots simply swap children arrays.  If either node keeps its
+ * children inline, the children are moved instead, so self must
+ * already have room for all of other's children.
+ */
 BLIST_LOCAL(void)
 blist_become_and_consume(PyBList *restrict self, PyBList *restrict other)
 {
         PyObject **tmp;
+        Py_ssize_t *tmp_ends;
+        int allocated;
 
         invariants(self, VALID_RW);
         assert(self != other);
-        assert(Py_REFCNT(other) == 1 || PyRootBList_Check(other));
+        assert(Py_REFCNT(other) == 1 || PyRootBList_Check(other)
+               || PyTypedBList_Check(other));
 
         Py_INCREF(other);
         blist_forget_children(self);
-        tmp = self->children;
-        self->children = other->children;
+        if (blist_is_inline(self) || blist_is_inline(other)) {
+                /* Inline arrays stay put; move the children instead */
+                assert(other->num_children <= self->allocated);
+                copy(self, 0, other, 0, other->num_children);
+        } else {
+                tmp = self->children;
+                self->children = other->children;
+                other->children = tmp;
+                allocated = self->allocated;
+                self->allocated = other->allocated;
+                other->allocated = allocated;
+        }
+        tmp_ends = self->child_ends;
+        self->child_ends = other->child_ends;
+        self->num_ends = other->num_ends;
         self->n = other->n;
         self->num_children = other->num_children;
         self->leaf = other->leaf;
+        if (other->leaf)
+                self->typecode = other->typecode;
 
-        other->children = tmp;
+        other->child_ends = tmp_ends;
+        other->num_ends = 0;
         other->n = 0;
         other->num_children = 0;
         other->leaf = 1;
@@ -1274,11 +1639,14 @@ static PyBList *blist_root_copy(PyBList *restrict self)
 {
         PyBList *copy;
 
-        copy = blist_root_new();
+        copy = blist_root_new_like(self);
         if (!copy) return NULL;
-        blist_become(copy, self);
-        ext_mark(copy, 0, DIRTY);
+        if (blist_become(copy, self) < 0) {
+                SAFE_DECREF(copy);
+                return NULL;
+        }
         ext_mark_set_dirty_all(self);
+        ext_share_index((PyBListRoot *) copy, (PyBListRoot *) self);
         return copy;
 }
 
@@ -1286,17 +1654,11 @@ static PyBList *blist_root_copy(PyBList *restrict self)
  * Useful internal utility functions
  */
 
-/* We are searching for the child that contains leaf element i.
- *
- * Returns a 3-tuple: (the child object, our index of the child,
- *                     the number of leaf elements before the child)
- */
-static void blist_locate(PyBList *self, Py_ssize_t i,
-                         PyObject **child, int *idx, Py_ssize_t *before)
+/* Without a child_ends cache, walk the children from whichever end
+ * is closer. */
+static void blist_locate_slow(PyBList *self, Py_ssize_t i,
+                              PyObject **child, int *idx, Py_ssize_t *before)
 {
-        invariants(self, VALID_PARENT);
-        assert (!self->leaf);
-
         if (i <= self->n/2) {
                 /* Search from the left */
                 Py_ssize_t so_far = 0;
@@ -1307,7 +1669,6 @@ static void blist_locate(PyBList *self, Py_ssize_t i,
                                 *child = (PyObject *) p;
                                 *idx = k;
                                 *before = so_far;
-                                _void();
                                 return;
                         }
                         so_far += p->n;
@@ -1323,7 +1684,6 @@ static void blist_locate(PyBList *self, Py_ssize_t i,
                                 *child = (PyObject *) p;
                                 *idx = k;
                                 *before = so_far;
-                                _void();
                                 return;
                         }
                 }
@@ -1333,6 +1693,69 @@ static void blist_locate(PyBList *self, Py_ssize_t i,
         *child = self->children[self->num_children-1];
         *idx = self->num_children-1;
         *before = self->n - ((PyBList *)(*child))->n;
+}
+
+/* We are searching for the child that contains leaf element i.
+ *
+ * Returns a 3-tuple: (the child object, our index of the child,
+ *                     the number of leaf elements before the child)
+ *
+ * The valid prefix of child_ends is extended only as far as needed to
+ * cover i, then binary searched.
+ */
+static void blist_locate(PyBList *self, Py_ssize_t i,
+                         PyObject **child, int *idx, Py_ssize_t *before)
+{
+        Py_ssize_t *ends;
+        int k, lo, hi;
+
+        invariants(self, VALID_PARENT);
+        assert (!self->leaf);
+
+        if (i >= self->n) {
+                /* Just append */
+                *child = self->children[self->num_children-1];
+                *idx = self->num_children-1;
+                *before = self->n - ((PyBList *)(*child))->n;
+                _void();
+                return;
+        }
+
+        ends = self->child_ends;
+        if (ends == NULL) {
+                ends = self->child_ends = PyMem_New(Py_ssize_t, LIMIT);
+                if (ends == NULL) {
+                        blist_locate_slow(self, i, child, idx, before);
+                        _void();
+                        return;
+                }
+        }
+
+        k = self->num_ends;
+        if (!k || ends[k-1] <= i) {
+                Py_ssize_t so_far = k ? ends[k-1] : 0;
+                do {
+                        so_far += ((PyBList *) self->children[k])->n;
+                        ends[k++] = so_far;
+                } while (so_far <= i);
+                self->num_ends = k;
+                k--;
+        } else {
+                lo = 0;
+                hi = k - 1;
+                while (lo < hi) {
+                        int mid = (lo + hi) / 2;
+                        if (ends[mid] <= i)
+                                lo = mid + 1;
+                        else
+                                hi = mid;
+                }
+                k = lo;
+        }
+
+        *child = self->children[k];
+        *idx = k;
+        *before = k ? ends[k-1] : 0;
 
         _void();
 }
@@ -1374,6 +1797,8 @@ blist_prepare_write(PyBList *self, int pt)
          * - decrement the child's .refcount
          * - replace self.children[pt] with the copy
          * - return the copy
+         *
+         * Either way, self and the child are tracked by the GC.
          */
 
         invariants(self, VALID_RW);
@@ -1387,13 +1812,19 @@ blist_prepare_write(PyBList *self, int pt)
                 blist_become(new_copy, (PyBList *) self->children[pt]);
                 SAFE_DECREF(self->children[pt]);
                 self->children[pt] = (PyObject *) new_copy;
+                node_epoch++;
         }
 
+        /* The caller may store anything in the child */
+        if (blist_is_inline(self))
+                blist_gc_track(self);
+        blist_gc_track(self->children[pt]);
+
         return (PyBList *) _ob(self->children[pt]);
 }
 
 /* Macro version assumes that pt is non-negative */
-#define blist_PREPARE_WRITE(self, pt) (Py_REFCNT((self)->children[(pt)]) > 1 ? blist_prepare_write((self), (pt)) : (PyBList *) (self)->children[(pt)])
+#define blist_PREPARE_WRITE(self, pt) (Py_REFCNT((self)->children[(pt)]) > 1 || !_PyObject_GC_IS_TRACKED((self)->children[(pt)]) ? blist_prepare_write((self), (pt)) : (PyBList *) (self)->children[(pt)])
 
 /* Recompute self->n */
 BLIST_LOCAL(void)
@@ -1408,9 +1839,21 @@ blist_adjust_n(PyBList *restrict self)
                 _void();
                 return;
         }
-        self->n = 0;
-        for (i = 0; i < self->num_children; i++)
-                self->n += ((PyBList *)self->children[i])->n;
+        if (self->child_ends == NULL) {
+                self->n = 0;
+                for (i = 0; i < self->num_children; i++)
+                        self->n += ((PyBList *)self->children[i])->n;
+        } else {
+                /* We're reading every child anyway, so refill the cache */
+                Py_ssize_t *restrict ends = self->child_ends;
+                Py_ssize_t n = 0;
+                for (i = 0; i < self->num_children; i++) {
+                        n += ((PyBList *)self->children[i])->n;
+                        ends[i] = n;
+                }
+                self->n = n;
+                self->num_ends = self->num_children;
+        }
 
         _void();
 }
@@ -1426,8 +1869,10 @@ static PyBList *blist_new_sibling(PyBList *sibling)
         assert(sibling->num_children == LIMIT);
         copy(self, 0, sibling, HALF, HALF);
         self->leaf = sibling->leaf;
+        self->typecode = sibling->typecode;
         self->num_children = HALF;
         sibling->num_children = HALF;
+        blist_forget_ends(sibling, HALF);
         blist_adjust_n(self);
         return self;
 }
@@ -1493,16 +1938,92 @@ static void ext_init(PyBListRoot *root)
 #endif
 }
 
+/* offset_list is preceded by a count of the roots sharing it */
+#define INDEX_REFS(root) ((root)->offset_list[-1])
+
 /* Deallocate any memory used by the index extension */
 static void ext_dealloc(PyBListRoot *root)
 {
-        if (root->index_list) PyMem_Free(root->index_list);
-        if (root->offset_list) PyMem_Free(root->offset_list);
-        if (root->setclean_list) PyMem_Free(root->setclean_list);
+        if (root->offset_list && --INDEX_REFS(root))
+                ; /* Still used by a copy */
+        else {
+                if (root->index_list) PyMem_Free(root->index_list);
+                if (root->offset_list) PyMem_Free(&INDEX_REFS(root));
+                if (root->setclean_list) PyMem_Free(root->setclean_list);
+        }
         if (root->dirty) PyMem_Free(root->dirty);
         ext_init(root);
 }
 
+/* A copy starts out sharing the index_list, offset_list, and
+ * setclean_list of the original, since both trees have the same
+ * leaves at the same offsets.  INDEX_REFS() counts the roots using
+ * them.  Shared leaves must not be written to directly, so the
+ * setclean_list is all zeros while it's shared.  Whichever root first
+ * needs to change its index gets a private copy here.
+ * O(n / INDEX_FACTOR), but only once per copy.
+ */
+static int ext_own_index(PyBListRoot *root)
+{
+        Py_ssize_t len = root->index_allocated;
+        PyBList **index_list;
+        Py_ssize_t *offset_list;
+        unsigned *setclean_list;
+
+        if (!root->offset_list || INDEX_REFS(root) == 1)
+                return 0;
+
+        index_list = PyMem_New(PyBList *, len);
+        offset_list = PyMem_New(Py_ssize_t, len + 1);
+        setclean_list = PyMem_New(unsigned, SETCLEAN_LEN(len));
+        if (!index_list || !offset_list || !setclean_list) {
+                PyMem_Free(index_list);
+                PyMem_Free(offset_list);
+                PyMem_Free(setclean_list);
+                return -1;
+        }
+        memcpy(index_list, root->index_list, len * sizeof(PyBList *));
+        memcpy(offset_list + 1, root->offset_list, len * sizeof(Py_ssize_t));
+        memset(setclean_list, 0, SETCLEAN_LEN(len) * sizeof(unsigned));
+
+        INDEX_REFS(root)--;
+        root->index_list = index_list;
+        root->offset_list = offset_list + 1;
+        INDEX_REFS(root) = 1;
+        root->setclean_list = setclean_list;
+        return 0;
+}
+
+/* copy has just become a copy of self, which has no setclean bits.
+ * Let copy read through self's index instead of rebuilding its own. */
+static void ext_share_index(PyBListRoot *copy, PyBListRoot *self)
+{
+        ext_mark((PyBList *) copy, 0, DIRTY);
+        if (self->leaf || self->dirty_root == DIRTY || !self->index_allocated)
+                return;
+        assert(self->dirty_root != CLEAN_RW);
+
+        if (self->dirty_root >= 0) {
+                copy->dirty = PyMem_New(Py_ssize_t, self->dirty_length);
+                if (!copy->dirty)
+                        return;
+                memcpy(copy->dirty, self->dirty,
+                       self->dirty_length * sizeof(Py_ssize_t));
+                copy->dirty_length = self->dirty_length;
+                copy->free_root = self->free_root;
+        }
+        copy->dirty_root = self->dirty_root;
+
+        INDEX_REFS(self)++;
+        copy->index_list = self->index_list;
+        copy->offset_list = self->offset_list;
+        copy->setclean_list = self->setclean_list;
+        copy->index_allocated = self->index_allocated;
+#ifdef Py_DEBUG
+        copy->last_n = copy->n;
+#endif
+}
+
 /* Find or create a new free node in "dirty" and return an index to it.
  * amortized O(1) */
 static Py_ssize_t ext_alloc(PyBListRoot *root)
@@ -1701,7 +2222,9 @@ static void ext_mark(PyBList *broot, Py_ssize_t offset, int value)
         if (root->dirty_root == value) return;
 
         if (root->dirty_root < 0) {
-                Py_ssize_t nvalue = root->dirty_root;
+                /* CLEAN_RW is only valid for dirty_root */
+                Py_ssize_t nvalue = root->dirty_root == CLEAN_RW
+                        ? CLEAN : root->dirty_root;
                 root->dirty_root = ext_alloc(root);
                 if (root->dirty_root < 0) {
                         ext_dealloc(root);
@@ -1726,12 +2249,24 @@ static void ext_mark(PyBList *broot, Py_ssize_t offset, int value)
 /* Mark a section of the list dirty for set operations */
 static void ext_mark_set_dirty(PyBList *broot, Py_ssize_t i, Py_ssize_t j)
 {
-        /* XXX We could set only the values in the setclean_list, but
-         * that takes O(n) time.  Marking the nodes dirty for reading
-         * takes O(log n) time but will slow down future reads.
-         * Ideally there'd be a separate index_list for set
-         * operations */
-        ext_mark(broot, i, DIRTY);
+        /* Sharing nodes doesn't move any leaves, so the index stays
+         * valid for reading.  Only the setclean bits from i onward
+         * are cleared, which takes O((n-i) / (INDEX_FACTOR * 32))
+         * time. */
+        PyBListRoot *root = (PyBListRoot *) broot;
+        Py_ssize_t ioffset = i / INDEX_FACTOR;
+        Py_ssize_t word = ioffset >> SETCLEAN_SHIFT;
+        Py_ssize_t len = SETCLEAN_LEN(root->index_allocated);
+
+        (void) j;
+        if (root->dirty_root == CLEAN_RW)
+                root->dirty_root = CLEAN;
+        if (!root->index_allocated || INDEX_REFS(root) > 1 || word >= len)
+                return; /* A shared setclean_list is already clear */
+
+        root->setclean_list[word] &= (1u << (ioffset & SETCLEAN_MASK)) - 1;
+        memset(&root->setclean_list[word+1], 0,
+               (len - word - 1) * sizeof(unsigned));
 }
 
 /* Mark an entire list dirty for set operations */
@@ -1840,15 +2375,52 @@ ext_is_dirty(PyBListRoot *root, Py_ssize_t offset, Py_ssize_t *dirty_offset)
         return i == DIRTY;
 }
 
+/* Determine if every offset from "offset" onward is CLEAN, returning
+ * a Boolean value.  May return false if only the offsets beyond the
+ * end of the list are DIRTY.  Worst-case O(log n)
+ */
+static int
+ext_is_clean_from(PyBListRoot *root, Py_ssize_t offset)
+{
+        Py_ssize_t i;
+        int bit;
+
+        if (root->dirty == NULL || root->dirty_root < 0)
+                return root->dirty_root != DIRTY;
+        i = root->dirty_root;
+        offset /= INDEX_FACTOR;
+        bit = highest_set_bit((root->n-1) / INDEX_FACTOR);
+
+#ifdef Py_DEBUG
+        assert(root->last_n == root->n);
+#endif
+
+        do {
+                assert(bit);
+                assert (i >= 0 && i+1 < root->dirty_length);
+                if (!(offset & bit)) {
+                        if (root->dirty[i+1] != CLEAN)
+                                return 0;
+                        i = root->dirty[i];
+                } else
+                        i = root->dirty[i+1];
+                bit >>= 1;
+        } while (i >= 0);
+
+        return i != DIRTY;
+}
+
 /* The length of the BList may have changed.  Adjust the lengths of
  * the extension data structures as needed */
 static int
 ext_grow_index(PyBListRoot *root)
 {
         Py_ssize_t oldl = root->index_allocated;
+        if (ext_own_index(root) < 0)
+                return -1;
         if (!root->index_allocated) {
                 if (root->index_list) PyMem_Free(root->index_list);
-                if (root->offset_list) PyMem_Free(root->offset_list);
+                if (root->offset_list) PyMem_Free(&INDEX_REFS(root));
                 if (root->setclean_list) PyMem_Free(root->setclean_list);
 
                 root->index_list = NULL;
@@ -1862,8 +2434,11 @@ ext_grow_index(PyBListRoot *root)
                         root->index_allocated = oldl;
                         return -1;
                 }
-                root->offset_list = PyMem_New(Py_ssize_t, root->index_allocated);
+                root->offset_list = PyMem_New(Py_ssize_t,
+                                              root->index_allocated + 1);
                 if (!root->offset_list) goto fail;
+                root->offset_list++;
+                INDEX_REFS(root) = 1;
                 root->setclean_list
                         = PyMem_New(unsigned,SETCLEAN_LEN(root->index_allocated));
                 if (!root->setclean_list) goto fail;
@@ -1878,10 +2453,10 @@ ext_grow_index(PyBListRoot *root)
                 if (!tmp) goto fail;
                 root->index_list = tmp;
 
-                tmp = root->offset_list;
-                PyMem_Resize(tmp, Py_ssize_t, root->index_allocated);
+                tmp = &INDEX_REFS(root);
+                PyMem_Resize(tmp, Py_ssize_t, root->index_allocated + 1);
                 if (!tmp) goto fail;
-                root->offset_list = tmp;
+                root->offset_list = (Py_ssize_t *) tmp + 1;
 
                 tmp = root->setclean_list;
                 PyMem_Resize(tmp, unsigned, SETCLEAN_LEN(root->index_allocated));
@@ -1992,6 +2567,10 @@ _ext_index_all(PyBListRoot *root, int set_ok_all)
 
         if (root->index_allocated < ioffset_max)
                 ext_grow_index(root);
+        if (ext_own_index(root) < 0) {
+                ext_dealloc(root);
+                return;
+        }
         if (set_ok_all) {
                 set_ok = SET_OK_ALL;
                 memset(root->setclean_list, 255,
@@ -2035,6 +2614,11 @@ ext_mark_clean(PyBListRoot *root, Py_ssize_t offset, PyBList *p, int setclean)
 
         assert(offset < root->n);
 
+        if (ext_own_index(root) < 0) {
+                ext_dealloc(root);
+                return;
+        }
+
         while (ioffset * INDEX_FACTOR < offset)
                 ioffset++;
         for (;ioffset * INDEX_FACTOR < offset + p->n; ioffset++) {
@@ -2060,10 +2644,239 @@ ext_mark_clean(PyBListRoot *root, Py_ssize_t offset, PyBList *p, int setclean)
         }
 }
 
+/* Repairing the index after an insertion costs one step per index
+ * entry past the insertion point.  Beyond this many entries, it is
+ * cheaper to mark them dirty and look leaves up again as needed. */
+#define INDEX_SHIFT_MAX (256)
+
+/* Called just before inserting at offset i.  If the index can be
+ * repaired afterwards by ext_mark_inserted(), returns true and sets
+ * [*lo, *hi) to a range of offsets, counted after the insertion, that
+ * covers every leaf the insertion may split, spill into, or copy.
+ * Leaves outside it keep their identity and shift by at most one.
+ * The range is empty if the receiving leaf has room and a private
+ * path, since then no leaf changes besides growing by one.
+ *
+ * Requires the index to be clean from the range onward, so that
+ * entries past the range can be shifted rather than looked up again.
+ */
+BLIST_LOCAL(int)
+ext_insert_range(PyBListRoot *root, Py_ssize_t i, Py_ssize_t *lo,
+                 Py_ssize_t *hi)
+{
+        Py_ssize_t ioffset, offset;
+        PyBList *p;
+
+        if (root->leaf || !root->index_allocated || INDEX_REFS(root) > 1
+            || (root->n - i) / INDEX_FACTOR > INDEX_SHIFT_MAX
+            || !ext_is_clean_from(root, i > 2*LIMIT ? i - 2*LIMIT : 0))
+                return 0;
+
+        ioffset = (i < root->n ? i : root->n - 1) / INDEX_FACTOR;
+        p = root->index_list[ioffset];
+        offset = root->offset_list[ioffset];
+        if (i < root->n && i >= offset + p->n) {
+                p = root->index_list[++ioffset];
+                offset = root->offset_list[ioffset];
+        }
+
+        if (p->num_children < LIMIT
+            && GET_BIT(root->setclean_list, ioffset)) {
+                *lo = *hi = i + 1;
+                return 1;
+        }
+
+        *lo = offset;
+        *hi = offset + p->n + 1;
+        if (p->num_children == LIMIT) {
+                /* blist_spill() moves items to the left only when
+                 * appending, and to the right only when inserting at
+                 * the front of the leaf. */
+                if (i == root->n)
+                        *lo = offset > LIMIT ? offset - LIMIT : 0;
+                else if (i == offset)
+                        *hi = offset + p->n + 1 + LIMIT;
+        }
+        if (*hi > root->n + 1)
+                *hi = root->n + 1;
+        return 1;
+}
+
+/* Look up the leaves covering offsets [lo, hi) and index them */
+BLIST_LOCAL(void)
+ext_index_range(PyBListRoot *root, Py_ssize_t lo, Py_ssize_t hi)
+{
+        while (lo < hi && root->dirty_root != DIRTY) {
+                PyBList *p = (PyBList *) root;
+                PyObject *child;
+                Py_ssize_t offset = 0, so_far;
+                int k, setclean = 1;
+                do {
+                        blist_locate(p, lo - offset, &child, &k, &so_far);
+                        p = (PyBList *) child;
+                        if (Py_REFCNT(p) > 1)
+                                setclean = 0;
+                        offset += so_far;
+                } while (!p->leaf);
+                ext_mark_clean(root, offset, p, setclean);
+                lo = offset + p->n;
+        }
+}
+
+/* An item has just been inserted at offset i.
+ *
+ * If ext_insert_range() approved the insertion beforehand, the leaves
+ * in [lo, hi) are looked up again.  Entries past them belong to the
+ * same leaves as before, and leaves that started after i are now one
+ * further along, so their offsets are bumped.  An entry whose leaf
+ * started exactly at the entry's offset now belongs to the leaf
+ * before instead, which is the leaf the previous entry pointed to,
+ * since every leaf holds at least INDEX_FACTOR items.
+ *
+ * Otherwise, leaves holding only earlier items keep their offsets,
+ * but the leaf that received the item may have been split, and
+ * blist_spill() may have copied and refilled the leaf before it, so
+ * everything from 2*LIMIT before i onward is marked dirty.
+ *
+ * The shape of the dirty tree depends on the number of index entries,
+ * so if that crossed a power of two the whole list is marked dirty.
+ */
+static void ext_mark_inserted(PyBList *broot, Py_ssize_t i,
+                              Py_ssize_t lo, Py_ssize_t hi)
+{
+        PyBListRoot *root = (PyBListRoot *) broot;
+        Py_ssize_t offset = i - 2*LIMIT;
+
+        if (root->n - 1 <= INDEX_FACTOR || broot->leaf
+            || (root->dirty_root >= 0
+                && highest_set_bit((root->n-1) / INDEX_FACTOR)
+                   != highest_set_bit((root->n-2) / INDEX_FACTOR))) {
+                ext_mark(broot, 0, DIRTY);
+                return;
+        }
+
+#ifdef Py_DEBUG
+        root->last_n = root->n;
+#endif
+
+        if (lo >= 0) {
+                Py_ssize_t last = (root->n - 2) / INDEX_FACTOR;
+                Py_ssize_t ioffset = (hi + INDEX_FACTOR - 1) / INDEX_FACTOR;
+                PyBList *prev = NULL;
+                Py_ssize_t prev_offset = 0;
+                int prev_bit = 0;
+
+                /* prev is what entry ioffset-1 held before the
+                 * insertion, with its offset bumped, or NULL if the
+                 * entry still holds the same leaf */
+                if (ioffset <= last) {
+                        prev = root->index_list[ioffset-1];
+                        prev_offset = root->offset_list[ioffset-1];
+                        if (prev_offset > i)
+                                prev_offset++;
+                        prev_bit = GET_BIT(root->setclean_list,
+                                           ioffset-1) != 0;
+                }
+
+                for (; ioffset <= last; ioffset++) {
+                        PyBList *next;
+                        int next_bit;
+                        Py_ssize_t next_offset = root->offset_list[ioffset];
+
+                        if (next_offset > i)
+                                next_offset++;
+                        if (next_offset <= ioffset * INDEX_FACTOR) {
+                                root->offset_list[ioffset] = next_offset;
+                                prev = NULL;
+                                continue;
+                        }
+
+                        if (!prev) {
+                                prev = root->index_list[ioffset-1];
+                                prev_offset = root->offset_list[ioffset-1];
+                                prev_bit = GET_BIT(root->setclean_list,
+                                                   ioffset-1) != 0;
+                        }
+                        next = root->index_list[ioffset];
+                        next_bit = GET_BIT(root->setclean_list, ioffset) != 0;
+                        root->index_list[ioffset] = prev;
+                        root->offset_list[ioffset] = prev_offset;
+                        if (prev_bit)
+                                SET_BIT(root->setclean_list, ioffset);
+                        else
+                                CLEAR_BIT(root->setclean_list, ioffset);
+                        prev = next;
+                        prev_offset = next_offset;
+                        prev_bit = next_bit;
+                }
+
+                ext_index_range(root, lo, hi);
+                if ((root->n - 1) % INDEX_FACTOR == 0)
+                        /* The list grew a new index entry */
+                        ext_index_range(root, root->n - 1, root->n);
+                return;
+        }
+
+        if (offset <= 0)
+                ext_mark(broot, 0, DIRTY);
+        else
+                ext_mark(broot, offset, DIRTY);
+}
+
+/* The last item has just been popped from a leaf that stays where it
+ * was, and the list lost an index entry.  No leaf moved, so the
+ * remaining entries are still right.  The entry past the new end is
+ * left as it was: whatever grows the list again looks it up again.
+ * As in ext_mark_inserted(), the whole list is marked dirty if the
+ * dirty tree would change shape.
+ */
+static void ext_mark_popped(PyBList *broot)
+{
+        PyBListRoot *root = (PyBListRoot *) broot;
+
+        if (root->n <= INDEX_FACTOR || broot->leaf
+            || (root->dirty_root >= 0
+                && highest_set_bit((root->n-1) / INDEX_FACTOR)
+                   != highest_set_bit(root->n / INDEX_FACTOR))) {
+                ext_mark(broot, 0, DIRTY);
+                return;
+        }
+
+#ifdef Py_DEBUG
+        root->last_n = root->n;
+#endif
+}
+
+/* The list held old_n items, and items have since been added or
+ * removed at its end without moving any leaf that starts before
+ * offset.  Entries from offset onward are marked dirty.  As in
+ * ext_mark_inserted(), the whole list is marked dirty if the dirty
+ * tree would change shape.
+ */
+static void ext_mark_resized(PyBList *broot, Py_ssize_t old_n,
+                             Py_ssize_t offset)
+{
+        PyBListRoot *root = (PyBListRoot *) broot;
+
+        if (offset <= 0 || old_n <= INDEX_FACTOR
+            || root->n <= INDEX_FACTOR || broot->leaf
+            || (root->dirty_root >= 0
+                && highest_set_bit((root->n-1) / INDEX_FACTOR)
+                   != highest_set_bit((old_n-1) / INDEX_FACTOR))) {
+                ext_mark(broot, 0, DIRTY);
+                return;
+        }
+
+#ifdef Py_DEBUG
+        root->last_n = root->n;
+#endif
+        ext_mark(broot, offset, DIRTY);
+}
+
 /* Lookup the node at offset i and mark it clean */
 static PyObject *ext_make_clean(PyBListRoot *root, Py_ssize_t i)
 {
-        PyObject *rv;
+        PyObject *rv, *child;
         Py_ssize_t so_far;
         Py_ssize_t offset = 0;
         PyBList *p = (PyBList *)root;
@@ -2071,7 +2884,8 @@ static PyObject *ext_make_clean(PyBListRoot *root, Py_ssize_t i)
         int k;
         int setclean = 1;
         do {
-                blist_locate(p, j, (PyObject **) &p, &k, &so_far);
+                blist_locate(p, j, &child, &k, &so_far);
+                p = (PyBList *) child;
                 if (Py_REFCNT(p) > 1)
                         setclean = 0;
                 offset += so_far;
@@ -2145,6 +2959,74 @@ static void blist_borrow_left(PyBList *self, int k)
         _void();
 }
 
+/* Child k is full and an insertion is headed for offset i within it.
+ *
+ * Splitting child k leaves two half-full nodes behind.  When items keep
+ * arriving at the same edge of the tree (appends, or inserts at the
+ * front), every split happens there and the whole tree ends up half
+ * full.  So if the insertion is at an edge of child k and the neighbour
+ * beyond that edge has room, move up to HALF children into the
+ * neighbour instead.  The neighbour fills up completely and child k
+ * stays at least half full.
+ *
+ * Returns the number of user objects moved off the front of child k.
+ */
+BLIST_LOCAL(Py_ssize_t)
+blist_spill(PyBList *self, int k, Py_ssize_t i)
+{
+        PyBList *restrict p = (PyBList *) self->children[k];
+        PyBList *restrict sibling;
+        Py_ssize_t n;
+        int migrate;
+
+        invariants(self, VALID_RW);
+        assert(!self->leaf);
+        assert(p->num_children == LIMIT);
+
+        if (i == p->n && k > 0) {
+                sibling = (PyBList *) self->children[k-1];
+                migrate = LIMIT - sibling->num_children;
+                if (!migrate)
+                        return _redir(0);
+                if (migrate > HALF)
+                        migrate = HALF;
+                sibling = blist_prepare_write(self, k-1);
+                p = blist_prepare_write(self, k);
+                n = p->n;
+                copy(sibling, sibling->num_children, p, 0, migrate);
+                sibling->num_children += migrate;
+                shift_left(p, migrate, migrate);
+                p->num_children -= migrate;
+                blist_adjust_n(sibling);
+                blist_adjust_n(p);
+                blist_forget_ends(self, k-1);
+                blist_maybe_untrack(sibling);
+                return _redir(n - p->n);
+        }
+
+        if (i == 0 && k+1 < self->num_children) {
+                sibling = (PyBList *) self->children[k+1];
+                migrate = LIMIT - sibling->num_children;
+                if (!migrate)
+                        return _redir(0);
+                if (migrate > HALF)
+                        migrate = HALF;
+                sibling = blist_prepare_write(self, k+1);
+                p = blist_prepare_write(self, k);
+                shift_right(sibling, 0, migrate);
+                copy(sibling, 0, p, LIMIT - migrate, migrate);
+                sibling->num_children += migrate;
+                p->num_children -= migrate;
+                blist_forget_ends(p, p->num_children);
+                blist_adjust_n(sibling);
+                blist_adjust_n(p);
+                blist_forget_ends(self, k);
+                blist_maybe_untrack(sibling);
+        }
+
+        return _redir(0);
+}
+
 /* Child k has underflowed.  Merge with k+1 */
 static void blist_merge_right(PyBList *self, int k)
 {
@@ -2155,7 +3037,7 @@ static void blist_merge_right(PyBList *self, int k)
         invariants(self, VALID_RW);
 
         copy(p, p->num_children, p2, 0, p2->num_children);
-        for (i = 0; i < p2->num_children; i++)
+        for (i = 0; i < p2->num_children && !blist_raw(p2); i++)
                 Py_INCREF(p2->children[i]);
         p->num_children += p2->num_children;
         blist_forget_child(self, k+1);
@@ -2176,7 +3058,7 @@ static void blist_merge_left(PyBList *self, int k)
         shift_right(p, 0, p2->num_children);
         p->num_children += p2->num_children;
         copy(p, 0, p2, 0, p2->num_children);
-        for (i = 0; i < p2->num_children; i++)
+        for (i = 0; i < p2->num_children && !blist_raw(p2); i++)
                 Py_INCREF(p2->children[i]);
         blist_forget_child(self, k-1);
         blist_adjust_n(p);
@@ -2277,6 +3159,11 @@ blist_insert_here(PyBList *self, int k, PyObject *item)
         invariants(self, VALID_RW|VALID_OVERFLOW);
         assert(k >= 0);
 
+        if (!blist_raw(self) && !_PyObject_GC_IS_TRACKED(self)
+            && (self->leaf ? _PyObject_GC_MAY_BE_TRACKED(item)
+                : _PyObject_GC_IS_TRACKED(item)))
+                PyObject_GC_Track(self);
+
         if (self->num_children < LIMIT) {
                 int collapse;
 
@@ -2331,7 +3218,9 @@ blist_insert_subtree(PyBList *self, int side, PyBList *subtree, int depth)
         self->n += subtree->n;
 
         if (depth) {
-                PyBList *restrict p = blist_prepare_write(self, side);
+                PyBList *restrict p;
+                blist_forget_ends(self, side < 0 ? self->num_children-1 : 0);
+                p = blist_prepare_write(self, side);
                 PyBList *overflow = blist_insert_subtree(p, side,
                                                          subtree, depth-1);
                 if (!overflow) return _blist(NULL);
@@ -2368,6 +3257,14 @@ blist_overflow_root(PyBList *self, PyBList *overflow)
         self->num_children = 2;
         self->leaf = 0;
         blist_adjust_n(self);
+        if (!_PyObject_GC_IS_TRACKED(self)) {
+                /* A detached subtree.  child holds what self held, so
+                 * it may stay untracked, but overflow may not hide
+                 * under self. */
+                PyObject_GC_UnTrack(child);
+                if (_PyObject_GC_IS_TRACKED(overflow))
+                        PyObject_GC_Track(self);
+        }
         return _int(-1);
 }
 
@@ -2438,11 +3335,11 @@ blist_concat_subtrees(PyBList *left_subtree, int left_depth,
          * Depths are the depth in the parent, not their height.
          */
 
-        int deepest = left_depth > right_depth ?
+        int shallowest = left_depth < right_depth ?
                 left_depth : right_depth;
         PyBList *root = blist_concat_blist(left_subtree, right_subtree,
                                      -(left_depth - right_depth), pdepth);
-        if (pdepth) *pdepth = deepest - *pdepth;
+        if (pdepth) *pdepth = shallowest - *pdepth;
         return root;
 }
 
@@ -2522,6 +3419,7 @@ ins1(PyBList *self, Py_ssize_t i, PyObject *item)
 {
         PyBList *ret;
         PyBList *restrict p;
+        PyObject *child;
         int k;
         Py_ssize_t so_far;
         PyBList *overflow;
@@ -2529,7 +3427,8 @@ ins1(PyBList *self, Py_ssize_t i, PyObject *item)
         invariants(self, VALID_RW|VALID_OVERFLOW);
 
         if (self->leaf) {
-                Py_INCREF(item);
+                if (!self->typecode)
+                        Py_INCREF(item);
 
                 /* Speed up the common case */
                 if (self->num_children < LIMIT) {
@@ -2543,14 +3442,26 @@ ins1(PyBList *self, Py_ssize_t i, PyObject *item)
                 return _blist(blist_insert_here(self, i, item));
         }
 
-        blist_locate(self, i, (PyObject **) &p, &k, &so_far);
+        blist_locate(self, i, &child, &k, &so_far);
+        if (((PyBList *) child)->num_children == LIMIT)
+                so_far += blist_spill(self, k, i - so_far);
 
         self->n += 1;
         p = blist_prepare_write(self, k);
         overflow = ins1(p, i - so_far, item);
 
-        if (!overflow) ret = NULL;
-        else ret = blist_insert_here(self, k+1, (PyObject *) overflow);
+        if (!overflow) {
+                Py_ssize_t *restrict ends = self->child_ends;
+                int j, num_ends = self->num_ends;
+                for (j = k; j < num_ends; j++)
+                        ends[j]++;
+                ret = NULL;
+        } else {
+                /* Inserts rarely return to the half just left behind */
+                blist_maybe_untrack(p);
+                blist_forget_ends(self, k);
+                ret = blist_insert_here(self, k+1, (PyObject *) overflow);
+        }
 
         return _blist(ret);
 }
@@ -2564,12 +3475,18 @@ blist_extend_blist(PyBList *self, PyBList *other)
 
         /* Special case for speed */
         if (self->leaf && other->leaf && self->n + other->n <= LIMIT) {
+                if (blist_reserve(self, self->n + other->n) < 0)
+                        return _int(-1);
                 copyref(self, self->n, other, 0, other->n);
                 self->n += other->n;
                 self->num_children = self->n;
                 return _int(0);
         }
 
+        /* self is about to become an internal node */
+        if (blist_reserve(self, LIMIT) < 0)
+                return _int(-1);
+
         /* Make not-user-visible roots for the subtrees */
         right = blist_copy(other); /* XXX not checking return values */
         left = blist_new();
@@ -2593,6 +3510,202 @@ blist_extend_blist(PyBList *self, PyBList *other)
         return _int(0);
 }
 
+/* Prepare one piece of a split for blist_concat_roots().  A piece is a
+ * detached subtree the caller owns outright; only its root may be
+ * short.  Empty pieces become NULL, and an internal node with a single
+ * child is replaced by that child.  Returns the piece and updates
+ * *pheight. */
+BLIST_LOCAL(PyBList *)
+blist_trim_piece(PyBList *piece, int *pheight)
+{
+        PyBList *child;
+
+        while (piece != NULL && !piece->leaf && piece->num_children <= 1) {
+                child = NULL;
+                if (piece->num_children) {
+                        child = (PyBList *) piece->children[0];
+                        piece->num_children = 0;
+                        piece->leaf = 1;
+                        if (Py_REFCNT(child) > 1) {
+                                /* Another list still shares it */
+                                PyBList *new_copy = blist_new();
+                                blist_become(new_copy, child);
+                                SAFE_DECREF(child);
+                                child = new_copy;
+                        }
+                }
+                SAFE_DECREF(piece);
+                piece = child;
+                (*pheight)--;
+        }
+
+        if (piece != NULL && piece->n == 0) {
+                SAFE_DECREF(piece);
+                piece = NULL;
+        }
+
+        return piece;
+}
+
+/* Join two pieces, either of which may be NULL */
+BLIST_LOCAL(PyBList *)
+blist_join_pieces(PyBList *left, int left_height,
+                  PyBList *right, int right_height, int *pheight)
+{
+        left = blist_trim_piece(left, &left_height);
+        right = blist_trim_piece(right, &right_height);
+
+        if (right == NULL) {
+                *pheight = left_height;
+                return left;
+        }
+        if (left == NULL) {
+                *pheight = right_height;
+                return right;
+        }
+
+        return blist_concat_roots(left, left_height, right, right_height,
+                                  pheight);
+}
+
+/* Split the detached subtree self, of the given height, into the
+ * subtrees holding its first i items and the rest.  Consumes self.
+ *
+ * Nodes off the path to item i are moved, not copied, so this takes
+ * O(log n) time.  Nodes on the path are only copied if another list
+ * shares them.
+ */
+BLIST_LOCAL(void)
+blist_split_tree(PyBList *self, int height, Py_ssize_t i,
+                 PyBList **pleft, int *pleft_height,
+                 PyBList **pright, int *pright_height)
+{
+        PyBList *p, *right, *left2, *right2;
+        PyObject *child;
+        int k, height2, right_height2;
+        Py_ssize_t so_far;
+
+        invariants(self, VALID_RW);
+        assert(Py_REFCNT(self) == 1);
+        assert(0 <= i && i <= self->n);
+
+        if (self->leaf) {
+                *pleft_height = *pright_height = 1;
+                if (i == 0 || i == self->n) {
+                        *pleft = i ? self : NULL;
+                        *pright = i ? NULL : self;
+                        _void();
+                        return;
+                }
+                right = blist_new(); /* XXX not checking return values */
+                right->typecode = self->typecode;
+                copy(right, 0, self, i, self->num_children - i);
+                right->num_children = self->num_children - i;
+                self->num_children = i;
+                blist_adjust_n(self);
+                blist_adjust_n(right);
+                *pleft = self;
+                *pright = right;
+                _void();
+                return;
+        }
+
+        blist_locate(self, i, &child, &k, &so_far);
+        p = blist_prepare_write(self, k);
+
+        /* self keeps children [0:k], right takes [k+1:] */
+        right = blist_new(); /* XXX not checking return values */
+        right->leaf = 0;
+        copy(right, 0, self, k+1, self->num_children - k - 1);
+        right->num_children = self->num_children - k - 1;
+        self->num_children = k;
+        blist_forget_ends(self, k);
+        blist_adjust_n(self);
+        blist_adjust_n(right);
+
+        blist_split_tree(p, height - 1, i - so_far,
+                         &left2, &height2, &right2, &right_height2);
+
+        *pleft = blist_join_pieces(self, height, left2, height2,
+                                   pleft_height);
+        *pright = blist_join_pieces(right2, right_height2, right, height,
+                                    pright_height);
+        _void();
+}
+
+/* Move the whole tree of the root self into a new detached node */
+static PyBList *blist_detach(PyBList *self)
+{
+        PyBList *tree = blist_new();
+        if (tree == NULL)
+                return NULL;
+        blist_become_and_consume(tree, self);
+        ext_mark(self, 0, DIRTY);
+        return tree;
+}
+
+/* Make the empty root self hold the detached tree, consuming it */
+BLIST_LOCAL(int)
+blist_adopt(PyBList *self, PyBList *tree)
+{
+        invariants(self, VALID_ROOT|VALID_RW);
+        assert(self->n == 0);
+
+        if (tree == NULL)
+                return _int(0);
+
+        if (blist_reserve(self, tree->leaf ? tree->num_children : LIMIT)
+            < 0) {
+                decref_later((PyObject *) tree);
+                return _int(-1);
+        }
+        blist_become_and_consume(self, tree);
+        SAFE_DECREF(tree);
+        ext_mark(self, 0, DIRTY);
+        return _int(0);
+}
+
+/* Replace self[lo:hi] with the detached tree mid, which may be NULL.
+ * The removed items are released later.  Like split() and join(),
+ * this moves nodes instead of sharing them, in O(log n) time. */
+BLIST_LOCAL(int)
+blist_replace_span(PyBList *self, Py_ssize_t lo, Py_ssize_t hi,
+                   PyBList *mid)
+{
+        PyBList *tree, *left, *right, *dead;
+        int height, left_height, right_height, dead_height, mid_height;
+
+        invariants(self, VALID_ROOT|VALID_RW);
+        assert(0 <= lo && lo <= hi && hi <= self->n);
+
+        tree = blist_detach(self);
+        if (tree == NULL) {
+                xdecref_later((PyObject *) mid);
+                return _int(-1);
+        }
+        node_epoch++;
+
+        height = blist_get_height(tree);
+        blist_split_tree(tree, height, hi, &left, &left_height,
+                         &right, &right_height);
+        left = blist_trim_piece(left, &left_height);
+        if (left != NULL) {
+                blist_split_tree(left, left_height, lo, &left, &left_height,
+                                 &dead, &dead_height);
+                xdecref_later((PyObject *) dead);
+        }
+
+        if (mid != NULL) {
+                mid_height = blist_get_height(mid);
+                left = blist_join_pieces(left, left_height, mid, mid_height,
+                                         &left_height);
+        }
+        left = blist_join_pieces(left, left_height, right, right_height,
+                                 &left_height);
+
+        return _int(blist_adopt(self, blist_trim_piece(left, &left_height)));
+}
+
 /* Recursive version of __delslice__ */
 static int blist_delslice(PyBList *self, Py_ssize_t i, Py_ssize_t j)
 {
@@ -2608,6 +3721,7 @@ static int blist_delslice(PyBList *self, Py_ssize_t i, Py_ssize_t j)
          */
 
         PyBList *restrict p, *restrict p2;
+        PyObject *child;
         int k, k2, depth;
         Py_ssize_t so_far, so_far2, low;
         int collapse_left, collapse_right, deleted_k, deleted_k2;
@@ -2633,8 +3747,10 @@ static int blist_delslice(PyBList *self, Py_ssize_t i, Py_ssize_t j)
                 return _int(0);
         }
 
-        blist_locate(self, i, (PyObject **) &p, &k, &so_far);
-        blist_locate(self, j-1, (PyObject **) &p2, &k2, &so_far2);
+        blist_locate(self, i, &child, &k, &so_far);
+        p = (PyBList *) child;
+        blist_locate(self, j-1, &child, &k2, &so_far2);
+        p2 = (PyBList *) child;
 
         if (k == k2) {
                 /* All of the deleted elements are contained under a single
@@ -2739,7 +3855,7 @@ static int blist_delslice(PyBList *self, Py_ssize_t i, Py_ssize_t j)
 BLIST_LOCAL(PyObject *)
 blist_get1(PyBList *self, Py_ssize_t i)
 {
-        PyBList *p;
+        PyObject *p;
         int k;
         Py_ssize_t so_far;
 
@@ -2748,13 +3864,17 @@ blist_get1(PyBList *self, Py_ssize_t i)
         if (self->leaf)
                 return _ob(self->children[i]);
 
-        blist_locate(self, i, (PyObject **) &p, &k, &so_far);
+        blist_locate(self, i, &p, &k, &so_far);
         assert(i >= so_far);
-        return _ob(blist_get1(p, i - so_far));
+        return _ob(blist_get1((PyBList *) p, i - so_far));
 }
 
-BLIST_LOCAL(PyObject *)
-blist_pop_last_fast(PyBList *self)
+/* Remove the last item and store it in *pv, if that can be done
+ * without rebalancing the tree.  Returns 0 on success and -1 if the
+ * caller must take the slow path.  (The item of a typed blist may be
+ * all zero bits, so it cannot double as the flag.) */
+BLIST_LOCAL(int)
+blist_pop_last_fast(PyBList *self, PyObject **pv)
 {
         PyBList *p;
 
@@ -2765,6 +3885,7 @@ blist_pop_last_fast(PyBList *self)
                 if (p != self && Py_REFCNT(p) > 1)
                         goto cleanup_and_slow;
                 p->n--;
+                blist_forget_ends(p, p->num_children-1);
         }
 
         if ((Py_REFCNT(p) > 1 || p->num_children == HALF)
@@ -2774,27 +3895,61 @@ blist_pop_last_fast(PyBList *self)
                 for (p2 = self; p != p2;
                      p2 = (PyBList*)p2->children[p2->num_children-1])
                         p2->n++;
-                return _ob(NULL);
+                return _int(-1);
         }
         p->n--;
         p->num_children--;
 
         if ((self->n) % INDEX_FACTOR == 0)
-                ext_mark(self, 0, DIRTY);
+                ext_mark_popped(self);
 #ifdef Py_DEBUG
         else
                 ((PyBListRoot*)self)->last_n--;
 #endif
-        return _ob(p->children[p->num_children]);
+        *pv = p->children[p->num_children];
+        return _int(0);
+}
+
+/* The mirror image of blist_pop_last_fast(), for the first item */
+BLIST_LOCAL(int)
+blist_pop_first_fast(PyBList *self, PyObject **pv)
+{
+        PyBList *p;
+
+        invariants(self, VALID_ROOT|VALID_RW);
+
+        for (p = self; !p->leaf; p = (PyBList*)p->children[0]) {
+                if (p != self && Py_REFCNT(p) > 1)
+                        goto cleanup_and_slow;
+                p->n--;
+                blist_forget_ends(p, 0);
+        }
+
+        if ((Py_REFCNT(p) > 1 || p->num_children == HALF)
+            && self != p) {
+                PyBList *p2;
+        cleanup_and_slow:
+                for (p2 = self; p != p2; p2 = (PyBList*)p2->children[0])
+                        p2->n++;
+                return _int(-1);
+        }
+        *pv = p->children[0];
+        shift_left(p, 1, 1);
+        p->n--;
+        p->num_children--;
+
+        ext_mark(self, 0, DIRTY);
+        return _int(0);
 }
 
 static void blist_delitem(PyBList *self, Py_ssize_t i)
 {
         invariants(self, VALID_ROOT|VALID_RW);
         if (i == self->n-1) {
-                PyObject *v = blist_pop_last_fast(self);
-                if (v) {
-                        decref_later(v);
+                PyObject *v;
+                if (blist_pop_last_fast(self, &v) == 0) {
+                        if (!self->typecode)
+                                decref_later(v);
                         _void();
                         return;
                 }
@@ -2815,111 +3970,222 @@ static PyObject *blist_delitem_return(PyBList *self, Py_ssize_t i)
 }
 
 /************************************************************************
- * BList iterator
+ * The tail leaf
+ *
+ * Appending to or popping from a list with more than one leaf would
+ * otherwise walk from the root to the last leaf and update n at every
+ * level.  Instead, like the tail of a persistent vector, the root of
+ * such a list may hold a detached leaf past the end of the tree.
+ * append() and pop() work on it directly.  A full tail is spliced
+ * into the tree, and an empty one is refilled from the last leaf.
+ *
+ * The tail is owned by the root alone and its items are not counted
+ * in the root's n.  Only len(), item access, append(), pop(),
+ * popleft(), iteration and the GC understand it.  Every other entry
+ * point calls blist_flush_tail() on the lists it uses first, so the
+ * rest of the code never sees a tail.
  */
 
-static iter_t *iter_init(iter_t *iter, PyBList *lst)
-{
-        iter->depth = 0;
+#define ROOT_TAIL(self) (((PyBListRoot *) (self))->tail)
 
-        while(!lst->leaf) {
-                iter->stack[iter->depth].lst = lst;
-                iter->stack[iter->depth++].i = 1;
-                Py_INCREF(lst);
-                lst = (PyBList *) lst->children[0];
-        }
+/* The number of items in a user-visible list */
+#define blist_user_n(self) \
+        ((self)->n + (ROOT_TAIL(self) ? ROOT_TAIL(self)->n : 0))
 
-        iter->leaf = lst;
-        iter->i = 0;
-        iter->depth++;
-        Py_INCREF(lst);
+#define blist_flush_tail(self) \
+        do { if (ROOT_TAIL(self)) blist_splice_tail((PyBList *) (self)); \
+        } while (0)
 
-        return iter;
-}
+/* Lists built into the interpreter have their ->n read directly */
+#ifdef BLIST_IN_PYTHON
+#define blist_wants_tail(self) 0
+#else
+#define blist_wants_tail(self) (!(self)->leaf && !(self)->typecode)
+#endif
 
-static iter_t *iter_init2(iter_t *iter, PyBList *lst, Py_ssize_t start)
+/* Splice the tail into the tree as its last leaf, where
+ * blist_insert_here() rebalances it if it is short. */
+BLIST_LOCAL(void)
+blist_splice_tail(PyBList *self)
 {
-        iter->depth = 0;
+        PyBList *tail = ROOT_TAIL(self);
+        PyBList *p, *overflow;
+        Py_ssize_t old_n = self->n;
+        int depth = 0, shared = 0;
 
-        assert(start >= 0);
-        while (!lst->leaf) {
-                PyBList *p;
-                int k;
-                Py_ssize_t so_far;
+        invariants(self, VALID_ROOT|VALID_RW);
+        assert(!self->leaf);
+
+        ROOT_TAIL(self) = NULL;
+        if (!tail->num_children) {
+                SAFE_DECREF(tail);
+                _void();
+                return;
+        }
 
-                blist_locate(lst, start, (PyObject **) &p, &k, &so_far);
-                iter->stack[iter->depth].lst = lst;
-                iter->stack[iter->depth++].i = k + 1;
-                Py_INCREF(lst);
-                lst = p;
-                start -= so_far;
+        for (p = self; !p->leaf;
+             p = (PyBList *) p->children[p->num_children-1]) {
+                if (p != self && Py_REFCNT(p) > 1)
+                        shared = 1;
+                depth++;
         }
+        if (Py_REFCNT(p) > 1)
+                shared = 1;
 
-        iter->leaf = lst;
-        iter->i = start;
-        iter->depth++;
-        Py_INCREF(lst);
+        overflow = blist_insert_subtree(self, -1, tail, depth - 1);
+        blist_overflow_root(self, overflow);
 
-        return iter;
+        if (shared)
+                ext_mark(self, 0, DIRTY);
+        else
+                ext_mark_resized(self, old_n, old_n - p->n);
+        _void();
 }
 
-static PyObject *iter_next(iter_t *iter)
+/* Move the items past the first HALF of the last leaf into the empty
+ * tail.  Returns -1 if there are none or the last leaf is shared. */
+BLIST_LOCAL(int)
+blist_refill_tail(PyBList *self)
 {
-        PyBList *p;
-        int i;
+        PyBList *tail = ROOT_TAIL(self);
+        PyBList *p, *p2;
+        Py_ssize_t old_n = self->n;
+        int k;
 
-        p = iter->leaf;
-        if (p == NULL)
-                return NULL;
+        invariants(self, VALID_ROOT|VALID_RW);
+        assert(!self->leaf);
+        assert(!tail->num_children);
 
-        if (!p->leaf) {
-                /* If p is the root, it may have been a leaf when we began
-                 * iterating, but turned into a non-leaf during iteration.
-                 * Modifying the list during iteration results in undefined
-                 * behavior, so just throw in the towel.
-                 */
+        for (p = self; !p->leaf;
+             p = (PyBList *) p->children[p->num_children-1])
+                if (p != self && Py_REFCNT(p) > 1)
+                        return _int(-1);
+
+        k = p->num_children - HALF;
+        if (k <= 0 || Py_REFCNT(p) > 1)
+                return _int(-1);
+
+        for (p2 = self; p2 != p;
+             p2 = (PyBList *) p2->children[p2->num_children-1]) {
+                p2->n -= k;
+                blist_forget_ends(p2, p2->num_children-1);
+        }
+        copy(tail, 0, p, HALF, k);
+        tail->num_children = k;
+        tail->n = k;
+        p->num_children = HALF;
+        p->n = HALF;
+        if (_PyObject_GC_IS_TRACKED(p))
+                blist_gc_track(tail);
+
+        ext_mark_resized(self, old_n, self->n - HALF);
+        return _int(0);
+}
+
+/* Give self an empty tail, untracked until it holds something that
+ * may be.  Returns NULL, without an exception, if there is no memory
+ * for one; the caller can always do without. */
+BLIST_LOCAL(PyBList *)
+blist_new_tail(PyBList *self)
+{
+        PyBList *tail;
+
+        assert(blist_wants_tail(self));
+        assert(!ROOT_TAIL(self));
 
+        tail = blist_new();
+        if (tail == NULL) {
+                PyErr_Clear();
                 return NULL;
         }
+        PyObject_GC_UnTrack(tail);
+        ROOT_TAIL(self) = tail;
+        return tail;
+}
 
-        if (iter->i < p->num_children)
-                return p->children[iter->i++];
+/* Replace item i of the list, which lies in the tail, with v.
+ * Returns the old item. */
+BLIST_LOCAL_INLINE(PyObject *)
+blist_tail_ass_item(PyBList *self, Py_ssize_t i, PyObject *v)
+{
+        PyBList *tail = ROOT_TAIL(self);
+        PyObject *rv = tail->children[i - self->n];
 
-        iter->depth--;
-        do {
-                decref_later((PyObject *) p);
-                if (!iter->depth) {
-                        iter->leaf = NULL;
-                        return NULL;
-                }
-                p = iter->stack[--iter->depth].lst;
-                i = iter->stack[iter->depth].i;
-        } while (i >= p->num_children);
+        Py_INCREF(v);
+        tail->children[i - self->n] = v;
+        if (!_PyObject_GC_IS_TRACKED(tail) && _PyObject_GC_MAY_BE_TRACKED(v))
+                PyObject_GC_Track(tail);
+        return rv;
+}
+
+/************************************************************************
+ * BList iterator
+ */
 
-        assert(iter->stack[iter->depth].lst == p);
-        iter->stack[iter->depth++].i = i+1;
+/* Point iter at the item at index i of iter->lst */
+static void iter_locate(iter_t *iter, Py_ssize_t i)
+{
+        PyBList *p = iter->lst;
+        Py_ssize_t offset = 0;
 
         while (!p->leaf) {
-                p = (PyBList *) p->children[i];
-                Py_INCREF(p);
-                i = 0;
-                iter->stack[iter->depth].lst = p;
-                iter->stack[iter->depth++].i = i+1;
+                PyObject *child;
+                int k;
+                Py_ssize_t so_far;
+
+                blist_locate(p, i - offset, &child, &k, &so_far);
+                offset += so_far;
+                p = (PyBList *) child;
         }
 
-        iter->leaf = iter->stack[iter->depth-1].lst;
-        iter->i = iter->stack[iter->depth-1].i;
+        iter->leaf = p;
+        iter->i = i - offset;
+        iter->offset = offset;
+        iter->epoch = node_epoch;
+}
 
-        return p->children[i];
+static iter_t *iter_init2(iter_t *iter, PyBList *lst, Py_ssize_t start)
+{
+        assert(start >= 0);
+        iter->lst = lst;
+        iter_locate(iter, start);
+        return iter;
 }
+#define iter_init(iter, lst) (iter_init2((iter), (lst), 0))
 
-static void iter_cleanup(iter_t *iter)
+static PyObject *iter_next(iter_t *iter)
 {
-        int i;
-        for (i = 0; i < iter->depth-1; i++)
-                decref_later((PyObject *) iter->stack[i].lst);
-        if (iter->depth)
-                decref_later((PyObject *) iter->leaf);
+        PyBList *p;
+        Py_ssize_t i;
+
+        p = iter->leaf;
+        if (p == NULL)
+                return NULL;
+
+        /* If p is the root, it may have been a leaf when we began
+         * iterating, but turned into a non-leaf during iteration.
+         */
+        if (iter->epoch == node_epoch && p->leaf
+            && iter->i < p->num_children)
+                return p->children[iter->i++];
+
+        /* Either we used up the leaf, or the tree changed under us and
+         * the leaf may be gone.  Find our place again from the root.
+         * Modifying the list during iteration results in undefined
+         * behavior, so long as we do not crash.
+         */
+        i = iter->offset + iter->i;
+        if (i >= iter->lst->n && PyRootBList_Check(iter->lst))
+                /* Items appended since may wait in the tail */
+                blist_flush_tail(iter->lst);
+        if (i >= iter->lst->n) {
+                iter->leaf = NULL;
+                return NULL;
+        }
+        iter_locate(iter, i);
+        assert(iter->i < iter->leaf->num_children);
+
+        return iter->leaf->children[iter->i++];
 }
 
 BLIST_PYAPI(PyObject *)
@@ -2948,14 +4214,8 @@ py_blist_iter(PyObject *oseq)
                         return _ob(NULL);
         }
 
-        if (seq->leaf) {
-                /* Speed up common case */
-                it->iter.leaf = seq;
-                it->iter.i = 0;
-                it->iter.depth = 1;
-                Py_INCREF(seq);
-        } else
-                iter_init(&it->iter, seq);
+        iter_init(&it->iter, seq);
+        Py_INCREF(seq);
 
         PyObject_GC_Track(it);
         return _ob((PyObject *) it);
@@ -2969,7 +4229,7 @@ static void blistiter_dealloc(PyObject *oit)
         it = (blistiterobject *) oit;
 
         PyObject_GC_UnTrack(it);
-        iter_cleanup(&it->iter);
+        decref_later((PyObject *) it->iter.lst);
         if (num_free_iters < MAXFREELISTS
             && (Py_TYPE(it) == &PyBListIter_Type))
                 free_iters[num_free_iters++] = it;
@@ -2981,15 +4241,11 @@ static void blistiter_dealloc(PyObject *oit)
 static int blistiter_traverse(PyObject *oit, visitproc visit, void *arg)
 {
         blistiterobject *it;
-        int i;
 
         assert(PyBListIter_Check(oit));
         it = (blistiterobject *) oit;
 
-        for (i = 0; i < it->iter.depth-1; i++)
-                Py_VISIT(it->iter.stack[i].lst);
-        if (it->iter.depth)
-                Py_VISIT(it->iter.leaf);
+        Py_VISIT(it->iter.lst);
         return 0;
 }
 
@@ -3003,7 +4259,8 @@ static PyObject *blistiter_next(PyObject *oit)
         p = it->iter.leaf;
         if (p == NULL)
                 return NULL;
-        if (p->leaf && it->iter.i < p->num_children) {
+        if (it->iter.epoch == node_epoch && p->leaf
+            && it->iter.i < p->num_children) {
                 obj = p->children[it->iter.i++];
                 Py_INCREF(obj);
                 return obj;
@@ -3012,8 +4269,8 @@ static PyObject *blistiter_next(PyObject *oit)
         obj = iter_next(&it->iter);
         if (obj != NULL)
                 Py_INCREF(obj);
+        _decref_flush(); /* Nodes a spliced tail made redundant */
 
-        _decref_flush();
         return obj;
 }
 
@@ -3021,29 +4278,15 @@ BLIST_PYAPI(PyObject *)
 blistiter_len(blistiterobject *it)
 {
         iter_t *iter = &it->iter;
-        int depth;
-        Py_ssize_t total = 0;
+        Py_ssize_t total;
 
         if (!iter->leaf)
                 return PyInt_FromLong(0);
 
-        total += iter->leaf->n - iter->i;
-
-        for (depth = iter->depth-2; depth >= 0; depth--) {
-                point_t point = iter->stack[depth];
-                int j;
-                if (point.lst->leaf) continue;
-                assert(point.i > 0);
-                for (j = point.i; j < point.lst->num_children; j++) {
-                        PyBList *child = (PyBList *) point.lst->children[j];
-                        total += child->n;
-                }
-        }
-        if (iter->depth > 1 && iter->stack[0].lst->leaf) {
-                int extra = iter->stack[0].lst->n - iter->stack[0].i;
-                if (extra > 0) total += extra;
-        }
-        return PyInt_FromLong(total);
+        total = blist_user_n(iter->lst) - (iter->offset + iter->i);
+        if (total < 0)
+                total = 0;
+        return PyInt_FromSsize_t(total);
 }
 
 PyDoc_STRVAR(length_hint_doc, "Private method returning an estimate of len(list(it)).");
@@ -3093,28 +4336,16 @@ PyTypeObject PyBListIter_Type = {
 BLIST_LOCAL(iter_t *)
 riter_init2(iter_t *iter, PyBList *lst, Py_ssize_t start, Py_ssize_t stop)
 {
-        iter->depth = 0;
-
         assert(stop >= 0);
         assert(start >= 0);
         assert(start >= stop);
-        while (!lst->leaf) {
-                PyBList *p;
-                int k;
-                Py_ssize_t so_far;
 
-                blist_locate(lst, start-1, (PyObject **) &p, &k, &so_far);
-                iter->stack[iter->depth].lst = lst;
-                iter->stack[iter->depth++].i = k - 1;
-                Py_INCREF(lst);
-                lst = p;
-                start -= so_far;
+        iter->lst = lst;
+        if (start == 0) {
+                iter->leaf = NULL;
+                return iter;
         }
-
-        iter->leaf = lst;
-        iter->i = start-1;
-        iter->depth++;
-        Py_INCREF(lst);
+        iter_locate(iter, start-1);
 
         return iter;
 }
@@ -3124,57 +4355,44 @@ BLIST_LOCAL(PyObject *)
 iter_prev(iter_t *iter)
 {
         PyBList *p;
-        int i;
+        Py_ssize_t i;
 
         p = iter->leaf;
         if (p == NULL)
                 return NULL;
 
-        if (!p->leaf) {
-                /* If p is the root, it may have been a leaf when we began
-                 * iterating, but turned into a non-leaf during iteration.
-                 * Modifying the list during iteration results in undefined
-                 * behavior, so just throw in the towel.
-                 */
+        if (iter->epoch == node_epoch && p->leaf
+            && iter->i >= 0 && iter->i < p->num_children)
+                return p->children[iter->i--];
 
+        /* See iter_next() */
+        i = iter->offset + iter->i;
+        if (i >= iter->lst->n)
+                i = iter->lst->n - 1;
+        if (i < 0) {
+                iter->leaf = NULL;
                 return NULL;
         }
+        iter_locate(iter, i);
 
-        if (iter->i >= p->num_children && iter->i >= 0)
-                iter->i = p->num_children - 1;
-
-        if (iter->i >= 0)
-                return p->children[iter->i--];
-
-        iter->depth--;
-        do {
-                decref_later((PyObject *) p);
-                if (!iter->depth) {
-                        iter->leaf = NULL;
-                        return NULL;
-                }
-                p = iter->stack[--iter->depth].lst;
-                i = iter->stack[iter->depth].i;
-
-                if (i >= p->num_children && i >= 0)
-                        i = p->num_children - 1;
-        } while (i < 0);
+        return iter->leaf->children[iter->i--];
+}
 
-        assert(iter->stack[iter->depth].lst == p);
-        iter->stack[iter->depth++].i = i-1;
+/* Return a borrowed reference to item i of iter->lst, only descending
+ * the tree again when i lies outside the current leaf.  Walking a
+ * slice with a fixed step costs O(1) per item plus O(log n) per leaf
+ * visited.  The list must not change in between. */
+BLIST_LOCAL_INLINE(PyObject *)
+iter_seek(iter_t *iter, Py_ssize_t i)
+{
+        Py_ssize_t j = i - iter->offset;
 
-        while (!p->leaf) {
-                p = (PyBList *) p->children[i];
-                Py_INCREF(p);
-                i = p->num_children-1;
-                iter->stack[iter->depth].lst = p;
-                iter->stack[iter->depth++].i = i-1;
+        if (j < 0 || j >= iter->leaf->num_children) {
+                iter_locate(iter, i);
+                j = iter->i;
         }
 
-        iter->leaf = iter->stack[iter->depth-1].lst;
-        iter->i = iter->stack[iter->depth-1].i;
-
-        return p->children[i];
+        return iter->leaf->children[j];
 }
 
 BLIST_PYAPI(PyObject *)
@@ -3182,7 +4400,9 @@ py_blist_reversed(PyBList *seq)
 {
         blistiterobject *it;
 
-        invariants(seq, VALID_USER);
+        invariants(seq, VALID_USER|VALID_DECREF);
+        blist_flush_tail(seq);
+        decref_flush();
 
         DANGER_BEGIN;
         it = PyObject_GC_New(blistiterobject,
@@ -3191,14 +4411,8 @@ py_blist_reversed(PyBList *seq)
         if (it == NULL)
                 return _ob(NULL);
 
-        if (seq->leaf) {
-                /* Speed up common case */
-                it->iter.leaf = seq;
-                it->iter.i = seq->n-1;
-                it->iter.depth = 1;
-                Py_INCREF(seq);
-        } else
-                riter_init(&it->iter, seq);
+        riter_init(&it->iter, seq);
+        Py_INCREF(seq);
 
         PyObject_GC_Track(it);
         return _ob((PyObject *) it);
@@ -3215,10 +4429,8 @@ static PyObject *blistiter_prev(PyObject *oit)
         if (p == NULL)
                 return NULL;
 
-        if (it->iter.i >= p->num_children && it->iter.i >= 0)
-                it->iter.i = p->num_children - 1;
-
-        if (p->leaf && it->iter.i >= 0) {
+        if (it->iter.epoch == node_epoch && p->leaf
+            && it->iter.i >= 0 && it->iter.i < p->num_children) {
                 obj = p->children[it->iter.i--];
                 Py_INCREF(obj);
                 return obj;
@@ -3228,7 +4440,6 @@ static PyObject *blistiter_prev(PyObject *oit)
         if (obj != NULL)
                 Py_INCREF(obj);
 
-        _decref_flush();
         return obj;
 }
 
@@ -3236,25 +4447,17 @@ BLIST_PYAPI(PyObject *)
 blistriter_len(blistiterobject *it)
 {
         iter_t *iter = &it->iter;
-        int depth;
-        Py_ssize_t total = 0;
+        Py_ssize_t total;
 
-        total += iter->i + 1;
+        if (!iter->leaf)
+                return PyInt_FromLong(0);
 
-        for (depth = iter->depth-2; depth >= 0; depth--) {
-                point_t point = iter->stack[depth];
-                int j;
-                if (point.lst->leaf) continue;
-                for (j = 0; j <= point.i; j++) {
-                        PyBList *child = (PyBList *) point.lst->children[j];
-                        total += child->n;
-                }
-        }
-        if (iter->depth > 1 && iter->stack[0].lst->leaf) {
-                int extra = iter->stack[0].i + 1;
-                if (extra > 0) total += extra;
-        }
-        return PyInt_FromLong(total);
+        total = iter->offset + iter->i + 1;
+        if (total > iter->lst->n)
+                total = iter->lst->n;
+        if (total < 0)
+                total = 0;
+        return PyInt_FromSsize_t(total);
 }
 
 static PyMethodDef blistriter_methods[] = {
@@ -3409,6 +4612,7 @@ forest_append(Forest *forest, PyBList *leaf)
         }
 
         leaf->n = leaf->num_children;
+        blist_maybe_untrack(leaf);
 
         if (forest->num_trees == forest->max_trees) {
                 PyBList **list = forest->list;
@@ -3441,6 +4645,7 @@ forest_append(Forest *forest, PyBList *leaf)
                 forest->num_trees -= LIMIT;
                 x = blist_underflow(parent, LIMIT - 1);
                 assert(!x); (void) x;
+                blist_maybe_untrack_last(parent);
 
                 forest->list[forest->num_trees++] = parent;
                 power *= LIMIT;
@@ -3472,6 +4677,7 @@ blist_init_from_child_array(PyBList **children, int num_children)
                 }
                 parent->num_children = j;
                 blist_adjust_n(parent);
+                blist_maybe_untrack(parent);
                 children[k++] = parent;
         }
 
@@ -3483,12 +4689,14 @@ blist_init_from_child_array(PyBList **children, int num_children)
                 PyBList *right = children[k-1];
                 int needed = HALF - right->num_children;
 
+                blist_gc_track(right);
                 shift_right(right, 0, needed);
                 copy(right, 0, left, LIMIT-needed, needed);
                 left->num_children -= needed;
                 right->num_children += needed;
                 blist_adjust_n(left);
                 blist_adjust_n(right);
+                blist_maybe_untrack(right);
         }
 
         return blist_init_from_child_array(children, k);
@@ -3601,6 +4809,7 @@ static PyBList *forest_finish(Forest *forest)
                 group->num_children = n;
                 forest->num_trees -= n;
                 adj = blist_underflow(group, n - 1);
+                blist_maybe_untrack_last(group);
                 if (out_tree == NULL) {
                         out_tree = group;
                         out_height = group_height - adj;
@@ -3616,6 +4825,49 @@ static PyBList *forest_finish(Forest *forest)
         return out_tree;
 }
 
+/* Add a new reference to item to the leaf *pleaf, handing full leaves
+ * to the forest.  On failure, the caller must release *pleaf, which
+ * may be NULL, and the forest. */
+BLIST_LOCAL_INLINE(int)
+forest_append_item(Forest *forest, PyBList **pleaf, PyObject *item)
+{
+        PyBList *leaf = *pleaf;
+
+        if (leaf->num_children == LIMIT) {
+                if (forest_append(forest, leaf) < 0)
+                        return -1;
+                leaf = *pleaf = blist_new();
+                if (leaf == NULL)
+                        return -1;
+        }
+
+        Py_INCREF(item);
+        leaf->children[leaf->num_children++] = item;
+        return 0;
+}
+
+/* Hand the last leaf to the forest and combine everything, storing
+ * the new tree, or NULL if no items were added, in *ptree. */
+BLIST_LOCAL(int)
+forest_finish_items(Forest *forest, PyBList *leaf, PyBList **ptree)
+{
+        *ptree = NULL;
+
+        if (forest_append(forest, leaf) < 0) {
+                decref_later((PyObject *) leaf);
+                forest_uninit(forest);
+                return -1;
+        }
+
+        if (forest->num_trees == 0) {
+                forest_uninit(forest);
+                return 0;
+        }
+
+        *ptree = forest_finish(forest);
+        return *ptree == NULL ? -1 : 0;
+}
+
 /************************************************************************
  * Functions that rely on forests.
  */
@@ -3635,6 +4887,8 @@ blist_init_from_array(PyBList *self, PyObject **restrict src, Py_ssize_t n)
         invariants(self, VALID_ROOT|VALID_RW);
 
         if (n <= LIMIT) {
+                if (blist_reserve(self, n) < 0)
+                        return _int(-1);
                 dst = self->children;
                 while (src < stop) {
                         Py_INCREF(*src);
@@ -3690,6 +4944,11 @@ blist_init_from_array(PyBList *self, PyObject **restrict src, Py_ssize_t n)
         }
 
         final = forest_finish(&forest);
+        if (blist_reserve(self, LIMIT) < 0) {
+                Py_DECREF(final);
+                gc_unpause(gc_previous);
+                return _int(-1);
+        }
         blist_become_and_consume(self, final);
 
         ext_reindex_set_all((PyBListRoot *) self);
@@ -3713,7 +4972,10 @@ blist_init_from_seq(PyBList *self, PyObject *b)
 
         if (PyBList_Check(b)) {
                 /* We can copy other BLists in O(1) time :-) */
-                blist_become(self, (PyBList *) b);
+                if (PyRootBList_Check(b))
+                        blist_flush_tail(b);
+                if (blist_become(self, (PyBList *) b) < 0)
+                        return _int(-1);
                 ext_mark(self, 0, DIRTY);
                 ext_mark_set_dirty_all((PyBList *) b);
                 return _int(0);
@@ -3759,6 +5021,13 @@ blist_init_from_seq(PyBList *self, PyObject *b)
                         goto done;
                 }
 
+                if (blist_reserve(self, self->num_children + 1) < 0) {
+                        self->n = self->num_children;
+                        DANGER_BEGIN;
+                        Py_DECREF(item);
+                        DANGER_END;
+                        goto error;
+                }
                 self->children[self->num_children] = item;
         }
 
@@ -3837,6 +5106,214 @@ blist_init_from_seq(PyBList *self, PyObject *b)
         return _int(-1);
 }
 
+/* Return room for n borrowed references, which the caller fills in
+ * and passes to blist_gather_finish() to initialize the empty root
+ * self.  Small results are gathered straight into self. */
+BLIST_LOCAL(PyObject **)
+blist_gather_start(PyBList *self, Py_ssize_t n)
+{
+        PyObject **items;
+
+        invariants(self, VALID_ROOT|VALID_RW);
+        assert(n > 0);
+
+        if (n <= LIMIT) {
+                if (blist_reserve(self, n) < 0)
+                        return (PyObject **) _ob(NULL);
+                return (PyObject **) _ob((PyObject *) self->children);
+        }
+
+        items = PyMem_New(PyObject *, n);
+        if (items == NULL)
+                PyErr_NoMemory();
+        return (PyObject **) _ob((PyObject *) items);
+}
+
+BLIST_LOCAL(int)
+blist_gather_finish(PyBList *self, PyObject **items, Py_ssize_t n)
+{
+        Py_ssize_t i;
+        int err;
+
+        invariants(self, VALID_ROOT|VALID_RW);
+
+        if (items == self->children) {
+                for (i = 0; i < n; i++)
+                        Py_INCREF(items[i]);
+                self->num_children = n;
+                self->n = n;
+                return _int(0);
+        }
+
+        err = blist_init_from_array(self, items, n);
+        PyMem_Free(items);
+        return _int(err);
+}
+
+/* Initialize the empty root self from the items of other at start,
+ * start+step, ..., streaming them through a forest. */
+BLIST_LOCAL(int)
+blist_init_from_step(PyBList *self, PyBList *other, Py_ssize_t start,
+                     Py_ssize_t step, Py_ssize_t slicelength)
+{
+        PyObject **items;
+        iter_t iter;
+        Py_ssize_t i;
+
+        invariants(self, VALID_ROOT|VALID_RW);
+
+        items = blist_gather_start(self, slicelength);
+        if (items == NULL)
+                return _int(-1);
+
+        iter_init2(&iter, other, start);
+        for (i = 0; i < slicelength; i++, start += step)
+                items[i] = iter_seek(&iter, start);
+
+        return _int(blist_gather_finish(self, items, slicelength));
+}
+
+/* Rebuild self[lo:hi] without the items picked by deleted(), whose
+ * argument counts from lo.  The survivors stream into a forest, and
+ * the new tree replaces the span, so this takes O(hi - lo + log n)
+ * time however many items go. */
+#define BLIST_DEL_SPAN(self, lo, hi, deleted, err) do {                \
+        Forest _forest;                                                 \
+        PyBList *_leaf, *_mid;                                          \
+        iter_t _iter;                                                   \
+        Py_ssize_t _j;                                                  \
+                                                                        \
+        (err) = -1;                                                     \
+        if (forest_init(&_forest) == NULL)                              \
+                break;                                                  \
+        _leaf = blist_new();                                            \
+        if (_leaf == NULL) {                                            \
+                forest_uninit(&_forest);                                \
+                break;                                                  \
+        }                                                               \
+        iter_init2(&_iter, (self), (lo));                               \
+        for (_j = 0; _j < (hi) - (lo); _j++) {                          \
+                PyObject *_item = iter_seek(&_iter, (lo) + _j);         \
+                if (deleted(_j))                                        \
+                        continue;                                       \
+                if (forest_append_item(&_forest, &_leaf, _item) < 0) {  \
+                        xdecref_later((PyObject *) _leaf);              \
+                        forest_uninit(&_forest);                        \
+                        _j = -1;                                        \
+                        break;                                          \
+                }                                                       \
+        }                                                               \
+        if (_j < 0 || forest_finish_items(&_forest, _leaf, &_mid) < 0)  \
+                break;                                                  \
+        (err) = blist_replace_span((self), (lo), (hi), _mid);           \
+} while (0)
+
+/* Delete the slicelength items of self at lo, lo+step, ... for some
+ * step > 1, rebuilding the span between the first and last of them. */
+BLIST_LOCAL(int)
+blist_del_step(PyBList *self, Py_ssize_t lo, Py_ssize_t step,
+               Py_ssize_t slicelength)
+{
+        Py_ssize_t hi = lo + step * (slicelength - 1) + 1;
+        Py_ssize_t i, j, k;
+        int err;
+
+        invariants(self, VALID_ROOT|VALID_RW);
+        assert(step > 1 && slicelength > 1);
+
+        if (self->leaf) {
+                /* Compact in place */
+                for (i = j = lo, k = 0; i < self->num_children; i++, k--) {
+                        if (!k && i < hi) {
+                                decref_later(self->children[i]);
+                                k = step;
+                        } else
+                                self->children[j++] = self->children[i];
+                }
+                self->num_children = j;
+                self->n = j;
+                return _int(0);
+        }
+
+#define STEP_DELETED(j) ((j) % step == 0)
+        BLIST_DEL_SPAN(self, lo, hi, STEP_DELETED, err);
+#undef STEP_DELETED
+
+        return _int(err);
+}
+
+/* Delete the items of self whose bit is set in marks, where bit j
+ * stands for item lo+j and the highest bit set is for item hi-1.  A
+ * few deletions in a wide span go one at a time, back to front;
+ * otherwise the span is rebuilt. */
+BLIST_LOCAL(int)
+blist_del_marked(PyBList *self, Py_ssize_t lo, Py_ssize_t hi,
+                 Py_ssize_t count, unsigned *marks)
+{
+        Py_ssize_t i, j;
+        int err;
+
+        invariants(self, VALID_ROOT|VALID_RW);
+
+        if (self->leaf) {
+                for (i = j = lo; i < self->num_children; i++) {
+                        if (i < hi && GET_BIT(marks, i - lo))
+                                decref_later(self->children[i]);
+                        else
+                                self->children[j++] = self->children[i];
+                }
+                self->num_children = j;
+                self->n = j;
+                return _int(0);
+        }
+
+        if ((hi - lo) / LIMIT > count) {
+                for (i = hi - lo - 1; i >= 0; i--) {
+                        if (!marks[i >> SETCLEAN_SHIFT]) {
+                                i &= ~(Py_ssize_t) SETCLEAN_MASK;
+                                continue;
+                        }
+                        if (GET_BIT(marks, i)) {
+                                PyObject *ob = blist_delitem_return(self,
+                                                                    lo + i);
+                                decref_later(ob);
+                        }
+                }
+                return _int(0);
+        }
+
+#define MARK_DELETED(j) GET_BIT(marks, (j))
+        BLIST_DEL_SPAN(self, lo, hi, MARK_DELETED, err);
+#undef MARK_DELETED
+
+        return _int(err);
+}
+
+/* Find the leaf holding item i of the root self, copying any node on
+ * the way that another list shares, so that the leaf may be written.
+ * Stores the index of the leaf's first item in *poffset. */
+BLIST_LOCAL(PyBList *)
+blist_locate_leaf_rw(PyBList *self, Py_ssize_t i, Py_ssize_t *poffset)
+{
+        PyBList *p = self;
+        Py_ssize_t offset = 0;
+
+        invariants(self, VALID_ROOT|VALID_RW);
+
+        while (!p->leaf) {
+                PyObject *child;
+                int k;
+                Py_ssize_t so_far;
+
+                blist_locate(p, i - offset, &child, &k, &so_far);
+                offset += so_far;
+                p = blist_prepare_write(p, k);
+        }
+
+        *poffset = offset;
+        return (PyBList *) _ob((PyObject *) p);
+}
+
 /* Utility function for performing repr() */
 BLIST_LOCAL(int)
 blist_repr_r(PyBList *self)
@@ -3878,19 +5355,33 @@ ext_make_clean_set(PyBListRoot *root, Py_ssize_t i, PyObject *v)
         PyBList *next;
         int k;
         Py_ssize_t so_far, offset = 0;
-        PyObject *old_value;
-        int did_mark = 0;
+        PyObject *old_value, *child;
+        int track = !root->typecode && v && _PyObject_GC_MAY_BE_TRACKED(v);
+
+        /* blist_prepare_write() tracks the copies it makes, so every
+         * node above the first shared one must be tracked as well */
+        if (!root->typecode) {
+                Py_ssize_t j = i;
+                for (next = p; !track && !next->leaf; j -= so_far) {
+                        blist_locate(next, j, &child, &k, &so_far);
+                        next = (PyBList *) child;
+                        track = Py_REFCNT(next) > 1;
+                }
+        }
 
         while (!p->leaf) {
-                blist_locate(p, i, (PyObject **) &next, &k, &so_far);
-                if (Py_REFCNT(next) <= 1)
+                blist_locate(p, i, &child, &k, &so_far);
+                next = (PyBList *) child;
+                if (Py_REFCNT(next) <= 1) {
                         p = next;
-                else {
+                        if (track)
+                                blist_gc_track(p);
+                } else {
+                        /* The leaves below next are now shared, and
+                         * so have no setclean bits.  The index stays
+                         * valid for reading: it only refers to leaves,
+                         * and the one leaf we copy is re-indexed below. */
                         p = blist_PREPARE_WRITE(p, k);
-                        if (!did_mark) {
-                                ext_mark((PyBList *) root, offset, DIRTY);
-                                did_mark = 1;
-                        }
                 }
                 assert(i >= so_far);
                 i -= so_far;
@@ -3935,7 +5426,13 @@ blist_ass_item_return_slow(PyBListRoot *root, Py_ssize_t i, PyObject *v)
                          * If it's an iterator, we can go ahead and make the
                          * change anyway since we're not changing the length
                          * of the list.
+                         *
+                         * An untracked leaf must not receive a container
+                         * directly, though; see blist_gc_track().
                          */
+                        if (!_PyObject_GC_IS_TRACKED(p) && !root->typecode
+                            && v && _PyObject_GC_MAY_BE_TRACKED(v))
+                                return _ob(ext_make_clean_set(root, i, v));
                         rv = p->children[i - offset];
                         p->children[i - offset] = v;
                         if (dirty_offset >= 0)
@@ -4012,11 +5509,10 @@ blist_richcompare_list(PyBList *v, PyListObject *w, int op)
                 cmp = fast_eq(item, w->ob_item[i], fast_cmp_type);
 
                 if (cmp < 0) {
-                        ITER_CLEANUP();
                         return _ob(NULL);
                 } else if (!cmp) {
-                        if (op == Py_EQ) { ITER_CLEANUP(); goto false; }
-                        if (op == Py_NE) { ITER_CLEANUP(); goto true; }
+                        if (op == Py_EQ) goto false;
+                        if (op == Py_NE) goto true;
 
                         /* Last RichComparebool may have modified the list */
                         if (i >= PyList_GET_SIZE(w)) {
@@ -4027,7 +5523,6 @@ blist_richcompare_list(PyBList *v, PyListObject *w, int op)
                         DANGER_BEGIN;
                         ret = PyObject_RichCompare(item, w->ob_item[i], op);
                         DANGER_END;
-                        ITER_CLEANUP();
                         return ret;
                 }
                 i++;
@@ -4112,20 +5607,18 @@ blist_richcompare_slow(PyBList *v, PyBList *w, int op)
         leaf2 = it2.leaf;
         fast_cmp_type = check_fast_cmp_type(it1.leaf->children[0], Py_EQ);
         do {
-                if (it1.i < leaf1->num_children) {
+                if (it1.epoch == node_epoch && it1.i < leaf1->num_children) {
                         item1 = leaf1->children[it1.i++];
                 } else {
                         item1 = iter_next(&it1);
                         leaf1 = it1.leaf;
                         if (item1 == NULL) {
                         compare_len:
-                                iter_cleanup(&it1);
-                                iter_cleanup(&it2);
                                 return blist_richcompare_len(v, w, op);
                         }
                 }
 
-                if (it2.i < leaf2->num_children) {
+                if (it2.epoch == node_epoch && it2.i < leaf2->num_children) {
                         item2 = leaf2->children[it2.i++];
                 } else {
                         item2 = iter_next(&it2);
@@ -4137,8 +5630,6 @@ blist_richcompare_slow(PyBList *v, PyBList *w, int op)
                 c = fast_eq(item1, item2, fast_cmp_type);
         } while (c >= 1);
 
-        iter_cleanup(&it1);
-        iter_cleanup(&it2);
         return blist_richcompare_item(c, op, item1, item2);
 }
 
@@ -4194,10 +5685,10 @@ BLIST_LOCAL_INLINE(void)
 reverse_slice(register PyObject **restrict lo, register PyObject **restrict hi)
 {
         register PyObject *t;
-        assert(lo && hi);
 
-        /* slice of length 0 */
+        /* slice of length 0, possibly of an empty root's NULL children */
         if (hi == lo) return;
+        assert(lo && hi);
 
         /* Use Duff's Device
          * http://en.wikipedia.org/wiki/Duff%27s_device
@@ -4235,6 +5726,7 @@ static void blist_double(PyBList *self)
                 return;
         }
 
+        assert(self->allocated == LIMIT);
         copyref(self, self->num_children, self, 0, self->num_children);
         self->num_children *= 2;
         self->n *= 2;
@@ -4249,6 +5741,8 @@ blist_extend(PyBList *self, PyObject *other)
         invariants(self, VALID_PARENT|VALID_RW);
 
         if (PyBList_Check(other)) {
+                if (PyRootBList_Check(other))
+                        blist_flush_tail(other);
                 err = blist_extend_blist(self, (PyBList *) other);
                 goto done;
         }
@@ -4275,30 +5769,42 @@ blist_repeat(PyBList *self, Py_ssize_t n)
         invariants(self, VALID_PARENT);
 
         if (n <= 0 || self->n == 0)
-                return _ob((PyObject *) blist_root_new());
+                return _ob((PyObject *) blist_root_new_like(self));
 
         if ((self->n * n) / n != self->n)
                 return _ob(PyErr_NoMemory());
 
-        rv = blist_root_new();
+        rv = blist_root_new_like(self);
         if (rv == NULL)
                 return _ob(NULL);
 
         if (n == 1) {
-                blist_become(rv, self);
+                if (blist_become(rv, self) < 0) {
+                        SAFE_DECREF(rv);
+                        return _ob(NULL);
+                }
                 ext_mark(rv, 0, DIRTY);
                 return _ob((PyObject *) rv);
         }
 
-        if (self->num_children > HALF)
-                blist_become(rv, self);
-        else {
+        if (self->num_children > HALF) {
+                if (blist_become(rv, self) < 0) {
+                        SAFE_DECREF(rv);
+                        return _ob(NULL);
+                }
+        } else {
                 Py_ssize_t fit, fitn, so_far;
 
-                rv->leaf = self->leaf;
                 fit = LIMIT / self->num_children;
                 if (fit > n) fit = n;
                 fitn = fit * self->num_children;
+                /* rv only stays small if it is the whole result */
+                if (blist_reserve(rv, fit == n && self->leaf ? fitn : LIMIT)
+                    < 0) {
+                        SAFE_DECREF(rv);
+                        return _ob(NULL);
+                }
+                rv->leaf = self->leaf;
                 xcopyref(rv, 0, self, 0, self->num_children);
                 so_far = self->num_children;
                 while (so_far*2 < fitn) {
@@ -4320,11 +5826,17 @@ blist_repeat(PyBList *self, Py_ssize_t n)
                 n /= fit;
 
                 if (remainder_n) {
-                        remainder = blist_root_new();
+                        remainder = blist_root_new_like(self);
                         if (remainder == NULL)
                                 goto error;
                         remainder->n = self->n * remainder_n;
                         remainder_n *= self->num_children;
+                        if (blist_reserve(remainder, self->leaf
+                                          ? remainder_n : LIMIT) < 0) {
+                                SAFE_DECREF(remainder);
+                                SAFE_DECREF(rv);
+                                return _ob(NULL);
+                        }
                         remainder->leaf = self->leaf;
                         xcopyref(remainder, 0, rv, 0, remainder_n);
                         remainder->num_children = remainder_n;
@@ -4336,7 +5848,7 @@ blist_repeat(PyBList *self, Py_ssize_t n)
                 goto do_remainder;
 
         power = rv;
-        rv = blist_root_new();
+        rv = blist_root_new_like(self);
         if (rv == NULL) {
                 SAFE_XDECREF(remainder);
         error:
@@ -4344,8 +5856,11 @@ blist_repeat(PyBList *self, Py_ssize_t n)
                 return _ob(NULL);
         }
 
-        if (n & 1)
-                blist_become(rv, power);
+        if ((n & 1) && blist_become(rv, power) < 0) {
+                SAFE_DECREF(rv);
+                SAFE_XDECREF(remainder);
+                goto error;
+        }
 
         for (mask = 2; mask <= n; mask <<= 1) {
                 blist_double(power);
@@ -4383,28 +5898,58 @@ linearize_rw_r(PyBList *self)
         return;
 }
 
+/* Track every node below self */
 BLIST_LOCAL(void)
-linearize_rw(PyBListRoot *self)
+blist_gc_track_all(PyBList *self)
 {
         int i;
 
-        if (self->leaf || self->dirty_root == CLEAN_RW)
-                return;
+        for (i = 0; i < self->num_children; i++) {
+                PyBList *p = (PyBList *) self->children[i];
+                blist_gc_track(p);
+                if (!p->leaf)
+                        blist_gc_track_all(p);
+        }
+}
 
-        if (self->dirty_root == CLEAN) {
-                Py_ssize_t n = SETCLEAN_LEN(INDEX_LENGTH(self));
+BLIST_LOCAL(void)
+linearize_rw(PyBListRoot *self)
+{
+        int i;
+
+        if (self->leaf)
+                return;
+
+        if (self->dirty_root == CLEAN_RW)
+                goto track;
+
+        if (self->dirty_root == CLEAN && INDEX_REFS(self) == 1) {
+                Py_ssize_t n = SETCLEAN_LEN(INDEX_LENGTH(self));
                 for (i = 0; i < n; i++)
                         if (self->setclean_list[i] != (unsigned) -1)
                                 goto slow;
                 memset(self->setclean_list, 255,
                        SETCLEAN_LEN(INDEX_LENGTH(self)) * sizeof(unsigned));
                 self->dirty_root = CLEAN_RW;
-                return;
+                goto track;
         }
 
 slow:
         linearize_rw_r((PyBList *)self);
         ext_reindex_set_all(self);
+
+track:
+        /* Our callers move items between leaves directly, so any leaf
+         * may receive a container.  If there is one anywhere, no node
+         * may stay untracked.  Every node is private to self by now,
+         * so tracking them can't expose another list's untracked
+         * nodes to the collector. */
+        for (i = 0; i < self->num_children && !self->typecode; i++) {
+                if (_PyObject_GC_IS_TRACKED(self->children[i])) {
+                        blist_gc_track_all((PyBList *) self);
+                        break;
+                }
+        }
 }
 
 BLIST_LOCAL(void)
@@ -4514,6 +6059,7 @@ blist_append(PyBList *self, PyObject *v)
 {
         PyBList *overflow;
         PyBList *p;
+        Py_ssize_t lo, hi;
 
         invariants(self, VALID_ROOT|VALID_RW);
 
@@ -4523,13 +6069,19 @@ blist_append(PyBList *self, PyObject *v)
                 return _int(-1);
         }
 
+        if (self->leaf && blist_reserve(self, self->num_children + 1) < 0)
+                return _int(-1);
+
         for (p = self; !p->leaf; p= (PyBList*)p->children[p->num_children-1]) {
                 if (p != self && Py_REFCNT(p) > 1)
                         goto cleanup_and_slow;
                 p->n++;
+                blist_forget_ends(p, p->num_children-1);
         }
 
-        if (p->num_children == LIMIT || (p != self && Py_REFCNT(p) > 1)) {
+        if (p->num_children == LIMIT || (p != self && Py_REFCNT(p) > 1)
+            || (!p->typecode && !_PyObject_GC_IS_TRACKED(p)
+                && _PyObject_GC_MAY_BE_TRACKED(v))) {
                 PyBList *p2;
         cleanup_and_slow:
                 for (p2 = self; p2 != p;
@@ -4540,10 +6092,11 @@ blist_append(PyBList *self, PyObject *v)
 
         p->children[p->num_children++] = v;
         p->n++;
-        Py_INCREF(v);
+        if (!p->typecode)
+                Py_INCREF(v);
 
         if ((self->n-1) % INDEX_FACTOR == 0)
-                ext_mark(self, 0, DIRTY);
+                ext_mark_inserted(self, self->n-1, self->n, self->n);
 #ifdef Py_DEBUG
         else
                 ((PyBListRoot*)self)->last_n++;
@@ -4552,14 +6105,225 @@ blist_append(PyBList *self, PyObject *v)
         return _int(0);
 
  slow:
+        if (!ext_insert_range((PyBListRoot *) self, self->n, &lo, &hi))
+                lo = -1;
         overflow = ins1(self, self->n, v);
         if (overflow)
                 blist_overflow_root(self, overflow);
-        ext_mark(self, 0, DIRTY);
+        ext_mark_inserted(self, self->n-1, lo, hi);
+
+        return _int(0);
+}
+
+BLIST_LOCAL(int)
+blist_insert(PyBList *self, Py_ssize_t i, PyObject *v)
+{
+        PyBList *overflow;
+        Py_ssize_t lo, hi;
+
+        invariants(self, VALID_ROOT|VALID_RW);
+
+        if (self->n == PY_SSIZE_T_MAX) {
+                PyErr_SetString(PyExc_OverflowError,
+                                "cannot add more objects to list");
+                return _int(-1);
+        }
+
+        if (i < 0) {
+                i += self->n;
+                if (i < 0)
+                        i = 0;
+        } else if (i > self->n)
+                i = self->n;
+
+        /* Speed up the common case */
+        if (self->leaf && self->num_children < LIMIT) {
+                if (blist_reserve(self, self->num_children + 1) < 0)
+                        return _int(-1);
+                if (!self->typecode)
+                        Py_INCREF(v);
+
+                shift_right(self, i, 1);
+                self->num_children++;
+                self->n++;
+                self->children[i] = v;
+                return _int(0);
+        }
+
+        if (!ext_insert_range((PyBListRoot *) self, i, &lo, &hi))
+                lo = -1;
+        overflow = ins1(self, i, v);
+        if (overflow)
+                blist_overflow_root(self, overflow);
+        ext_mark_inserted(self, i, lo, hi);
+        return _int(0);
+}
+
+/* Insert v at the front of the list.  Like blist_append(), this walks
+ * down the left edge without rebalancing when the first leaf has room.
+ * Every item moves one position to the right, so the index is marked
+ * dirty either way. */
+BLIST_LOCAL(int)
+blist_appendleft(PyBList *self, PyObject *v)
+{
+        PyBList *p;
 
+        invariants(self, VALID_ROOT|VALID_RW);
+
+        if (self->n == PY_SSIZE_T_MAX) {
+                PyErr_SetString(PyExc_OverflowError,
+                                "cannot add more objects to list");
+                return _int(-1);
+        }
+
+        if (self->leaf && blist_reserve(self, self->num_children + 1) < 0)
+                return _int(-1);
+
+        for (p = self; !p->leaf; p = (PyBList*)p->children[0]) {
+                if (p != self && Py_REFCNT(p) > 1)
+                        goto cleanup_and_slow;
+                p->n++;
+                blist_forget_ends(p, 0);
+        }
+
+        if (p->num_children == LIMIT || (p != self && Py_REFCNT(p) > 1)
+            || (!p->typecode && !_PyObject_GC_IS_TRACKED(p)
+                && _PyObject_GC_MAY_BE_TRACKED(v))) {
+                PyBList *p2;
+        cleanup_and_slow:
+                for (p2 = self; p2 != p; p2 = (PyBList*)p2->children[0])
+                        p2->n--;
+                return _int(blist_insert(self, 0, v));
+        }
+
+        shift_right(p, 0, 1);
+        p->children[0] = v;
+        p->num_children++;
+        p->n++;
+        if (!p->typecode)
+                Py_INCREF(v);
+
+        ext_mark(self, 0, DIRTY);
         return _int(0);
 }
 
+/************************************************************************
+ * Searching sorted BLists
+ *
+ * These are the building blocks for the sortedlist and sortedset
+ * types.  A binary search by position costs O(log n) lookups of
+ * O(log n) each, plus an interpreted comparison per step.  Instead,
+ * we descend from the root to a leaf once, picking a child at each
+ * level by comparing against the last key stored beneath it.
+ */
+
+/* Return the last item in the subtree rooted at self */
+BLIST_LOCAL(PyObject *)
+blist_last_item(PyBList *self)
+{
+        while (!self->leaf)
+                self = (PyBList *) self->children[self->num_children-1];
+        return self->children[self->num_children-1];
+}
+
+/* Return the position where key belongs in the sorted BList self: to
+ * the left of any equal keys if right is 0, and to their right
+ * otherwise.  If keyed is true, each item is a (key, value) tuple and
+ * only the key is compared.
+ *
+ * Comparisons may execute arbitrary code that modifies the list.  We
+ * hold a reference to each node as we descend, so that writers copy
+ * it instead of changing it out from under us, and to each item while
+ * it is being compared.  If the list is modified the result is
+ * meaningless, but it is still a valid position.
+ *
+ * Returns -1 and sets an exception if a comparison fails.  The caller
+ * must call decref_flush().
+ */
+BLIST_LOCAL(Py_ssize_t)
+blist_bisect(PyBList *self, PyObject *key, int keyed, int right)
+{
+        fast_compare_data_t fast_cmp_type;
+        PyBList *p, *child;
+        PyObject *item, *item_key;
+        Py_ssize_t so_far = 0;
+        int lo, hi, mid, k, c;
+
+        invariants(self, VALID_PARENT);
+
+        fast_cmp_type = check_fast_cmp_type(key, Py_LT);
+        p = self;
+        Py_INCREF(p);
+
+        for (;;) {
+                lo = 0;
+                hi = p->num_children;
+                while (lo < hi) {
+                        mid = (lo + hi) / 2;
+                        if (p->leaf)
+                                item = p->children[mid];
+                        else
+                                item = blist_last_item((PyBList *)
+                                                       p->children[mid]);
+                        if (!keyed)
+                                item_key = item;
+                        else if (PyTuple_Check(item)
+                                 && PyTuple_GET_SIZE(item) > 0)
+                                item_key = PyTuple_GET_ITEM(item, 0);
+                        else {
+                                PyErr_SetString(PyExc_TypeError,
+                                                "keyed items must be tuples");
+                                decref_later((PyObject *) p);
+                                return _int(-1);
+                        }
+
+                        Py_INCREF(item);
+                        if (right)
+                                c = fast_lt(key, item_key, fast_cmp_type);
+                        else
+                                c = fast_lt(item_key, key, fast_cmp_type);
+                        decref_later(item);
+
+                        if (c < 0) {
+                                decref_later((PyObject *) p);
+                                return _int(-1);
+                        }
+                        if (right == c)
+                                hi = mid;
+                        else
+                                lo = mid + 1;
+
+                        /* Only the root can change size under us */
+                        if (hi > p->num_children)
+                                hi = p->num_children;
+                        if (lo > hi)
+                                lo = hi;
+                }
+
+                if (p->leaf) {
+                        so_far += lo;
+                        break;
+                }
+                if (lo == p->num_children) {
+                        so_far += p->n;
+                        break;
+                }
+
+                for (k = 0; k < lo; k++)
+                        so_far += ((PyBList *) p->children[k])->n;
+                child = (PyBList *) p->children[lo];
+                Py_INCREF(child);
+                decref_later((PyObject *) p);
+                p = child;
+        }
+
+        decref_later((PyObject *) p);
+
+        if (so_far > self->n)
+                so_far = self->n;
+        return _int(so_far);
+}
+
 /************************************************************************
  * Sorting code
  *
@@ -4587,14 +6351,225 @@ unwrap_leaf_array(PyBList **leafs, int leafs_n, int n,
                         wrapper = (sortwrapperobject *) leaf->children[j];
                         leaf->children[j] = wrapper->value;
                         DANGER_BEGIN;
-                        Py_DECREF(wrapper->key);
+                        Py_XDECREF(wrapper->key);
                         DANGER_END;
                 }
+                if (leafs_n > 1)
+                        blist_maybe_untrack(leaf);
         }
 }
 
 #define KEY_ALL_DOUBLE 1
 #define KEY_ALL_LONG 2
+#define KEY_ALL_STR 4
+#define KEY_ALL_BYTES 8
+
+/* Tuples and ints, which sort_words() may handle */
+#ifdef BLIST_FLOAT_RADIX_SORT
+#define KEY_ALL_WIDE 16
+#else
+#define KEY_ALL_WIDE 0
+#endif
+
+#if PY_MAJOR_VERSION >= 3
+#define KEY_BYTES_TYPE PyBytes_Type
+#define KEY_BYTES_AS_STRING PyBytes_AS_STRING
+#define KEY_BYTES_SIZE PyBytes_GET_SIZE
+#else
+#define KEY_BYTES_TYPE PyString_Type
+#define KEY_BYTES_AS_STRING PyString_AS_STRING
+#define KEY_BYTES_SIZE PyString_GET_SIZE
+#endif
+
+/* str keys need the PEP 393 representation */
+#if PY_MAJOR_VERSION > 3 || PY_MAJOR_VERSION == 3 && PY_MINOR_VERSION >= 3
+#define BLIST_STR_KEYS 1
+#endif
+
+#ifdef BLIST_FLOAT_RADIX_SORT
+/* Map a double to an unsigned integer with the same order */
+BLIST_LOCAL_INLINE(PY_UINT64_T)
+double_sort_key(double d)
+{
+        PY_UINT64_T di, mask;
+        memcpy(&di, &d, 8);
+        mask = (-(PY_INT64_T) (di >> 63)) | (1ull << 63ull);
+        return di ^ mask;
+}
+#endif
+
+#if PY_VERSION_HEX >= 0x03050000
+/* operator.itemgetter() and attrgetter() objects give up their
+ * arguments through __reduce__() */
+#define BLIST_KEY_GETTERS 1
+#endif
+
+#define GETTER_ITEM 1
+#define GETTER_ATTR 2
+#define GETTER_MAX_ITEMS 8
+
+/* A key function that wrap_leaf_array() can apply without calling it */
+typedef struct {
+        int kind;               /* 0 if keyfunc must be called */
+        PyObject *args;         /* The items or attribute names */
+        Py_ssize_t n;
+        int indexed;            /* Whether every item is an int */
+        Py_ssize_t index[GETTER_MAX_ITEMS];
+} sort_getter_t;
+
+#ifdef BLIST_KEY_GETTERS
+static PyObject *itemgetter_type = NULL;
+static PyObject *attrgetter_type = NULL;
+#endif
+
+/* Fill in getter for keyfunc, leaving getter->kind 0 unless keyfunc
+ * is an itemgetter or an attrgetter without dotted names */
+BLIST_LOCAL(void)
+sort_getter_init(sort_getter_t *getter, PyObject *keyfunc)
+{
+#ifdef BLIST_KEY_GETTERS
+        static int imported = 0;
+        PyObject *reduced, *args;
+        Py_ssize_t i;
+        int kind;
+#endif
+
+        getter->kind = 0;
+        getter->args = NULL;
+        getter->n = 0;
+        getter->indexed = 0;
+
+#ifdef BLIST_KEY_GETTERS
+        if (keyfunc == NULL)
+                return;
+
+        if (!imported) {
+                PyObject *module;
+                imported = 1;
+                DANGER_BEGIN;
+                module = PyImport_ImportModule("operator");
+                DANGER_END;
+                if (module != NULL) {
+                        itemgetter_type = PyObject_GetAttrString(module,
+                                                                 "itemgetter");
+                        attrgetter_type = PyObject_GetAttrString(module,
+                                                                 "attrgetter");
+                        Py_DECREF(module);
+                }
+                PyErr_Clear();
+        }
+
+        if (itemgetter_type != NULL
+            && (PyObject *) Py_TYPE(keyfunc) == itemgetter_type)
+                kind = GETTER_ITEM;
+        else if (attrgetter_type != NULL
+                 && (PyObject *) Py_TYPE(keyfunc) == attrgetter_type)
+                kind = GETTER_ATTR;
+        else
+                return;
+
+        reduced = PyObject_CallMethod(keyfunc, "__reduce__", NULL);
+        if (reduced == NULL) {
+                PyErr_Clear();
+                return;
+        }
+        if (!PyTuple_Check(reduced) || PyTuple_GET_SIZE(reduced) != 2)
+                goto done;
+        args = PyTuple_GET_ITEM(reduced, 1);
+        if (!PyTuple_CheckExact(args) || PyTuple_GET_SIZE(args) < 1
+            || PyTuple_GET_SIZE(args) > GETTER_MAX_ITEMS)
+                goto done;
+
+        getter->n = PyTuple_GET_SIZE(args);
+        getter->indexed = kind == GETTER_ITEM;
+        for (i = 0; i < getter->n; i++) {
+                PyObject *arg = PyTuple_GET_ITEM(args, i);
+                if (kind == GETTER_ATTR) {
+                        if (!PyUnicode_CheckExact(arg)
+                            || PyUnicode_READY(arg) < 0
+                            || PyUnicode_FindChar(arg, '.', 0,
+                                                  PyUnicode_GET_LENGTH(arg),
+                                                  1) != -1) {
+                                PyErr_Clear();
+                                goto done;
+                        }
+                } else if (getter->indexed) {
+                        if (PyLong_CheckExact(arg))
+                                getter->index[i] = PyLong_AsSsize_t(arg);
+                        if (!PyLong_CheckExact(arg) || PyErr_Occurred()) {
+                                PyErr_Clear();
+                                getter->indexed = 0;
+                        }
+                }
+        }
+
+        getter->kind = kind;
+        getter->args = args;
+        Py_INCREF(args);
+
+ done:
+        Py_DECREF(reduced);
+#else
+        (void) keyfunc;
+#endif
+}
+
+/* Item or attribute i of value, as picked by the getter */
+BLIST_LOCAL_INLINE(PyObject *)
+sort_getter_item(const sort_getter_t *getter, PyObject *value, Py_ssize_t i)
+{
+        PyObject *arg = PyTuple_GET_ITEM(getter->args, i);
+
+        if (getter->kind == GETTER_ATTR)
+                return PyObject_GetAttr(value, arg);
+
+        if (getter->indexed) {
+                Py_ssize_t j = getter->index[i], size;
+                PyObject **items;
+
+                if (PyTuple_CheckExact(value)) {
+                        size = PyTuple_GET_SIZE(value);
+                        items = &PyTuple_GET_ITEM(value, 0);
+                } else if (PyList_CheckExact(value)) {
+                        size = PyList_GET_SIZE(value);
+                        items = ((PyListObject *) value)->ob_item;
+                } else
+                        return PyObject_GetItem(value, arg);
+
+                if (j < 0)
+                        j += size;
+                if (j >= 0 && j < size) {
+                        Py_INCREF(items[j]);
+                        return items[j];
+                }
+        }
+
+        return PyObject_GetItem(value, arg);
+}
+
+/* The key for value, as keyfunc would return it */
+BLIST_LOCAL_INLINE(PyObject *)
+sort_getter_key(const sort_getter_t *getter, PyObject *value)
+{
+        PyObject *key, *item;
+        Py_ssize_t i;
+
+        if (getter->n == 1)
+                return sort_getter_item(getter, value, 0);
+
+        key = PyTuple_New(getter->n);
+        if (key == NULL)
+                return NULL;
+        for (i = 0; i < getter->n; i++) {
+                item = sort_getter_item(getter, value, i);
+                if (item == NULL) {
+                        Py_DECREF(key);
+                        return NULL;
+                }
+                PyTuple_SET_ITEM(key, i, item);
+        }
+        return key;
+}
 
 static int
 wrap_leaf_array(sortwrapperobject *restrict array,
@@ -4604,8 +6579,11 @@ wrap_leaf_array(sortwrapperobject *restrict array,
 {
         int i, j, k;
         int key_flags;
+        sort_getter_t getter;
 
-        key_flags = KEY_ALL_DOUBLE | KEY_ALL_LONG;
+        key_flags = KEY_ALL_DOUBLE | KEY_ALL_LONG | KEY_ALL_STR | KEY_ALL_BYTES
+                | KEY_ALL_WIDE;
+        sort_getter_init(&getter, keyfunc);
 
         for (k = i = 0; i < leafs_n; i++) {
                 PyBList *restrict leaf = leafs[i];
@@ -4621,24 +6599,36 @@ wrap_leaf_array(sortwrapperobject *restrict array,
                                 Py_INCREF(key);
                         } else {
                                 DANGER_BEGIN;
-                                key = PyObject_CallFunctionObjArgs(
-                                        keyfunc, value, NULL);
+                                if (getter.kind)
+                                        key = sort_getter_key(&getter, value);
+                                else
+                                        key = PyObject_CallFunctionObjArgs(
+                                                keyfunc, value, NULL);
                                 DANGER_END;
                                 if (key == NULL) {
                                         unwrap_leaf_array(leafs, leafs_n, k, array);
+                                        Py_XDECREF(getter.args);
                                         return -1;
                                 }
                         }
                         type = key->ob_type;
 #ifdef BLIST_FLOAT_RADIX_SORT
                         if (type == &PyFloat_Type) {
-                                double d = PyFloat_AS_DOUBLE(key);
-                                PY_UINT64_T di, mask;
-                                memcpy(&di, &d, 8);
-                                mask = (-(PY_INT64_T) (di >> 63))
-                                        | (1ull << 63ull);
-                                pair->fkey.k_uint64 = di ^ mask;
+                                pair->fkey.k_uint64 = double_sort_key(
+                                        PyFloat_AS_DOUBLE(key));
                                 key_flags &= KEY_ALL_DOUBLE;
+                        } else if (type == &PyTuple_Type) {
+                                key_flags &= KEY_ALL_WIDE;
+                        } else if (type == &KEY_BYTES_TYPE) {
+                                key_flags &= KEY_ALL_BYTES;
+#ifdef BLIST_STR_KEYS
+                        } else if (type == &PyUnicode_Type) {
+                                if (PyUnicode_READY(key) < 0) {
+                                        PyErr_Clear();
+                                        key_flags = 0;
+                                } else
+                                        key_flags &= KEY_ALL_STR;
+#endif
                         } else
 #endif
 #if PY_MAJOR_VERSION < 3
@@ -4647,7 +6637,7 @@ wrap_leaf_array(sortwrapperobject *restrict array,
                                 unsigned long u = i;
                                 const unsigned long mask = 1ul << (sizeof(long)*8-1);
                                 pair->fkey.k_ulong = u ^ mask;
-                                key_flags &= KEY_ALL_LONG;
+                                key_flags &= KEY_ALL_LONG | KEY_ALL_WIDE;
                         } else
 #endif
                         if (type == &PyLong_Type) {
@@ -4655,11 +6645,11 @@ wrap_leaf_array(sortwrapperobject *restrict array,
                                 if (x == (unsigned long) (long) -1
                                     && PyErr_Occurred()) {
                                         PyErr_Clear();
-                                        key_flags = 0;
+                                        key_flags &= KEY_ALL_WIDE;
                                 } else {
                                         const unsigned long mask = 1ul << (sizeof(long)*8-1);
                                         pair->fkey.k_ulong = x ^ mask;
-                                        key_flags &= KEY_ALL_LONG;
+                                        key_flags &= KEY_ALL_LONG | KEY_ALL_WIDE;
                                 }
                         } else
                                 key_flags = 0;
@@ -4671,35 +6661,12 @@ wrap_leaf_array(sortwrapperobject *restrict array,
         }
 
         assert(k == n);
+        Py_XDECREF(getter.args);
 
         *pkey_flags = key_flags;
         return 0;
 }
 
-/* If COMPARE is NULL, calls PyObject_RichCompareBool with Py_LT, else calls
- * islt.  This avoids a layer of function call in the usual case, and
- * sorting does many comparisons.
- * Returns -1 on error, 1 if x < y, 0 if x >= y.
- *
- * In Python 3, COMPARE is always NULL.
- */
-
-#define FAST_ISLT(X, Y, fast_cmp_type)                          \
-        (fast_lt(((sortwrapperobject *)(X))->key,               \
-                 ((sortwrapperobject *)(Y))->key,               \
-                 (fast_cmp_type)))
-
-#if PY_MAJOR_VERSION < 3
-#define ISLT(X, Y, COMPARE, fast_cmp_type)      \
-        ((COMPARE) == NULL ?                    \
-         FAST_ISLT(X, Y, fast_cmp_type) :       \
-         islt(((sortwrapperobject *)(X))->key, \
-              ((sortwrapperobject *)(Y))->key, COMPARE))
-#else
-#define ISLT(X, Y, COMPARE, fast_cmp_type)              \
-        (FAST_ISLT((X), (Y), (fast_cmp_type)))
-#endif
-
 #if PY_MAJOR_VERSION < 3
 /* XXX
 
@@ -4750,34 +6717,246 @@ static int islt(PyObject *x, PyObject *y, PyObject *compare)
 }
 #endif
 
-#define INSERTION_THRESH 0
-#define BINARY_THRESH 10
+/* Comparison kernels for sort().  sort_cmp_init() looks at the keys
+ * once, and picks the kernel that every comparison of the sort then
+ * calls through ISLT(), so that homogeneous keys skip rich comparison.
+ * Each kernel returns -1 on error, 1 if x < y, 0 if x >= y.
+ *
+ * The types that sort_item_cmp() handles are built-in, immutable,
+ * non-container types, as for fast_lt() above: comparing them runs no
+ * Python code and cannot fail.
+ */
 
-#define TESTSWAP(i, j) { \
-        if (fast_lt(sortarray[j], sortarray[i], fast_cmp_type)) {       \
-                PyObject *t = sortarray[j];                             \
-                sortarray[j] = sortarray[i];                            \
-                sortarray[i] = t;                                       \
-        }                                                               \
-        }
+typedef int sort_lt_t(PyObject *x, PyObject *y, PyObject *compare);
 
-#if 0
-BLIST_LOCAL(int)
-network_sort(PyObject **sortarray, Py_ssize_t n)
+typedef struct sort_cmp_t {
+        sort_lt_t *lt;
+        PyObject *compare;      /* Python 2's cmp argument, or NULL */
+} sort_cmp_t;
+
+#define ISLT(X, Y, cmp)                                                 \
+        ((cmp)->lt(((sortwrapperobject *)(X))->key,                     \
+                   ((sortwrapperobject *)(Y))->key, (cmp)->compare))
+
+/* Results of sort_item_cmp() */
+#define SORT_ERR (-1)
+#define SORT_EQ 0
+#define SORT_LT 1
+#define SORT_NOT_LT 2           /* Unequal, but not less, e.g., NaN */
+
+BLIST_LOCAL_INLINE(int)
+sort_item_type_ok(PyTypeObject *type)
 {
-        fast_compare_data_t fast_cmp_type;
-        fast_cmp_type = check_fast_cmp_type(sortarray[0], Py_LT);
+        return type == &PyFloat_Type
+                || type == &PyLong_Type
+                || type == &PyUnicode_Type
+#if PY_MAJOR_VERSION < 3
+                || type == &PyInt_Type
+                || type == &PyString_Type
+#else
+                || type == &PyBytes_Type
+#endif
+                ;
+}
 
-        switch(n) {
-        case 0:
-        case 1:
-                assert(0);
-        case 2:
-                TESTSWAP(0, 1);
-                return 0;
-        case 3:
-                TESTSWAP(0, 1);
-                TESTSWAP(0, 2);
+/* Compare x and y, which share a type accepted by sort_item_type_ok() */
+BLIST_LOCAL_INLINE(int)
+sort_item_cmp(PyObject *x, PyObject *y)
+{
+        PyTypeObject *type = Py_TYPE(x);
+        PyObject *res;
+
+        if (type == &PyFloat_Type) {
+                double a = PyFloat_AS_DOUBLE(x), b = PyFloat_AS_DOUBLE(y);
+                return a < b ? SORT_LT : a == b ? SORT_EQ : SORT_NOT_LT;
+        }
+#if PY_MAJOR_VERSION < 3
+        if (type == &PyInt_Type) {
+                long a = PyInt_AS_LONG(x), b = PyInt_AS_LONG(y);
+                return a < b ? SORT_LT : a == b ? SORT_EQ : SORT_NOT_LT;
+        }
+        if (type == &PyString_Type) {
+#else
+        if (type == &PyBytes_Type) {
+#endif
+                Py_ssize_t na = KEY_BYTES_SIZE(x), nb = KEY_BYTES_SIZE(y);
+                int c = memcmp(KEY_BYTES_AS_STRING(x), KEY_BYTES_AS_STRING(y),
+                               na < nb ? na : nb);
+                if (c == 0)
+                        c = (na > nb) - (na < nb);
+                return c < 0 ? SORT_LT : c == 0 ? SORT_EQ : SORT_NOT_LT;
+        }
+        if (type == &PyUnicode_Type) {
+                int c = PyUnicode_Compare(x, y);
+                return c < 0 ? SORT_LT : c == 0 ? SORT_EQ : SORT_NOT_LT;
+        }
+        if (type == &PyLong_Type) {
+                int oa, ob;
+                long a = PyLong_AsLongAndOverflow(x, &oa);
+                long b = PyLong_AsLongAndOverflow(y, &ob);
+                if (!oa && !ob)
+                        return a < b ? SORT_LT
+                                : a == b ? SORT_EQ : SORT_NOT_LT;
+#if PY_MAJOR_VERSION < 3
+                /* Python 2's long has only tp_compare */
+                oa = type->tp_compare(x, y);
+                return oa < 0 ? SORT_LT : oa == 0 ? SORT_EQ : SORT_NOT_LT;
+#endif
+        }
+
+        res = type->tp_richcompare(x, y, Py_EQ);
+        Py_DECREF(res);
+        if (res == Py_True)
+                return SORT_EQ;
+        res = type->tp_richcompare(x, y, Py_LT);
+        Py_DECREF(res);
+        return res == Py_True ? SORT_LT : SORT_NOT_LT;
+}
+
+/* Any keys */
+static int
+sort_lt_any(PyObject *x, PyObject *y, PyObject *compare)
+{
+        return fast_lt(x, y, no_fast_lt);
+}
+
+#if PY_MAJOR_VERSION < 3
+static int
+sort_lt_cmp(PyObject *x, PyObject *y, PyObject *compare)
+{
+        return islt(x, y, compare);
+}
+#endif
+
+/* Keys that share a type accepted by sort_item_type_ok() */
+static int
+sort_lt_same(PyObject *x, PyObject *y, PyObject *compare)
+{
+        PyTypeObject *type = Py_TYPE(x);
+
+        if (type == &PyFloat_Type)
+                return PyFloat_AS_DOUBLE(x) < PyFloat_AS_DOUBLE(y);
+        if (type != &PyLong_Type)
+                return sort_item_cmp(x, y) == SORT_LT;
+
+        /* Rarely small, or radix sort would have had them */
+#if PY_MAJOR_VERSION < 3
+        return type->tp_compare(x, y) < 0;
+#else
+        {
+                PyObject *res = type->tp_richcompare(x, y, Py_LT);
+                Py_DECREF(res);
+                return res == Py_True;
+        }
+#endif
+}
+
+/* Tuples.  Like tuple's own comparison, finds the first items that
+ * differ and compares them, but compares items of the same simple type
+ * directly. */
+static int
+sort_lt_tuple(PyObject *x, PyObject *y, PyObject *compare)
+{
+        Py_ssize_t i, nx = PyTuple_GET_SIZE(x), ny = PyTuple_GET_SIZE(y);
+        Py_ssize_t n = nx < ny ? nx : ny;
+        int c;
+
+        for (i = 0; i < n; i++) {
+                PyObject *a = PyTuple_GET_ITEM(x, i);
+                PyObject *b = PyTuple_GET_ITEM(y, i);
+                if (a == b)
+                        continue;
+                if (Py_TYPE(a) == Py_TYPE(b)
+                    && sort_item_type_ok(Py_TYPE(a))) {
+                        c = sort_item_cmp(a, b);
+                        if (c == SORT_EQ)
+                                continue;
+                        return c == SORT_LT;
+                }
+
+                DANGER_BEGIN;
+                c = PyObject_RichCompareBool(a, b, Py_EQ);
+                if (c == 0)
+                        c = PyObject_RichCompareBool(a, b, Py_LT);
+                else if (c > 0)
+                        c = 2;
+                DANGER_END;
+                if (c != 2)
+                        return c;
+        }
+
+        return nx < ny;
+}
+
+/* Any two keys, for when no kernel has been picked */
+static int
+sort_lt_pair(PyObject *x, PyObject *y, PyObject *compare)
+{
+#if PY_MAJOR_VERSION < 3
+        if (compare != NULL)
+                return islt(x, y, compare);
+#endif
+        if (Py_TYPE(x) == Py_TYPE(y) && sort_item_type_ok(Py_TYPE(x)))
+                return sort_item_cmp(x, y) == SORT_LT;
+        return fast_lt(x, y, no_fast_lt);
+}
+
+/* Pick the kernel for the n keys in array */
+BLIST_LOCAL(void)
+sort_cmp_init(sort_cmp_t *cmp, sortwrapperobject *array, Py_ssize_t n,
+              PyObject *compare)
+{
+        PyTypeObject *type;
+        Py_ssize_t i;
+
+        cmp->compare = compare;
+        cmp->lt = sort_lt_any;
+#if PY_MAJOR_VERSION < 3
+        if (compare != NULL) {
+                cmp->lt = sort_lt_cmp;
+                return;
+        }
+#endif
+        if (n == 0)
+                return;
+
+        type = Py_TYPE(array[0].key);
+        if (type != &PyTuple_Type && !sort_item_type_ok(type))
+                return;
+        for (i = 1; i < n; i++)
+                if (Py_TYPE(array[i].key) != type)
+                        return;
+        cmp->lt = type == &PyTuple_Type ? sort_lt_tuple : sort_lt_same;
+}
+
+#define INSERTION_THRESH 0
+#define BINARY_THRESH 10
+
+#define TESTSWAP(i, j) { \
+        if (fast_lt(sortarray[j], sortarray[i], fast_cmp_type)) {       \
+                PyObject *t = sortarray[j];                             \
+                sortarray[j] = sortarray[i];                            \
+                sortarray[i] = t;                                       \
+        }                                                               \
+        }
+
+#if 0
+BLIST_LOCAL(int)
+network_sort(PyObject **sortarray, Py_ssize_t n)
+{
+        fast_compare_data_t fast_cmp_type;
+        fast_cmp_type = check_fast_cmp_type(sortarray[0], Py_LT);
+
+        switch(n) {
+        case 0:
+        case 1:
+                assert(0);
+        case 2:
+                TESTSWAP(0, 1);
+                return 0;
+        case 3:
+                TESTSWAP(0, 1);
+                TESTSWAP(0, 2);
                 TESTSWAP(1, 2);
                 return 0;
         case 4:
@@ -4912,7 +7091,7 @@ static int binary_sort_int64(sortwrapperobject *array, int n)
 #endif
 
 BLIST_LOCAL(int)
-mini_merge(PyObject **array, int middle, int n, PyObject *compare)
+mini_merge(PyObject **array, int middle, int n, const sort_cmp_t *cmp)
 {
         int c, ret = 0;
 
@@ -4923,14 +7102,11 @@ mini_merge(PyObject **array, int middle, int n, PyObject *compare)
         PyObject **lend = &copy[middle];
         PyObject **src;
         PyObject **dst;
-        fast_compare_data_t fast_cmp_type;
 
         assert (middle <= LIMIT);
 
-        fast_cmp_type = check_fast_cmp_type(array[0], Py_LT);
-
         for (left = array; left < right; left++) {
-                c = ISLT(*right, *left, compare, fast_cmp_type);
+                c = ISLT(*right, *left, cmp);
                 if (c < 0)
                         return -1;
                 if (c)
@@ -4951,7 +7127,7 @@ mini_merge(PyObject **array, int middle, int n, PyObject *compare)
         *dst++ = *right++;
 
         for (left = copy; left < lend && right < rend; dst++) {
-                c = ISLT(*right, *left, compare, fast_cmp_type);
+                c = ISLT(*right, *left, cmp);
                 if (c < 0) {
                         ret = -1;
                         goto done;
@@ -4972,7 +7148,7 @@ mini_merge(PyObject **array, int middle, int n, PyObject *compare)
 #define RUN_THRESH 5
 
 BLIST_LOCAL(int)
-gallop_sort(PyObject **array, int n, PyObject *compare)
+gallop_sort(PyObject **array, int n, const sort_cmp_t *cmp)
 {
         int i;
         int run_start = 0, run_dir = 2;
@@ -4980,14 +7156,11 @@ gallop_sort(PyObject **array, int n, PyObject *compare)
         int ns[LIMIT/RUN_THRESH+2];
         int num_runs = 0;
         PyObject **run = array;
-        fast_compare_data_t fast_cmp_type;
 
         if (n < 2) return 0;
 
-        fast_cmp_type = check_fast_cmp_type(array[0], Py_LT);
-
         for (i = 1; i < n; i++) {
-                int c = ISLT(array[i], array[i-1], compare, fast_cmp_type);
+                int c = ISLT(array[i], array[i-1], cmp);
                 assert(c < 0 || c == 0 || c == 1);
                 if (c == run_dir)
                         continue;
@@ -5015,8 +7188,7 @@ gallop_sort(PyObject **array, int n, PyObject *compare)
 
                         while (low < high) {
                                 mid = low + (high - low)/2;
-                                c = ISLT(tmp, array[mid], compare,
-                                         fast_cmp_type);
+                                c = ISLT(tmp, array[mid], cmp);
                                 assert(c < 0 || c == 0 || c == 1);
                                 if (c == run_dir)
                                         low = mid+1;
@@ -5041,8 +7213,7 @@ gallop_sort(PyObject **array, int n, PyObject *compare)
         while(num_runs > 1) {
                 for (i = 0; i < num_runs/2; i++) {
                         int total = ns[2*i] + ns[2*i+1];
-                        if (0 > mini_merge(runs[2*i], ns[2*i], total,
-                                           compare)) {
+                        if (0 > mini_merge(runs[2*i], ns[2*i], total, cmp)) {
                                 /* List valid due to invariants */
                                 return -1;
                         }
@@ -5129,7 +7300,7 @@ do_fast_merge(PyBList **restrict out, PyBList **in1, PyBList **in2,
 BLIST_LOCAL(int)
 try_fast_merge(PyBList **restrict out, PyBList **in1, PyBList **in2,
                Py_ssize_t n1, Py_ssize_t n2,
-               PyObject *compare, int *err)
+               const sort_cmp_t *cmp, int *err)
 {
         int c;
         PyBList *end;
@@ -5137,7 +7308,7 @@ try_fast_merge(PyBList **restrict out, PyBList **in1, PyBList **in2,
         end = in1[n1-1];
 
         c = ISLT(end->children[end->num_children-1],
-                 in2[0]->children[0], compare, no_fast_lt);
+                 in2[0]->children[0], cmp);
 
         if (c < 0) {
         error:
@@ -5152,7 +7323,7 @@ try_fast_merge(PyBList **restrict out, PyBList **in1, PyBList **in2,
         end = in2[n2-1];
 
         c = ISLT(end->children[end->num_children-1],
-                 in1[0]->children[0], compare, no_fast_lt);
+                 in1[0]->children[0], cmp);
         if (c < 0)
                 goto error;
         else if (c) {
@@ -5167,18 +7338,36 @@ try_fast_merge(PyBList **restrict out, PyBList **in1, PyBList **in2,
 BLIST_LOCAL(int)
 sub_merge(PyBList **restrict out, PyBList **in1, PyBList **in2,
           Py_ssize_t n1, Py_ssize_t n2,
-          PyObject *compare, int *err)
+          const sort_cmp_t *cmp, int *err)
 {
         int c;
         Py_ssize_t i, j;
         PyBList *restrict leaf1, *restrict leaf2, *restrict output;
         int leaf1_i = 0, leaf2_i = 0;
         Py_ssize_t nout = 0;
-        fast_compare_data_t fast_cmp_type;
 
-        if (try_fast_merge(out, in1, in2, n1, n2, compare, err))
+        if (try_fast_merge(out, in1, in2, n1, n2, cmp, err))
                 return n1 + n2;
 
+        /* Leaves of in1 that end before in2 begins go out whole */
+        while (leaf1_i < n1 - 1) {
+                leaf1 = in1[leaf1_i];
+                c = ISLT(in2[0]->children[0],
+                         leaf1->children[leaf1->num_children-1], cmp);
+                if (c < 0) {
+                        *err = -1;
+                        memcpy(&out[nout], &in1[leaf1_i],
+                               sizeof(PyBList *) * (n1 - leaf1_i));
+                        memcpy(&out[nout + n1 - leaf1_i], in2,
+                               sizeof(PyBList *) * n2);
+                        return n1 + n2;
+                }
+                if (c)
+                        break;
+                out[nout++] = leaf1;
+                leaf1_i++;
+        }
+
         leaf1 = in1[leaf1_i++];
         leaf2 = in2[leaf2_i++];
 
@@ -5187,8 +7376,6 @@ sub_merge(PyBList **restrict out, PyBList **in1, PyBList **in2,
 
         output = blist_new_no_GC();
 
-        fast_cmp_type = check_fast_cmp_type(leaf1->children[0], Py_LT);
-
         while ((leaf1_i < n1 || i < leaf1->num_children)
                && (leaf2_i < n2 || j < leaf2->num_children)) {
 
@@ -5217,8 +7404,7 @@ sub_merge(PyBList **restrict out, PyBList **in1, PyBList **in2,
                 }
 
                 /* Figure out which input leaf has the lower element */
-                c = ISLT(leaf2->children[j], leaf1->children[i], compare,
-                        fast_cmp_type);
+                c = ISLT(leaf2->children[j], leaf1->children[i], cmp);
                 if (c < 0) {
                         *err = -1;
                         goto done;
@@ -5282,31 +7468,151 @@ sub_merge(PyBList **restrict out, PyBList **in1, PyBList **in2,
         return nout;
 }
 
-/* If swap is true, place the output in scratch.
+/* sort_find_runs() result for items that all strictly descend */
+#define SCAN_DESCENDING (-2)
+
+BLIST_LOCAL_INLINE(PyObject *)
+scan_key(PyObject *ob, int wrapped)
+{
+        return wrapped ? ((sortwrapperobject *) ob)->key : ob;
+}
+
+/* Look for order in the items of leafs, which are sort wrappers if
+ * wrapped is true.  A run is a stretch of leaves that are each in
+ * order and in order with each other; a leaf out of order is a run by
+ * itself.  Stores the first leaf of each run in runs, followed by
+ * leafs_n, and returns the number of runs, 0 if the items are already
+ * in order, SCAN_DESCENDING if each item is less than the one before,
+ * or -1 on error.  Gives up after max_runs runs, which must be at
+ * least 1, returning max_runs+1.
+ * A nonzero from says the leaves before it are known to be one run,
+ * and the items not to descend. */
+BLIST_LOCAL(Py_ssize_t)
+sort_find_runs(PyBList **leafs, Py_ssize_t leafs_n, Py_ssize_t from,
+               const sort_cmp_t *cmp, int wrapped, Py_ssize_t *runs,
+               Py_ssize_t max_runs)
+{
+        Py_ssize_t i, k = 0;
+        PyObject *prev;
+        PyBList *leaf;
+        int j, c, in_order, prev_in_order = 0;
+
+#define SCAN_LT(x, y) (cmp->lt(scan_key((x), wrapped),                  \
+                               scan_key((y), wrapped), cmp->compare))
+
+        if (from == 0) {
+                /* A descent must start with the first two items */
+                leaf = leafs[0];
+                assert(leaf->num_children >= 2);
+                c = SCAN_LT(leaf->children[1], leaf->children[0]);
+                if (c < 0)
+                        return -1;
+                if (c) {
+                        prev = leaf->children[1];
+                        for (i = 0, j = 2; i < leafs_n; i++, j = 0) {
+                                leaf = leafs[i];
+                                for (; j < leaf->num_children; j++) {
+                                        c = SCAN_LT(leaf->children[j], prev);
+                                        if (c <= 0)
+                                                goto not_descending;
+                                        prev = leaf->children[j];
+                                }
+                        }
+                        return SCAN_DESCENDING;
+                not_descending:
+                        if (c < 0)
+                                return -1;
+                }
+        } else {
+                runs[k++] = 0;
+                prev_in_order = 1;
+        }
+
+        for (i = from; i < leafs_n; i++) {
+                leaf = leafs[i];
+                in_order = 1;
+                for (j = 1; j < leaf->num_children; j++) {
+                        c = SCAN_LT(leaf->children[j], leaf->children[j-1]);
+                        if (c < 0)
+                                return -1;
+                        if (c) {
+                                in_order = 0;
+                                break;
+                        }
+                }
+
+                c = 1;
+                if (in_order && prev_in_order) {
+                        PyBList *last = leafs[i-1];
+                        c = SCAN_LT(leaf->children[0],
+                                    last->children[last->num_children-1]);
+                        if (c < 0)
+                                return -1;
+                }
+                if (c) {
+                        if (k == max_runs) {
+                                runs[k] = i;
+                                return max_runs + 1;
+                        }
+                        runs[k++] = i;
+                }
+                prev_in_order = in_order;
+        }
+        runs[k] = leafs_n;
+
+#undef SCAN_LT
+
+        return k == 1 && prev_in_order ? 0 : k;
+}
+
+/* Like sort_find_runs() with a max_runs of 1, but first checks that
+ * the last leaf is in order or descends, so that a list with only a
+ * few items out of order at the end is not scanned in vain */
+BLIST_LOCAL(Py_ssize_t)
+sort_find_order(PyBList **leafs, Py_ssize_t leafs_n, const sort_cmp_t *cmp,
+                int wrapped, Py_ssize_t *runs)
+{
+        Py_ssize_t k;
+
+        if (leafs_n > 1) {
+                k = sort_find_runs(&leafs[leafs_n-1], 1, 0, cmp, wrapped,
+                                   runs, 1);
+                if (k == -1 || k == 1)
+                        return k;
+        }
+        return sort_find_runs(leafs, leafs_n, 0, cmp, wrapped, runs, 1);
+}
+
+/* Merge sort the k runs of in found by sort_find_runs().  The leaves
+ * of a run are already in order, but a run of one leaf may need
+ * sorting.
+ *
+ * If swap is true, place the output in scratch.
  * Otherwise, place the output in "in" */
 BLIST_LOCAL(Py_ssize_t)
-sub_sort(PyBList **restrict scratch, PyBList **in, PyObject *compare,
-         Py_ssize_t n, int *err, int swap)
+sub_sort(PyBList **restrict scratch, PyBList **in, const Py_ssize_t *runs,
+         Py_ssize_t k, const sort_cmp_t *cmp, int *err, int swap)
 {
-        Py_ssize_t half, n1, n2;
+        Py_ssize_t half, n1, n2, n = runs[k] - runs[0];
 
-        if (!n) return n;
         if (*err) {
                 if (swap)
                         memcpy(scratch, in, n * sizeof(PyBList *));
                 return n;
         }
-        if (n == 1) {
-                *err |= gallop_sort(in[0]->children, in[0]->num_children,
-                                    compare);
-                *scratch = *in;
-                return 1;
+        if (k == 1) {
+                if (n == 1)
+                        *err |= gallop_sort(in[0]->children,
+                                            in[0]->num_children, cmp);
+                memcpy(scratch, in, n * sizeof(PyBList *));
+                return n;
         }
 
-        half = n / 2;
+        half = runs[k/2] - runs[0];
 
-        n1 = sub_sort(scratch, in, compare, half, err, !swap);
-        n2 = sub_sort(&scratch[half], &in[half], compare, n-half, err, !swap);
+        n1 = sub_sort(scratch, in, runs, k/2, cmp, err, !swap);
+        n2 = sub_sort(&scratch[half], &in[half], runs + k/2, k - k/2,
+                      cmp, err, !swap);
 
         /* If swap is true, the output is currently in "in".
          * Otherwise, the output is currently in scratch.
@@ -5316,9 +7622,9 @@ sub_sort(PyBList **restrict scratch, PyBList **in, PyObject *compare,
 
         if (!*err) {
                 if (swap)
-                        n = sub_merge(scratch, in, &in[half], n1, n2, compare, err);
+                        n = sub_merge(scratch, in, &in[half], n1, n2, cmp, err);
                 else
-                        n = sub_merge(in, scratch, &scratch[half], n1, n2, compare, err);
+                        n = sub_merge(in, scratch, &scratch[half], n1, n2, cmp, err);
         } else {
                 if (swap) {
                         memcpy(scratch, in, n1 * sizeof(PyBList *));
@@ -5353,7 +7659,7 @@ array_enable_GC(PyBList **leafs, Py_ssize_t num_leafs)
 #define BITS_PER_PASS 8
 #define HISTOGRAM_SIZE (((Py_ssize_t) 1) << BITS_PER_PASS)
 #define MASK (HISTOGRAM_SIZE - 1)
-#define NUM_PASSES (((sizeof(unsigned long)*8-1) / BITS_PER_PASS)+1)
+#define NUM_PASSES ((int) ((sizeof(unsigned long)*8-1) / BITS_PER_PASS)+1)
 
 /* The histogram arrays are two-dimension arrays of
  * [HISTOGRAM_SIZE][NUM_PASSES].  Since that can end up somewhat large (16k on
@@ -5361,85 +7667,455 @@ array_enable_GC(PyBList **leafs, Py_ssize_t num_leafs)
  */
 typedef Py_ssize_t histogram_array_t[NUM_PASSES];
 
-BLIST_LOCAL_INLINE(int)
-sort_ulong(sortwrapperobject *restrict sortarray, Py_ssize_t n)
-{
-        sortwrapperobject *restrict scratch, *from, *to, *tmp;
-        Py_ssize_t i, j, sums[NUM_PASSES], count[NUM_PASSES], tsum;
-        histogram_array_t *histograms;
+/* Radix sorts of at least this many items release the GIL, and give
+ * each thread at least this many items. */
+#define RADIX_NOGIL_MIN (((Py_ssize_t) 1) << 15)
 
-        memset(sums, 0, sizeof sums);
-        memset(count, 0, sizeof count);
+/* Radix sorts of at least this many items sort in place, saving n
+ * wrappers of memory for about a third more time.  -1 never does. */
+#ifndef RADIX_INPLACE_MIN
+#define RADIX_INPLACE_MIN (-1)
+#endif
+#define MAX_SORT_THREADS 64
 
-        scratch = PyMem_New(sortwrapperobject, n);
-        if (scratch == NULL)
-                return -1;
+/* Set by set_sort_threads() */
+static int sort_threads = 1;
 
-        histograms = PyMem_New(histogram_array_t, HISTOGRAM_SIZE);
-        if (histograms == NULL) {
-                PyMem_Free(scratch);
-                return -1;
-        }
-        memset(histograms, 0, sizeof(histogram_array_t) * HISTOGRAM_SIZE);
+/* Set by set_sort_inplace_threshold() */
+static Py_ssize_t radix_inplace_min = RADIX_INPLACE_MIN;
 
-        for (i = 0; i < n; i++) {
-                unsigned long v = sortarray[i].fkey.k_ulong;
-                for (j = 0; j < NUM_PASSES; j++) {
-                        histograms[(v >> (BITS_PER_PASS * j)) & MASK][j]++;
-                }
-        }
+enum { RADIX_COUNT_ALL, RADIX_COUNT, RADIX_SCATTER, RADIX_COPY };
 
-        for (i = 0; i < HISTOGRAM_SIZE; i++) {
-                for (j = 0; j < NUM_PASSES; j++) {
-                        count[j] += !!histograms[i][j];
-                        tsum = histograms[i][j] + sums[j];
-                        histograms[i][j] = sums[j] - 1;
-                        sums[j] = tsum;
-                }
-        }
+/* One radix sort shared by the threads.  Thread t owns the t-th slice
+ * of the array and the t-th block of HISTOGRAM_SIZE histograms. */
+typedef struct radix_job_t {
+        sortwrapperobject *sortarray, *from, *to;
+        Py_ssize_t n;
+        histogram_array_t *histograms;
+        int nthreads;
+        int phase;
+        int pass;
+} radix_job_t;
 
-        from = sortarray;
-        to = scratch;
-        for (j = 0; j < NUM_PASSES; j++) {
-                sortwrapperobject *restrict f = from;
-                sortwrapperobject *restrict t = to;
-                if (count[j] == 1) continue;
-                for (i = 0; i < n; i++) {
+static void
+radix_task(radix_job_t *job, int t)
+{
+        histogram_array_t *restrict h = job->histograms + t * HISTOGRAM_SIZE;
+        sortwrapperobject *restrict f = job->from;
+        sortwrapperobject *restrict to = job->to;
+        Py_ssize_t lo = job->n * t / job->nthreads;
+        Py_ssize_t hi = job->n * (t+1) / job->nthreads;
+        int shift = BITS_PER_PASS * job->pass;
+        Py_ssize_t i, j;
+
+        switch (job->phase) {
+        case RADIX_COUNT_ALL:
+                memset(h, 0, sizeof(histogram_array_t) * HISTOGRAM_SIZE);
+                for (i = lo; i < hi; i++) {
+                        unsigned long v = f[i].fkey.k_ulong;
+                        for (j = 0; j < NUM_PASSES; j++)
+                                h[(v >> (BITS_PER_PASS * j)) & MASK][j]++;
+                }
+                break;
+        case RADIX_COUNT:
+                for (i = 0; i < HISTOGRAM_SIZE; i++)
+                        h[i][job->pass] = 0;
+                for (i = lo; i < hi; i++)
+                        h[(f[i].fkey.k_ulong >> shift) & MASK][job->pass]++;
+                break;
+        case RADIX_SCATTER:
+                for (i = lo; i < hi; i++) {
                         unsigned long fi = f[i].fkey.k_ulong;
-                        Py_ssize_t pos = (fi >> (BITS_PER_PASS * j)) & MASK;
-                        pos = ++histograms[pos][j];
-                        t[pos].fkey.k_ulong = fi;
-                        t[pos].value = f[i].value;
+                        Py_ssize_t pos = (fi >> shift) & MASK;
+                        pos = ++h[pos][job->pass];
+                        to[pos].fkey.k_ulong = fi;
+                        to[pos].value = f[i].value;
                 }
+                break;
+        case RADIX_COPY:
+                for (i = lo; i < hi; i++)
+                        job->sortarray[i].value = f[i].value;
+                break;
+        }
+}
+
+#ifdef WITH_THREAD
+#include "pythread.h"
+
+/* Worker threads sleep on their start lock until sort_pool_run() hands
+ * them a phase, and release their done lock when they finish it.  They
+ * never touch Python objects, so they run without the GIL, and live
+ * until the process exits.  One sort at a time may use them; sorts in
+ * other threads meanwhile run on one thread. */
+typedef struct sort_worker_t {
+        PyThread_type_lock start, done;
+        radix_job_t *job;
+        int t;
+} sort_worker_t;
+
+static sort_worker_t sort_workers[MAX_SORT_THREADS];
+static int sort_workers_n = 0;
+static PyThread_type_lock sort_pool_lock = NULL;
+#ifdef HAVE_FORK
+static long sort_pool_pid;
+#endif
 
-                tmp = from;
-                from = to;
-                to = tmp;
+static void
+sort_worker(void *arg)
+{
+        sort_worker_t *w = (sort_worker_t *) arg;
+
+        for (;;) {
+                PyThread_acquire_lock(w->start, WAIT_LOCK);
+                radix_task(w->job, w->t);
+                PyThread_release_lock(w->done);
         }
+}
 
-        if (from != sortarray)
-                for (i = 0; i < n; i++)
-                        sortarray[i].value = scratch[i].value;
+/* Reserve the pool for up to want threads, including the caller.
+ * Returns how many threads the caller may use.  Requires the GIL. */
+BLIST_LOCAL(int)
+sort_pool_acquire(int want)
+{
+        int got;
 
-        PyMem_Free(histograms);
-        PyMem_Free(scratch);
-        return 0;
+        if (want <= 1)
+                return 1;
+#ifdef HAVE_FORK
+        /* A child process inherits none of the threads, and perhaps a
+         * pool that was busy in another thread at the fork.  Leak it. */
+        if (sort_pool_lock != NULL && sort_pool_pid != (long) getpid()) {
+                sort_pool_lock = NULL;
+                sort_workers_n = 0;
+        }
+#endif
+        if (sort_pool_lock == NULL) {
+                sort_pool_lock = PyThread_allocate_lock();
+                if (sort_pool_lock == NULL)
+                        return 1;
+#ifdef HAVE_FORK
+                sort_pool_pid = (long) getpid();
+#endif
+        }
+        if (!PyThread_acquire_lock(sort_pool_lock, NOWAIT_LOCK))
+                return 1;
+
+        while (sort_workers_n < want - 1) {
+                sort_worker_t *w = &sort_workers[sort_workers_n];
+                w->start = PyThread_allocate_lock();
+                w->done = PyThread_allocate_lock();
+                if (w->start == NULL || w->done == NULL)
+                        goto fail;
+                PyThread_acquire_lock(w->start, WAIT_LOCK);
+                PyThread_acquire_lock(w->done, WAIT_LOCK);
+                w->t = sort_workers_n + 1;
+                if (PyThread_start_new_thread(sort_worker, w) == -1)
+                        goto fail;
+                sort_workers_n++;
+                continue;
+
+        fail:
+                if (w->start != NULL)
+                        PyThread_free_lock(w->start);
+                if (w->done != NULL)
+                        PyThread_free_lock(w->done);
+                break;
+        }
+
+        got = sort_workers_n + 1 < want ? sort_workers_n + 1 : want;
+        if (got == 1)
+                PyThread_release_lock(sort_pool_lock);
+        return got;
 }
 
-#undef NUM_PASSES
+BLIST_LOCAL(void)
+sort_pool_release(int nthreads)
+{
+        if (nthreads > 1)
+                PyThread_release_lock(sort_pool_lock);
+}
 
-#ifdef BLIST_FLOAT_RADIX_SORT
-#if SIZEOF_LONG == 8
-#define sort_uint64 sort_ulong
+/* Run the current phase of job on all of its threads */
+BLIST_LOCAL(void)
+sort_pool_run(radix_job_t *job)
+{
+        int t;
+
+        for (t = 1; t < job->nthreads; t++) {
+                sort_workers[t-1].job = job;
+                PyThread_release_lock(sort_workers[t-1].start);
+        }
+        radix_task(job, 0);
+        for (t = 1; t < job->nthreads; t++)
+                PyThread_acquire_lock(sort_workers[t-1].done, WAIT_LOCK);
+}
 #else
-#define NUM_PASSES (((64-1) / BITS_PER_PASS)+1)
+#define sort_pool_acquire(want) (1)
+#define sort_pool_release(nthreads) do {} while (0)
+#define sort_pool_run(job) radix_task((job), 0)
+#endif
 
-BLIST_LOCAL_INLINE(int)
-sort_uint64(sortwrapperobject *restrict sortarray, Py_ssize_t n)
-{
-        sortwrapperobject *restrict scratch, *from, *to, *tmp;
-        Py_ssize_t i, j, sums[NUM_PASSES], count[NUM_PASSES], tsum;
-        histogram_array_t *histograms;
+/* In-place MSD radix sort, for when a second array of n wrappers would
+ * cost too much memory.  Each run is permuted into its 256 buckets by
+ * the next byte of the key, as in American flag sort, and the buckets
+ * become runs for the next byte.  Permuting is not stable, so the
+ * items' original positions extend the key as extra bytes, and ties
+ * in fkey come out in their original order.  The positions live in
+ * the key slots, so the keys, which are ints or floats, are released
+ * early. */
+
+#define WRAPPER_POS(w) ((Py_ssize_t) (Py_uintptr_t) (w).key)
+#define INPLACE_INSERTION_MAX 32
+
+typedef struct inplace_run_t {
+        Py_ssize_t lo, hi;
+        int depth;
+} inplace_run_t;
+
+/* Byte depth of the key made of k and then pos, which has digits bytes */
+BLIST_LOCAL_INLINE(Py_ssize_t)
+inplace_digit(unsigned long k, Py_uintptr_t pos, int depth, int digits)
+{
+        if (depth < (int) sizeof(unsigned long))
+                return (k >> (BITS_PER_PASS
+                              * ((int) sizeof(unsigned long) - 1 - depth)))
+                        & MASK;
+        return (pos >> (BITS_PER_PASS * (digits - 1 - depth))) & MASK;
+}
+
+#define INPLACE_DIGIT(w, depth) inplace_digit((w).fkey.k_ulong,        \
+        (Py_uintptr_t) WRAPPER_POS(w), (depth), digits)
+
+BLIST_LOCAL_INLINE(int)
+inplace_lt(const sortwrapperobject *a, const sortwrapperobject *b)
+{
+        if (a->fkey.k_ulong != b->fkey.k_ulong)
+                return a->fkey.k_ulong < b->fkey.k_ulong;
+        return WRAPPER_POS(*a) < WRAPPER_POS(*b);
+}
+
+BLIST_LOCAL(int)
+sort_ulong_inplace(sortwrapperobject *restrict array, Py_ssize_t n)
+{
+        inplace_run_t *runs, run;
+        Py_ssize_t i, j, m, num_runs = 1, sum;
+        unsigned long kdiff;
+        Py_uintptr_t pdiff;
+        Py_ssize_t count[HISTOGRAM_SIZE], heads[HISTOGRAM_SIZE];
+        Py_ssize_t tails[HISTOGRAM_SIZE];
+        int b, d, digits = (int) sizeof(unsigned long);
+
+        for (i = n - 1; i; i >>= BITS_PER_PASS)
+                digits++;
+
+        /* A run leaves at most HISTOGRAM_SIZE-1 others on the stack
+         * while one of its buckets is sorted, at each depth. */
+        runs = PyMem_New(inplace_run_t, digits * (HISTOGRAM_SIZE-1) + 1);
+        if (runs == NULL)
+                return -1;
+
+        for (i = 0; i < n; i++) {
+                Py_DECREF(array[i].key);
+                array[i].key = (PyObject *) (Py_uintptr_t) i;
+        }
+
+        DANGER_BEGIN;
+        runs[0].lo = 0;
+        runs[0].hi = n;
+        runs[0].depth = 0;
+
+        Py_BEGIN_ALLOW_THREADS
+        while (num_runs) {
+                sortwrapperobject *restrict a;
+
+                run = runs[--num_runs];
+                a = array + run.lo;
+                m = run.hi - run.lo;
+
+                if (m < INPLACE_INSERTION_MAX) {
+                        for (i = 1; i < m; i++) {
+                                sortwrapperobject w = a[i];
+                                for (j = i; j >= 1; j--) {
+                                        if (!inplace_lt(&w, &a[j-1]))
+                                                break;
+                                        a[j] = a[j-1];
+                                }
+                                a[j] = w;
+                        }
+                        continue;
+                }
+
+                /* Note which bytes differ at all, to skip the rest */
+                memset(count, 0, sizeof count);
+                kdiff = 0;
+                pdiff = 0;
+                for (i = 0; i < m; i++) {
+                        count[INPLACE_DIGIT(a[i], run.depth)]++;
+                        kdiff |= a[i].fkey.k_ulong ^ a[0].fkey.k_ulong;
+                        pdiff |= (Py_uintptr_t) (WRAPPER_POS(a[i])
+                                                 ^ WRAPPER_POS(a[0]));
+                }
+                if (count[INPLACE_DIGIT(a[0], run.depth)] == m) {
+                        do
+                                run.depth++;
+                        while (run.depth < digits && !inplace_digit(
+                                       kdiff, pdiff, run.depth, digits));
+                        if (run.depth == digits)
+                                continue;
+                        memset(count, 0, sizeof count);
+                        for (i = 0; i < m; i++)
+                                count[INPLACE_DIGIT(a[i], run.depth)]++;
+                }
+
+                for (b = 0, sum = 0; b < HISTOGRAM_SIZE; b++) {
+                        heads[b] = sum;
+                        sum += count[b];
+                        tails[b] = sum;
+                }
+
+                for (b = 0; b < HISTOGRAM_SIZE; b++) {
+                        while (heads[b] < tails[b]) {
+                                sortwrapperobject w = a[heads[b]];
+                                d = (int) INPLACE_DIGIT(w, run.depth);
+                                while (d != b) {
+                                        sortwrapperobject t = a[heads[d]];
+                                        a[heads[d]++] = w;
+                                        w = t;
+                                        d = (int) INPLACE_DIGIT(w, run.depth);
+                                }
+                                a[heads[b]++] = w;
+                        }
+                }
+
+                if (run.depth + 1 == digits)
+                        continue;
+                for (b = 0, sum = run.lo; b < HISTOGRAM_SIZE; b++) {
+                        if (count[b] > 1) {
+                                runs[num_runs].lo = sum;
+                                runs[num_runs].hi = sum + count[b];
+                                runs[num_runs].depth = run.depth + 1;
+                                num_runs++;
+                        }
+                        sum += count[b];
+                }
+        }
+
+        Py_END_ALLOW_THREADS
+        DANGER_END;
+
+        for (i = 0; i < n; i++)
+                array[i].key = NULL;
+
+        PyMem_Free(runs);
+        return 0;
+}
+
+#undef INPLACE_DIGIT
+
+/* sort_ulong() for large arrays.  The passes touch no Python objects,
+ * so they run without the GIL.  With several threads, each thread
+ * counts and scatters its own slice, and a prefix sum over the
+ * per-thread histograms tells each one where its items go, which
+ * keeps the sort stable. */
+BLIST_LOCAL(int)
+sort_ulong_nogil(sortwrapperobject *restrict sortarray, Py_ssize_t n)
+{
+        radix_job_t job;
+        sortwrapperobject *scratch, *tmp;
+        Py_ssize_t i, j, sum, count[NUM_PASSES];
+        int t, want, first = 1;
+
+        want = sort_threads;
+        if (want > n / RADIX_NOGIL_MIN)
+                want = (int) (n / RADIX_NOGIL_MIN);
+
+        scratch = PyMem_New(sortwrapperobject, n);
+        if (scratch == NULL)
+                return -1;
+
+        job.nthreads = sort_pool_acquire(want);
+        job.histograms = PyMem_New(histogram_array_t,
+                                   HISTOGRAM_SIZE * job.nthreads);
+        if (job.histograms == NULL) {
+                sort_pool_release(job.nthreads);
+                PyMem_Free(scratch);
+                return -1;
+        }
+        job.sortarray = job.from = sortarray;
+        job.to = scratch;
+        job.n = n;
+        job.pass = 0;
+
+        DANGER_BEGIN;
+        job.phase = RADIX_COUNT_ALL;
+
+        Py_BEGIN_ALLOW_THREADS
+        sort_pool_run(&job);
+
+        for (j = 0; j < NUM_PASSES; j++) {
+                count[j] = 0;
+                for (i = 0; i < HISTOGRAM_SIZE; i++) {
+                        for (t = 0, sum = 0; t < job.nthreads; t++)
+                                sum |= job.histograms[t*HISTOGRAM_SIZE+i][j];
+                        count[j] += !!sum;
+                }
+        }
+
+        for (j = 0; j < NUM_PASSES; j++) {
+                if (count[j] == 1) continue;
+                job.pass = (int) j;
+
+                /* The totals of RADIX_COUNT_ALL do not depend on the
+                 * order, but the slices' shares do. */
+                if (!first && job.nthreads > 1) {
+                        job.phase = RADIX_COUNT;
+                        sort_pool_run(&job);
+                }
+                first = 0;
+
+                for (i = 0, sum = 0; i < HISTOGRAM_SIZE; i++) {
+                        for (t = 0; t < job.nthreads; t++) {
+                                Py_ssize_t *p =
+                                        &job.histograms[t*HISTOGRAM_SIZE+i][j];
+                                Py_ssize_t tsum = *p + sum;
+                                *p = sum - 1;
+                                sum = tsum;
+                        }
+                }
+
+                job.phase = RADIX_SCATTER;
+                sort_pool_run(&job);
+
+                tmp = job.from;
+                job.from = job.to;
+                job.to = tmp;
+        }
+
+        if (job.from != sortarray) {
+                job.phase = RADIX_COPY;
+                sort_pool_run(&job);
+        }
+
+        Py_END_ALLOW_THREADS
+        DANGER_END;
+
+        sort_pool_release(job.nthreads);
+        PyMem_Free(job.histograms);
+        PyMem_Free(scratch);
+        return 0;
+}
+
+BLIST_LOCAL_INLINE(int)
+sort_ulong(sortwrapperobject *restrict sortarray, Py_ssize_t n)
+{
+        sortwrapperobject *restrict scratch, *from, *to, *tmp;
+        Py_ssize_t i, j, sums[NUM_PASSES], count[NUM_PASSES], tsum;
+        histogram_array_t *histograms;
+
+        if (radix_inplace_min >= 0 && n >= radix_inplace_min)
+                return sort_ulong_inplace(sortarray, n);
+        if (n >= RADIX_NOGIL_MIN)
+                return sort_ulong_nogil(sortarray, n);
 
         memset(sums, 0, sizeof sums);
         memset(count, 0, sizeof count);
@@ -5456,7 +8132,7 @@ sort_uint64(sortwrapperobject *restrict sortarray, Py_ssize_t n)
         memset(histograms, 0, sizeof(histogram_array_t) * HISTOGRAM_SIZE);
 
         for (i = 0; i < n; i++) {
-                PY_UINT64_T v = sortarray[i].fkey.k_uint64;
+                unsigned long v = sortarray[i].fkey.k_ulong;
                 for (j = 0; j < NUM_PASSES; j++) {
                         histograms[(v >> (BITS_PER_PASS * j)) & MASK][j]++;
                 }
@@ -5474,13 +8150,15 @@ sort_uint64(sortwrapperobject *restrict sortarray, Py_ssize_t n)
         from = sortarray;
         to = scratch;
         for (j = 0; j < NUM_PASSES; j++) {
+                sortwrapperobject *restrict f = from;
+                sortwrapperobject *restrict t = to;
                 if (count[j] == 1) continue;
                 for (i = 0; i < n; i++) {
-                        PY_UINT64_T fi = from[i].fkey.k_uint64;
+                        unsigned long fi = f[i].fkey.k_ulong;
                         Py_ssize_t pos = (fi >> (BITS_PER_PASS * j)) & MASK;
                         pos = ++histograms[pos][j];
-                        to[pos].fkey.k_uint64 = fi;
-                        to[pos].value = from[i].value;
+                        t[pos].fkey.k_ulong = fi;
+                        t[pos].value = f[i].value;
                 }
 
                 tmp = from;
@@ -5499,1794 +8177,5484 @@ sort_uint64(sortwrapperobject *restrict sortarray, Py_ssize_t n)
 
 #undef NUM_PASSES
 
-#endif
-#endif
+#ifdef BLIST_FLOAT_RADIX_SORT
+#if SIZEOF_LONG == 8
+#define sort_uint64 sort_ulong
+#else
+#define NUM_PASSES (((64-1) / BITS_PER_PASS)+1)
 
-BLIST_LOCAL(Py_ssize_t)
-sort(PyBListRoot *restrict self, PyObject *compare, PyObject *keyfunc)
+BLIST_LOCAL_INLINE(int)
+sort_uint64(sortwrapperobject *restrict sortarray, Py_ssize_t n)
 {
-        PyBList *leaf;
-        PyBList **leafs;
-        int err=0;
-        Py_ssize_t i, leafs_n = 0;
-        sortwrapperobject sortarraystack[10];
-        sortwrapperobject *sortarray = sortarraystack;
-        int key_flags;
+        sortwrapperobject *restrict scratch, *from, *to, *tmp;
+        Py_ssize_t i, j, sums[NUM_PASSES], count[NUM_PASSES], tsum;
+        histogram_array_t *histograms;
 
-        if (self->leaf)
-                leafs = &leaf;
-        else {
-                leafs = PyMem_New(PyBList *, self->n / HALF + 1);
-                if (!leafs)
-                        return -1;
-        }
+        memset(sums, 0, sizeof sums);
+        memset(count, 0, sizeof count);
 
-        if (self->leaf) {
-                leaf = (PyBList *) self;
-                leafs_n = 1;
-        } else {
-                linearize_rw(self);
+        scratch = PyMem_New(sortwrapperobject, n);
+        if (scratch == NULL)
+                return -1;
 
-                assert(INDEX_LENGTH(self) <= self->index_allocated);
-                for (i = 0; i < INDEX_LENGTH(self)-1; i++) {
-                        leaf = self->index_list[i];
-                        if (leaf == self->index_list[i+1])
-                                continue;
-                        leafs[leafs_n++] = leaf;
-                        Py_INCREF(leaf);
-                }
-                leaf = self->index_list[i];
-                leafs[leafs_n++] = leaf;
-                Py_INCREF(leaf);
+        histograms = PyMem_New(histogram_array_t, HISTOGRAM_SIZE);
+        if (histograms == NULL) {
+                PyMem_Free(scratch);
+                return -1;
         }
+        memset(histograms, 0, sizeof(histogram_array_t) * HISTOGRAM_SIZE);
 
-        if (self->n > 10) {
-                sortarray = PyMem_New(sortwrapperobject, self->n);
-                if (sortarray == NULL) {
-                        sortarray = sortarraystack;
-                        goto error;
+        for (i = 0; i < n; i++) {
+                PY_UINT64_T v = sortarray[i].fkey.k_uint64;
+                for (j = 0; j < NUM_PASSES; j++) {
+                        histograms[(v >> (BITS_PER_PASS * j)) & MASK][j]++;
                 }
         }
 
-        err = wrap_leaf_array(sortarray, leafs, leafs_n, self->n, keyfunc,
-                              &key_flags);
-        if (err < 0) {
-        error:
-                if (!self->leaf) {
-                        for (i = 0; i < leafs_n; i++)
-                                SAFE_DECREF(leafs[i]);
-                        PyMem_Free(leafs);
+        for (i = 0; i < HISTOGRAM_SIZE; i++) {
+                for (j = 0; j < NUM_PASSES; j++) {
+                        count[j] += !!histograms[i][j];
+                        tsum = histograms[i][j] + sums[j];
+                        histograms[i][j] = sums[j] - 1;
+                        sums[j] = tsum;
                 }
-                if (sortarray != sortarraystack)
-                        PyMem_Free(sortarray);
-                return -1;
         }
 
-        if (key_flags && compare == NULL) {
-#ifdef BLIST_FLOAT_RADIX_SORT
-                if (key_flags & KEY_ALL_DOUBLE) {
-                        if (self->n < 40 && self->leaf)
-                                err = insertion_sort_uint64(sortarray,self->n);
-                        else
-                                err = sort_uint64(sortarray, self->n);
-                } else
-#endif
-                if (key_flags & KEY_ALL_LONG) {
-                        if (self->n < 40 && self->leaf)
-                                err = insertion_sort_ulong(sortarray, self->n);
-                        else
-                                err = sort_ulong(sortarray, self->n);
-                }
-                else
-                        assert(0); /* Should not be possible */
-                unwrap_leaf_array(leafs, leafs_n, self->n, sortarray);
-                if (!self->leaf) {
-                        for (i = 0; i < leafs_n; i++)
-                                SAFE_DECREF(leafs[i]);
-                        PyMem_Free(leafs);
-                }
-        } else if (self->leaf) {
-                err = gallop_sort(self->children, self->num_children, compare);
-                unwrap_leaf_array(leafs, 1, self->n, sortarray);
-        } else {
-                PyBList **scratch = PyMem_New(PyBList *, self->n / HALF + 1);
-                if (!scratch) {
-                        PyMem_Free(leafs);
-                        PyMem_Free(sortarray);
-                        return -1;
+        from = sortarray;
+        to = scratch;
+        for (j = 0; j < NUM_PASSES; j++) {
+                if (count[j] == 1) continue;
+                for (i = 0; i < n; i++) {
+                        PY_UINT64_T fi = from[i].fkey.k_uint64;
+                        Py_ssize_t pos = (fi >> (BITS_PER_PASS * j)) & MASK;
+                        pos = ++histograms[pos][j];
+                        to[pos].fkey.k_uint64 = fi;
+                        to[pos].value = from[i].value;
                 }
-                leafs_n = sub_sort(scratch, leafs, compare, leafs_n, &err, 0);
-                array_enable_GC(leafs, leafs_n);
-                PyMem_Free(scratch);
-                unwrap_leaf_array(leafs, leafs_n, self->n, sortarray);
-                i = blist_init_from_child_array(leafs, leafs_n);
 
-                if (i < 0) {
-                        /* XXX leaking memory here when out of memory */
-                        PyMem_Free(sortarray);
-                        return -1;
-                } else {
-                        assert(i == 1);
-                        blist_become_and_consume((PyBList *) self, leafs[0]);
-                }
-                SAFE_DECREF(leafs[0]);
-                PyMem_Free(leafs);
+                tmp = from;
+                from = to;
+                to = tmp;
         }
 
-        if (sortarray != sortarraystack)
-                PyMem_Free(sortarray);
-        return err;
+        if (from != sortarray)
+                for (i = 0; i < n; i++)
+                        sortarray[i].value = scratch[i].value;
+
+        PyMem_Free(histograms);
+        PyMem_Free(scratch);
+        return 0;
 }
 
-/************************************************************************
- * Section for functions callable directly by the interpreter.
+#undef NUM_PASSES
+
+#endif
+#endif
+
+#ifdef BLIST_FLOAT_RADIX_SORT
+/* MSD radix sort for str and bytes keys.
  *
- * Each of these functions are marked with VALID_USER for debug mode.
- *
- * If they, or any function they call, makes calls to decref_later,
- * they must call decref_flush() just before returning.
- *
- * These functions must not be called directly by other blist
- * functions.  They should *only* be called by the interpreter, to
- * ensure that decref_flush() is the last thing called before
- * returning to the interpreter.
+ * Each pass packs the next few characters of every key in a run into
+ * fkey, followed by a byte holding how many characters were left,
+ * capped at one more than the number packed.  Zero padding then puts
+ * a key before any longer key that it is a prefix of.  Keys that tie
+ * with the cap in that byte have characters left, and their run is
+ * sorted again by the characters after; other ties are equal keys.
+ * Every step is stable, and so is the result.
  */
 
-BLIST_PYAPI(PyObject *)
-py_blist_root_tp_new(PyTypeObject *subtype, PyObject *args, PyObject *kwds)
-{
-        PyBList *self;
+#define RUN_PASSES (64 / BITS_PER_PASS)
+#define RUN_INSERTION_MAX 40
 
-        if (subtype == &PyRootBList_Type)
-                return (PyObject *) blist_root_new();
+typedef Py_ssize_t run_histogram_t[RUN_PASSES];
 
-        self = (PyBList *) subtype->tp_alloc(subtype, 0);
-        if (self == NULL)
-                return NULL;
-        self->children = PyMem_New(PyObject *, LIMIT);
-        if (self->children == NULL) {
-                subtype->tp_free(self);
-                return NULL;
-        }
+typedef struct sort_run_t {
+        Py_ssize_t lo, hi, depth;
+} sort_run_t;
 
-        self->leaf = 1;
-        ext_init((PyBListRoot *)self);
+/* Bits needed for each character of the keys */
+BLIST_LOCAL(int)
+str_sort_width(sortwrapperobject *array, Py_ssize_t n)
+{
+#ifdef BLIST_STR_KEYS
+        Py_ssize_t i;
+        unsigned kind = PyUnicode_1BYTE_KIND;
+
+        if (n == 0 || Py_TYPE(array[0].key) != &PyUnicode_Type)
+                return 8;
+        for (i = 0; i < n; i++)
+                if (PyUnicode_KIND(array[i].key) > kind)
+                        kind = PyUnicode_KIND(array[i].key);
+        if (kind == PyUnicode_2BYTE_KIND)
+                return 16;
+        if (kind == PyUnicode_4BYTE_KIND)
+                return 21;
+#endif
+        return 8;
+}
+
+/* Pack the characters of key from depth on, as described above */
+BLIST_LOCAL_INLINE(PY_UINT64_T)
+str_sort_key(PyObject *key, Py_ssize_t depth, int width)
+{
+        int i, per = 56 / width;
+        PY_UINT64_T k = 0;
+        Py_ssize_t left;
+
+#ifdef BLIST_STR_KEYS
+        if (Py_TYPE(key) == &PyUnicode_Type) {
+                unsigned kind = PyUnicode_KIND(key);
+                void *data = PyUnicode_DATA(key);
+                left = PyUnicode_GET_LENGTH(key) - depth;
+                for (i = 0; i < per; i++) {
+                        k <<= width;
+                        if (i < left)
+                                k |= PyUnicode_READ(kind, data, depth + i);
+                }
+        } else
+#endif
+        {
+                const unsigned char *s = (const unsigned char *)
+                        KEY_BYTES_AS_STRING(key);
+                left = KEY_BYTES_SIZE(key) - depth;
+                for (i = 0; i < per; i++) {
+                        k <<= 8;
+                        if (i < left)
+                                k |= s[depth + i];
+                }
+        }
 
-        return (PyObject *) self;
+        return (k << 8) | (PY_UINT64_T) (left > per ? per + 1 : left);
 }
 
-/* Should only be used by the unpickler */
-BLIST_PYAPI(PyObject *)
-py_blist_internal_tp_new(PyTypeObject *subtype, PyObject *args, PyObject *kwds)
+BLIST_LOCAL_INLINE(Py_ssize_t)
+str_sort_len(PyObject *key)
 {
-        assert (subtype == &PyBList_Type);
-        return (PyObject *) blist_new();
+#ifdef BLIST_STR_KEYS
+        if (Py_TYPE(key) == &PyUnicode_Type)
+                return PyUnicode_GET_LENGTH(key);
+#endif
+        return KEY_BYTES_SIZE(key);
 }
 
-/* Should only be used by the unpickler */
-BLIST_PYAPI(int)
-py_blist_internal_init(PyObject *oself, PyObject *args, PyObject *kw)
+/* How many characters a and b share from depth on, up to limit */
+BLIST_LOCAL_INLINE(Py_ssize_t)
+str_sort_match(PyObject *a, PyObject *b, Py_ssize_t depth, Py_ssize_t limit)
 {
-        return 0;
+        const unsigned char *s, *t;
+        Py_ssize_t i, size = 1;
+
+#ifdef BLIST_STR_KEYS
+        if (Py_TYPE(a) == &PyUnicode_Type) {
+                unsigned kind = PyUnicode_KIND(a);
+                if (PyUnicode_KIND(b) != kind) {
+                        for (i = 0; i < limit; i++)
+                                if (PyUnicode_READ_CHAR(a, depth + i)
+                                    != PyUnicode_READ_CHAR(b, depth + i))
+                                        break;
+                        return i;
+                }
+                size = kind;
+                s = (const unsigned char *) PyUnicode_DATA(a);
+                t = (const unsigned char *) PyUnicode_DATA(b);
+        } else
+#endif
+        {
+                s = (const unsigned char *) KEY_BYTES_AS_STRING(a);
+                t = (const unsigned char *) KEY_BYTES_AS_STRING(b);
+        }
+
+        s += depth * size;
+        t += depth * size;
+        for (i = 0; i < limit * size; i++)
+                if (s[i] != t[i])
+                        break;
+        return i / size;
 }
 
-BLIST_PYAPI(int)
-py_blist_init(PyObject *oself, PyObject *args, PyObject *kw)
+/* The depth at which the keys of array stop agreeing, at least depth */
+BLIST_LOCAL(Py_ssize_t)
+str_sort_skip(sortwrapperobject *array, Py_ssize_t n, Py_ssize_t depth)
 {
-        int ret;
-        PyObject *arg = NULL;
-        static char *kwlist[] = {"sequence", 0};
-        int err;
-        PyBList *self;
+        PyObject *first = array[0].key;
+        Py_ssize_t i, left, common = str_sort_len(first) - depth;
 
-        invariants(oself, VALID_USER|VALID_DECREF);
-        self = (PyBList *) oself;
+        for (i = 1; i < n && common > 0; i++) {
+                left = str_sort_len(array[i].key) - depth;
+                common = str_sort_match(first, array[i].key, depth,
+                                        left < common ? left : common);
+        }
 
-        DANGER_BEGIN;
-        err = PyArg_ParseTupleAndKeywords(args, kw, "|O:list", kwlist, &arg);
-        DANGER_END;
-        if (!err)
-                return _int(-1);
+        return depth + common;
+}
 
-        if (self->n) {
-                blist_CLEAR(self);
-                ext_dealloc((PyBListRoot *) self);
+/* Stable sort of array by fkey, moving the whole wrappers.  Used by
+ * sort_str() and sort_words() for each run of tied keys. */
+BLIST_LOCAL(void)
+sort_run_uint64(sortwrapperobject *restrict array,
+             sortwrapperobject *restrict scratch, Py_ssize_t n,
+             run_histogram_t *restrict histograms)
+{
+        sortwrapperobject *from, *to, *tmp;
+        Py_ssize_t i, j, sums[RUN_PASSES], count[RUN_PASSES], tsum;
+
+        if (n < RUN_INSERTION_MAX) {
+                for (i = 1; i < n; i++) {
+                        sortwrapperobject w = array[i];
+                        for (j = i; j >= 1; j--) {
+                                if (w.fkey.k_uint64
+                                    >= array[j-1].fkey.k_uint64)
+                                        break;
+                                array[j] = array[j-1];
+                        }
+                        array[j] = w;
+                }
+                return;
         }
 
-        if (arg == NULL)
-                return _int(0);
+        memset(sums, 0, sizeof sums);
+        memset(count, 0, sizeof count);
+        memset(histograms, 0, sizeof(run_histogram_t) * HISTOGRAM_SIZE);
 
-        ret = blist_init_from_seq(self, arg);
+        for (i = 0; i < n; i++) {
+                PY_UINT64_T v = array[i].fkey.k_uint64;
+                for (j = 0; j < RUN_PASSES; j++)
+                        histograms[(v >> (BITS_PER_PASS * j)) & MASK][j]++;
+        }
 
-        decref_flush(); /* Needed due to blist_CLEAR() call */
-        return _int(ret);
-}
+        for (i = 0; i < HISTOGRAM_SIZE; i++) {
+                for (j = 0; j < RUN_PASSES; j++) {
+                        count[j] += !!histograms[i][j];
+                        tsum = histograms[i][j] + sums[j];
+                        histograms[i][j] = sums[j] - 1;
+                        sums[j] = tsum;
+                }
+        }
 
-BLIST_PYAPI(PyObject *)
-py_blist_richcompare(PyObject *v, PyObject *w, int op)
-{
-        PyObject *rv;
+        from = array;
+        to = scratch;
+        for (j = 0; j < RUN_PASSES; j++) {
+                if (count[j] == 1) continue;
+                for (i = 0; i < n; i++) {
+                        PY_UINT64_T fi = from[i].fkey.k_uint64;
+                        Py_ssize_t pos = (fi >> (BITS_PER_PASS * j)) & MASK;
+                        to[++histograms[pos][j]] = from[i];
+                }
 
-        if (!PyRootBList_Check(v)) {
-        not_implemented:
-                Py_INCREF(Py_NotImplemented);
-                return Py_NotImplemented;
+                tmp = from;
+                from = to;
+                to = tmp;
         }
 
-        invariants((PyBList *) v, VALID_USER|VALID_DECREF);
-        if (PyRootBList_Check(w)) {
-                rv = blist_richcompare_blist((PyBList *)v, (PyBList *)w, op);
-                decref_flush();
-                return _ob(rv);
-        }
-#ifndef Py_BUILD_CORE
-        if (PyList_Check(w)) {
-                rv = blist_richcompare_list((PyBList*)v, (PyListObject*)w, op);
-                decref_flush();
-                return _ob(rv);
-        }
-#endif
-        _void();
-        goto not_implemented;
+        if (from != array)
+                memcpy(array, from, n * sizeof *array);
 }
 
-BLIST_PYAPI(int)
-py_blist_traverse(PyObject *oself, visitproc visit, void *arg)
+/* Push a run onto the stack of runs still to sort, growing it if needed */
+BLIST_LOCAL(int)
+sort_push_run(sort_run_t **runs, Py_ssize_t *num_runs, Py_ssize_t *allocated,
+              Py_ssize_t lo, Py_ssize_t hi, Py_ssize_t depth)
 {
-        PyBList *self;
-        int i;
-
-        assert(PyBList_Check(oself));
-        self = (PyBList *) oself;
-
-        for (i = 0; i < self->num_children; i++) {
-                if (self->children[i] != NULL)
-                        Py_VISIT(self->children[i]);
+        if (*num_runs == *allocated) {
+                sort_run_t *bigger = *runs;
+                PyMem_Resize(bigger, sort_run_t, *allocated * 2);
+                if (bigger == NULL)
+                        return -1;
+                *runs = bigger;
+                *allocated *= 2;
         }
+        (*runs)[*num_runs].lo = lo;
+        (*runs)[*num_runs].hi = hi;
+        (*runs)[*num_runs].depth = depth;
+        (*num_runs)++;
         return 0;
 }
 
-BLIST_PYAPI(int)
-py_blist_tp_clear(PyObject *oself)
+/* Sort array by its str or bytes keys.  Unlike sort_ulong(), this
+ * moves the keys along with the values. */
+BLIST_LOCAL(int)
+sort_str(sortwrapperobject *array, Py_ssize_t n)
 {
-        PyBList *self;
+        sortwrapperobject *scratch;
+        run_histogram_t *histograms;
+        sort_run_t *runs, run;
+        Py_ssize_t i, j, depth, num_runs = 1, allocated = 16;
+        int width = str_sort_width(array, n);
+        PY_UINT64_T more = 56 / width + 1;
 
-        invariants(oself, VALID_USER|VALID_RW|VALID_DECREF);
-        self = (PyBList *) oself;
-
-        blist_forget_children(self);
-        self->n = 0;
-        self->leaf = 1;
-        ext_dealloc((PyBListRoot *) self);
+        scratch = PyMem_New(sortwrapperobject, n);
+        histograms = PyMem_New(run_histogram_t, HISTOGRAM_SIZE);
+        runs = PyMem_New(sort_run_t, allocated);
+        if (scratch == NULL || histograms == NULL || runs == NULL)
+                goto nomem;
+
+        runs[0].lo = 0;
+        runs[0].hi = n;
+        runs[0].depth = 0;
+        while (num_runs) {
+                run = runs[--num_runs];
+                for (i = run.lo; i < run.hi; i++)
+                        array[i].fkey.k_uint64 = str_sort_key(array[i].key,
+                                                              run.depth,
+                                                              width);
+                sort_run_uint64(array + run.lo, scratch, run.hi - run.lo,
+                             histograms);
+
+                for (i = run.lo; i < run.hi; i = j) {
+                        PY_UINT64_T k = array[i].fkey.k_uint64;
+                        for (j = i+1; j < run.hi; j++)
+                                if (array[j].fkey.k_uint64 != k)
+                                        break;
+                        if (j - i == 1 || (k & MASK) != more)
+                                continue;
+                        depth = run.depth + more - 1;
+                        /* Keys with a long common prefix would otherwise
+                         * take a pass per few characters of it. */
+                        if (i == run.lo && j == run.hi)
+                                depth = str_sort_skip(array + i, j - i, depth);
+                        if (sort_push_run(&runs, &num_runs, &allocated,
+                                          i, j, depth) < 0)
+                                goto nomem;
+                }
+        }
 
-        decref_flush();
-        return _int(0);
-}
+        PyMem_Free(runs);
+        PyMem_Free(histograms);
+        PyMem_Free(scratch);
+        return 0;
 
-#if PY_MAJOR_VERSION == 2 && PY_MINOR_VERSION >= 6 || PY_MAJOR_VERSION >= 3
-#define py_blist_nohash PyObject_HashNotImplemented
-#else
-BLIST_PYAPI(long)
-py_blist_nohash(PyObject *self)
-{
-        PyErr_SetString(PyExc_TypeError, "list objects are unhashable");
+  nomem:
+        PyMem_Free(runs);
+        PyMem_Free(histograms);
+        PyMem_Free(scratch);
+        PyErr_NoMemory();
         return -1;
 }
-#endif
 
-BLIST_PYAPI(void)
-py_blist_dealloc(PyObject *oself)
-{
-        int i;
-        PyBList *self;
+/* MSD radix sort for tuples of ints and floats, and for ints of up to
+ * 128 bits.
+ *
+ * Each key becomes a few 64-bit words: one per float, one per int in a
+ * tuple position whose ints all fit in 64 bits, and two, high word
+ * first, per int in a position that needs up to 128.  Mapped the way
+ * wrap_leaf_array() maps floats and ints, the words compare as the
+ * items do, provided each position holds the same kind of number in
+ * every key.  As in sort_str(), the array is sorted by the first word,
+ * and each run of ties again by the next.  Keys with a NaN, or of any
+ * other shape, are left to the comparison sort.
+ */
 
-        assert(PyBList_Check(oself));
-        self = (PyBList *) oself;
+#define WORDS_MAX 8
 
-        if (_PyObject_GC_IS_TRACKED(self))
-                PyObject_GC_UnTrack(self);
+enum { WORD_DOUBLE, WORD_LONG, WORD_HIGH, WORD_LOW };
 
-        Py_TRASHCAN_SAFE_BEGIN(self)
+typedef struct words_layout_t {
+        int n;                          /* Words per key */
+        int tuple;                      /* Whether the keys are tuples */
+        unsigned char item[WORDS_MAX];  /* Tuple position of each word */
+        unsigned char part[WORDS_MAX];  /* WORD_* */
+} words_layout_t;
 
-        /* Py_XDECREF() is needed here because the Python C API allows list
-         * items to be NULL. */
-        for (i = 0; i < self->num_children; i++)
-                Py_XDECREF(self->children[i]);
+/* WORD_DOUBLE, WORD_LONG, WORD_HIGH if ob needs two words, or -1 */
+BLIST_LOCAL_INLINE(int)
+words_kind(PyObject *ob)
+{
+        int overflow;
+        size_t bits;
 
-        if (PyRootBList_Check(self)) {
-                ext_dealloc((PyBListRoot *) self);
-                if (PyRootBList_CheckExact(self)
-                    && num_free_ulists < MAXFREELISTS)
-                        free_ulists[num_free_ulists++] = self;
-                else
-                        goto free_blist;
-        } else if (Py_TYPE(self) == &PyBList_Type
-                   && num_free_lists < MAXFREELISTS)
-                free_lists[num_free_lists++] = self;
-        else {
-        free_blist:
-                PyMem_Free(self->children);
-                Py_TYPE(self)->tp_free((PyObject *)self);
+        if (Py_TYPE(ob) == &PyFloat_Type)
+                return Py_IS_NAN(PyFloat_AS_DOUBLE(ob)) ? -1 : WORD_DOUBLE;
+#if PY_MAJOR_VERSION < 3
+        if (Py_TYPE(ob) == &PyInt_Type)
+                return WORD_LONG;
+#endif
+        if (Py_TYPE(ob) != &PyLong_Type)
+                return -1;
+        PyLong_AsLongLongAndOverflow(ob, &overflow);
+        if (!overflow)
+                return WORD_LONG;
+        bits = _PyLong_NumBits(ob);
+        if (bits == (size_t) -1)
+                PyErr_Clear();
+        return bits < 128 ? WORD_HIGH : -1;
+}
+
+/* Work out the words of the keys, which are tuples or ints.  Returns -1
+ * if they do not fit. */
+BLIST_LOCAL(int)
+words_layout(words_layout_t *layout, sortwrapperobject *array, Py_ssize_t n)
+{
+        int kinds[WORDS_MAX], kind, w;
+        Py_ssize_t i, c, size = 1;
+        PyObject *key;
+
+        layout->tuple = Py_TYPE(array[0].key) == &PyTuple_Type;
+        if (layout->tuple) {
+                size = PyTuple_GET_SIZE(array[0].key);
+                if (size > WORDS_MAX)
+                        return -1;
         }
+        for (c = 0; c < size; c++)
+                kinds[c] = -1;
 
-        Py_TRASHCAN_SAFE_END(self);
+        for (i = 0; i < n; i++) {
+                key = array[i].key;
+                if ((Py_TYPE(key) == &PyTuple_Type) != layout->tuple)
+                        return -1;
+                if (layout->tuple && PyTuple_GET_SIZE(key) != size)
+                        return -1;
+                for (c = 0; c < size; c++) {
+                        kind = words_kind(layout->tuple
+                                          ? PyTuple_GET_ITEM(key, c) : key);
+                        if (kind < 0)
+                                return -1;
+                        if (kinds[c] < 0 || kind == WORD_HIGH)
+                                kinds[c] = kind;
+                        else if ((kinds[c] == WORD_DOUBLE)
+                                 != (kind == WORD_DOUBLE))
+                                return -1;
+                }
+        }
+
+        for (c = w = 0; c < size; c++) {
+                if (w >= WORDS_MAX)
+                        return -1;
+                layout->item[w] = (unsigned char) c;
+                layout->part[w++] = (unsigned char) kinds[c];
+                if (kinds[c] == WORD_HIGH) {
+                        if (w >= WORDS_MAX)
+                                return -1;
+                        layout->item[w] = (unsigned char) c;
+                        layout->part[w++] = WORD_LOW;
+                }
+        }
+        layout->n = w;
+        return 0;
 }
 
-BLIST_PYAPI(int)
-py_blist_ass_item(PyObject *oself, Py_ssize_t i, PyObject *v)
+/* The word of key at depth */
+BLIST_LOCAL_INLINE(PY_UINT64_T)
+words_sort_key(PyObject *key, const words_layout_t *layout, Py_ssize_t depth)
 {
-        PyObject *old_value;
-        PyBList *self;
+        const PY_UINT64_T sign = 1ull << 63;
+        int i, part = layout->part[depth], overflow = 0;
+        PyObject *item = key;
+        unsigned char b[16];
+        PY_UINT64_T w = 0;
+        PY_INT64_T v;
 
-        invariants(oself, VALID_USER|VALID_RW|VALID_DECREF);
-
-        self = (PyBList *) oself;
+        if (layout->tuple)
+                item = PyTuple_GET_ITEM(key, layout->item[depth]);
 
-        if (i >= self->n || i < 0) {
-                set_index_error();
-                return _int(-1);
+        if (part == WORD_DOUBLE) {
+                double d = PyFloat_AS_DOUBLE(item);
+                /* -0.0 == 0.0, so later words must break the tie */
+                return double_sort_key(d == 0.0 ? 0.0 : d);
         }
 
-        if (v == NULL) {
-                blist_delitem(self, i);
-                ext_mark(self, 0, DIRTY);
-                decref_flush();
-                return _int(0);
+#if PY_MAJOR_VERSION < 3
+        if (Py_TYPE(item) == &PyInt_Type)
+                v = PyInt_AS_LONG(item);
+        else
+#endif
+        v = PyLong_AsLongLongAndOverflow(item, &overflow);
+        if (!overflow) {
+                if (part == WORD_HIGH)
+                        return (v < 0 ? ~(PY_UINT64_T) 0 : 0) ^ sign;
+                if (part == WORD_LOW)
+                        return (PY_UINT64_T) v;
+                return (PY_UINT64_T) v ^ sign;
         }
 
-        old_value = blist_ass_item_return(self, i, v);
-        Py_XDECREF(old_value);
-        return _int(0);
+        _PyLong_AsByteArray((PyLongObject *) item, b, 16, 1, 1);
+        for (i = 0; i < 8; i++)
+                w |= (PY_UINT64_T) b[part == WORD_HIGH ? i + 8 : i] << (8*i);
+        return part == WORD_HIGH ? w ^ sign : w;
 }
 
-BLIST_PYAPI(int)
-py_blist_ass_slice(PyObject *oself, Py_ssize_t ilow, Py_ssize_t ihigh,
-                   PyObject *v)
+/* Sort array by its keys, which fit layout.  Like sort_str(), this
+ * moves the keys along with the values. */
+BLIST_LOCAL(int)
+sort_words(sortwrapperobject *array, Py_ssize_t n,
+           const words_layout_t *layout)
 {
-        Py_ssize_t net;
-        PyBList *other, *left, *right, *self;
-
-        invariants(oself, VALID_RW|VALID_USER|VALID_DECREF);
+        sortwrapperobject *scratch;
+        run_histogram_t *histograms;
+        sort_run_t *runs, run;
+        Py_ssize_t i, j, num_runs = 1, allocated = 16;
 
-        self = (PyBList *) oself;
+        if (layout->n == 0)
+                return 0;
 
-        if (ilow < 0) ilow = 0;
-        else if (ilow > self->n) ilow = self->n;
-        if (ihigh < ilow) ihigh = ilow;
-        else if (ihigh > self->n) ihigh = self->n;
+        scratch = PyMem_New(sortwrapperobject, n);
+        histograms = PyMem_New(run_histogram_t, HISTOGRAM_SIZE);
+        runs = PyMem_New(sort_run_t, allocated);
+        if (scratch == NULL || histograms == NULL || runs == NULL)
+                goto nomem;
+
+        runs[0].lo = 0;
+        runs[0].hi = n;
+        runs[0].depth = 0;
+        while (num_runs) {
+                run = runs[--num_runs];
+                for (i = run.lo; i < run.hi; i++)
+                        array[i].fkey.k_uint64 = words_sort_key(
+                                array[i].key, layout, run.depth);
+                sort_run_uint64(array + run.lo, scratch, run.hi - run.lo,
+                                histograms);
+                if (run.depth + 1 == layout->n)
+                        continue;
+
+                for (i = run.lo; i < run.hi; i = j) {
+                        PY_UINT64_T k = array[i].fkey.k_uint64;
+                        for (j = i+1; j < run.hi; j++)
+                                if (array[j].fkey.k_uint64 != k)
+                                        break;
+                        if (j - i > 1
+                            && sort_push_run(&runs, &num_runs, &allocated,
+                                             i, j, run.depth + 1) < 0)
+                                goto nomem;
+                }
+        }
+
+        PyMem_Free(runs);
+        PyMem_Free(histograms);
+        PyMem_Free(scratch);
+        return 0;
+
+  nomem:
+        PyMem_Free(runs);
+        PyMem_Free(histograms);
+        PyMem_Free(scratch);
+        PyErr_NoMemory();
+        return -1;
+}
+
+#undef RUN_PASSES
+#endif
+
+BLIST_LOCAL(Py_ssize_t)
+sort(PyBListRoot *restrict self, PyObject *compare, PyObject *keyfunc)
+{
+        PyBList *leaf;
+        PyBList **leafs;
+        int err=0;
+        Py_ssize_t i, leafs_n = 0;
+        sortwrapperobject sortarraystack[10];
+        sortwrapperobject *sortarray = sortarraystack;
+        sort_cmp_t cmp;
+        int key_flags, radix;
+        Py_ssize_t runs_stack[2], *runs = runs_stack, k, from = 0;
+#ifdef BLIST_FLOAT_RADIX_SORT
+        words_layout_t layout = { 0 };
+#endif
+
+        if (self->leaf)
+                leafs = &leaf;
+        else {
+                leafs = PyMem_New(PyBList *, self->n / HALF + 1);
+                if (!leafs)
+                        return -1;
+        }
+
+        if (self->leaf) {
+                leaf = (PyBList *) self;
+                leafs_n = 1;
+        } else {
+                linearize_rw(self);
+
+                assert(INDEX_LENGTH(self) <= self->index_allocated);
+                for (i = 0; i < INDEX_LENGTH(self)-1; i++) {
+                        leaf = self->index_list[i];
+                        if (leaf == self->index_list[i+1])
+                                continue;
+                        leafs[leafs_n++] = leaf;
+                        Py_INCREF(leaf);
+                }
+                leaf = self->index_list[i];
+                leafs[leafs_n++] = leaf;
+                Py_INCREF(leaf);
+
+                runs = PyMem_New(Py_ssize_t, leafs_n + 1);
+                if (runs == NULL) {
+                        runs = runs_stack;
+                        PyErr_NoMemory();
+                        goto error;
+                }
+        }
+
+        /* A list in order needs no sorting, and one in reverse order
+         * only reversing.  Without a key function, that can be found
+         * out before wrapping. */
+        if (keyfunc == NULL) {
+                sort_cmp_t pair;
+                pair.lt = sort_lt_pair;
+                pair.compare = compare;
+                k = sort_find_order(leafs, leafs_n, &pair, 0, runs);
+                if (k == -1)
+                        goto error;
+                if (k == 0 || k == SCAN_DESCENDING)
+                        goto in_order;
+                if (k > 1 && runs[1] > 1)
+                        from = runs[1];
+        }
+
+        if (self->n > 10) {
+                sortarray = PyMem_New(sortwrapperobject, self->n);
+                if (sortarray == NULL) {
+                        sortarray = sortarraystack;
+                        goto error;
+                }
+        }
+
+        err = wrap_leaf_array(sortarray, leafs, leafs_n, self->n, keyfunc,
+                              &key_flags);
+        if (err < 0) {
+        error:
+                if (!self->leaf) {
+                        for (i = 0; i < leafs_n; i++)
+                                SAFE_DECREF(leafs[i]);
+                        PyMem_Free(leafs);
+                }
+                if (runs != runs_stack)
+                        PyMem_Free(runs);
+                if (sortarray != sortarraystack)
+                        PyMem_Free(sortarray);
+                return -1;
+        }
+
+#ifdef BLIST_FLOAT_RADIX_SORT
+        if (key_flags == KEY_ALL_WIDE && compare == NULL
+            && words_layout(&layout, sortarray, self->n) < 0)
+                key_flags = 0;
+#endif
+        radix = key_flags && compare == NULL;
+
+        /* Find the runs to merge.  A radix sort gains nothing from
+         * them, but keys from a key function may already be in order. */
+        k = leafs_n;
+        if (radix ? keyfunc != NULL : keyfunc != NULL || !self->leaf) {
+                sort_cmp_init(&cmp, sortarray, self->n, compare);
+                if (radix)
+                        k = sort_find_order(leafs, leafs_n, &cmp, 1, runs);
+                else
+                        k = sort_find_runs(leafs, leafs_n, from, &cmp, 1,
+                                           runs, leafs_n);
+                if (k == -1) {
+                        unwrap_leaf_array(leafs, leafs_n, self->n, sortarray);
+                        goto error;
+                }
+                if (k == 0 || k == SCAN_DESCENDING) {
+                        unwrap_leaf_array(leafs, leafs_n, self->n, sortarray);
+                        goto in_order;
+                }
+        }
+
+        if (radix) {
+#ifdef BLIST_FLOAT_RADIX_SORT
+                if (key_flags & KEY_ALL_DOUBLE) {
+                        if (self->n < 40 && self->leaf)
+                                err = insertion_sort_uint64(sortarray,self->n);
+                        else
+                                err = sort_uint64(sortarray, self->n);
+                } else if (key_flags & (KEY_ALL_STR | KEY_ALL_BYTES))
+                        err = sort_str(sortarray, self->n);
+                else if (key_flags == KEY_ALL_WIDE)
+                        err = sort_words(sortarray, self->n, &layout);
+                else
+#endif
+                if (key_flags & KEY_ALL_LONG) {
+                        if (self->n < 40 && self->leaf)
+                                err = insertion_sort_ulong(sortarray, self->n);
+                        else
+                                err = sort_ulong(sortarray, self->n);
+                }
+                else
+                        assert(0); /* Should not be possible */
+                unwrap_leaf_array(leafs, leafs_n, self->n, sortarray);
+                if (!self->leaf) {
+                        for (i = 0; i < leafs_n; i++)
+                                SAFE_DECREF(leafs[i]);
+                        PyMem_Free(leafs);
+                }
+        } else if (self->leaf) {
+                if (keyfunc == NULL)
+                        sort_cmp_init(&cmp, sortarray, self->n, compare);
+                err = gallop_sort(self->children, self->num_children, &cmp);
+                unwrap_leaf_array(leafs, 1, self->n, sortarray);
+        } else {
+                PyBList **scratch = PyMem_New(PyBList *, self->n / HALF + 1);
+                if (!scratch) {
+                        PyMem_Free(leafs);
+                        PyMem_Free(runs);
+                        PyMem_Free(sortarray);
+                        return -1;
+                }
+                leafs_n = sub_sort(scratch, leafs, runs, k, &cmp, &err, 0);
+                array_enable_GC(leafs, leafs_n);
+                PyMem_Free(scratch);
+                unwrap_leaf_array(leafs, leafs_n, self->n, sortarray);
+                i = blist_init_from_child_array(leafs, leafs_n);
+
+                if (i < 0) {
+                        /* XXX leaking memory here when out of memory */
+                        PyMem_Free(sortarray);
+                        return -1;
+                } else {
+                        assert(i == 1);
+                        blist_become_and_consume((PyBList *) self, leafs[0]);
+                }
+                SAFE_DECREF(leafs[0]);
+                PyMem_Free(leafs);
+        }
+
+        if (runs != runs_stack)
+                PyMem_Free(runs);
+        if (sortarray != sortarraystack)
+                PyMem_Free(sortarray);
+        return err;
+
+ in_order:
+        if (!self->leaf) {
+                for (i = 0; i < leafs_n; i++)
+                        SAFE_DECREF(leafs[i]);
+                PyMem_Free(leafs);
+        }
+        if (runs != runs_stack)
+                PyMem_Free(runs);
+        if (sortarray != sortarraystack)
+                PyMem_Free(sortarray);
+        if (k == SCAN_DESCENDING)
+                blist_reverse(self);
+        return 0;
+}
+
+/************************************************************************
+ * Value counts for hash_values()
+ *
+ * A root in this mode keeps a dict mapping each item to the number of
+ * times it occurs, so that membership tests need not scan the list.
+ * Adding or removing a single item updates the dict in O(1) time.
+ * Anything else throws the dict away, and the next lookup rebuilds it
+ * in O(n) time.  If maintaining the dict fails, e.g., because an item
+ * is unhashable, the dict is thrown away too, and lookups scan the
+ * list until a rebuild succeeds.
+ *
+ * Hashing and comparing items may run Python code that changes the
+ * list.  Each change bumps the stamp, so the dict is taken out while
+ * that code runs, and put back only if the stamp shows that nothing
+ * else happened to the list meanwhile.  For the same reason, the
+ * BListCounts itself lives as long as the root.
+ *
+ * Small blists must stay small, so the root holds only a flag that
+ * fits in its padding.  The BListCounts are found through a table
+ * keyed by the root's address, with linear probing.  Finding an entry
+ * never fails, so a root cannot lose track of stale counts.
+ */
+
+typedef struct BListCounts {
+        PyBList *root;
+        PyObject *dict;            /* item -> multiplicity, or NULL if stale */
+        unsigned long stamp;       /* Bumped by each change to the items */
+} BListCounts;
+
+static BListCounts **counts_table = NULL;
+static size_t counts_mask = 0;      /* Size of counts_table, minus one */
+static size_t counts_used = 0;
+
+#define COUNTS_HASH(root) ((((size_t) (root)) >> 4) * 2654435761u)
+
+/* The slot that holds the entry for root, or the empty slot where it
+ * belongs. */
+static BListCounts **counts_slot(PyBList *root)
+{
+        size_t i = COUNTS_HASH(root) & counts_mask;
+
+        while (counts_table[i] != NULL && counts_table[i]->root != root)
+                i = (i + 1) & counts_mask;
+        return &counts_table[i];
+}
+
+/* Make room for one more entry.  Returns -1 on MemoryError. */
+static int counts_reserve(void)
+{
+        BListCounts **old = counts_table;
+        size_t i, old_size = old == NULL ? 0 : counts_mask + 1;
+        size_t size = old_size ? old_size : 8;
+
+        while ((counts_used + 1) * 2 > size)
+                size *= 2;
+        if (size == old_size)
+                return 0;
+
+        counts_table = PyMem_New(BListCounts *, size);
+        if (counts_table == NULL) {
+                counts_table = old;
+                PyErr_NoMemory();
+                return -1;
+        }
+        memset(counts_table, 0, size * sizeof(BListCounts *));
+        counts_mask = size - 1;
+        for (i = 0; i < old_size; i++)
+                if (old[i] != NULL)
+                        *counts_slot(old[i]->root) = old[i];
+        PyMem_Free(old);
+        return 0;
+}
+
+static void counts_init(PyBListRoot *root)
+{
+        root->counting = 0;
+}
+
+/* Release everything.  Only for roots that are going away. */
+static void counts_dealloc(PyBListRoot *root)
+{
+        BListCounts **slot, *c;
+        size_t i;
+
+        if (counts_used == 0)
+                return;
+        slot = counts_slot((PyBList *) root);
+        c = *slot;
+        if (c == NULL)
+                return;
+
+        /* Close the gap, so that later entries stay reachable */
+        *slot = NULL;
+        counts_used--;
+        for (i = (slot - counts_table + 1) & counts_mask;
+             counts_table[i] != NULL; i = (i + 1) & counts_mask) {
+                BListCounts *moved = counts_table[i];
+                counts_table[i] = NULL;
+                *counts_slot(moved->root) = moved;
+        }
+
+        root->counting = 0;
+        Py_XDECREF(c->dict);
+        PyMem_Free(c);
+}
+
+/* The counts of self if they are being kept, or NULL */
+#define COUNTS_ON(self) (((PyBListRoot *) (self))->counting           \
+                         ? *counts_slot((PyBList *) (self)) : NULL)
+
+/* Store the count of item in dict into *pcount.  May run Python
+ * code. */
+static int counts_get(PyObject *dict, PyObject *item, Py_ssize_t *pcount)
+{
+        PyObject *v;
+
+#if PY_MAJOR_VERSION >= 3
+        v = PyDict_GetItemWithError(dict, item);
+        if (v == NULL && PyErr_Occurred())
+                return -1;
+#else
+        if (PyObject_Hash(item) == -1)
+                return -1;
+        v = PyDict_GetItem(dict, item);
+#endif
+        *pcount = v == NULL ? 0 : PyInt_AsSsize_t(v);
+        return 0;
+}
+
+/* Add delta to the count of item in dict.  May run Python code. */
+static int counts_adjust(PyObject *dict, PyObject *item, Py_ssize_t delta)
+{
+        Py_ssize_t count;
+        PyObject *v;
+        int err;
+
+        if (counts_get(dict, item, &count) < 0)
+                return -1;
+        count += delta;
+        if (count < 0) {
+                PyErr_SetObject(PyExc_KeyError, item);
+                return -1;
+        }
+        if (count == 0)
+                return PyDict_DelItem(dict, item);
+
+        v = PyInt_FromSsize_t(count);
+        if (v == NULL)
+                return -1;
+        err = PyDict_SetItem(dict, item, v);
+        Py_DECREF(v);
+        return err;
+}
+
+/* Put dict back into c unless something happened since stamp, or
+ * err is set.  Runs inside DANGER_BEGIN. */
+static int counts_restore(BListCounts *c, PyObject *dict, unsigned long stamp,
+                          int err)
+{
+        if (err < 0)
+                PyErr_Clear();
+        if (err < 0 || !((PyBListRoot *) c->root)->counting
+            || c->dict != NULL || c->stamp != stamp) {
+                Py_DECREF(dict);
+                return -1;
+        }
+        c->dict = dict;
+        return 0;
+}
+
+/* Throw away the counts of self after a change they do not follow.
+ * Must be called after the change, once self is consistent again. */
+BLIST_LOCAL(void)
+counts_forget(PyBList *self)
+{
+        BListCounts *c = COUNTS_ON(self);
+        PyObject *dict;
+
+        if (c == NULL)
+                return;
+
+        c->stamp++;
+        dict = c->dict;
+        c->dict = NULL;
+        if (dict != NULL) {
+                DANGER_BEGIN;
+                Py_DECREF(dict);
+                DANGER_END;
+        }
+}
+
+/* Count item added, which is now in self, and item removed, which is
+ * no longer; either may be NULL.  Must be called after the change, once
+ * self is consistent again. */
+BLIST_LOCAL(void)
+counts_update(PyBList *self, PyObject *added, PyObject *removed)
+{
+        BListCounts *c = COUNTS_ON(self);
+        PyObject *dict;
+        unsigned long stamp;
+        int err = 0;
+
+        if (c == NULL)
+                return;
+
+        stamp = ++c->stamp;
+        dict = c->dict;
+        if (dict == NULL || added == removed)
+                return;
+        c->dict = NULL;
+
+        DANGER_BEGIN;
+        if (added != NULL)
+                err = counts_adjust(dict, added, 1);
+        if (err == 0 && removed != NULL)
+                err = counts_adjust(dict, removed, -1);
+        counts_restore(c, dict, stamp, err);
+        DANGER_END;
+}
+
+/* Count the items of self from scratch.  Returns -1 if that failed or
+ * self changed meanwhile. */
+BLIST_LOCAL(int)
+counts_rebuild(PyBList *self, BListCounts *c)
+{
+        unsigned long stamp = c->stamp;
+        PyObject *dict, *item;
+        int err = 0;
+
+        DANGER_BEGIN;
+        dict = PyDict_New();
+        if (dict == NULL)
+                PyErr_Clear();
+        DANGER_END;
+        if (dict == NULL)
+                return -1;
+
+        ITER(self, item, {
+                DANGER_BEGIN;
+                err = counts_adjust(dict, item, 1);
+                DANGER_END;
+                if (err < 0 || c->stamp != stamp)
+                        break;
+        })
+
+        DANGER_BEGIN;
+        err = counts_restore(c, dict, stamp, err);
+        DANGER_END;
+
+        return err;
+}
+
+/* Look up how many times item occurs in self without scanning it.
+ * Returns 1 and stores the count in *pcount if that worked, or 0 if
+ * the caller must scan self instead. */
+BLIST_LOCAL(int)
+counts_lookup(PyBList *self, PyObject *item, Py_ssize_t *pcount)
+{
+        BListCounts *c = COUNTS_ON(self);
+        PyObject *dict;
+        int err;
+
+        if (c == NULL)
+                return 0;
+        if (c->dict == NULL && counts_rebuild(self, c) < 0)
+                return 0;
+
+        dict = c->dict;
+        Py_INCREF(dict);
+        DANGER_BEGIN;
+        err = counts_get(dict, item, pcount);
+        if (err < 0)
+                PyErr_Clear();
+        Py_DECREF(dict);
+        DANGER_END;
+
+        return err == 0;
+}
+
+/************************************************************************
+ * Section for functions callable directly by the interpreter.
+ *
+ * Each of these functions are marked with VALID_USER for debug mode.
+ *
+ * If they, or any function they call, makes calls to decref_later,
+ * they must call decref_flush() just before returning.
+ *
+ * These functions must not be called directly by other blist
+ * functions.  They should *only* be called by the interpreter, to
+ * ensure that decref_flush() is the last thing called before
+ * returning to the interpreter.
+ */
+
+BLIST_PYAPI(PyObject *)
+py_blist_root_tp_new(PyTypeObject *subtype, PyObject *args, PyObject *kwds)
+{
+        PyBList *self;
+
+        if (subtype == &PyRootBList_Type)
+                return (PyObject *) blist_root_new();
+
+        self = (PyBList *) subtype->tp_alloc(subtype, 0);
+        if (self == NULL)
+                return NULL;
+
+        self->leaf = 1;
+        ((PyBListRoot *)self)->tail = NULL;
+        ext_init((PyBListRoot *)self);
+        counts_init((PyBListRoot *)self);
+
+        return (PyObject *) self;
+}
+
+/* Should only be used by the unpickler */
+BLIST_PYAPI(PyObject *)
+py_blist_internal_tp_new(PyTypeObject *subtype, PyObject *args, PyObject *kwds)
+{
+        assert (subtype == &PyBList_Type);
+        return (PyObject *) blist_new();
+}
+
+/* Should only be used by the unpickler */
+BLIST_PYAPI(int)
+py_blist_internal_init(PyObject *oself, PyObject *args, PyObject *kw)
+{
+        return 0;
+}
+
+BLIST_PYAPI(int)
+py_blist_init(PyObject *oself, PyObject *args, PyObject *kw)
+{
+        int ret;
+        PyObject *arg = NULL;
+        static char *kwlist[] = {"sequence", 0};
+        int err;
+        PyBList *self;
+
+        invariants(oself, VALID_USER|VALID_DECREF);
+        blist_flush_tail(oself);
+        decref_flush();
+        self = (PyBList *) oself;
+
+        DANGER_BEGIN;
+        err = PyArg_ParseTupleAndKeywords(args, kw, "|O:list", kwlist, &arg);
+        DANGER_END;
+        if (!err)
+                return _int(-1);
+
+        if (self->n) {
+                blist_CLEAR(self);
+                ext_dealloc((PyBListRoot *) self);
+        }
+
+        if (arg == NULL) {
+                counts_forget(self);
+                decref_flush();
+                return _int(0);
+        }
+
+        ret = blist_init_from_seq(self, arg);
+        counts_forget(self);
+
+        decref_flush(); /* Needed due to blist_CLEAR() call */
+        return _int(ret);
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_richcompare(PyObject *v, PyObject *w, int op)
+{
+        PyObject *rv;
+
+        if (!PyRootBList_Check(v)) {
+        not_implemented:
+                Py_INCREF(Py_NotImplemented);
+                return Py_NotImplemented;
+        }
+
+        invariants((PyBList *) v, VALID_USER|VALID_DECREF);
+        blist_flush_tail(v);
+        decref_flush();
+        if (PyRootBList_Check(w)) {
+                blist_flush_tail(w);
+                rv = blist_richcompare_blist((PyBList *)v, (PyBList *)w, op);
+                decref_flush();
+                return _ob(rv);
+        }
+#ifndef Py_BUILD_CORE
+        if (PyList_Check(w)) {
+                rv = blist_richcompare_list((PyBList*)v, (PyListObject*)w, op);
+                decref_flush();
+                return _ob(rv);
+        }
+#endif
+        _void();
+        goto not_implemented;
+}
+
+BLIST_PYAPI(int)
+py_blist_traverse(PyObject *oself, visitproc visit, void *arg)
+{
+        PyBList *self;
+        int i;
+
+        assert(PyBList_Check(oself) || PyTypedBList_Check(oself));
+        self = (PyBList *) oself;
+
+        if (blist_raw(self))
+                return 0;
+
+        for (i = 0; i < self->num_children; i++) {
+                if (self->children[i] != NULL)
+                        Py_VISIT(self->children[i]);
+        }
+        if (PyRootBList_Check(self))
+                Py_VISIT(ROOT_TAIL(self));
+        if (counts_used && PyRootBList_Check(self)) {
+                BListCounts *c = *counts_slot(self);
+                if (c != NULL)
+                        Py_VISIT(c->dict);
+        }
+        return 0;
+}
+
+BLIST_PYAPI(int)
+py_blist_tp_clear(PyObject *oself)
+{
+        PyBList *self;
+
+        invariants(oself, VALID_USER|VALID_RW|VALID_DECREF);
+        self = (PyBList *) oself;
+
+        if (ROOT_TAIL(self)) {
+                PyBList *tail = ROOT_TAIL(self);
+                ROOT_TAIL(self) = NULL;
+                decref_later((PyObject *) tail);
+        }
+        reclaim_children_later(self);
+        blist_forget_children(self);
+        self->n = 0;
+        self->leaf = 1;
+        ext_dealloc((PyBListRoot *) self);
+        counts_forget(self);
+
+        decref_flush();
+        return _int(0);
+}
+
+#if PY_MAJOR_VERSION == 2 && PY_MINOR_VERSION >= 6 || PY_MAJOR_VERSION >= 3
+#define py_blist_nohash PyObject_HashNotImplemented
+#else
+BLIST_PYAPI(long)
+py_blist_nohash(PyObject *self)
+{
+        PyErr_SetString(PyExc_TypeError, "list objects are unhashable");
+        return -1;
+}
+#endif
+
+BLIST_PYAPI(void)
+py_blist_dealloc(PyObject *oself)
+{
+        int i;
+        PyBList *self;
+
+        assert(PyBList_Check(oself) || PyTypedBList_Check(oself));
+        self = (PyBList *) oself;
+
+        if (_PyObject_GC_IS_TRACKED(self))
+                PyObject_GC_UnTrack(self);
+
+        Py_TRASHCAN_SAFE_BEGIN(self)
+
+        if (PyRootBList_Check(self) || PyTypedBList_Check(self))
+                reclaim_children_later(self);
+        else
+                node_epoch++;
+
+        /* Py_XDECREF() is needed here because the Python C API allows list
+         * items to be NULL. */
+        for (i = 0; i < self->num_children && !blist_raw(self); i++)
+                Py_XDECREF(self->children[i]);
+
+        if (PyRootBList_Check(self) || PyTypedBList_Check(self)) {
+                Py_CLEAR(ROOT_TAIL(self));
+                ext_dealloc((PyBListRoot *) self);
+                counts_dealloc((PyBListRoot *) self);
+                if (PyRootBList_CheckExact(self)
+                    && num_free_ulists < MAXFREELISTS) {
+                        /* Whoever reuses it may only need a few slots */
+                        PyMem_Free(self->children);
+                        PyMem_Free(self->child_ends);
+                        self->children = NULL;
+                        self->child_ends = NULL;
+                        self->allocated = 0;
+                        free_ulists[num_free_ulists++] = self;
+                }
+                else
+                        goto free_blist;
+        } else if (blist_is_inline(self)
+                   && num_free_lists < MAXFREELISTS)
+                free_lists[num_free_lists++] = self;
+        else {
+        free_blist:
+                if (!blist_is_inline(self))
+                        PyMem_Free(self->children);
+                PyMem_Free(self->child_ends);
+                Py_TYPE(self)->tp_free((PyObject *)self);
+        }
+
+        Py_TRASHCAN_SAFE_END(self);
+}
+
+BLIST_PYAPI(int)
+py_blist_ass_item(PyObject *oself, Py_ssize_t i, PyObject *v)
+{
+        PyObject *old_value;
+        PyBList *self;
+
+        invariants(oself, VALID_USER|VALID_RW|VALID_DECREF);
+
+        self = (PyBList *) oself;
+
+        if (v == NULL) {
+                blist_flush_tail(self);
+                decref_flush();
+        }
+
+        if (i >= blist_user_n(self) || i < 0) {
+                set_index_error();
+                return _int(-1);
+        }
+
+        if (v == NULL) {
+                old_value = blist_delitem_return(self, i);
+                ext_mark(self, 0, DIRTY);
+                counts_update(self, NULL, old_value);
+                decref_later(old_value);
+                decref_flush();
+                return _int(0);
+        }
+
+        if (i >= self->n)
+                old_value = blist_tail_ass_item(self, i, v);
+        else
+                old_value = blist_ass_item_return(self, i, v);
+        counts_update(self, v, old_value);
+        Py_XDECREF(old_value);
+        return _int(0);
+}
+
+BLIST_PYAPI(int)
+py_blist_ass_slice(PyObject *oself, Py_ssize_t ilow, Py_ssize_t ihigh,
+                   PyObject *v)
+{
+        Py_ssize_t net;
+        PyBList *other, *left, *right, *self;
+
+        invariants(oself, VALID_RW|VALID_USER|VALID_DECREF);
+        blist_flush_tail(oself);
+        decref_flush();
+
+        self = (PyBList *) oself;
+
+        if (ilow < 0) ilow = 0;
+        else if (ilow > self->n) ilow = self->n;
+        if (ihigh < ilow) ihigh = ilow;
+        else if (ihigh > self->n) ihigh = self->n;
 
         if (!v) {
                 blist_delslice(self, ilow, ihigh);
                 ext_mark(self, 0, DIRTY);
-                decref_flush();
+                counts_forget(self);
+                decref_flush();
+                return _int(0);
+        }
+
+        if (PyRootBList_Check(v) && (PyObject *) self != v) {
+                other = (PyBList *) v;
+                blist_flush_tail(other);
+                decref_flush();
+                Py_INCREF(other);
+                ext_mark_set_dirty_all(other);
+        } else {
+                other = blist_root_new();
+                if (v) {
+                        int err = blist_init_from_seq(other, v);
+                        if (err < 0) {
+                                decref_later((PyObject *) other);
+                                decref_flush();
+                                return _int(-1);
+                        }
+                }
+        }
+
+        net = other->n - (ihigh - ilow);
+
+        /* Special case small lists */
+        if (self->leaf && other->leaf && (self->n + net <= LIMIT))
+        {
+                Py_ssize_t i;
+
+                if (blist_reserve(self, self->n + net) < 0) {
+                        SAFE_DECREF(other);
+                        decref_flush();
+                        return _int(-1);
+                }
+
+                for (i = ilow; i < ihigh; i++)
+                        decref_later(self->children[i]);
+
+                if (net >= 0)
+                        shift_right(self, ihigh, net);
+                else
+                        shift_left(self, ihigh, -net);
+                self->num_children += net;
+                copyref(self, ilow, other, 0, other->n);
+                SAFE_DECREF(other);
+                blist_adjust_n(self);
+                counts_forget(self);
+                decref_flush();
+                return _int(0);
+        }
+
+        left = self;
+        right = blist_root_copy(self);
+        blist_delslice(left, ilow, left->n);
+        blist_delslice(right, 0, ihigh);
+        blist_extend_blist(left, other); /* XXX check return values */
+        blist_extend_blist(left, right);
+
+        ext_mark(self, 0, DIRTY);
+        counts_forget(self);
+
+        SAFE_DECREF(other);
+        SAFE_DECREF(right);
+
+        decref_flush();
+
+        return _int(0);
+}
+
+BLIST_PYAPI(int)
+py_blist_ass_subscript(PyObject *oself, PyObject *item, PyObject *value)
+{
+        PyBList *self;
+
+        invariants(oself, VALID_USER|VALID_RW|VALID_DECREF);
+
+        self = (PyBList *) oself;
+
+        if (PyIndex_Check(item)) {
+                Py_ssize_t i;
+                PyObject *old_value;
+
+                if (PyLong_CheckExact(item)) {
+                        i = PyInt_AsSsize_t(item);
+                        if (i == -1 && PyErr_Occurred()) {
+                                PyErr_Clear();
+                                goto number;
+                        }
+                } else {
+                number:
+                        i = PyNumber_AsSsize_t(item, PyExc_IndexError);
+                        if (i == -1 && PyErr_Occurred())
+                                return _int(-1);
+                }
+                if (i < 0)
+                        i += blist_user_n(self);
+
+                if (i >= blist_user_n(self) || i < 0) {
+                        set_index_error();
+                        return _int(-1);
+                }
+
+                if (value == NULL) {
+                        blist_flush_tail(self);
+                        decref_flush();
+                } else if (i >= self->n) {
+                        old_value = blist_tail_ass_item(self, i, value);
+                        counts_update(self, value, old_value);
+                        DANGER_BEGIN;
+                        Py_DECREF(old_value);
+                        DANGER_END;
+                        return _int(0);
+                }
+
+                if (self->leaf) {
+                        /* Speed up common cases */
+
+                        old_value = self->children[i];
+                        if (value == NULL) {
+                                shift_left(self, i+1, 1);
+                                self->num_children--;
+                                self->n--;
+                        } else {
+                                self->children[i] = value;
+                                Py_INCREF(value);
+                        }
+                        counts_update(self, value, old_value);
+                        DANGER_BEGIN;
+                        Py_DECREF(old_value);
+                        DANGER_END;
+                        return _int(0);
+                }
+
+                if (value == NULL) {
+                        old_value = blist_delitem_return(self, i);
+                        ext_mark(self, 0, DIRTY);
+                        counts_update(self, NULL, old_value);
+                        decref_later(old_value);
+                        decref_flush();
+                        return _int(0);
+                }
+
+                Py_INCREF(value);
+                old_value = blist_ass_item_return2((PyBListRoot*)self,i,value);
+                counts_update(self, value, old_value);
+                DANGER_BEGIN;
+                Py_DECREF(old_value);
+                DANGER_END;
+                return _int(0);
+        } else if (PySlice_Check(item)) {
+                Py_ssize_t start, stop, step, slicelength;
+
+                blist_flush_tail(self);
+                decref_flush();
+                ext_mark(self, 0, DIRTY);
+
+#if PY_MAJOR_VERSION < 3 || PY_MAJOR_VERSION == 3 && PY_MINOR_VERSION < 2
+                if (PySlice_GetIndicesEx((PySliceObject*)item, self->n,
+#else
+                if (PySlice_GetIndicesEx(item, self->n,
+#endif
+                                         &start, &stop,&step,&slicelength)<0)
+                        return _int(-1);
+
+                /* treat L[slice(a,b)] = v _exactly_ like L[a:b] = v */
+                if (step == 1 && ((PySliceObject*)item)->step == Py_None)
+                        return _redir(py_blist_ass_slice(oself,start,stop,value));
+
+                if (value == NULL) {
+                        Py_ssize_t i, cur;
+                        int err = 0;
+
+                        if (slicelength <= 0)
+                                return _int(0);
+
+                        if (step < 0) {
+                                start = start + step*(slicelength-1);
+                                step = -step;
+                        }
+
+                        if (step == 1)
+                                blist_delslice(self, start,
+                                               start + slicelength);
+                        else if (slicelength > 1 && step < LIMIT) {
+                                /* Dense enough to rebuild the span */
+                                err = blist_del_step(self, start, step,
+                                                     slicelength);
+                        } else {
+                                /* Delete back-to-front */
+                                start = start + step*(slicelength-1);
+                                for (cur = start, i = 0; i < slicelength;
+                                     cur -= step, i++) {
+                                        PyObject *ob = blist_delitem_return(
+                                                self, cur);
+                                        decref_later(ob);
+                                }
+                        }
+
+                        ext_mark(self, 0, DIRTY);
+                        counts_forget(self);
+                        decref_flush();
+
+                        return _int(err);
+                } else { /* assign slice */
+                        PyObject *ins, *seq;
+                        PyBList *leaf;
+                        Py_ssize_t cur, i, offset, hi;
+
+                        DANGER_BEGIN;
+                        seq = PySequence_Fast(value,
+                                  "Must assign iterable to extended slice");
+                        DANGER_END;
+                        if (!seq)
+                                return _int(-1);
+
+                        if (seq == (PyObject *) self) {
+                                Py_DECREF(seq);
+                                seq = (PyObject *) blist_root_copy(self);
+                        }
+
+                        if (PySequence_Fast_GET_SIZE(seq) != slicelength) {
+                                PyErr_Format(PyExc_ValueError,
+                                             "attempt to assign sequence of size %zd to extended slice of size %zd",
+                                             PySequence_Fast_GET_SIZE(seq),
+                                             slicelength);
+                                Py_DECREF(seq);
+                                return _int(-1);
+                        }
+
+                        if (!slicelength) {
+                                Py_DECREF(seq);
+                                return _int(0);
+                        }
+
+                        /* Each leaf is made writable once, not once
+                         * per item */
+                        leaf = NULL;
+                        offset = hi = 0;
+                        for (cur = start, i = 0; i < slicelength;
+                             cur += step, i++) {
+                                if (cur < offset || cur >= hi) {
+                                        leaf = blist_locate_leaf_rw(
+                                                self, cur, &offset);
+                                        hi = offset + leaf->num_children;
+                                }
+                                ins = PySequence_Fast_GET_ITEM(seq, i);
+                                Py_INCREF(ins);
+                                decref_later(leaf->children[cur - offset]);
+                                leaf->children[cur - offset] = ins;
+                        }
+
+                        Py_DECREF(seq);
+                        counts_forget(self);
+
+                        decref_flush();
+
+                        return _int(0);
+                }
+        } else {
+                PyErr_SetString(PyExc_TypeError,
+                                "list indices must be integers");
+                return _int(-1);
+        }
+}
+
+BLIST_PYAPI(Py_ssize_t)
+py_blist_length(PyObject *ob)
+{
+        assert(PyRootBList_Check(ob) || PyTypedBList_Check(ob));
+        return blist_user_n((PyBList *) ob);
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_repeat(PyObject *oself, Py_ssize_t n)
+{
+        PyObject *ret;
+        PyBList *self;
+
+        invariants(oself, VALID_USER|VALID_DECREF);
+        blist_flush_tail(oself);
+        decref_flush();
+
+        self = (PyBList *) oself;
+
+        ret = blist_repeat(self, n);
+        decref_flush();
+        ext_mark_set_dirty_all(self);
+
+        return _ob(ret);
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_inplace_repeat(PyObject *oself, Py_ssize_t n)
+{
+        PyBList *tmp, *self;
+
+        invariants(oself, VALID_USER|VALID_RW|VALID_DECREF);
+        blist_flush_tail(oself);
+        decref_flush();
+
+        self = (PyBList *) oself;
+
+        tmp = (PyBList *) blist_repeat(self, n);
+        if (tmp == NULL)
+                return (PyObject *) _blist(NULL);
+        blist_become_and_consume(self, tmp);
+        Py_INCREF(self);
+        SAFE_DECREF(tmp);
+
+        decref_flush();
+
+        ext_mark(self, 0, DIRTY);
+        counts_forget(self);
+
+        return (PyObject *) _blist(self);
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_extend(PyBList *self, PyObject *other)
+{
+        int err;
+
+        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
+        blist_flush_tail(self);
+        decref_flush();
+
+        err = blist_extend(self, other);
+        decref_flush();
+        ext_mark(self, 0, DIRTY);
+        if (PyBList_Check(other))
+                ext_mark_set_dirty_all((PyBList *) other);
+        counts_forget(self);
+
+        if (err < 0)
+                return _ob(NULL);
+        Py_RETURN_NONE;
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_inplace_concat(PyObject *oself, PyObject *other)
+{
+        int err;
+        PyBList *self;
+
+        invariants(oself, VALID_RW|VALID_USER|VALID_DECREF);
+        blist_flush_tail(oself);
+        decref_flush();
+
+        self = (PyBList *) oself;
+
+        err = blist_extend(self, other);
+        decref_flush();
+        ext_mark(self, 0, DIRTY);
+        if (PyBList_Check(other))
+                ext_mark_set_dirty_all((PyBList*) other);
+        counts_forget(self);
+
+        if (err < 0)
+                return _ob(NULL);
+
+        Py_INCREF(self);
+        return _ob((PyObject *)self);
+}
+
+BLIST_PYAPI(int)
+py_blist_contains(PyObject *oself, PyObject *el)
+{
+        int c, ret = 0;
+        PyObject *item;
+        PyBList *self;
+        Py_ssize_t count;
+        fast_compare_data_t fast_cmp_type;
+
+        invariants(oself, VALID_USER | VALID_DECREF);
+        blist_flush_tail(oself);
+        decref_flush();
+
+        self = (PyBList *) oself;
+        if (counts_lookup(self, el, &count))
+                return _int(count > 0);
+
+        fast_cmp_type = check_fast_cmp_type(el, Py_EQ);
+
+        ITER(self, item, {
+                c = fast_eq(el, item, fast_cmp_type);
+                if (c < 0) {
+                        ret = -1;
+                        break;
+                }
+                if (c > 0) {
+                        ret = 1;
+                        break;
+                }
+        });
+
+        decref_flush();
+        return _int(ret);
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_get_slice(PyObject *oself, Py_ssize_t ilow, Py_ssize_t ihigh)
+{
+        PyBList *rv, *self;
+
+        invariants(oself, VALID_USER | VALID_DECREF);
+        blist_flush_tail(oself);
+        decref_flush();
+
+        self = (PyBList *) oself;
+
+        if (ilow < 0) ilow = 0;
+        else if (ilow > self->n) ilow = self->n;
+        if (ihigh < ilow) ihigh = ilow;
+        else if (ihigh > self->n) ihigh = self->n;
+
+        if (ilow == 0 && ihigh == self->n && !self->leaf)
+                /* A copy of the whole list can share self's index */
+                return (PyObject *) _blist(blist_root_copy(self));
+
+        rv = blist_root_new_like(self);
+        if (rv == NULL)
+                return (PyObject *) _blist(NULL);
+
+        if (ihigh <= ilow || ilow >= self->n)
+                return (PyObject *) _blist(rv);
+
+        if (self->leaf) {
+                Py_ssize_t delta = ihigh - ilow;
+
+                if (blist_reserve(rv, delta) < 0) {
+                        SAFE_DECREF(rv);
+                        return (PyObject *) _blist(NULL);
+                }
+                copyref(rv, 0, self, ilow, delta);
+                rv->num_children = delta;
+                rv->n = delta;
+                return (PyObject *) _blist(rv);
+        }
+
+        if (blist_become(rv, self) < 0) {
+                SAFE_DECREF(rv);
+                return (PyObject *) _blist(NULL);
+        }
+        blist_delslice(rv, ihigh, self->n);
+        blist_delslice(rv, 0, ilow);
+
+        ext_mark(rv, 0, DIRTY);
+        ext_mark_set_dirty(self, ilow, ihigh);
+        decref_flush();
+
+        return (PyObject *) _blist(rv);
+}
+
+/* This should only be called by _PyBList_GET_ITEM_FAST2() */
+PyObject *_PyBList_GetItemFast3(PyBListRoot *root, Py_ssize_t i)
+{
+        PyObject *rv;
+        Py_ssize_t dirty_offset = -1;
+
+        invariants(root, VALID_PARENT);
+        assert(!root->leaf);
+        assert(root->dirty_root != CLEAN);
+        assert(i >= 0);
+        assert(i < root->n);
+
+        if (ext_is_dirty(root, i, &dirty_offset)){
+                rv = ext_make_clean(root, i);
+        } else {
+                Py_ssize_t ioffset = i / INDEX_FACTOR;
+                Py_ssize_t offset = root->offset_list[ioffset];
+                PyBList *p = root->index_list[ioffset];
+                assert(i >= offset);
+                assert(p);
+                assert(p->leaf);
+                if (i < offset + p->n) {
+                        rv = p->children[i - offset];
+                        if (dirty_offset >= 0)
+                                ext_make_clean(root, dirty_offset);
+                } else if (ext_is_dirty(root,i + INDEX_FACTOR,&dirty_offset)){
+                        rv = ext_make_clean(root, i);
+                } else {
+                        ioffset++;
+                        assert(ioffset < root->index_allocated);
+                        offset = root->offset_list[ioffset];
+                        p = root->index_list[ioffset];
+                        rv = p->children[i - offset];
+                        assert(p);
+                        assert(p->leaf);
+                        assert(i < offset + p->n);
+                        if (dirty_offset >= 0)
+                                ext_make_clean(root, dirty_offset);
+                }
+        }
+
+        assert(rv == blist_get1((PyBList *)root, i));
+
+        return _ob(rv);
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_get_item(PyObject *oself, Py_ssize_t i)
+{
+        PyBList *self = (PyBList *) oself;
+        PyObject *ret;
+
+        invariants(self, VALID_USER);
+
+        if (i < 0 || i >= blist_user_n(self)) {
+                set_index_error();
+                return _ob(NULL);
+        }
+
+        if (self->leaf)
+                ret = self->children[i];
+        else if (i >= self->n)
+                ret = ROOT_TAIL(self)->children[i - self->n];
+        else
+                ret = _PyBList_GET_ITEM_FAST2((PyBListRoot*)self, i);
+        Py_INCREF(ret);
+        return _ob(ret);
+}
+
+/* Note: this may be called as __radd__, which means the arguments may
+ * be reversed. */
+BLIST_PYAPI(PyObject *)
+py_blist_concat(PyObject *ob1, PyObject *ob2)
+{
+        PyBList *rv;
+        int err;
+
+        int is_blist1 = PyRootBList_Check(ob1);
+        int is_blist2 = PyRootBList_Check(ob2);
+
+        /* Typed blists are boxed by blist_init_from_seq() below */
+        if ((!is_blist1 && !PyList_Check(ob1) && !PyTypedBList_Check(ob1))
+            || (!is_blist2 && !PyList_Check(ob2)
+                && !PyTypedBList_Check(ob2))) {
+                Py_INCREF(Py_NotImplemented);
+                return Py_NotImplemented;
+        }
+
+        if (is_blist1)
+                blist_flush_tail(ob1);
+        if (is_blist2)
+                blist_flush_tail(ob2);
+
+        if (is_blist1 && is_blist2) {
+                PyBList *blist1 = (PyBList *) ob1;
+                PyBList *blist2 = (PyBList *) ob2;
+                if (blist1->n < LIMIT && blist2->n < LIMIT
+                    && blist1->n + blist2->n < LIMIT) {
+                        rv = blist_root_new();
+                        if (rv == NULL)
+                                return NULL;
+                        if (blist_reserve(rv, blist1->n + blist2->n) < 0) {
+                                Py_DECREF(rv);
+                                return NULL;
+                        }
+                        copyref(rv, 0, blist1, 0, blist1->n);
+                        copyref(rv, blist1->n, blist2, 0, blist2->n);
+                        rv->n = rv->num_children = blist1->n + blist2->n;
+                        goto done;
+                }
+
+                rv = blist_root_copy(blist1);
+                blist_extend_blist(rv, blist2);
+                ext_mark(rv, 0, DIRTY);
+                ext_mark_set_dirty_all(blist2);
+                goto done;
+        }
+
+        rv = blist_root_new();
+        err = blist_init_from_seq(rv, ob1);
+        if (err < 0) {
+                decref_later((PyObject *) rv);
+                rv = NULL;
+                goto done;
+        }
+        err = blist_extend(rv, ob2);
+        if (err < 0) {
+                decref_later((PyObject *) rv);
+                rv = NULL;
+                goto done;
+        }
+        ext_mark(rv, 0, DIRTY);
+        if (PyBList_Check(ob1))
+                ext_mark_set_dirty_all((PyBList *) ob1);
+        if (PyBList_Check(ob2))
+                ext_mark_set_dirty_all((PyBList *) ob2);
+
+done:
+        _decref_flush();
+        return (PyObject *) rv;
+}
+
+/* User-visible repr() */
+BLIST_PYAPI(PyObject *)
+py_blist_repr(PyObject *oself)
+{
+        /* Basic approach: Clone self in O(1) time, then walk through
+         * the clone, changing each element to repr() of the element,
+         * in O(n) time.  Finally, enclose it in square brackets and
+         * call join.
+         */
+
+        Py_ssize_t i;
+        PyBList *pieces = NULL, *self;
+        PyObject *result = NULL;
+        PyObject *s, *tmp, *tmp2;
+
+        invariants(oself, VALID_USER|VALID_DECREF);
+        blist_flush_tail(oself);
+        decref_flush();
+        self = (PyBList *) oself;
+
+        DANGER_BEGIN;
+        i = Py_ReprEnter((PyObject *) self);
+        DANGER_END;
+        if (i) {
+                return i > 0 ? _ob(PyUnicode_FromString("[...]")) : _ob(NULL);
+        }
+
+        if (self->n == 0) {
+#ifdef Py_BUILD_CORE
+                result = PyUnicode_FromString("[]");
+#else
+                result = PyUnicode_FromString("blist([])");
+#endif
+                goto Done;
+        }
+
+        pieces = blist_root_copy(self);
+        if (pieces == NULL)
+                goto Done;
+
+        if (blist_repr_r(pieces) < 0)
+                goto Done;
+
+#ifdef Py_BUILD_CORE
+        s = PyUnicode_FromString("[");
+#else
+        s = PyUnicode_FromString("blist([");
+#endif
+        if (s == NULL)
+                goto Done;
+        tmp = blist_get1(pieces, 0);
+        tmp2 = PyUnicode_Concat(s, tmp);
+        Py_DECREF(s);
+        s = tmp2;
+        DANGER_BEGIN;
+        py_blist_ass_item((PyObject *) pieces, 0, s);
+        DANGER_END;
+        Py_DECREF(s);
+
+#ifdef Py_BUILD_CORE
+        s = PyUnicode_FromString("]");
+#else
+        s = PyUnicode_FromString("])");
+#endif
+        if (s == NULL)
+                goto Done;
+        tmp = blist_get1(pieces, pieces->n-1);
+        tmp2 = PyUnicode_Concat(tmp, s);
+        Py_DECREF(s);
+        tmp = tmp2;
+        DANGER_BEGIN;
+        py_blist_ass_item((PyObject *) pieces, pieces->n-1, tmp);
+        DANGER_END;
+        Py_DECREF(tmp);
+
+        s = PyUnicode_FromString(", ");
+        if (s == NULL)
+                goto Done;
+        result = PyUnicode_Join(s, (PyObject *) pieces);
+        Py_DECREF(s);
+
+ Done:
+        DANGER_BEGIN;
+        /* Only deallocating strings, so this is safe */
+        Py_XDECREF(pieces);
+        DANGER_END;
+
+        DANGER_BEGIN;
+        Py_ReprLeave((PyObject *) self);
+        DANGER_END;
+        return _ob(result);
+}
+
+#if defined(Py_DEBUG) && !defined(BLIST_IN_PYTHON)
+/* Return a string that shows the internal structure of the BList */
+BLIST_PYAPI(PyObject *)
+blist_debug(PyBList *self, PyObject *indent)
+{
+        PyObject *result, *s, *nl_indent, *comma, *indent2, *tmp, *tmp2;
+
+        invariants(self, VALID_PARENT);
+
+        comma = PyUnicode_FromString(", ");
+
+        if (indent == NULL)
+                indent = PyUnicode_FromString("");
+        else
+                Py_INCREF(indent);
+
+        tmp = PyUnicode_FromString("  ");
+        indent2 = PyUnicode_Concat(indent, tmp);
+        Py_DECREF(tmp);
+
+        if (!self->leaf) {
+                int i;
+
+                nl_indent = indent2;
+                tmp = PyUnicode_FromString("\n");
+                nl_indent = PyUnicode_Concat(indent2, tmp);
+                Py_DECREF(tmp);
+
+                result = PyUnicode_FromFormat("blist(leaf=%d, n=%d, r=%d, ",
+                                             self->leaf, self->n,
+                                             Py_REFCNT(self));
+                /* PyUnicode_Concat(&result, nl_indent); */
+
+                for (i = 0; i < self->num_children; i++) {
+                        s = blist_debug((PyBList *)self->children[i], indent2);
+                        tmp = PyUnicode_Concat(result, nl_indent);
+                        Py_DECREF(result);
+                        result = tmp;
+                        tmp = PyUnicode_Concat(result, s);
+                        Py_DECREF(result);
+                        result = tmp;
+                        Py_DECREF(s);
+                }
+
+                tmp = PyUnicode_FromString(")");
+                tmp2 = PyUnicode_Concat(result, tmp);
+                Py_DECREF(result);
+                Py_DECREF(tmp);
+                result = tmp2;
+        } else {
+                int i;
+
+                result = PyUnicode_FromFormat("blist(leaf=%d, n=%d, r=%d, ",
+                                             self->leaf, self->n,
+                                             Py_REFCNT(self));
+                for (i = 0; i < self->num_children; i++) {
+                        s = PyObject_Str(self->children[i]);
+                        tmp = PyUnicode_Concat(result, s);
+                        Py_DECREF(result);
+                        result = tmp;
+                        Py_DECREF(s);
+                        tmp = PyUnicode_Concat(result, comma);
+                        Py_DECREF(result);
+                        result = tmp;
+                }
+        }
+
+        s = indent;
+        tmp = PyUnicode_Concat(s, result);
+        Py_DECREF(result);
+        result = tmp;
+
+        Py_DECREF(comma);
+        Py_DECREF(indent);
+        check_invariants(self);
+        return _ob(result);
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_debug(PyBList *self)
+{
+        invariants(self, VALID_USER|VALID_DECREF);
+        blist_flush_tail(self);
+        decref_flush();
+        return _ob(blist_debug(self, NULL));
+}
+#endif
+
+BLIST_PYAPI(PyObject *)
+py_blist_sort(PyBListRoot *self, PyObject *args, PyObject *kwds)
+{
+#if PY_MAJOR_VERSION < 3
+        static char *kwlist[] = {"cmp", "key", "reverse", 0};
+#else
+        static char *kwlist[] = {"key", "reverse", 0};
+#endif
+        int reverse = 0;
+        int ret = -1;
+        PyBListRoot saved;
+        PyObject *result = NULL;
+        PyObject *compare = NULL, *keyfunc = NULL;
+        static PyObject **extra_list = NULL;
+
+        invariants(self, VALID_USER|VALID_RW | VALID_DECREF);
+        blist_flush_tail(self);
+        decref_flush();
+
+        if (args != NULL) {
+                int err;
+                DANGER_BEGIN;
+#if PY_MAJOR_VERSION < 3
+                err = PyArg_ParseTupleAndKeywords(args, kwds, "|OOi:sort",
+                                                  kwlist, &compare, &keyfunc,
+                                                  &reverse);
+                DANGER_END;
+                if (!err)
+                        return _ob(NULL);
+#else
+                err = PyArg_ParseTupleAndKeywords(args, kwds, "|Oi:sort",
+                                                  kwlist, &keyfunc, &reverse);
+                DANGER_END;
+                if (!err)
+                        return _ob(NULL);
+                if (Py_SIZE(args) > 0) {
+                        PyErr_SetString(PyExc_TypeError,
+                                "must use keyword argument for key function");
+                        return _ob(NULL);
+                }
+#endif
+        }
+
+        if (self->n < 2)
+                Py_RETURN_NONE;
+
+#if PY_MAJOR_VERSION < 3
+        if (is_default_cmp(compare))
+                compare = NULL;
+#endif
+        if (keyfunc == Py_None)
+                keyfunc = NULL;
+
+        memset(&saved, 0, offsetof(PyBListRoot, BLIST_FIRST_FIELD));
+        memcpy(&saved.BLIST_FIRST_FIELD, &self->BLIST_FIRST_FIELD,
+               sizeof(*self) - offsetof(PyBListRoot, BLIST_FIRST_FIELD));
+        Py_TYPE(&saved) = &PyRootBList_Type;
+        Py_REFCNT(&saved) = 1;
+        self->child_ends = NULL;
+        self->num_ends = 0;
+        self->counting = 0; /* Stays with saved */
+
+        if (extra_list != NULL) {
+                self->children = extra_list;
+                extra_list = NULL;
+        } else {
+                self->children = PyMem_New(PyObject *, LIMIT);
+                if (self->children == NULL) {
+                        PyErr_NoMemory();
+                        goto err;
+                }
+        }
+        self->allocated = LIMIT;
+        self->n = 0;
+        self->num_children = 0;
+        self->leaf = 1;
+        ext_init(self);
+
+        /* Reverse sort stability achieved by initially reversing the list,
+           applying a stable forward sort, then reversing the final result. */
+        if (reverse)
+                blist_reverse(&saved);
+
+        ret = sort(&saved, compare, keyfunc);
+
+        if (ret >= 0) {
+                result = Py_None;
+                if (reverse) {
+                        ext_mark((PyBList*)&saved, 0, DIRTY);
+                        blist_reverse(&saved);
+                }
+        } else
+                ext_mark((PyBList*)&saved, 0, DIRTY);
+
+        blist_flush_tail(self);
+        if (self->n && saved.n) {
+                DANGER_BEGIN;
+                /* An error may also have been raised by a comparison
+                 * function.  Since this may decref that traceback, it can
+                 * execute arbitrary python code. */
+                PyErr_SetString(PyExc_ValueError, "list modified during sort");
+                DANGER_END;
+                result = NULL;
+                blist_CLEAR((PyBList*) self);
+        }
+
+        if (extra_list == NULL && self->allocated == LIMIT)
+                extra_list = self->children;
+        else
+                PyMem_Free(self->children);
+
+        PyMem_Free(self->child_ends);
+        ext_dealloc(self);
+        counts_forget((PyBList *) self); /* hash_values() ran meanwhile */
+        assert(!self->n);
+  err:
+        memcpy(&self->BLIST_FIRST_FIELD, &saved.BLIST_FIRST_FIELD,
+               sizeof(*self) - offsetof(PyBListRoot, BLIST_FIRST_FIELD));
+
+        Py_XINCREF(result);
+
+        decref_flush();
+
+        /* This must come after the decref_flush(); otherwise, we may have
+         * extra temporary references to internal nodes, which throws off the
+         * debug-mode sanity checking. */
+        if (ret >= 0)
+                ext_reindex_set_all(&saved);
+
+        return _ob(result);
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_reverse(PyBList *restrict self)
+{
+        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
+        blist_flush_tail(self);
+        decref_flush();
+
+        if (self->leaf)
+                reverse_slice(self->children,
+                              &self->children[self->num_children]);
+        else {
+                blist_reverse((PyBListRoot*) self);
+        }
+
+        Py_RETURN_NONE;
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_count(PyBList *self, PyObject *v)
+{
+        Py_ssize_t count = 0;
+        PyObject *item;
+        int c;
+        fast_compare_data_t fast_cmp_type;
+
+        invariants(self, VALID_USER | VALID_DECREF);
+        blist_flush_tail(self);
+        decref_flush();
+
+        if (counts_lookup(self, v, &count))
+                return _ob(PyInt_FromSsize_t(count));
+
+        fast_cmp_type = check_fast_cmp_type(v, Py_EQ);
+
+        ITER(self, item, {
+                c = fast_eq(item, v, fast_cmp_type);
+                if (c > 0)
+                        count++;
+                else if (c < 0) {
+                        decref_flush();
+                        return _ob(NULL);
+                }
+        })
+
+        decref_flush();
+        return _ob(PyInt_FromSsize_t(count));
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_index(PyBList *self, PyObject *args)
+{
+        Py_ssize_t i, count, start=0, stop=PY_SSIZE_T_MAX;
+        PyObject *v;
+        int c, err;
+        PyObject *item;
+        fast_compare_data_t fast_cmp_type;
+
+        invariants(self, VALID_USER|VALID_DECREF);
+        blist_flush_tail(self);
+        decref_flush();
+
+        DANGER_BEGIN;
+        err = PyArg_ParseTuple(args, "O|O&O&:index", &v,
+                               _PyEval_SliceIndex, &start,
+                               _PyEval_SliceIndex, &stop);
+        DANGER_END;
+        if (!err)
+                return _ob(NULL);
+        if (start < 0) {
+                start += self->n;
+                if (start < 0)
+                        start = 0;
+        } else if (start > self->n)
+                start = self->n;
+        if (stop < 0) {
+                stop += self->n;
+                if (stop < 0)
+                        stop = 0;
+        } else if (stop > self->n)
+                stop = self->n;
+
+        if (counts_lookup(self, v, &count) && count == 0)
+                goto not_found;
+
+        fast_cmp_type = check_fast_cmp_type(v, Py_EQ);
+        i = start;
+        ITER2(self, item, start, stop, {
+                c = fast_eq(item, v, fast_cmp_type);
+                if (c > 0) {
+                        decref_flush();
+                        return _ob(PyInt_FromSsize_t(i));
+                } else if (c < 0) {
+                        decref_flush();
+                        return _ob(NULL);
+                }
+                i++;
+        })
+
+  not_found:
+        decref_flush();
+        PyErr_SetString(PyExc_ValueError, "list.index(x): x not in list");
+        return _ob(NULL);
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_remove(PyBList *self, PyObject *v)
+{
+        Py_ssize_t i, count;
+        int c;
+        PyObject *item;
+        fast_compare_data_t fast_cmp_type;
+
+        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
+        blist_flush_tail(self);
+        decref_flush();
+
+        if (counts_lookup(self, v, &count) && count == 0)
+                goto not_found;
+
+        fast_cmp_type = check_fast_cmp_type(v, Py_EQ);
+        i = 0;
+        ITER(self, item, {
+                c = fast_eq(item, v, fast_cmp_type);
+                if (c > 0) {
+                        item = blist_delitem_return(self, i);
+                        ext_mark(self, 0, DIRTY);
+                        counts_update(self, NULL, item);
+                        decref_later(item);
+                        decref_flush();
+                        Py_RETURN_NONE;
+                } else if (c < 0) {
+                        decref_flush();
+                        return _ob(NULL);
+                }
+                i++;
+        })
+
+  not_found:
+        decref_flush();
+        PyErr_SetString(PyExc_ValueError, "list.remove(x): x not in list");
+        return _ob(NULL);
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_pop(PyBList *self, PyObject *args)
+{
+        Py_ssize_t i = -1;
+        PyObject *v;
+        int err;
+
+        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
+
+        DANGER_BEGIN;
+        err = PyArg_ParseTuple(args, "|n:pop", &i);
+        DANGER_END;
+        if (!err)
+                return _ob(NULL);
+
+        if (self->n == 0) {
+                /* Special-case most common failure cause */
+                PyErr_SetString(PyExc_IndexError, "pop from empty list");
+                return _ob(NULL);
+        }
+
+        if (i == -1 || i == blist_user_n(self)-1) {
+                PyBList *tail = ROOT_TAIL(self);
+
+                if (tail == NULL && blist_wants_tail(self))
+                        tail = blist_new_tail(self);
+                if (tail != NULL) {
+                        if (tail->num_children
+                            || blist_refill_tail(self) == 0) {
+                                v = tail->children[--tail->num_children];
+                                tail->n--;
+                                counts_update(self, NULL, v);
+                                return _ob(v);
+                        }
+                        blist_flush_tail(self);
+                        decref_flush();
+                }
+
+                if (blist_pop_last_fast(self, &v) == 0) {
+                        counts_update(self, NULL, v);
+                        return _ob(v);
+                }
+        }
+
+        blist_flush_tail(self);
+        decref_flush();
+        if (i < 0)
+                i += self->n;
+        if (i < 0 || i >= self->n) {
+                PyErr_SetString(PyExc_IndexError, "pop index out of range");
+                return _ob(NULL);
+        }
+
+        v = blist_delitem_return(self, i);
+        ext_mark(self, 0, DIRTY);
+        counts_update(self, NULL, v);
+
+        decref_flush(); /* Remove any deleted BList nodes */
+
+        return _ob(v); /* the caller now owns the reference the list had */
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_popleft(PyBList *self)
+{
+        PyObject *v = NULL;
+
+        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
+
+        if (self->n == 0) {
+                PyErr_SetString(PyExc_IndexError, "pop from empty list");
+                return _ob(NULL);
+        }
+
+        /* Only the first leaf changes, so any tail may stay */
+        if (blist_pop_first_fast(self, &v) == 0) {
+                counts_update(self, NULL, v);
+                return _ob(v);
+        }
+
+        blist_flush_tail(self);
+        v = blist_delitem_return(self, 0);
+        ext_mark(self, 0, DIRTY);
+        counts_update(self, NULL, v);
+
+        decref_flush(); /* Remove any deleted BList nodes */
+
+        return _ob(v); /* the caller now owns the reference the list had */
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_appendleft(PyBList *self, PyObject *v)
+{
+        int err;
+
+        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
+        blist_flush_tail(self);
+        decref_flush();
+
+        err = blist_appendleft(self, v);
+
+        if (err < 0)
+                return _ob(NULL);
+        counts_update(self, v, NULL);
+
+        Py_RETURN_NONE;
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_extendleft(PyBList *self, PyObject *other)
+{
+        PyBList *left, *right;
+        int err;
+
+        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
+        blist_flush_tail(self);
+        decref_flush();
+
+        left = blist_root_new();
+        if (left == NULL)
+                return _ob(NULL);
+        err = blist_init_from_seq(left, other);
+        if (err < 0) {
+                decref_later((PyObject *) left);
+                decref_flush();
+                return _ob(NULL);
+        }
+        if (left->n > 1)
+                blist_reverse((PyBListRoot *) left);
+
+        /* Same as self[0:0] = left */
+        right = blist_root_copy(self);
+        blist_delslice(self, 0, self->n);
+        blist_extend_blist(self, left); /* XXX check return values */
+        blist_extend_blist(self, right);
+        ext_mark(self, 0, DIRTY);
+        counts_forget(self);
+
+        SAFE_DECREF(left);
+        SAFE_DECREF(right);
+
+        decref_flush();
+
+        Py_RETURN_NONE;
+}
+
+/* Splits the list in two and swaps the halves, which is O(log n) */
+BLIST_PYAPI(PyObject *)
+py_blist_rotate(PyBList *self, PyObject *args)
+{
+        Py_ssize_t k = 1, split;
+        PyBList *left;
+        int err;
+
+        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
+        blist_flush_tail(self);
+        decref_flush();
+
+        DANGER_BEGIN;
+        err = PyArg_ParseTuple(args, "|n:rotate", &k);
+        DANGER_END;
+        if (!err)
+                return _ob(NULL);
+
+        if (self->n <= 1)
+                Py_RETURN_NONE;
+        k %= self->n;
+        if (k < 0)
+                k += self->n;
+        if (k == 0)
+                Py_RETURN_NONE;
+        split = self->n - k;
+
+        if (self->leaf) {
+                reverse_slice(self->children, &self->children[split]);
+                reverse_slice(&self->children[split],
+                              &self->children[self->n]);
+                reverse_slice(self->children, &self->children[self->n]);
+                Py_RETURN_NONE;
+        }
+
+        left = blist_root_copy(self);
+        blist_delslice(left, split, left->n);
+        blist_delslice(self, 0, split);
+        blist_extend_blist(self, left); /* XXX check return values */
+        ext_mark(self, 0, DIRTY);
+
+        SAFE_DECREF(left);
+
+        decref_flush();
+
+        Py_RETURN_NONE;
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_split(PyBList *self, PyObject *args)
+{
+        Py_ssize_t i;
+        PyBList *left, *right, *tree, *left_tree, *right_tree;
+        int height, left_height, right_height;
+        PyObject *rv;
+        int err;
+
+        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
+        blist_flush_tail(self);
+        decref_flush();
+
+        DANGER_BEGIN;
+        err = PyArg_ParseTuple(args, "n:split", &i);
+        DANGER_END;
+        if (!err)
+                return _ob(NULL);
+
+        if (i < 0) {
+                i += self->n;
+                if (i < 0)
+                        i = 0;
+        } else if (i > self->n)
+                i = self->n;
+
+        left = blist_root_new_like(self);
+        right = blist_root_new_like(self);
+        if (left == NULL || right == NULL) {
+                SAFE_XDECREF(left);
+                SAFE_XDECREF(right);
+                return _ob(NULL);
+        }
+
+        tree = blist_detach(self);
+        if (tree == NULL) {
+                SAFE_DECREF(left);
+                SAFE_DECREF(right);
+                return _ob(NULL);
+        }
+        /* Any iterator over self must not follow its nodes elsewhere */
+        node_epoch++;
+
+        height = blist_get_height(tree);
+        blist_split_tree(tree, height, i, &left_tree, &left_height,
+                         &right_tree, &right_height);
+        blist_adopt(left, blist_trim_piece(left_tree, &left_height));
+        blist_adopt(right, blist_trim_piece(right_tree, &right_height));
+        counts_forget(self);
+
+        decref_flush();
+
+        DANGER_BEGIN;
+        rv = PyTuple_Pack(2, left, right);
+        DANGER_END;
+        SAFE_DECREF(left);
+        SAFE_DECREF(right);
+
+        return _ob(rv);
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_join(PyBList *self, PyObject *oother)
+{
+        PyBList *other, *left, *right, *root;
+        int left_height, right_height, height;
+
+        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
+        blist_flush_tail(self);
+        decref_flush();
+
+        if (!PyRootBList_Check(oother)) {
+                PyErr_SetString(PyExc_TypeError,
+                                "join() argument must be a blist");
+                return _ob(NULL);
+        }
+        if (oother == (PyObject *) self) {
+                PyErr_SetString(PyExc_ValueError,
+                                "cannot join a blist to itself");
+                return _ob(NULL);
+        }
+        other = (PyBList *) oother;
+        blist_flush_tail(other);
+        decref_flush();
+
+        if (self->n > PY_SSIZE_T_MAX - other->n) {
+                PyErr_SetString(PyExc_OverflowError,
+                                "cannot add more objects to list");
+                return _ob(NULL);
+        }
+
+        if (other->n == 0)
+                Py_RETURN_NONE;
+
+        left = blist_detach(self);
+        if (left == NULL)
+                return _ob(NULL);
+        right = blist_detach(other);
+        if (right == NULL) {
+                blist_adopt(self, left);
+                return _ob(NULL);
+        }
+        /* Any iterator over other must not follow its nodes into self */
+        node_epoch++;
+
+        left_height = blist_get_height(left);
+        right_height = blist_get_height(right);
+        root = blist_join_pieces(left, left_height, right, right_height,
+                                 &height);
+        blist_adopt(self, blist_trim_piece(root, &height));
+        counts_forget(self);
+        counts_forget(other);
+
+        decref_flush();
+
+        Py_RETURN_NONE;
+}
+
+/* Convert the sequence of integers indices into an array of
+ * non-negative indices into self, or raise IndexError.  Sets
+ * *pmonotone if the indices never change direction. */
+static Py_ssize_t *
+blist_get_indices(PyBList *self, PyObject *indices, Py_ssize_t *pk,
+                  int *pmonotone)
+{
+        PyObject *seq, *item;
+        Py_ssize_t *pos, i, k;
+        int up = 1, down = 1;
+
+        DANGER_BEGIN;
+        seq = PySequence_Fast(indices, "indices must be iterable");
+        DANGER_END;
+        if (seq == NULL)
+                return NULL;
+
+        k = PySequence_Fast_GET_SIZE(seq);
+        pos = PyMem_New(Py_ssize_t, k ? k : 1);
+        if (pos == NULL) {
+                PyErr_NoMemory();
+                goto error;
+        }
+
+        /* __index__ may run arbitrary code, so convert everything
+         * before looking at self */
+        for (i = 0; i < k; i++) {
+                item = PySequence_Fast_GET_ITEM(seq, i);
+                if (PyLong_CheckExact(item)) {
+                        pos[i] = PyInt_AsSsize_t(item);
+                        if (pos[i] == -1 && PyErr_Occurred()) {
+                                PyErr_Clear();
+                                goto number;
+                        }
+                } else {
+                number:
+                        DANGER_BEGIN;
+                        pos[i] = PyNumber_AsSsize_t(item, PyExc_IndexError);
+                        DANGER_END;
+                        if (pos[i] == -1 && PyErr_Occurred())
+                                goto error;
+                }
+        }
+
+        for (i = 0; i < k; i++) {
+                if (pos[i] < 0)
+                        pos[i] += self->n;
+                if (pos[i] < 0 || pos[i] >= self->n) {
+                        set_index_error();
+                        goto error;
+                }
+                if (i) {
+                        up &= pos[i] >= pos[i-1];
+                        down &= pos[i] <= pos[i-1];
+                }
+        }
+
+        DANGER_BEGIN;
+        Py_DECREF(seq);
+        DANGER_END;
+        *pk = k;
+        *pmonotone = up || down;
+        return pos;
+
+ error:
+        PyMem_Free(pos);
+        DANGER_BEGIN;
+        Py_DECREF(seq);
+        DANGER_END;
+        return NULL;
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_take(PyBList *self, PyObject *indices)
+{
+        Py_ssize_t *pos, i, k;
+        PyObject **items;
+        PyBList *result;
+        int monotone;
+
+        invariants(self, VALID_USER|VALID_DECREF);
+        blist_flush_tail(self);
+        decref_flush();
+
+        pos = blist_get_indices(self, indices, &k, &monotone);
+        if (pos == NULL)
+                return _ob(NULL);
+
+        result = blist_root_new();
+        if (result == NULL || k == 0) {
+                PyMem_Free(pos);
+                return _ob((PyObject *) result);
+        }
+
+        items = blist_gather_start(result, k);
+        if (items == NULL) {
+                PyMem_Free(pos);
+                decref_later((PyObject *) result);
+                decref_flush();
+                return _ob(NULL);
+        }
+
+        if (self->leaf) {
+                for (i = 0; i < k; i++)
+                        items[i] = self->children[pos[i]];
+        } else if (monotone) {
+                /* Visit each leaf once */
+                iter_t iter;
+                iter_init2(&iter, self, pos[0]);
+                for (i = 0; i < k; i++)
+                        items[i] = iter_seek(&iter, pos[i]);
+        } else {
+                /* Sorting would cost more than the root index, which
+                 * finds each leaf in O(1) once it is clean */
+                for (i = 0; i < k; i++)
+                        items[i] = _PyBList_GET_ITEM_FAST2(
+                                (PyBListRoot *) self, pos[i]);
+        }
+        PyMem_Free(pos);
+
+        if (blist_gather_finish(result, items, k) < 0) {
+                decref_later((PyObject *) result);
+                decref_flush();
+                return _ob(NULL);
+        }
+
+        ext_mark(result, 0, DIRTY);
+        return _ob((PyObject *) result);
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_put(PyBList *self, PyObject *args)
+{
+        PyObject *indices, *values, *seq, *v;
+        Py_ssize_t *pos, i, k, offset, hi;
+        PyBList *leaf;
+        unsigned long epoch;
+        int monotone, err;
+
+        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
+        blist_flush_tail(self);
+        decref_flush();
+
+        DANGER_BEGIN;
+        err = PyArg_ParseTuple(args, "OO:put", &indices, &values);
+        DANGER_END;
+        if (!err)
+                return _ob(NULL);
+
+        DANGER_BEGIN;
+        seq = PySequence_Fast(values, "values must be iterable");
+        DANGER_END;
+        if (seq == NULL)
+                return _ob(NULL);
+
+        pos = blist_get_indices(self, indices, &k, &monotone);
+        if (pos == NULL) {
+                decref_later(seq);
+                decref_flush();
+                return _ob(NULL);
+        }
+
+        if (PySequence_Fast_GET_SIZE(seq) != k) {
+                PyErr_Format(PyExc_ValueError,
+                             "put() got %zd indices but %zd values",
+                             k, PySequence_Fast_GET_SIZE(seq));
+                PyMem_Free(pos);
+                decref_later(seq);
+                decref_flush();
+                return _ob(NULL);
+        }
+
+        if (monotone && !self->leaf) {
+                /* Like an extended slice assignment, make each leaf
+                 * writable once */
+                epoch = node_epoch;
+                leaf = NULL;
+                offset = hi = 0;
+                for (i = 0; i < k; i++) {
+                        if (pos[i] < offset || pos[i] >= hi) {
+                                leaf = blist_locate_leaf_rw(self, pos[i],
+                                                            &offset);
+                                hi = offset + leaf->num_children;
+                        }
+                        v = PySequence_Fast_GET_ITEM(seq, i);
+                        Py_INCREF(v);
+                        decref_later(leaf->children[pos[i] - offset]);
+                        leaf->children[pos[i] - offset] = v;
+                }
+                /* Copied leaves are not in the index */
+                if (epoch != node_epoch)
+                        ext_mark(self, 0, DIRTY);
+        } else {
+                for (i = 0; i < k; i++) {
+                        PyObject *ob;
+                        v = PySequence_Fast_GET_ITEM(seq, i);
+                        ob = blist_ass_item_return(self, pos[i], v);
+                        decref_later(ob);
+                }
+        }
+
+        PyMem_Free(pos);
+        counts_forget(self);
+        decref_later(seq);
+        decref_flush();
+
+        Py_RETURN_NONE;
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_del_many(PyBList *self, PyObject *indices)
+{
+        Py_ssize_t *pos, i, k, lo, hi, count;
+        unsigned *marks;
+        int monotone, err;
+
+        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
+        blist_flush_tail(self);
+        decref_flush();
+
+        pos = blist_get_indices(self, indices, &k, &monotone);
+        if (pos == NULL)
+                return _ob(NULL);
+        if (k == 0) {
+                PyMem_Free(pos);
+                Py_RETURN_NONE;
+        }
+
+        lo = hi = pos[0];
+        for (i = 1; i < k; i++) {
+                if (pos[i] < lo) lo = pos[i];
+                if (pos[i] > hi) hi = pos[i];
+        }
+        hi++;
+
+        marks = PyMem_New(unsigned, SETCLEAN_LEN(hi - lo));
+        if (marks == NULL) {
+                PyMem_Free(pos);
+                return _ob(PyErr_NoMemory());
+        }
+        memset(marks, 0, SETCLEAN_LEN(hi - lo) * sizeof(unsigned));
+        for (count = i = 0; i < k; i++) {
+                if (!GET_BIT(marks, pos[i] - lo)) {
+                        SET_BIT(marks, pos[i] - lo);
+                        count++;
+                }
+        }
+        PyMem_Free(pos);
+
+        err = blist_del_marked(self, lo, hi, count, marks);
+        PyMem_Free(marks);
+
+        ext_mark(self, 0, DIRTY);
+        counts_forget(self);
+        decref_flush();
+
+        if (err < 0)
+                return _ob(NULL);
+        Py_RETURN_NONE;
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_filter(PyBList *self, PyObject *pred)
+{
+        PyBList *tree, *kept, *leaf;
+        PyObject *item, *result;
+        Forest forest;
+        iter_t iter;
+        int truth;
+
+        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
+        blist_flush_tail(self);
+        decref_flush();
+
+        if (self->n == 0)
+                Py_RETURN_NONE;
+        if (pred == Py_None)
+                pred = NULL;
+
+        if (forest_init(&forest) == NULL)
+                return _ob(NULL);
+        leaf = blist_new();
+        if (leaf == NULL) {
+                forest_uninit(&forest);
+                return _ob(NULL);
+        }
+
+        /* Like sort(), the list appears empty while pred runs */
+        tree = blist_detach(self);
+        if (tree == NULL) {
+                decref_later((PyObject *) leaf);
+                forest_uninit(&forest);
+                decref_flush();
+                return _ob(NULL);
+        }
+        node_epoch++;
+
+        iter_init(&iter, tree);
+        while ((item = iter_next(&iter)) != NULL) {
+                /* tree is private, so item stays alive */
+                DANGER_BEGIN;
+                if (pred == NULL)
+                        truth = PyObject_IsTrue(item);
+                else {
+                        result = PyObject_CallFunctionObjArgs(pred, item,
+                                                              NULL);
+                        if (result == NULL)
+                                truth = -1;
+                        else {
+                                truth = PyObject_IsTrue(result);
+                                Py_DECREF(result);
+                        }
+                }
+                DANGER_END;
+
+                if (truth < 0)
+                        goto error;
+                if (truth && forest_append_item(&forest, &leaf, item) < 0)
+                        goto error;
+        }
+
+        if (forest_finish_items(&forest, leaf, &kept) < 0) {
+                /* Put everything back */
+                blist_CLEAR(self);
+                blist_adopt(self, tree);
+                counts_forget(self);
+                decref_flush();
+                return _ob(NULL);
+        }
+
+        if (self->n) {
+                DANGER_BEGIN;
+                PyErr_SetString(PyExc_ValueError,
+                                "list modified during filter");
+                DANGER_END;
+                blist_CLEAR(self);
+                ext_mark(self, 0, DIRTY);
+                xdecref_later((PyObject *) kept);
+                blist_adopt(self, tree);
+                counts_forget(self);
+                decref_flush();
+                return _ob(NULL);
+        }
+
+        decref_later((PyObject *) tree);
+        blist_adopt(self, kept);
+        counts_forget(self);
+        decref_flush();
+
+        Py_RETURN_NONE;
+
+ error:
+        xdecref_later((PyObject *) leaf);
+        forest_uninit(&forest);
+        blist_CLEAR(self);
+        blist_adopt(self, tree);
+        counts_forget(self);
+        decref_flush();
+        return _ob(NULL);
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_hash_values(PyBList *self, PyObject *args)
+{
+        PyBListRoot *root = (PyBListRoot *) self;
+        BListCounts **slot, *c;
+        int enable = 1, err;
+
+        invariants(self, VALID_USER|VALID_DECREF);
+        blist_flush_tail(self);
+        decref_flush();
+
+        DANGER_BEGIN;
+        err = PyArg_ParseTuple(args, "|i:hash_values", &enable);
+        DANGER_END;
+        if (!err)
+                return _ob(NULL);
+
+        if (!enable) {
+                counts_forget(self);
+                root->counting = 0;
+                Py_RETURN_NONE;
+        }
+        if (root->counting)
+                Py_RETURN_NONE;
+
+        /* An entry outlives hash_values(False), see above */
+        if (counts_reserve() < 0)
+                return _ob(NULL);
+        slot = counts_slot(self);
+        if (*slot == NULL) {
+                c = PyMem_New(BListCounts, 1);
+                if (c == NULL)
+                        return _ob(PyErr_NoMemory());
+                c->root = self;
+                c->dict = NULL;
+                c->stamp = 0;
+                *slot = c;
+                counts_used++;
+        }
+        /* Counted on the first lookup */
+        root->counting = 1;
+
+        Py_RETURN_NONE;
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_clear(PyBList *self)
+{
+        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
+        blist_flush_tail(self);
+        decref_flush();
+
+        reclaim_children_later(self);
+        blist_forget_children(self);
+        self->n = 0;
+        self->leaf = 1;
+        ext_dealloc((PyBListRoot *) self);
+        counts_forget(self);
+
+        decref_flush();
+        Py_RETURN_NONE;
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_copy(PyBList *self)
+{
+        invariants(self, VALID_USER|VALID_DECREF);
+        blist_flush_tail(self);
+        decref_flush();
+        return (PyObject *) _blist(blist_root_copy(self));
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_insert(PyBList *self, PyObject *args)
+{
+        Py_ssize_t i;
+        PyObject *v;
+        int err;
+
+        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
+        blist_flush_tail(self);
+        decref_flush();
+
+        DANGER_BEGIN;
+        err = PyArg_ParseTuple(args, "nO:insert", &i, &v);
+        DANGER_END;
+        if (!err)
+                return _ob(NULL);
+
+        if (blist_insert(self, i, v) < 0)
+                return _ob(NULL);
+        counts_update(self, v, NULL);
+
+        Py_RETURN_NONE;
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_bisect_left(PyBList *self, PyObject *args)
+{
+        PyObject *key;
+        int keyed = 0, err;
+        Py_ssize_t i;
+
+        invariants(self, VALID_USER|VALID_DECREF);
+        blist_flush_tail(self);
+        decref_flush();
+
+        DANGER_BEGIN;
+        err = PyArg_ParseTuple(args, "O|i:_bisect_left", &key, &keyed);
+        DANGER_END;
+        if (!err)
+                return _ob(NULL);
+
+        i = blist_bisect(self, key, keyed, 0);
+        decref_flush();
+        if (i < 0)
+                return _ob(NULL);
+        return _ob(PyInt_FromSsize_t(i));
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_bisect_right(PyBList *self, PyObject *args)
+{
+        PyObject *key;
+        int keyed = 0, err;
+        Py_ssize_t i;
+
+        invariants(self, VALID_USER|VALID_DECREF);
+        blist_flush_tail(self);
+        decref_flush();
+
+        DANGER_BEGIN;
+        err = PyArg_ParseTuple(args, "O|i:_bisect_right", &key, &keyed);
+        DANGER_END;
+        if (!err)
+                return _ob(NULL);
+
+        i = blist_bisect(self, key, keyed, 1);
+        decref_flush();
+        if (i < 0)
+                return _ob(NULL);
+        return _ob(PyInt_FromSsize_t(i));
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_insort(PyBList *self, PyObject *args)
+{
+        PyObject *v, *key;
+        int keyed = 0, err;
+        Py_ssize_t i;
+
+        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
+        blist_flush_tail(self);
+        decref_flush();
+
+        DANGER_BEGIN;
+        err = PyArg_ParseTuple(args, "O|i:_insort", &v, &keyed);
+        DANGER_END;
+        if (!err)
+                return _ob(NULL);
+
+        if (!keyed)
+                key = v;
+        else if (PyTuple_Check(v) && PyTuple_GET_SIZE(v) > 0)
+                key = PyTuple_GET_ITEM(v, 0);
+        else {
+                PyErr_SetString(PyExc_TypeError, "keyed items must be tuples");
+                return _ob(NULL);
+        }
+
+        Py_INCREF(v);
+        i = blist_bisect(self, key, keyed, 1);
+        if (i >= 0)
+                err = blist_insert(self, i, v);
+        if (i >= 0 && err >= 0)
+                counts_update(self, v, NULL);
+        decref_later(v);
+        decref_flush();
+        if (i < 0 || err < 0)
+                return _ob(NULL);
+
+        Py_RETURN_NONE;
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_append(PyBList *self, PyObject *v)
+{
+        int err;
+
+        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
+
+        if (blist_wants_tail(self)) {
+                PyBList *tail = ROOT_TAIL(self);
+
+                if (tail == NULL || tail->num_children == LIMIT) {
+                        blist_flush_tail(self);
+                        decref_flush();
+                        tail = NULL;
+                        if (self->n < PY_SSIZE_T_MAX - LIMIT)
+                                tail = blist_new_tail(self);
+                }
+                if (tail != NULL) {
+                        tail->children[tail->num_children++] = v;
+                        tail->n++;
+                        Py_INCREF(v);
+                        if (!_PyObject_GC_IS_TRACKED(tail)
+                            && _PyObject_GC_MAY_BE_TRACKED(v))
+                                PyObject_GC_Track(tail);
+                        counts_update(self, v, NULL);
+                        Py_RETURN_NONE;
+                }
+        }
+
+        err = blist_append(self, v);
+
+        if (err < 0)
+                return _ob(NULL);
+        counts_update(self, v, NULL);
+
+        Py_RETURN_NONE;
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_subscript(PyObject *oself, PyObject *item)
+{
+        PyBList *self;
+
+        invariants(oself, VALID_USER|VALID_DECREF);
+
+        self = (PyBList *) oself;
+
+        if (PyIndex_Check(item)) {
+                Py_ssize_t i;
+                PyObject *ret;
+
+                if (PyLong_CheckExact(item)) {
+                        i = PyInt_AsSsize_t(item);
+                        if (i == -1 && PyErr_Occurred()) {
+                                PyErr_Clear();
+                                goto number;
+                        }
+                } else {
+                number:
+                        i = PyNumber_AsSsize_t(item, PyExc_IndexError);
+                        if (i == -1 && PyErr_Occurred())
+                                return _ob(NULL);
+                }
+
+                if (i < 0)
+                        i += blist_user_n(self);
+
+                if (i < 0 || i >= blist_user_n(self)) {
+                        set_index_error();
+                        return _ob(NULL);
+                }
+
+                if (self->leaf)
+                        ret = self->children[i];
+                else if (i >= self->n)
+                        ret = ROOT_TAIL(self)->children[i - self->n];
+                else
+                        ret = _PyBList_GET_ITEM_FAST2((PyBListRoot*)self, i);
+                Py_INCREF(ret);
+
+                return _ob(ret);
+        } else if (PySlice_Check(item)) {
+                Py_ssize_t start, stop, step, slicelength;
+                PyBList* result;
+
+                blist_flush_tail(self);
+                decref_flush();
+
+#if PY_MAJOR_VERSION < 3 || PY_MAJOR_VERSION == 3 && PY_MINOR_VERSION < 2
+                if (PySlice_GetIndicesEx((PySliceObject*)item, self->n,
+#else
+                if (PySlice_GetIndicesEx(item, self->n,
+#endif
+                                         &start, &stop,&step,&slicelength)<0) {
+                        return _ob(NULL);
+                }
+
+                if (step == 1)
+                        return _redir((PyObject *)
+                                      py_blist_get_slice((PyObject *) self, start, stop));
+
+                result = blist_root_new();
+
+                if (slicelength <= 0 || result == NULL)
+                        return _ob((PyObject *) result);
+
+                if (blist_init_from_step(result, self, start, step,
+                                         slicelength) < 0) {
+                        decref_later((PyObject *) result);
+                        decref_flush();
+                        return _ob(NULL);
+                }
+
+                ext_mark(result, 0, DIRTY);
+                return _ob((PyObject *) result);
+        } else {
+                PyErr_SetString(PyExc_TypeError,
+                                "list indices must be integers");
+                return _ob(NULL);
+        }
+}
+
+#if PY_MAJOR_VERSION == 2 && PY_MINOR_VERSION >= 6 || PY_MAJOR_VERSION >= 3
+static PyObject *
+py_blist_root_sizeof(PyBListRoot *root)
+{
+        Py_ssize_t res;
+        res = sizeof(PyBListRoot)
+                + root->allocated * sizeof(PyObject *)
+                + (root->child_ends ? LIMIT * sizeof(Py_ssize_t) : 0)
+                + root->index_allocated * (sizeof (PyBList *) +sizeof(Py_ssize_t))
+                + root->dirty_length * sizeof(Py_ssize_t)
+                + (root->index_allocated ?
+                   SETCLEAN_LEN(root->index_allocated) * sizeof(unsigned): 0)
+                + (root->tail ?
+                   sizeof(PyBList) + LIMIT * sizeof(PyObject *) : 0);
+        return PyLong_FromSsize_t(res);
+}
+
+static PyObject *
+py_blist_sizeof(PyBList *self)
+{
+        Py_ssize_t res;
+        res = sizeof(PyBList)
+                + LIMIT * sizeof(PyObject *)
+                + (self->child_ends ? LIMIT * sizeof(Py_ssize_t) : 0);
+        return PyLong_FromSsize_t(res);
+}
+
+PyDoc_STRVAR(sizeof_doc,
+"L.__sizeof__() -- size of L in memory, in bytes");
+#endif
+
+/************************************************************************
+ * Routines for supporting pickling
+ */
+
+#ifndef BLIST_IN_PYTHON
+BLIST_PYAPI(PyObject *)
+blist_getstate(PyBList *self)
+{
+        PyObject *lst;
+        int i;
+
+        invariants(self, VALID_PARENT);
+
+        lst = PyList_New(self->num_children);
+        for (i = 0; i < self->num_children; i++) {
+                PyList_SET_ITEM(lst, i, self->children[i]);
+                Py_INCREF(PyList_GET_ITEM(lst, i));
+        }
+
+        if (PyRootBList_CheckExact(self))
+                ext_mark_set_dirty_all(self);
+
+        return _ob(lst);
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_setstate(PyBList *self, PyObject *state)
+{
+        Py_ssize_t i;
+
+        invariants(self, VALID_PARENT);
+        if (PyRootBList_Check(self)) {
+                blist_flush_tail(self);
+                _decref_flush();
+        }
+
+        if (!PyList_CheckExact(state) || PyList_GET_SIZE(state) > LIMIT) {
+                PyErr_SetString(PyExc_TypeError, "invalid state");
+                return _ob(NULL);
+        }
+
+        /* A state of nodes makes self an internal node */
+        i = PyList_GET_SIZE(state);
+        if (i && Py_TYPE(PyList_GET_ITEM(state, 0)) == &PyBList_Type)
+                i = LIMIT;
+        if (blist_reserve(self, i) < 0)
+                return _ob(NULL);
+
+        blist_forget_ends(self, 0);
+        for (self->n = i = 0; i < PyList_GET_SIZE(state); i++) {
+                PyObject *child = PyList_GET_ITEM(state, i);
+                if (Py_TYPE(child) == &PyBList_Type) {
+                        self->leaf = 0;
+                        self->n += ((PyBList*)child)->n;
+                } else
+                        self->n++;
+                self->children[i] = child;
+                Py_INCREF(child);
+        }
+
+        self->num_children = PyList_GET_SIZE(state);
+
+        if (PyRootBList_CheckExact(self))
+                ext_reindex_all((PyBListRoot*)self);
+
+        Py_RETURN_NONE;
+}
+
+BLIST_PYAPI(PyObject *)
+py_blist_reduce(PyBList *self)
+{
+        PyObject *rv, *args, *type;
+
+        invariants(self, VALID_PARENT);
+        if (PyRootBList_Check(self)) {
+                blist_flush_tail(self);
+                _decref_flush();
+        }
+
+        if (blist_raw(self)) {
+                PyErr_SetString(PyExc_TypeError,
+                                "cannot pickle the nodes of a typedblist");
+                return _ob(NULL);
+        }
+
+        type = (PyObject *) Py_TYPE(self);
+        args = PyTuple_New(0);
+        rv = PyTuple_New(3);
+        PyTuple_SET_ITEM(rv, 0, type);
+        Py_INCREF(type);
+        PyTuple_SET_ITEM(rv, 1, args);
+        PyTuple_SET_ITEM(rv, 2, blist_getstate(self));
+
+        return _ob(rv);
+}
+#endif
+
+PyDoc_STRVAR(getitem_doc,
+             "x.__getitem__(y) <==> x[y]");
+PyDoc_STRVAR(reversed_doc,
+             "L.__reversed__() -- return a reverse iterator over the list");
+PyDoc_STRVAR(append_doc,
+"L.append(object) -- append object to end");
+PyDoc_STRVAR(extend_doc,
+"L.extend(iterable) -- extend list by appending elements from the iterable");
+PyDoc_STRVAR(insert_doc,
+"L.insert(index, object) -- insert object before index");
+PyDoc_STRVAR(pop_doc,
+"L.pop([index]) -> item -- remove and return item at index (default last)");
+PyDoc_STRVAR(appendleft_doc,
+"L.appendleft(object) -- insert object at the beginning");
+PyDoc_STRVAR(extendleft_doc,
+"L.extendleft(iterable) -- insert elements from the iterable at the beginning,\n"
+"one at a time, so that they end up in reverse order");
+PyDoc_STRVAR(popleft_doc,
+"L.popleft() -> item -- remove and return the first item");
+PyDoc_STRVAR(rotate_doc,
+"L.rotate([k]) -- move the last k items (default 1) to the beginning.\n"
+"If k is negative, move the first -k items to the end instead.");
+PyDoc_STRVAR(split_doc,
+"L.split(index) -> (left, right) -- move the items before index into a new\n"
+"blist left and the rest into a new blist right, leaving L empty");
+PyDoc_STRVAR(join_doc,
+"L.join(blist) -- move all items of the other blist to the end of L,\n"
+"leaving the other blist empty");
+PyDoc_STRVAR(take_doc,
+"L.take(indices) -> blist -- return a new blist of the items at indices");
+PyDoc_STRVAR(put_doc,
+"L.put(indices, values) -- store each value at the matching index;\n"
+"later duplicates win");
+PyDoc_STRVAR(del_many_doc,
+"L.del_many(indices) -- remove the items at all of the indices at once");
+PyDoc_STRVAR(filter_doc,
+"L.filter(function) -- keep only the items for which function(item) is\n"
+"true, or which are true themselves if function is None");
+PyDoc_STRVAR(hash_values_doc,
+"L.hash_values(enable=True) -- keep a hash of the items to speed up\n"
+"x in L, L.count(x), and misses in L.index(x) and L.remove(x)");
+PyDoc_STRVAR(remove_doc,
+"L.remove(value) -- remove first occurrence of value");
+PyDoc_STRVAR(index_doc,
+"L.index(value, [start, [stop]]) -> integer -- return first index of value");
+PyDoc_STRVAR(count_doc,
+"L.count(value) -> integer -- return number of occurrences of value");
+PyDoc_STRVAR(reverse_doc,
+"L.reverse() -- reverse *IN PLACE*");
+PyDoc_STRVAR(sort_doc,
+"L.sort(cmp=None, key=None, reverse=False) -- stable sort *IN PLACE*;\n\
+cmp(x, y) -> -1, 0, 1");
+PyDoc_STRVAR(clear_doc,
+"L.clear() -> None -- remove all items from L");
+PyDoc_STRVAR(copy_doc,
+"L.copy() -> list -- a shallow copy of L");
+PyDoc_STRVAR(bisect_left_doc,
+"L._bisect_left(key, keyed=False) -> integer -- leftmost position for key\n\
+in a sorted list; if keyed, items are (key, value) tuples");
+PyDoc_STRVAR(bisect_right_doc,
+"L._bisect_right(key, keyed=False) -> integer -- rightmost position for key\n\
+in a sorted list; if keyed, items are (key, value) tuples");
+PyDoc_STRVAR(insort_doc,
+"L._insort(item, keyed=False) -- insert item into a sorted list,\n\
+to the right of any equal items");
+
+static PyMethodDef blist_methods[] = {
+        {"__getitem__", (PyCFunction)py_blist_subscript, METH_O|METH_COEXIST, getitem_doc},
+        {"__reversed__",(PyCFunction)py_blist_reversed, METH_NOARGS, reversed_doc},
+#ifndef BLIST_IN_PYTHON
+        {"__reduce__",  (PyCFunction)py_blist_reduce, METH_NOARGS, NULL},
+        {"__setstate__",(PyCFunction)py_blist_setstate, METH_O, NULL},
+#endif
+        {"append",      (PyCFunction)py_blist_append,  METH_O, append_doc},
+        {"insert",      (PyCFunction)py_blist_insert,  METH_VARARGS, insert_doc},
+        {"extend",      (PyCFunction)py_blist_extend,  METH_O, extend_doc},
+        {"pop",         (PyCFunction)py_blist_pop,     METH_VARARGS, pop_doc},
+        {"remove",      (PyCFunction)py_blist_remove,  METH_O, remove_doc},
+        {"index",       (PyCFunction)py_blist_index,   METH_VARARGS, index_doc},
+        {"clear",       (PyCFunction)py_blist_clear,   METH_NOARGS, clear_doc},
+        {"copy",       (PyCFunction)py_blist_copy,   METH_NOARGS, copy_doc},
+        {"appendleft",  (PyCFunction)py_blist_appendleft, METH_O, appendleft_doc},
+        {"extendleft",  (PyCFunction)py_blist_extendleft, METH_O, extendleft_doc},
+        {"popleft",     (PyCFunction)py_blist_popleft, METH_NOARGS, popleft_doc},
+        {"rotate",      (PyCFunction)py_blist_rotate,  METH_VARARGS, rotate_doc},
+        {"split",       (PyCFunction)py_blist_split,   METH_VARARGS, split_doc},
+        {"join",        (PyCFunction)py_blist_join,    METH_O, join_doc},
+        {"take",        (PyCFunction)py_blist_take,    METH_O, take_doc},
+        {"put",         (PyCFunction)py_blist_put,     METH_VARARGS, put_doc},
+        {"del_many",    (PyCFunction)py_blist_del_many, METH_O, del_many_doc},
+        {"filter",      (PyCFunction)py_blist_filter,  METH_O, filter_doc},
+        {"hash_values", (PyCFunction)py_blist_hash_values, METH_VARARGS, hash_values_doc},
+
+        {"count",       (PyCFunction)py_blist_count,   METH_O, count_doc},
+        {"reverse",     (PyCFunction)py_blist_reverse, METH_NOARGS, reverse_doc},
+        {"sort",        (PyCFunction)py_blist_sort,    METH_VARARGS | METH_KEYWORDS, sort_doc},
+        {"_bisect_left", (PyCFunction)py_blist_bisect_left, METH_VARARGS, bisect_left_doc},
+        {"_bisect_right", (PyCFunction)py_blist_bisect_right, METH_VARARGS, bisect_right_doc},
+        {"_insort",     (PyCFunction)py_blist_insort,  METH_VARARGS, insort_doc},
+#if defined(Py_DEBUG) && !defined(BLIST_IN_PYTHON)
+        {"debug",       (PyCFunction)py_blist_debug,   METH_NOARGS, NULL},
+#endif
+#if PY_MAJOR_VERSION == 2 && PY_MINOR_VERSION >= 6 || PY_MAJOR_VERSION >= 3
+        {"__sizeof__",  (PyCFunction)py_blist_root_sizeof, METH_NOARGS, sizeof_doc},
+#endif
+        {NULL,          NULL}           /* sentinel */
+};
+
+static PyMethodDef blist_internal_methods[] = {
+#ifndef BLIST_IN_PYTHON
+        {"__reduce__",  (PyCFunction)py_blist_reduce, METH_NOARGS, NULL},
+        {"__setstate__",(PyCFunction)py_blist_setstate, METH_O, NULL},
+#endif
+#if PY_MAJOR_VERSION == 2 && PY_MINOR_VERSION >= 6 || PY_MAJOR_VERSION >= 3
+        {"__sizeof__",  (PyCFunction)py_blist_sizeof, METH_NOARGS, sizeof_doc},
+#endif
+        {NULL,          NULL}           /* sentinel */
+};
+
+static PySequenceMethods blist_as_sequence = {
+        py_blist_length,                   /* sq_length */
+        0,                /* sq_concat */
+        py_blist_repeat,              /* sq_repeat */
+        py_blist_get_item,            /* sq_item */
+        py_blist_get_slice,      /* sq_slice */
+        py_blist_ass_item,         /* sq_ass_item */
+        py_blist_ass_slice,   /* sq_ass_slice */
+        py_blist_contains,              /* sq_contains */
+        0,        /* sq_inplace_concat */
+        py_blist_inplace_repeat,      /* sq_inplace_repeat */
+};
+
+PyDoc_STRVAR(blist_doc,
+"blist() -> new list\n"
+"blist(iterable) -> new list initialized from iterable's items");
+
+static PyMappingMethods blist_as_mapping = {
+        py_blist_length,
+        py_blist_subscript,
+        py_blist_ass_subscript
+};
+
+/* All of this, just to get __radd__ to work */
+#if PY_MAJOR_VERSION < 3
+static PyNumberMethods blist_as_number = {
+        py_blist_concat,                    /* nb_add */
+        0,                                  /* nb_subtract */
+        0,                                  /* nb_multiply */
+        0,                                  /* nb_divide */
+        0,                                  /* nb_remainder */
+        0,                                  /* nb_divmod */
+        0,                                  /* nb_power */
+        0,                                  /* nb_negative */
+        0,                                  /* tp_positive */
+        0,                                  /* tp_absolute */
+        0,                                  /* tp_nonzero */
+        0,                                  /* nb_invert */
+        0,                                  /* nb_lshift */
+        0,                                  /* nb_rshift */
+        0,                                  /* nb_and */
+        0,                                  /* nb_xor */
+        0,                                  /* nb_or */
+        0,                                  /* nb_coerce */
+        0,                                  /* nb_int */
+        0,                                  /* nb_long */
+        0,                                  /* nb_float */
+        0,                                  /* nb_oct */
+        0,                                  /* nb_hex */
+        py_blist_inplace_concat,            /* nb_inplace_add */
+        0,                                  /* nb_inplace_subtract */
+        0,                                  /* nb_inplace_multiply */
+        0,                                  /* nb_inplace_divide */
+        0,                                  /* nb_inplace_remainder */
+        0,                                  /* nb_inplace_power */
+        0,                                  /* nb_inplace_lshift */
+        0,                                  /* nb_inplace_rshift */
+        0,                                  /* nb_inplace_and */
+        0,                                  /* nb_inplace_xor */
+        0,                                  /* nb_inplace_or */
+        0,                                  /* nb_floor_divide */
+        0,                                  /* nb_true_divide */
+        0,                                  /* nb_inplace_floor_divide */
+        0,                                  /* nb_inplace_true_divide */
+        0,                                  /* nb_index */
+};
+#else
+static PyNumberMethods blist_as_number = {
+        (binaryfunc) py_blist_concat,       /* nb_add */
+        0,                                  /* nb_subtract */
+        0,                                  /* nb_multiply */
+        0,                                  /* nb_remainder */
+        0,                                  /* nb_divmod */
+        0,                                  /* nb_power */
+        0,                                  /* nb_negative */
+        0,                                  /* tp_positive */
+        0,                                  /* tp_absolute */
+        0,                                  /* tp_bool */
+        0,                                  /* nb_invert */
+        0,                                  /* nb_lshift */
+        0,                                  /* nb_rshift */
+        0,                                  /* nb_and */
+        0,                                  /* nb_xor */
+        0,                                  /* nb_or */
+        0,                                  /* nb_int */
+        0,                                  /* nb_reserved */
+        0,                                  /* nb_float */
+        py_blist_inplace_concat,            /* nb_inplace_add */
+        0,                                  /* nb_inplace_subtract */
+        0,                                  /* nb_inplace_multiply */
+        0,                                  /* nb_inplace_remainder */
+        0,                                  /* nb_inplace_power */
+        0,                                  /* nb_inplace_lshift */
+        0,                                  /* nb_inplace_rshift */
+        0,                                  /* nb_inplace_and */
+        0,                                  /* nb_inplace_xor */
+        0,                                  /* nb_inplace_or */
+        0,                                  /* nb_floor_divide */
+        0,                                  /* nb_true_divide */
+        0,                                  /* nb_inplace_floor_divide */
+        0,                                  /* nb_inplace_true_divide */
+        0,                                  /* nb_index */
+};
+#endif
+
+PyTypeObject PyBList_Type = {
+        PyVarObject_HEAD_INIT(NULL, 0)
+#ifdef BLIST_IN_PYTHON
+        "__internal_blist",
+#else
+        "blist._blist.__internal_blist",
+#endif
+        sizeof(PyBList) + LIMIT * sizeof(PyObject *), /* children inline */
+        0,
+        py_blist_dealloc,                       /* tp_dealloc */
+        0,                                      /* tp_print */
+        0,                                      /* tp_getattr */
+        0,                                      /* tp_setattr */
+        0,                                      /* tp_compare */
+        0,                                      /* tp_repr */
+        0,                                      /* tp_as_number */
+        0,                                      /* tp_as_sequence */
+        0,                                      /* tp_as_mapping */
+        py_blist_nohash,                        /* tp_hash */
+        0,                                      /* tp_call */
+        0,                                      /* tp_str */
+        PyObject_GenericGetAttr,                /* tp_getattro */
+        0,                                      /* tp_setattro */
+        0,                                      /* tp_as_buffer */
+        Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC |
+                Py_TPFLAGS_BASETYPE,            /* tp_flags */
+        blist_doc,                              /* tp_doc */
+        py_blist_traverse,                      /* tp_traverse */
+        0,                                      /* tp_clear */
+        0,                                      /* tp_richcompare */
+        0,                                      /* tp_weaklistoffset */
+        0,                                      /* tp_iter */
+        0,                                      /* tp_iternext */
+        blist_internal_methods,                 /* tp_methods */
+        0,                                      /* tp_members */
+        0,                                      /* tp_getset */
+        0,                                      /* tp_base */
+        0,                                      /* tp_dict */
+        0,                                      /* tp_descr_get */
+        0,                                      /* tp_descr_set */
+        0,                                      /* tp_dictoffset */
+        py_blist_internal_init,                 /* tp_init */
+        0,                                      /* tp_alloc */
+        py_blist_internal_tp_new,               /* tp_new */
+        PyObject_GC_Del,                        /* tp_free */
+};
+
+PyTypeObject PyRootBList_Type = {
+        PyVarObject_HEAD_INIT(NULL, 0)
+#ifdef BLIST_IN_PYTHON
+        "list",
+#else
+        "blist.blist",
+#endif
+        sizeof(PyBListRoot),
+        0,
+        py_blist_dealloc,                       /* tp_dealloc */
+        0,                                      /* tp_print */
+        0,                                      /* tp_getattr */
+        0,                                      /* tp_setattr */
+        0,                                      /* tp_compare */
+        py_blist_repr,                          /* tp_repr */
+        &blist_as_number,                       /* tp_as_number */
+        &blist_as_sequence,                     /* tp_as_sequence */
+        &blist_as_mapping,                      /* tp_as_mapping */
+        py_blist_nohash,                        /* tp_hash */
+        0,                                      /* tp_call */
+        0,                                      /* tp_str */
+        PyObject_GenericGetAttr,                /* tp_getattro */
+        0,                                      /* tp_setattro */
+        0,                                      /* tp_as_buffer */
+        Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC |
+                Py_TPFLAGS_BASETYPE             /* tp_flags */
+#if (PY_MAJOR_VERSION == 2 && PY_MINOR_VERSION >= 6 || PY_MAJOR_VERSION >= 3) && defined(BLIST_IN_PYTHON)
+        | Py_TPFLAGS_LIST_SUBCLASS
+#endif
+        ,
+        blist_doc,                              /* tp_doc */
+        py_blist_traverse,                      /* tp_traverse */
+        py_blist_tp_clear,                      /* tp_clear */
+        py_blist_richcompare,                   /* tp_richcompare */
+        0,                                      /* tp_weaklistoffset */
+        py_blist_iter,                          /* tp_iter */
+        0,                                      /* tp_iternext */
+        blist_methods,                          /* tp_methods */
+        0,                                      /* tp_members */
+        0,                                      /* tp_getset */
+        0,                                      /* tp_base */
+        0,                                      /* tp_dict */
+        0,                                      /* tp_descr_get */
+        0,                                      /* tp_descr_set */
+        0,                                      /* tp_dictoffset */
+        py_blist_init,                          /* tp_init */
+        PyType_GenericAlloc,                    /* tp_alloc */
+        py_blist_root_tp_new,                   /* tp_new */
+        PyObject_GC_Del,                        /* tp_free */
+};
+
+#ifdef BLIST_TYPED
+/************************************************************************
+ * Typed BLists
+ *
+ * A typedblist is a blist of machine numbers, in the manner of the
+ * array module.  It is the same tree as a regular blist, except that
+ * each leaf slot holds a raw 64-bit value where a regular leaf holds
+ * a PyObject pointer.  The root and every leaf carry the typecode, so
+ * that the few routines that touch the reference counts of leaf
+ * children (see blist_raw()) can leave raw values alone.  Everything
+ * else -- copy-on-write, concatenation, slicing, the index extension
+ * -- only moves children around and works unchanged.
+ *
+ * Values are unboxed and range-checked on the way in and boxed on the
+ * way out.  A raw value may be all zero bits, so code that walks a
+ * typed blist must not take a NULL child to mean the end of the list.
+ */
+
+#define TYPED_INT 0     /* Stored as a PY_INT64_T */
+#define TYPED_UINT 1    /* Stored as a PY_UINT64_T */
+#define TYPED_FLOAT 2   /* Stored as a double */
+
+typedef union {
+        PyObject *ob;
+        PY_INT64_T i;
+        PY_UINT64_T u;
+        double d;
+} typed_value_t;
+
+typedef struct {
+        char typecode;
+        char kind;
+        PY_INT64_T min;         /* Range of the TYPED_INT typecodes */
+        PY_UINT64_T max;
+} typed_desc_t;
+
+#define TYPED_SMAX(type) \
+        ((PY_INT64_T) (~(PY_UINT64_T) 0 >> (65 - 8*sizeof(type))))
+#define TYPED_UMAX(type) (~(PY_UINT64_T) 0 >> (64 - 8*sizeof(type)))
+#define TYPED_SIGNED(c, type) \
+        { (c), TYPED_INT, -TYPED_SMAX(type) - 1, TYPED_SMAX(type) }
+#define TYPED_UNSIGNED(c, type) \
+        { (c), sizeof(type) == 8 ? TYPED_UINT : TYPED_INT, 0, TYPED_UMAX(type) }
+
+static const typed_desc_t typed_descs[] = {
+        TYPED_SIGNED('b', signed char),
+        TYPED_UNSIGNED('B', unsigned char),
+        TYPED_SIGNED('h', short),
+        TYPED_UNSIGNED('H', unsigned short),
+        TYPED_SIGNED('i', int),
+        TYPED_UNSIGNED('I', unsigned int),
+        TYPED_SIGNED('l', long),
+        TYPED_UNSIGNED('L', unsigned long),
+        TYPED_SIGNED('q', PY_LONG_LONG),
+        TYPED_UNSIGNED('Q', unsigned PY_LONG_LONG),
+        { 'f', TYPED_FLOAT, 0, 0 },
+        { 'd', TYPED_FLOAT, 0, 0 },
+        { 0, 0, 0, 0 }
+};
+
+BLIST_LOCAL(const typed_desc_t *)
+typed_desc(int typecode)
+{
+        const typed_desc_t *desc;
+
+        for (desc = typed_descs; desc->typecode; desc++)
+                if (desc->typecode == typecode)
+                        return desc;
+        return NULL;
+}
+
+#define typed_kind(self) (typed_desc((self)->typecode)->kind)
+
+BLIST_LOCAL(PyObject *)
+typed_typecode_object(char typecode)
+{
+#if PY_MAJOR_VERSION < 3
+        return PyString_FromStringAndSize(&typecode, 1);
+#else
+        return PyUnicode_FromStringAndSize(&typecode, 1);
+#endif
+}
+
+/* Return a new Python number for the raw value */
+BLIST_LOCAL_INLINE(PyObject *)
+typed_box(int kind, PyObject *raw)
+{
+        typed_value_t v;
+
+        v.ob = raw;
+        if (kind == TYPED_FLOAT)
+                return PyFloat_FromDouble(v.d);
+#if PY_MAJOR_VERSION < 3
+        if (kind == TYPED_INT ? v.i >= LONG_MIN && v.i <= LONG_MAX
+            : v.u <= LONG_MAX)
+                return PyInt_FromLong((long) v.i);
+#endif
+        if (kind == TYPED_UINT)
+                return PyLong_FromUnsignedLongLong(v.u);
+        return PyLong_FromLongLong(v.i);
+}
+
+/* Convert ob to a raw value for desc.  Returns -1 and sets an
+ * exception if ob is not a suitable number or is out of range. */
+BLIST_LOCAL(int)
+typed_pack(const typed_desc_t *desc, PyObject *ob, PyObject **raw)
+{
+        typed_value_t v;
+        int overflow;
+
+        if (desc->kind == TYPED_FLOAT) {
+                if (PyFloat_CheckExact(ob))
+                        v.d = PyFloat_AS_DOUBLE(ob);
+                else {
+                        DANGER_BEGIN;
+                        v.d = PyFloat_AsDouble(ob);
+                        DANGER_END;
+                        if (v.d == -1.0 && PyErr_Occurred())
+                                return -1;
+                }
+                if (desc->typecode == 'f')
+                        v.d = (float) v.d;
+                *raw = v.ob;
+                return 0;
+        }
+
+        if (PyInt_CheckExact(ob) || PyLong_CheckExact(ob))
+                Py_INCREF(ob);
+        else {
+                DANGER_BEGIN;
+                ob = PyNumber_Index(ob);
+                DANGER_END;
+                if (ob == NULL)
+                        return -1;
+        }
+
+        v.i = PyLong_AsLongLongAndOverflow(ob, &overflow);
+        if (overflow > 0 && desc->kind == TYPED_UINT) {
+                v.u = PyLong_AsUnsignedLongLong(ob);
+                if (v.u == (PY_UINT64_T) -1 && PyErr_Occurred()) {
+                        PyErr_Clear();
+                        goto range;
+                }
+        } else if (v.i == -1 && PyErr_Occurred()) {
+                Py_DECREF(ob);
+                return -1;
+        } else if (overflow || v.i < desc->min
+                   || (desc->kind == TYPED_INT
+                       && v.i > (PY_INT64_T) desc->max)) {
+        range:
+                Py_DECREF(ob);
+                PyErr_Format(PyExc_OverflowError,
+                             "value out of range for typecode '%c'",
+                             desc->typecode);
+                return -1;
+        }
+
+        Py_DECREF(ob);
+        *raw = v.ob;
+        return 0;
+}
+
+/* Find the raw value that compares equal to ob, for searching.
+ * Returns 1 and sets *key if there is one, 0 if ob is a number that
+ * no value of this typecode can equal, and -1 if ob must be compared
+ * the slow way. */
+BLIST_LOCAL(int)
+typed_probe(const typed_desc_t *desc, PyObject *ob, typed_value_t *key)
+{
+        if (PyFloat_CheckExact(ob)) {
+                double d = PyFloat_AS_DOUBLE(ob);
+
+                if (desc->kind == TYPED_FLOAT) {
+                        key->d = d;
+                        if (desc->typecode == 'f')
+                                return (double) (float) d == d;
+                        return d == d; /* NaN equals nothing */
+                }
+                if (d != floor(d))
+                        return 0;
+                if (desc->kind == TYPED_UINT) {
+                        if (!(d >= 0.0 && d < 18446744073709551616.0))
+                                return 0;
+                        key->u = (PY_UINT64_T) d;
+                        return 1;
+                }
+                if (!(d >= -9223372036854775808.0
+                      && d < 9223372036854775808.0))
+                        return 0;
+                key->i = (PY_INT64_T) d;
+                return key->i >= desc->min
+                        && key->i <= (PY_INT64_T) desc->max;
+        }
+
+        if (PyInt_CheckExact(ob) || PyLong_CheckExact(ob)
+            || PyBool_Check(ob)) {
+                int overflow;
+                PY_INT64_T i = PyLong_AsLongLongAndOverflow(ob, &overflow);
+
+                if (desc->kind == TYPED_FLOAT) {
+                        /* Only small integers convert exactly */
+                        if (overflow || i > ((PY_INT64_T) 1 << 53)
+                            || i < -((PY_INT64_T) 1 << 53))
+                                return -1;
+                        key->d = (double) i;
+                        return 1;
+                }
+                if (overflow > 0 && desc->kind == TYPED_UINT) {
+                        key->u = PyLong_AsUnsignedLongLong(ob);
+                        if (key->u == (PY_UINT64_T) -1 && PyErr_Occurred()){
+                                PyErr_Clear();
+                                return 0;
+                        }
+                        return 1;
+                }
+                if (overflow)
+                        return 0;
+                key->i = i;
+                if (desc->kind == TYPED_UINT)
+                        return i >= 0;
+                return i >= desc->min && i <= (PY_INT64_T) desc->max;
+        }
+
+        return -1;
+}
+
+/* Compare a raw value to ob the slow way, by boxing it */
+BLIST_LOCAL(int)
+typed_eq_slow(int kind, PyObject *raw, PyObject *ob)
+{
+        PyObject *item;
+        int c;
+
+        item = typed_box(kind, raw);
+        if (item == NULL)
+                return -1;
+        DANGER_BEGIN;
+        c = PyObject_RichCompareBool(item, ob, Py_EQ);
+        Py_DECREF(item);
+        DANGER_END;
+        return c;
+}
+
+/* Store the next raw value of a typed blist in *raw.  Returns 0 at
+ * the end of the list. */
+BLIST_LOCAL_INLINE(int)
+typed_iter_next(iter_t *iter, PyObject **raw)
+{
+        PyBList *p = iter->leaf;
+
+        if (p == NULL)
+                return 0;
+        if (iter->epoch == node_epoch && p->leaf
+            && iter->i < p->num_children) {
+                *raw = p->children[iter->i++];
+                return 1;
+        }
+        *raw = iter_next(iter);
+        return iter->leaf != NULL;
+}
+
+/* Fetch the next item from the iterator it and unbox it.  Returns 1
+ * on success, 0 when the iterator is exhausted, and -1 on error. */
+BLIST_LOCAL(int)
+typed_iternext(const typed_desc_t *desc, PyObject *it, PyObject **raw)
+{
+        PyObject *item;
+        int err;
+
+        DANGER_BEGIN;
+        item = Py_TYPE(it)->tp_iternext(it);
+        DANGER_END;
+        if (item == NULL) {
+                if (PyErr_Occurred()) {
+                        if (!PyErr_ExceptionMatches(PyExc_StopIteration))
+                                return -1;
+                        PyErr_Clear();
+                }
+                return 0;
+        }
+
+        err = typed_pack(desc, item, raw);
+        DANGER_BEGIN;
+        Py_DECREF(item);
+        DANGER_END;
+        return err < 0 ? -1 : 1;
+}
+
+/* Return the raw value at index i of the typed root self */
+BLIST_LOCAL_INLINE(PyObject *)
+typed_get(PyBList *self, Py_ssize_t i)
+{
+        if (self->leaf)
+                return self->children[i];
+        return _PyBList_GET_ITEM_FAST2((PyBListRoot *) self, i);
+}
+
+/* Overwrite the raw value at index i of the typed root self */
+BLIST_LOCAL_INLINE(void)
+typed_set(PyBList *self, Py_ssize_t i, PyObject *raw)
+{
+        if (self->leaf)
+                self->children[i] = raw;
+        else
+                blist_ass_item_return2((PyBListRoot *) self, i, raw);
+}
+
+/* Initialize an empty typed BList from a Python sequence in O(n) time */
+BLIST_LOCAL(int)
+typed_init_from_seq(PyBList *self, PyObject *b)
+{
+        const typed_desc_t *desc = typed_desc(self->typecode);
+        PyObject *it;
+        PyBList *cur, *final;
+        Forest forest;
+        int err;
+
+        invariants(self, VALID_ROOT | VALID_RW);
+
+        if (PyTypedBList_Check(b) && b != (PyObject *) self
+            && ((PyBList *) b)->typecode == self->typecode) {
+                /* We can copy other typed BLists in O(1) time :-) */
+                if (blist_become(self, (PyBList *) b) < 0)
+                        return _int(-1);
+                ext_mark(self, 0, DIRTY);
+                ext_mark_set_dirty_all((PyBList *) b);
                 return _int(0);
         }
 
-        if (PyRootBList_Check(v) && (PyObject *) self != v) {
-                other = (PyBList *) v;
-                Py_INCREF(other);
-                ext_mark_set_dirty_all(other);
-        } else {
-                other = blist_root_new();
-                if (v) {
-                        int err = blist_init_from_seq(other, v);
-                        if (err < 0) {
-                                decref_later((PyObject *) other);
-                                decref_flush();
-                                return _int(-1);
-                        }
+        DANGER_BEGIN;
+        it = PyObject_GetIter(b);
+        DANGER_END;
+        if (it == NULL)
+                return _int(-1);
+
+        /* Try common case of len(sequence) <= LIMIT */
+        for (self->num_children = 0; self->num_children < LIMIT;
+             self->num_children++) {
+                PyObject *raw;
+
+                err = typed_iternext(desc, it, &raw);
+                if (err > 0 && blist_reserve(self, self->num_children+1) < 0)
+                        err = -1;
+                if (err <= 0) {
+                        self->n = self->num_children;
+                        if (err < 0)
+                                goto error;
+                        goto done;
                 }
+                self->children[self->num_children] = raw;
         }
 
-        net = other->n - (ihigh - ilow);
-
-        /* Special case small lists */
-        if (self->leaf && other->leaf && (self->n + net <= LIMIT))
-        {
-                Py_ssize_t i;
+        /* No such luck, build bottom-up instead.  The sequence data
+         * so far goes in a leaf node. */
 
-                for (i = ilow; i < ihigh; i++)
-                        decref_later(self->children[i]);
+        cur = blist_new();
+        if (cur == NULL)
+                goto error;
+        blist_become_and_consume(cur, self);
 
-                if (net >= 0)
-                        shift_right(self, ihigh, net);
-                else
-                        shift_left(self, ihigh, -net);
-                self->num_children += net;
-                copyref(self, ilow, other, 0, other->n);
-                SAFE_DECREF(other);
-                blist_adjust_n(self);
-                decref_flush();
-                return _int(0);
+        if (forest_init(&forest) == NULL) {
+                decref_later(it);
+                decref_later((PyObject *) cur);
+                return _int(-1);
         }
 
-        left = self;
-        right = blist_root_copy(self);
-        blist_delslice(left, ilow, left->n);
-        blist_delslice(right, 0, ihigh);
-        blist_extend_blist(left, other); /* XXX check return values */
-        blist_extend_blist(left, right);
-
-        ext_mark(self, 0, DIRTY);
+        if (0 > forest_append(&forest, cur))
+                goto error2;
 
-        SAFE_DECREF(other);
-        SAFE_DECREF(right);
+        cur = blist_new();
+        if (cur == NULL)
+                goto error2;
+        cur->typecode = self->typecode;
 
-        decref_flush();
+        while (1) {
+                PyObject *raw;
 
-        return _int(0);
-}
+                err = typed_iternext(desc, it, &raw);
+                if (err < 0)
+                        goto error2;
+                if (err == 0)
+                        break;
 
-BLIST_PYAPI(int)
-py_blist_ass_subscript(PyObject *oself, PyObject *item, PyObject *value)
-{
-        PyBList *self;
+                if (cur->num_children == LIMIT) {
+                        if (forest_append(&forest, cur) < 0) goto error2;
+                        cur = blist_new();
+                        if (cur == NULL)
+                                goto error2;
+                        cur->typecode = self->typecode;
+                }
 
-        invariants(oself, VALID_USER|VALID_RW|VALID_DECREF);
+                cur->children[cur->num_children++] = raw;
+        }
 
-        self = (PyBList *) oself;
+        if (cur->num_children) {
+                if (forest_append(&forest, cur) < 0) goto error2;
+                cur->n = cur->num_children;
+        } else {
+                SAFE_DECREF(cur);
+        }
 
-        if (PyIndex_Check(item)) {
-                Py_ssize_t i;
-                PyObject *old_value;
+        final = forest_finish(&forest);
+        blist_become_and_consume(self, final);
+        SAFE_DECREF(final);
 
-                if (PyLong_CheckExact(item)) {
-                        i = PyInt_AsSsize_t(item);
-                        if (i == -1 && PyErr_Occurred()) {
-                                PyErr_Clear();
-                                goto number;
-                        }
-                } else {
-                number:
-                        i = PyNumber_AsSsize_t(item, PyExc_IndexError);
-                        if (i == -1 && PyErr_Occurred())
-                                return _int(-1);
-                }
-                if (i < 0)
-                        i += self->n;
+ done:
+        ext_reindex_set_all((PyBListRoot*)self);
+        decref_later(it);
+        return _int(0);
 
-                if (i >= self->n || i < 0) {
-                        set_index_error();
-                        return _int(-1);
-                }
+ error2:
+        DANGER_BEGIN;
+        Py_XDECREF((PyObject *) cur);
+        forest_uninit_now(&forest);
+        DANGER_END;
+ error:
+        DANGER_BEGIN;
+        Py_DECREF(it);
+        DANGER_END;
+        blist_CLEAR(self);
+        return _int(-1);
+}
 
-                if (self->leaf) {
-                        /* Speed up common cases */
+BLIST_LOCAL(int)
+typed_extend(PyBList *self, PyObject *other)
+{
+        int err;
+        PyBList *bother;
 
-                        old_value = self->children[i];
-                        if (value == NULL) {
-                                shift_left(self, i+1, 1);
-                                self->num_children--;
-                                self->n--;
-                        } else {
-                                self->children[i] = value;
-                                Py_INCREF(value);
-                        }
-                        DANGER_BEGIN;
-                        Py_DECREF(old_value);
-                        DANGER_END;
-                        return _int(0);
-                }
+        invariants(self, VALID_PARENT|VALID_RW);
 
-                if (value == NULL) {
-                        blist_delitem(self, i);
-                        ext_mark(self, 0, DIRTY);
-                        decref_flush();
-                        return _int(0);
-                }
+        if (PyTypedBList_Check(other)
+            && ((PyBList *) other)->typecode == self->typecode)
+                return _int(blist_extend_blist(self, (PyBList *) other));
 
-                Py_INCREF(value);
-                old_value = blist_ass_item_return2((PyBListRoot*)self,i,value);
-                DANGER_BEGIN;
-                Py_DECREF(old_value);
-                DANGER_END;
-                return _int(0);
-        } else if (PySlice_Check(item)) {
-                Py_ssize_t start, stop, step, slicelength;
+        bother = typed_root_new(self->typecode);
+        if (bother == NULL)
+                return _int(-1);
+        err = typed_init_from_seq(bother, other);
+        if (err >= 0)
+                err = blist_extend_blist(self, bother);
+        SAFE_DECREF(bother);
+        return _int(err);
+}
 
-                ext_mark(self, 0, DIRTY);
+/* Look for v in self[start:stop].  Returns the index of the first
+ * match, or -1 if there is none.  If pcount is not NULL, counts all
+ * of the matches into *pcount instead.  Returns -2 if a comparison
+ * raised an exception. */
+BLIST_LOCAL(Py_ssize_t)
+typed_find(PyBList *self, PyObject *v, Py_ssize_t start, Py_ssize_t stop,
+           Py_ssize_t *pcount)
+{
+        const typed_desc_t *desc = typed_desc(self->typecode);
+        typed_value_t key, x;
+        Py_ssize_t i, count = 0;
+        iter_t it;
+        int c, match;
 
-#if PY_MAJOR_VERSION < 3 || PY_MAJOR_VERSION == 3 && PY_MINOR_VERSION < 2
-                if (PySlice_GetIndicesEx((PySliceObject*)item, self->n,
-#else
-                if (PySlice_GetIndicesEx(item, self->n,
-#endif
-                                         &start, &stop,&step,&slicelength)<0)
-                        return _int(-1);
+        invariants(self, VALID_PARENT);
 
-                /* treat L[slice(a,b)] = v _exactly_ like L[a:b] = v */
-                if (step == 1 && ((PySliceObject*)item)->step == Py_None)
-                        return _redir(py_blist_ass_slice(oself,start,stop,value));
+        if (pcount)
+                *pcount = 0;
+        key.u = 0;
+        c = typed_probe(desc, v, &key);
+        if (c == 0 || start >= stop)
+                return _int(-1);
 
-                if (value == NULL) {
-                        /* Delete back-to-front */
-                        Py_ssize_t i, cur;
+        iter_init2(&it, self, start);
+        for (i = start; i < stop && typed_iter_next(&it, &x.ob); i++) {
+                if (c < 0) {
+                        match = typed_eq_slow(desc->kind, x.ob, v);
+                        if (match < 0)
+                                return _int(-2);
+                } else if (desc->kind == TYPED_FLOAT)
+                        match = x.d == key.d;
+                else
+                        match = x.ob == key.ob;
 
-                        if (slicelength <= 0)
-                                return _int(0);
+                if (match) {
+                        if (pcount == NULL)
+                                return _int(i);
+                        count++;
+                }
+        }
 
-                        if (step > 0) {
-                                stop = start - 1;
-                                start = start + step*(slicelength-1);
-                                step = -step;
-                        }
+        if (pcount)
+                *pcount = count;
+        return _int(-1);
+}
 
-                        for (cur = start, i = 0; i < slicelength;
-                             cur += step, i++) {
-                                PyObject *ob = blist_delitem_return(self, cur);
-                                decref_later(ob);
-                        }
+BLIST_LOCAL(PyObject *)
+typed_tolist(PyBList *self)
+{
+        int kind = typed_kind(self);
+        PyObject *lst, *raw, *ob;
+        Py_ssize_t i;
+        iter_t it;
 
-                        decref_flush();
-                        ext_mark(self, 0, DIRTY);
+        invariants(self, VALID_PARENT);
 
-                        return _int(0);
-                } else { /* assign slice */
-                        PyObject *ins, *seq;
-                        Py_ssize_t cur, i;
+        lst = PyList_New(self->n);
+        if (lst == NULL)
+                return _ob(NULL);
 
-                        DANGER_BEGIN;
-                        seq = PySequence_Fast(value,
-                                  "Must assign iterable to extended slice");
-                        DANGER_END;
-                        if (!seq)
-                                return _int(-1);
+        iter_init(&it, self);
+        for (i = 0; i < self->n && typed_iter_next(&it, &raw); i++) {
+                ob = typed_box(kind, raw);
+                if (ob == NULL) {
+                        Py_DECREF(lst);
+                        return _ob(NULL);
+                }
+                PyList_SET_ITEM(lst, i, ob);
+        }
 
-                        if (seq == (PyObject *) self) {
-                                Py_DECREF(seq);
-                                seq = (PyObject *) blist_root_copy(self);
-                        }
+        return _ob(lst);
+}
 
-                        if (PySequence_Fast_GET_SIZE(seq) != slicelength) {
-                                PyErr_Format(PyExc_ValueError,
-                                             "attempt to assign sequence of size %zd to extended slice of size %zd",
-                                             PySequence_Fast_GET_SIZE(seq),
-                                             slicelength);
-                                Py_DECREF(seq);
-                                return _int(-1);
-                        }
+/* Compare two raw values, of possibly different kinds, for equality */
+BLIST_LOCAL(int)
+typed_values_eq(int kind1, PyObject *raw1, int kind2, PyObject *raw2)
+{
+        typed_value_t v1, v2;
+        PyObject *ob;
+        int c;
 
-                        if (!slicelength) {
-                                Py_DECREF(seq);
-                                return _int(0);
-                        }
+        if (kind1 == kind2) {
+                if (kind1 != TYPED_FLOAT)
+                        return raw1 == raw2;
+                v1.ob = raw1;
+                v2.ob = raw2;
+                return v1.d == v2.d;
+        }
 
-                        for (cur = start, i = 0; i < slicelength;
-                             cur += step, i++) {
-                                PyObject *ob;
-                                ins = PySequence_Fast_GET_ITEM(seq, i);
-                                ob = blist_ass_item_return(self, cur, ins);
-                                decref_later(ob);
-                        }
+        ob = typed_box(kind2, raw2);
+        if (ob == NULL)
+                return -1;
+        c = typed_eq_slow(kind1, raw1, ob);
+        Py_DECREF(ob);
+        return c;
+}
 
-                        Py_DECREF(seq);
+BLIST_LOCAL(PyObject *)
+typed_richcompare(PyBList *v, PyBList *w, int op)
+{
+        int kind1 = typed_kind(v), kind2 = typed_kind(w);
+        PyObject *raw1 = NULL, *raw2 = NULL, *ob1, *ob2, *ret;
+        iter_t it1, it2;
+        int c = 1;
 
-                        decref_flush();
+        if (v->n != w->n && (op == Py_EQ || op == Py_NE))
+                /* Shortcut: if the lengths differ, the lists differ */
+                return blist_richcompare_len(v, w, op);
 
-                        return _int(0);
-                }
-        } else {
-                PyErr_SetString(PyExc_TypeError,
-                                "list indices must be integers");
-                return _int(-1);
+        /* Search for the first index where items are different */
+        iter_init(&it1, v);
+        iter_init(&it2, w);
+        while (typed_iter_next(&it1, &raw1) && typed_iter_next(&it2, &raw2)) {
+                c = typed_values_eq(kind1, raw1, kind2, raw2);
+                if (c != 1)
+                        break;
         }
+
+        if (c > 0)
+                return blist_richcompare_len(v, w, op);
+        if (c < 0)
+                return NULL;
+        if (op == Py_EQ)
+                Py_RETURN_FALSE;
+        if (op == Py_NE)
+                Py_RETURN_TRUE;
+
+        ob1 = typed_box(kind1, raw1);
+        ob2 = typed_box(kind2, raw2);
+        if (ob1 == NULL || ob2 == NULL)
+                ret = NULL;
+        else
+                ret = PyObject_RichCompare(ob1, ob2, op);
+        Py_XDECREF(ob1);
+        Py_XDECREF(ob2);
+        return ret;
 }
 
-BLIST_PYAPI(Py_ssize_t)
-py_blist_length(PyObject *ob)
+#define TYPED_SIGN (((PY_UINT64_T) 1) << 63)
+
+/* Map a raw value to an unsigned integer with the same order */
+BLIST_LOCAL_INLINE(PY_UINT64_T)
+typed_sort_key(int kind, PY_UINT64_T u)
 {
-        assert(PyRootBList_Check(ob));
-        return ((PyBList *) ob)->n;
+        if (kind == TYPED_INT)
+                return u ^ TYPED_SIGN;
+        if (kind == TYPED_FLOAT)
+                return u ^ ((-(PY_INT64_T) (u >> 63)) | TYPED_SIGN);
+        return u;
 }
 
-BLIST_PYAPI(PyObject *)
-py_blist_repeat(PyObject *oself, Py_ssize_t n)
+/* The inverse of typed_sort_key() */
+BLIST_LOCAL_INLINE(PY_UINT64_T)
+typed_sort_unkey(int kind, PY_UINT64_T k)
 {
-        PyObject *ret;
-        PyBList *self;
+        if (kind == TYPED_INT)
+                return k ^ TYPED_SIGN;
+        if (kind == TYPED_FLOAT)
+                return (k & TYPED_SIGN) ? k ^ TYPED_SIGN : ~k;
+        return k;
+}
 
-        invariants(oself, VALID_USER|VALID_DECREF);
+#define TYPED_PASSES (64 / BITS_PER_PASS)
 
-        self = (PyBList *) oself;
+/* Like sort_uint64(), but for bare keys */
+BLIST_LOCAL(int)
+typed_radix_sort(PY_UINT64_T *restrict keys, Py_ssize_t n)
+{
+        PY_UINT64_T *restrict scratch, *from, *to, *tmp;
+        Py_ssize_t i, j, sums[TYPED_PASSES], count[TYPED_PASSES], tsum;
+        Py_ssize_t (*histograms)[TYPED_PASSES];
 
-        ret = blist_repeat(self, n);
-        decref_flush();
-        ext_mark_set_dirty_all(self);
+        memset(sums, 0, sizeof sums);
+        memset(count, 0, sizeof count);
 
-        return _ob(ret);
-}
+        scratch = PyMem_New(PY_UINT64_T, n);
+        if (scratch == NULL)
+                return -1;
 
-BLIST_PYAPI(PyObject *)
-py_blist_inplace_repeat(PyObject *oself, Py_ssize_t n)
-{
-        PyBList *tmp, *self;
+        histograms = PyMem_Malloc(HISTOGRAM_SIZE * sizeof *histograms);
+        if (histograms == NULL) {
+                PyMem_Free(scratch);
+                return -1;
+        }
+        memset(histograms, 0, HISTOGRAM_SIZE * sizeof *histograms);
 
-        invariants(oself, VALID_USER|VALID_RW|VALID_DECREF);
+        for (i = 0; i < n; i++) {
+                PY_UINT64_T v = keys[i];
+                for (j = 0; j < TYPED_PASSES; j++)
+                        histograms[(v >> (BITS_PER_PASS * j)) & MASK][j]++;
+        }
 
-        self = (PyBList *) oself;
+        for (i = 0; i < HISTOGRAM_SIZE; i++) {
+                for (j = 0; j < TYPED_PASSES; j++) {
+                        count[j] += !!histograms[i][j];
+                        tsum = histograms[i][j] + sums[j];
+                        histograms[i][j] = sums[j] - 1;
+                        sums[j] = tsum;
+                }
+        }
 
-        tmp = (PyBList *) blist_repeat(self, n);
-        if (tmp == NULL)
-                return (PyObject *) _blist(NULL);
-        blist_become_and_consume(self, tmp);
-        Py_INCREF(self);
-        SAFE_DECREF(tmp);
+        from = keys;
+        to = scratch;
+        for (j = 0; j < TYPED_PASSES; j++) {
+                if (count[j] == 1) continue;
+                for (i = 0; i < n; i++) {
+                        PY_UINT64_T fi = from[i];
+                        Py_ssize_t pos = (fi >> (BITS_PER_PASS * j)) & MASK;
+                        to[++histograms[pos][j]] = fi;
+                }
 
-        decref_flush();
+                tmp = from;
+                from = to;
+                to = tmp;
+        }
 
-        ext_mark(self, 0, DIRTY);
+        if (from != keys)
+                memcpy(keys, from, n * sizeof *keys);
 
-        return (PyObject *) _blist(self);
+        PyMem_Free(histograms);
+        PyMem_Free(scratch);
+        return 0;
 }
 
-BLIST_PYAPI(PyObject *)
-py_blist_extend(PyBList *self, PyObject *other)
+/* Sort the typed blist in place.  Equal keys have equal bit patterns,
+ * so stability does not matter and we sort the keys alone, mapping
+ * them back to values afterwards.  For the same reason, a reverse
+ * sort is a forward sort followed by a reversal. */
+BLIST_LOCAL(int)
+typed_sort(PyBListRoot *self, int reverse)
 {
-        int err;
+        int kind = typed_kind(self);
+        PY_UINT64_T *keys, key;
+        typed_value_t v;
+        PyBList *leaf;
+        Py_ssize_t i, j, k, num_leafs;
 
-        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
+        invariants(self, VALID_ROOT|VALID_RW);
 
-        err = blist_extend(self, other);
-        decref_flush();
-        ext_mark(self, 0, DIRTY);
-        if (PyBList_Check(other))
-                ext_mark_set_dirty_all((PyBList *) other);
+        keys = PyMem_New(PY_UINT64_T, self->n);
+        if (keys == NULL) {
+                PyErr_NoMemory();
+                return _int(-1);
+        }
 
-        if (err < 0)
-                return _ob(NULL);
-        Py_RETURN_NONE;
-}
+        linearize_rw(self);
+        num_leafs = self->leaf ? 1 : INDEX_LENGTH(self);
 
-BLIST_PYAPI(PyObject *)
-py_blist_inplace_concat(PyObject *oself, PyObject *other)
-{
-        int err;
-        PyBList *self;
+        for (k = i = 0; i < num_leafs; i++) {
+                leaf = self->leaf ? (PyBList *) self : self->index_list[i];
+                if (i && leaf == self->index_list[i-1])
+                        continue;
+                for (j = 0; j < leaf->num_children; j++) {
+                        v.ob = leaf->children[j];
+                        keys[k++] = typed_sort_key(kind, v.u);
+                }
+        }
+        assert(k == self->n);
 
-        invariants(oself, VALID_RW|VALID_USER|VALID_DECREF);
+        if (self->n < 40) {
+                for (i = 1; i < self->n; i++) {
+                        key = keys[i];
+                        for (j = i; j > 0 && keys[j-1] > key; j--)
+                                keys[j] = keys[j-1];
+                        keys[j] = key;
+                }
+        } else if (typed_radix_sort(keys, self->n) < 0) {
+                PyMem_Free(keys);
+                PyErr_NoMemory();
+                return _int(-1);
+        }
 
-        self = (PyBList *) oself;
+        for (k = i = 0; i < num_leafs; i++) {
+                leaf = self->leaf ? (PyBList *) self : self->index_list[i];
+                if (i && leaf == self->index_list[i-1])
+                        continue;
+                for (j = 0; j < leaf->num_children; j++) {
+                        v.u = typed_sort_unkey(kind, keys[k++]);
+                        leaf->children[j] = v.ob;
+                }
+        }
 
-        err = blist_extend(self, other);
-        decref_flush();
-        ext_mark(self, 0, DIRTY);
-        if (PyBList_Check(other))
-                ext_mark_set_dirty_all((PyBList*) other);
+        PyMem_Free(keys);
 
-        if (err < 0)
-                return _ob(NULL);
+        if (reverse)
+                blist_reverse(self);
 
-        Py_INCREF(self);
-        return _ob((PyObject *)self);
+        return _int(0);
 }
 
-BLIST_PYAPI(int)
-py_blist_contains(PyObject *oself, PyObject *el)
+/************************************************************************
+ * Typed BList iterator
+ */
+
+typedef struct {
+        PyObject_HEAD
+        iter_t iter;            /* Same layout as a blistiterobject */
+        int kind;
+} typediterobject;
+
+BLIST_PYAPI(PyObject *)
+py_typed_iter(PyObject *oseq)
 {
-        int c, ret = 0;
-        PyObject *item;
-        PyBList *self;
-        fast_compare_data_t fast_cmp_type;
+        PyBList *seq;
+        typediterobject *it;
 
-        invariants(oself, VALID_USER | VALID_DECREF);
+        seq = (PyBList *) oseq;
 
-        self = (PyBList *) oself;
-        fast_cmp_type = check_fast_cmp_type(el, Py_EQ);
+        invariants(seq, VALID_USER);
 
-        ITER(self, item, {
-                c = fast_eq(el, item, fast_cmp_type);
-                if (c < 0) {
-                        ret = -1;
-                        break;
-                }
-                if (c > 0) {
-                        ret = 1;
-                        break;
-                }
-        });
+        DANGER_BEGIN;
+        it = PyObject_GC_New(typediterobject, &PyTypedBListIter_Type);
+        DANGER_END;
+        if (it == NULL)
+                return _ob(NULL);
 
-        decref_flush();
-        return _int(ret);
+        iter_init(&it->iter, seq);
+        Py_INCREF(seq);
+        it->kind = typed_kind(seq);
+
+        PyObject_GC_Track(it);
+        return _ob((PyObject *) it);
 }
 
-BLIST_PYAPI(PyObject *)
-py_blist_get_slice(PyObject *oself, Py_ssize_t ilow, Py_ssize_t ihigh)
+static void typediter_dealloc(PyObject *oit)
 {
-        PyBList *rv, *self;
-
-        invariants(oself, VALID_USER | VALID_DECREF);
-
-        self = (PyBList *) oself;
+        typediterobject *it = (typediterobject *) oit;
 
-        if (ilow < 0) ilow = 0;
-        else if (ilow > self->n) ilow = self->n;
-        if (ihigh < ilow) ihigh = ilow;
-        else if (ihigh > self->n) ihigh = self->n;
+        PyObject_GC_UnTrack(it);
+        decref_later((PyObject *) it->iter.lst);
+        PyObject_GC_Del(it);
+        _decref_flush();
+}
 
-        rv = blist_root_new();
-        if (rv == NULL)
-                return (PyObject *) _blist(NULL);
+static int typediter_traverse(PyObject *oit, visitproc visit, void *arg)
+{
+        typediterobject *it = (typediterobject *) oit;
 
-        if (ihigh <= ilow || ilow >= self->n)
-                return (PyObject *) _blist(rv);
+        Py_VISIT(it->iter.lst);
+        return 0;
+}
 
-        if (self->leaf) {
-                Py_ssize_t delta = ihigh - ilow;
+static PyObject *typediter_next(PyObject *oit)
+{
+        typediterobject *it = (typediterobject *) oit;
+        PyObject *raw = NULL;
+        int more;
 
-                copyref(rv, 0, self, ilow, delta);
-                rv->num_children = delta;
-                rv->n = delta;
-                return (PyObject *) _blist(rv);
-        }
+        more = typed_iter_next(&it->iter, &raw);
+        if (!more)
+                return NULL;
+        return typed_box(it->kind, raw);
+}
 
-        blist_become(rv, self);
-        blist_delslice(rv, ihigh, self->n);
-        blist_delslice(rv, 0, ilow);
+static PyMethodDef typediter_methods[] = {
+        {"__length_hint__", (PyCFunction)blistiter_len, METH_NOARGS, length_hint_doc},
+        {NULL,          NULL}           /* sentinel */
+};
 
-        ext_mark(rv, 0, DIRTY);
-        ext_mark_set_dirty(self, ilow, ihigh);
-        decref_flush();
+PyTypeObject PyTypedBListIter_Type = {
+        PyVarObject_HEAD_INIT(NULL, 0)
+        "typedblistiterator",                   /* tp_name */
+        sizeof(typediterobject),                /* tp_basicsize */
+        0,                                      /* tp_itemsize */
+        /* methods */
+        typediter_dealloc,                      /* tp_dealloc */
+        0,                                      /* tp_print */
+        0,                                      /* tp_getattr */
+        0,                                      /* tp_setattr */
+        0,                                      /* tp_compare */
+        0,                                      /* tp_repr */
+        0,                                      /* tp_as_number */
+        0,                                      /* tp_as_sequence */
+        0,                                      /* tp_as_mapping */
+        0,                                      /* tp_hash */
+        0,                                      /* tp_call */
+        0,                                      /* tp_str */
+        PyObject_GenericGetAttr,                /* tp_getattro */
+        0,                                      /* tp_setattro */
+        0,                                      /* tp_as_buffer */
+        Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,/* tp_flags */
+        0,                                      /* tp_doc */
+        typediter_traverse,                     /* tp_traverse */
+        0,                                      /* tp_clear */
+        0,                                      /* tp_richcompare */
+        0,                                      /* tp_weaklistoffset */
+        PyObject_SelfIter,                      /* tp_iter */
+        typediter_next,                         /* tp_iternext */
+        typediter_methods,                      /* tp_methods */
+        0,                                      /* tp_members */
+};
 
-        return (PyObject *) _blist(rv);
-}
+/************************************************************************
+ * Typed BList functions callable directly by the interpreter.  The
+ * rules for the blist ones apply.  Anything that does not look at the
+ * values themselves (len, *, reverse, clear, copy, plain slicing) is
+ * shared with blist.
+ */
 
-/* This should only be called by _PyBList_GET_ITEM_FAST2() */
-PyObject *_PyBList_GetItemFast3(PyBListRoot *root, Py_ssize_t i)
+BLIST_PYAPI(PyObject *)
+py_typed_tp_new(PyTypeObject *subtype, PyObject *args, PyObject *kwds)
 {
-        PyObject *rv;
-        Py_ssize_t dirty_offset = -1;
-
-        invariants(root, VALID_PARENT);
-        assert(!root->leaf);
-        assert(root->dirty_root != CLEAN);
-        assert(i >= 0);
-        assert(i < root->n);
+        static char *kwlist[] = {"typecode", "iterable", 0};
+        PyObject *arg = NULL;
+        PyBList *self;
+#if PY_MAJOR_VERSION < 3
+        char typecode;
 
-        if (ext_is_dirty(root, i, &dirty_offset)){
-                rv = ext_make_clean(root, i);
-        } else {
-                Py_ssize_t ioffset = i / INDEX_FACTOR;
-                Py_ssize_t offset = root->offset_list[ioffset];
-                PyBList *p = root->index_list[ioffset];
-                assert(i >= offset);
-                assert(p);
-                assert(p->leaf);
-                if (i < offset + p->n) {
-                        rv = p->children[i - offset];
-                        if (dirty_offset >= 0)
-                                ext_make_clean(root, dirty_offset);
-                } else if (ext_is_dirty(root,i + INDEX_FACTOR,&dirty_offset)){
-                        rv = ext_make_clean(root, i);
-                } else {
-                        ioffset++;
-                        assert(ioffset < root->index_allocated);
-                        offset = root->offset_list[ioffset];
-                        p = root->index_list[ioffset];
-                        rv = p->children[i - offset];
-                        assert(p);
-                        assert(p->leaf);
-                        assert(i < offset + p->n);
-                        if (dirty_offset >= 0)
-                                ext_make_clean(root, dirty_offset);
-                }
+        if (!PyArg_ParseTupleAndKeywords(args, kwds, "c|O:typedblist",
+                                         kwlist, &typecode, &arg))
+                return NULL;
+#else
+        int typecode;
+
+        if (!PyArg_ParseTupleAndKeywords(args, kwds, "C|O:typedblist",
+                                         kwlist, &typecode, &arg))
+                return NULL;
+#endif
+        if (typed_desc(typecode) == NULL) {
+                PyErr_SetString(PyExc_ValueError,
+                                "bad typecode (must be b, B, h, H, i, I, "
+                                "l, L, q, Q, f or d)");
+                return NULL;
         }
 
-        assert(rv == blist_get1((PyBList *)root, i));
+        if (subtype == &PyTypedBList_Type)
+                return (PyObject *) typed_root_new(typecode);
 
-        return _ob(rv);
+        self = (PyBList *) subtype->tp_alloc(subtype, 0);
+        if (self == NULL)
+                return NULL;
+
+        self->leaf = 1;
+        self->typecode = typecode;
+        ((PyBListRoot *)self)->tail = NULL;
+        ext_init((PyBListRoot *)self);
+        counts_init((PyBListRoot *)self);
+
+        return (PyObject *) self;
 }
 
-BLIST_PYAPI(PyObject *)
-py_blist_get_item(PyObject *oself, Py_ssize_t i)
+BLIST_PYAPI(int)
+py_typed_init(PyObject *oself, PyObject *args, PyObject *kw)
 {
-        PyBList *self = (PyBList *) oself;
-        PyObject *ret;
+        int ret;
+        PyObject *arg = NULL;
+        static char *kwlist[] = {"typecode", "iterable", 0};
+        int err;
+        PyBList *self;
+#if PY_MAJOR_VERSION < 3
+        char typecode;
+#else
+        int typecode;
+#endif
 
-        invariants(self, VALID_USER);
+        invariants(oself, VALID_USER|VALID_DECREF);
+        self = (PyBList *) oself;
 
-        if (i < 0 || i >= self->n) {
-                set_index_error();
-                return _ob(NULL);
+        DANGER_BEGIN;
+#if PY_MAJOR_VERSION < 3
+        err = PyArg_ParseTupleAndKeywords(args, kw, "c|O:typedblist", kwlist,
+                                          &typecode, &arg);
+#else
+        err = PyArg_ParseTupleAndKeywords(args, kw, "C|O:typedblist", kwlist,
+                                          &typecode, &arg);
+#endif
+        DANGER_END;
+        if (!err)
+                return _int(-1);
+
+        if (typecode != self->typecode) {
+                PyErr_SetString(PyExc_ValueError,
+                                "cannot change the typecode of a typedblist");
+                return _int(-1);
         }
 
-        if (self->leaf)
-                ret = self->children[i];
-        else
-                ret = _PyBList_GET_ITEM_FAST2((PyBListRoot*)self, i);
-        Py_INCREF(ret);
-        return _ob(ret);
+        if (self->n) {
+                blist_CLEAR(self);
+                ext_dealloc((PyBListRoot *) self);
+        }
+
+        ret = arg == NULL ? 0 : typed_init_from_seq(self, arg);
+
+        decref_flush(); /* Needed due to blist_CLEAR() call */
+        return _int(ret);
 }
 
-/* Note: this may be called as __radd__, which means the arguments may
- * be reversed. */
 BLIST_PYAPI(PyObject *)
-py_blist_concat(PyObject *ob1, PyObject *ob2)
+py_typed_richcompare(PyObject *v, PyObject *w, int op)
 {
-        PyBList *rv;
-        int err;
-
-        int is_blist1 = PyRootBList_Check(ob1);
-        int is_blist2 = PyRootBList_Check(ob2);
+        PyObject *rv;
 
-        if ((!is_blist1 && !PyList_Check(ob1))
-            || (!is_blist2 && !PyList_Check(ob2))) {
+        if (!PyTypedBList_Check(v) || !PyTypedBList_Check(w)) {
                 Py_INCREF(Py_NotImplemented);
                 return Py_NotImplemented;
         }
 
-        if (is_blist1 && is_blist2) {
-                PyBList *blist1 = (PyBList *) ob1;
-                PyBList *blist2 = (PyBList *) ob2;
-                if (blist1->n < LIMIT && blist2->n < LIMIT
-                    && blist1->n + blist2->n < LIMIT) {
-                        rv = blist_root_new();
-                        copyref(rv, 0, blist1, 0, blist1->n);
-                        copyref(rv, blist1->n, blist2, 0, blist2->n);
-                        rv->n = rv->num_children = blist1->n + blist2->n;
-                        goto done;
-                }
+        invariants((PyBList *) v, VALID_USER|VALID_DECREF);
+        rv = typed_richcompare((PyBList *) v, (PyBList *) w, op);
+        decref_flush();
+        return _ob(rv);
+}
 
-                rv = blist_root_copy(blist1);
-                blist_extend_blist(rv, blist2);
-                ext_mark(rv, 0, DIRTY);
-                ext_mark_set_dirty_all(blist2);
-                goto done;
-        }
+BLIST_PYAPI(PyObject *)
+py_typed_repr(PyObject *oself)
+{
+        PyBList *self;
+        PyObject *lst, *result;
 
-        rv = blist_root_new();
-        err = blist_init_from_seq(rv, ob1);
-        if (err < 0) {
-                decref_later((PyObject *) rv);
-                rv = NULL;
-                goto done;
-        }
-        err = blist_extend(rv, ob2);
-        if (err < 0) {
-                decref_later((PyObject *) rv);
-                rv = NULL;
-                goto done;
-        }
-        ext_mark(rv, 0, DIRTY);
-        if (PyBList_Check(ob1))
-                ext_mark_set_dirty_all((PyBList *) ob1);
-        if (PyBList_Check(ob2))
-                ext_mark_set_dirty_all((PyBList *) ob2);
+        invariants(oself, VALID_USER|VALID_DECREF);
+        self = (PyBList *) oself;
 
-done:
-        _decref_flush();
-        return (PyObject *) rv;
+        if (self->n == 0)
+                return _ob(PyUnicode_FromFormat("typedblist('%c')",
+                                                self->typecode));
+
+        lst = typed_tolist(self);
+        decref_flush();
+        if (lst == NULL)
+                return _ob(NULL);
+        result = PyUnicode_FromFormat("typedblist('%c', %R)",
+                                      self->typecode, lst);
+        Py_DECREF(lst);
+        return _ob(result);
 }
 
-/* User-visible repr() */
 BLIST_PYAPI(PyObject *)
-py_blist_repr(PyObject *oself)
+py_typed_tolist(PyBList *self)
 {
-        /* Basic approach: Clone self in O(1) time, then walk through
-         * the clone, changing each element to repr() of the element,
-         * in O(n) time.  Finally, enclose it in square brackets and
-         * call join.
-         */
+        PyObject *lst;
 
-        Py_ssize_t i;
-        PyBList *pieces = NULL, *self;
-        PyObject *result = NULL;
-        PyObject *s, *tmp, *tmp2;
+        invariants(self, VALID_USER|VALID_DECREF);
 
-        invariants(oself, VALID_USER);
-        self = (PyBList *) oself;
+        lst = typed_tolist(self);
+        decref_flush();
+        return _ob(lst);
+}
 
-        DANGER_BEGIN;
-        i = Py_ReprEnter((PyObject *) self);
-        DANGER_END;
-        if (i) {
-                return i > 0 ? _ob(PyUnicode_FromString("[...]")) : _ob(NULL);
-        }
+BLIST_PYAPI(PyObject *)
+py_typed_reduce(PyBList *self)
+{
+        PyObject *lst, *typecode;
 
-        if (self->n == 0) {
-#ifdef Py_BUILD_CORE
-                result = PyUnicode_FromString("[]");
-#else
-                result = PyUnicode_FromString("blist([])");
-#endif
-                goto Done;
-        }
+        invariants(self, VALID_USER|VALID_DECREF);
 
-        pieces = blist_root_copy(self);
-        if (pieces == NULL)
-                goto Done;
+        lst = typed_tolist(self);
+        decref_flush();
+        if (lst == NULL)
+                return _ob(NULL);
+        typecode = typed_typecode_object(self->typecode);
+        if (typecode == NULL) {
+                Py_DECREF(lst);
+                return _ob(NULL);
+        }
 
-        if (blist_repr_r(pieces) < 0)
-                goto Done;
+        return _ob(Py_BuildValue("(O(NN))", Py_TYPE(self), typecode, lst));
+}
 
-#ifdef Py_BUILD_CORE
-        s = PyUnicode_FromString("[");
-#else
-        s = PyUnicode_FromString("blist([");
-#endif
-        if (s == NULL)
-                goto Done;
-        tmp = blist_get1(pieces, 0);
-        tmp2 = PyUnicode_Concat(s, tmp);
-        Py_DECREF(s);
-        s = tmp2;
-        DANGER_BEGIN;
-        py_blist_ass_item((PyObject *) pieces, 0, s);
-        DANGER_END;
-        Py_DECREF(s);
+BLIST_PYAPI(PyObject *)
+py_typed_get_typecode(PyBList *self, void *closure)
+{
+        return typed_typecode_object(self->typecode);
+}
 
-#ifdef Py_BUILD_CORE
-        s = PyUnicode_FromString("]");
-#else
-        s = PyUnicode_FromString("])");
-#endif
-        if (s == NULL)
-                goto Done;
-        tmp = blist_get1(pieces, pieces->n-1);
-        tmp2 = PyUnicode_Concat(tmp, s);
-        Py_DECREF(s);
-        tmp = tmp2;
-        DANGER_BEGIN;
-        py_blist_ass_item((PyObject *) pieces, pieces->n-1, tmp);
-        DANGER_END;
-        Py_DECREF(tmp);
+BLIST_PYAPI(PyObject *)
+py_typed_get_item(PyObject *oself, Py_ssize_t i)
+{
+        PyBList *self = (PyBList *) oself;
 
-        s = PyUnicode_FromString(", ");
-        if (s == NULL)
-                goto Done;
-        result = PyUnicode_Join(s, (PyObject *) pieces);
-        Py_DECREF(s);
+        invariants(self, VALID_USER);
 
- Done:
-        DANGER_BEGIN;
-        /* Only deallocating strings, so this is safe */
-        Py_XDECREF(pieces);
-        DANGER_END;
+        if (i < 0 || i >= self->n) {
+                set_index_error();
+                return _ob(NULL);
+        }
 
-        DANGER_BEGIN;
-        Py_ReprLeave((PyObject *) self);
-        DANGER_END;
-        return _ob(result);
+        return _ob(typed_box(typed_kind(self), typed_get(self, i)));
 }
 
-#if defined(Py_DEBUG) && !defined(BLIST_IN_PYTHON)
-/* Return a string that shows the internal structure of the BList */
-BLIST_PYAPI(PyObject *)
-blist_debug(PyBList *self, PyObject *indent)
+BLIST_PYAPI(int)
+py_typed_ass_item(PyObject *oself, Py_ssize_t i, PyObject *v)
 {
-        PyObject *result, *s, *nl_indent, *comma, *indent2, *tmp, *tmp2;
+        PyObject *raw;
+        PyBList *self;
 
-        invariants(self, VALID_PARENT);
+        invariants(oself, VALID_USER|VALID_RW|VALID_DECREF);
 
-        comma = PyUnicode_FromString(", ");
+        self = (PyBList *) oself;
 
-        if (indent == NULL)
-                indent = PyUnicode_FromString("");
-        else
-                Py_INCREF(indent);
+        /* Unbox first, since it may run code that changes self */
+        if (v != NULL && typed_pack(typed_desc(self->typecode), v, &raw) < 0)
+                return _int(-1);
 
-        tmp = PyUnicode_FromString("  ");
-        indent2 = PyUnicode_Concat(indent, tmp);
-        Py_DECREF(tmp);
+        if (i >= self->n || i < 0) {
+                set_index_error();
+                return _int(-1);
+        }
 
-        if (!self->leaf) {
-                int i;
+        if (v == NULL) {
+                blist_delitem(self, i);
+                ext_mark(self, 0, DIRTY);
+        } else
+                typed_set(self, i, raw);
 
-                nl_indent = indent2;
-                tmp = PyUnicode_FromString("\n");
-                nl_indent = PyUnicode_Concat(indent2, tmp);
-                Py_DECREF(tmp);
+        decref_flush();
+        return _int(0);
+}
+
+BLIST_PYAPI(int)
+py_typed_ass_slice(PyObject *oself, Py_ssize_t ilow, Py_ssize_t ihigh,
+                   PyObject *v)
+{
+        Py_ssize_t net;
+        PyBList *other = NULL, *left, *right, *self;
 
-                result = PyUnicode_FromFormat("blist(leaf=%d, n=%d, r=%d, ",
-                                             self->leaf, self->n,
-                                             Py_REFCNT(self));
-                /* PyUnicode_Concat(&result, nl_indent); */
+        invariants(oself, VALID_RW|VALID_USER|VALID_DECREF);
 
-                for (i = 0; i < self->num_children; i++) {
-                        s = blist_debug((PyBList *)self->children[i], indent2);
-                        tmp = PyUnicode_Concat(result, nl_indent);
-                        Py_DECREF(result);
-                        result = tmp;
-                        tmp = PyUnicode_Concat(result, s);
-                        Py_DECREF(result);
-                        result = tmp;
-                        Py_DECREF(s);
+        self = (PyBList *) oself;
+
+        if (v) {
+                /* Unbox first, since it may run code that changes self */
+                other = typed_root_new(self->typecode);
+                if (other == NULL)
+                        return _int(-1);
+                if (typed_init_from_seq(other, v) < 0) {
+                        decref_later((PyObject *) other);
+                        decref_flush();
+                        return _int(-1);
                 }
+        }
 
-                tmp = PyUnicode_FromString(")");
-                tmp2 = PyUnicode_Concat(result, tmp);
-                Py_DECREF(result);
-                Py_DECREF(tmp);
-                result = tmp2;
-        } else {
-                int i;
+        if (ilow < 0) ilow = 0;
+        else if (ilow > self->n) ilow = self->n;
+        if (ihigh < ilow) ihigh = ilow;
+        else if (ihigh > self->n) ihigh = self->n;
 
-                result = PyUnicode_FromFormat("blist(leaf=%d, n=%d, r=%d, ",
-                                             self->leaf, self->n,
-                                             Py_REFCNT(self));
-                for (i = 0; i < self->num_children; i++) {
-                        s = PyObject_Str(self->children[i]);
-                        tmp = PyUnicode_Concat(result, s);
-                        Py_DECREF(result);
-                        result = tmp;
-                        Py_DECREF(s);
-                        tmp = PyUnicode_Concat(result, comma);
-                        Py_DECREF(result);
-                        result = tmp;
+        if (!v) {
+                blist_delslice(self, ilow, ihigh);
+                ext_mark(self, 0, DIRTY);
+                decref_flush();
+                return _int(0);
+        }
+
+        net = other->n - (ihigh - ilow);
+
+        /* Special case small lists */
+        if (self->leaf && other->leaf && (self->n + net <= LIMIT))
+        {
+                if (blist_reserve(self, self->n + net) < 0) {
+                        SAFE_DECREF(other);
+                        decref_flush();
+                        return _int(-1);
                 }
+                if (net >= 0)
+                        shift_right(self, ihigh, net);
+                else
+                        shift_left(self, ihigh, -net);
+                self->num_children += net;
+                copyref(self, ilow, other, 0, other->n);
+                SAFE_DECREF(other);
+                blist_adjust_n(self);
+                decref_flush();
+                return _int(0);
         }
 
-        s = indent;
-        tmp = PyUnicode_Concat(s, result);
-        Py_DECREF(result);
-        result = tmp;
+        left = self;
+        right = blist_root_copy(self);
+        blist_delslice(left, ilow, left->n);
+        blist_delslice(right, 0, ihigh);
+        blist_extend_blist(left, other); /* XXX check return values */
+        blist_extend_blist(left, right);
 
-        Py_DECREF(comma);
-        Py_DECREF(indent);
-        check_invariants(self);
-        return _ob(result);
-}
+        ext_mark(self, 0, DIRTY);
 
-BLIST_PYAPI(PyObject *)
-py_blist_debug(PyBList *self)
-{
-        invariants(self, VALID_USER);
-        return _ob(blist_debug(self, NULL));
+        SAFE_DECREF(other);
+        SAFE_DECREF(right);
+
+        decref_flush();
+
+        return _int(0);
 }
-#endif
 
 BLIST_PYAPI(PyObject *)
-py_blist_sort(PyBListRoot *self, PyObject *args, PyObject *kwds)
+py_typed_subscript(PyObject *oself, PyObject *item)
 {
-#if PY_MAJOR_VERSION < 3
-        static char *kwlist[] = {"cmp", "key", "reverse", 0};
-#else
-        static char *kwlist[] = {"key", "reverse", 0};
-#endif
-        int reverse = 0;
-        int ret = -1;
-        PyBListRoot saved;
-        PyObject *result = NULL;
-        PyObject *compare = NULL, *keyfunc = NULL;
-        static PyObject **extra_list = NULL;
+        PyBList *self;
 
-        invariants(self, VALID_USER|VALID_RW | VALID_DECREF);
+        invariants(oself, VALID_USER);
 
-        if (args != NULL) {
-                int err;
-                DANGER_BEGIN;
-#if PY_MAJOR_VERSION < 3
-                err = PyArg_ParseTupleAndKeywords(args, kwds, "|OOi:sort",
-                                                  kwlist, &compare, &keyfunc,
-                                                  &reverse);
-                DANGER_END;
-                if (!err)
-                        return _ob(NULL);
-#else
-                err = PyArg_ParseTupleAndKeywords(args, kwds, "|Oi:sort",
-                                                  kwlist, &keyfunc, &reverse);
-                DANGER_END;
-                if (!err)
+        self = (PyBList *) oself;
+
+        if (PyIndex_Check(item)) {
+                Py_ssize_t i;
+
+                i = PyNumber_AsSsize_t(item, PyExc_IndexError);
+                if (i == -1 && PyErr_Occurred())
                         return _ob(NULL);
-                if (Py_SIZE(args) > 0) {
-                        PyErr_SetString(PyExc_TypeError,
-                                "must use keyword argument for key function");
+
+                if (i < 0)
+                        i += self->n;
+
+                if (i < 0 || i >= self->n) {
+                        set_index_error();
                         return _ob(NULL);
                 }
-#endif
-        }
 
-        if (self->n < 2)
-                Py_RETURN_NONE;
+                return _ob(typed_box(typed_kind(self), typed_get(self, i)));
+        } else if (PySlice_Check(item)) {
+                Py_ssize_t start, stop, step, slicelength, cur, i;
+                PyBList* result;
 
-#if PY_MAJOR_VERSION < 3
-        if (is_default_cmp(compare))
-                compare = NULL;
+#if PY_MAJOR_VERSION < 3 || PY_MAJOR_VERSION == 3 && PY_MINOR_VERSION < 2
+                if (PySlice_GetIndicesEx((PySliceObject*)item, self->n,
+#else
+                if (PySlice_GetIndicesEx(item, self->n,
 #endif
-        if (keyfunc == Py_None)
-                keyfunc = NULL;
-
-        memset(&saved, 0, offsetof(PyBListRoot, BLIST_FIRST_FIELD));
-        memcpy(&saved.BLIST_FIRST_FIELD, &self->BLIST_FIRST_FIELD,
-               sizeof(*self) - offsetof(PyBListRoot, BLIST_FIRST_FIELD));
-        Py_TYPE(&saved) = &PyRootBList_Type;
-        Py_REFCNT(&saved) = 1;
-
-        if (extra_list != NULL) {
-                self->children = extra_list;
-                extra_list = NULL;
-        } else {
-                self->children = PyMem_New(PyObject *, LIMIT);
-                if (self->children == NULL) {
-                        PyErr_NoMemory();
-                        goto err;
+                                         &start, &stop,&step,&slicelength)<0) {
+                        return _ob(NULL);
                 }
-        }
-        self->n = 0;
-        self->num_children = 0;
-        self->leaf = 1;
-        ext_init(self);
 
-        /* Reverse sort stability achieved by initially reversing the list,
-           applying a stable forward sort, then reversing the final result. */
-        if (reverse)
-                blist_reverse(&saved);
+                if (step == 1)
+                        return _redir((PyObject *)
+                                      py_blist_get_slice((PyObject *) self, start, stop));
 
-        ret = sort(&saved, compare, keyfunc);
+                result = blist_root_new_like(self);
+                if (result == NULL || slicelength <= 0)
+                        return _ob((PyObject *) result);
 
-        if (ret >= 0) {
-                result = Py_None;
-                if (reverse) {
-                        ext_mark((PyBList*)&saved, 0, DIRTY);
-                        blist_reverse(&saved);
+                for (cur = start, i = 0; i < slicelength; cur += step, i++) {
+                        if (blist_append(result, blist_get1(self, cur)) < 0) {
+                                Py_DECREF(result);
+                                return _ob(NULL);
+                        }
                 }
-        } else
-                ext_mark((PyBList*)&saved, 0, DIRTY);
 
-        if (self->n && saved.n) {
-                DANGER_BEGIN;
-                /* An error may also have been raised by a comparison
-                 * function.  Since this may decref that traceback, it can
-                 * execute arbitrary python code. */
-                PyErr_SetString(PyExc_ValueError, "list modified during sort");
-                DANGER_END;
-                result = NULL;
-                blist_CLEAR((PyBList*) self);
+                ext_mark(result, 0, DIRTY);
+                return _ob((PyObject *) result);
+        } else {
+                PyErr_SetString(PyExc_TypeError,
+                                "list indices must be integers");
+                return _ob(NULL);
         }
+}
 
-        if (extra_list == NULL)
-                extra_list = self->children;
-        else
-                PyMem_Free(self->children);
+BLIST_PYAPI(int)
+py_typed_ass_subscript(PyObject *oself, PyObject *item, PyObject *value)
+{
+        PyBList *self;
+        const typed_desc_t *desc;
 
-        ext_dealloc(self);
-        assert(!self->n);
-  err:
-        memcpy(&self->BLIST_FIRST_FIELD, &saved.BLIST_FIRST_FIELD,
-               sizeof(*self) - offsetof(PyBListRoot, BLIST_FIRST_FIELD));
+        invariants(oself, VALID_USER|VALID_RW|VALID_DECREF);
 
-        Py_XINCREF(result);
+        self = (PyBList *) oself;
+        desc = typed_desc(self->typecode);
 
-        decref_flush();
+        if (PyIndex_Check(item)) {
+                Py_ssize_t i;
+                PyObject *raw;
 
-        /* This must come after the decref_flush(); otherwise, we may have
-         * extra temporary references to internal nodes, which throws off the
-         * debug-mode sanity checking. */
-        if (ret >= 0)
-                ext_reindex_set_all(&saved);
+                i = PyNumber_AsSsize_t(item, PyExc_IndexError);
+                if (i == -1 && PyErr_Occurred())
+                        return _int(-1);
+                if (value != NULL && typed_pack(desc, value, &raw) < 0)
+                        return _int(-1);
 
-        return _ob(result);
-}
+                if (i < 0)
+                        i += self->n;
+
+                if (i >= self->n || i < 0) {
+                        set_index_error();
+                        return _int(-1);
+                }
+
+                if (value == NULL) {
+                        blist_delitem(self, i);
+                        ext_mark(self, 0, DIRTY);
+                } else
+                        typed_set(self, i, raw);
+
+                decref_flush();
+                return _int(0);
+        } else if (PySlice_Check(item)) {
+                Py_ssize_t start, stop, step, slicelength;
+                Py_ssize_t cur, i, n;
+                PyObject *seq, **raws;
 
-BLIST_PYAPI(PyObject *)
-py_blist_reverse(PyBList *restrict self)
-{
-        invariants(self, VALID_USER|VALID_RW);
+                ext_mark(self, 0, DIRTY);
 
-        if (self->leaf)
-                reverse_slice(self->children,
-                              &self->children[self->num_children]);
-        else {
-                blist_reverse((PyBListRoot*) self);
-        }
+#if PY_MAJOR_VERSION < 3 || PY_MAJOR_VERSION == 3 && PY_MINOR_VERSION < 2
+                if (PySlice_GetIndicesEx((PySliceObject*)item, self->n,
+#else
+                if (PySlice_GetIndicesEx(item, self->n,
+#endif
+                                         &start, &stop,&step,&slicelength)<0)
+                        return _int(-1);
 
-        Py_RETURN_NONE;
-}
+                /* treat L[slice(a,b)] = v _exactly_ like L[a:b] = v */
+                if (step == 1 && ((PySliceObject*)item)->step == Py_None)
+                        return _redir(py_typed_ass_slice(oself,start,stop,value));
 
-BLIST_PYAPI(PyObject *)
-py_blist_count(PyBList *self, PyObject *v)
-{
-        Py_ssize_t count = 0;
-        PyObject *item;
-        int c;
-        fast_compare_data_t fast_cmp_type;
+                if (value == NULL) {
+                        /* Delete back-to-front */
+                        if (slicelength <= 0)
+                                return _int(0);
 
-        invariants(self, VALID_USER | VALID_DECREF);
+                        if (step > 0) {
+                                stop = start - 1;
+                                start = start + step*(slicelength-1);
+                                step = -step;
+                        }
 
-        fast_cmp_type = check_fast_cmp_type(v, Py_EQ);
+                        for (cur = start, i = 0; i < slicelength;
+                             cur += step, i++)
+                                blist_delitem(self, cur);
 
-        ITER(self, item, {
-                c = fast_eq(item, v, fast_cmp_type);
-                if (c > 0)
-                        count++;
-                else if (c < 0) {
-                        ITER_CLEANUP();
                         decref_flush();
-                        return _ob(NULL);
-                }
-        })
+                        ext_mark(self, 0, DIRTY);
 
-        decref_flush();
-        return _ob(PyInt_FromSsize_t(count));
-}
+                        return _int(0);
+                }
 
-BLIST_PYAPI(PyObject *)
-py_blist_index(PyBList *self, PyObject *args)
-{
-        Py_ssize_t i, start=0, stop=self->n;
-        PyObject *v;
-        int c, err;
-        PyObject *item;
-        fast_compare_data_t fast_cmp_type;
+                /* Assign slice.  Unbox everything before changing self,
+                 * so that a bad value leaves it untouched. */
+                DANGER_BEGIN;
+                seq = PySequence_Fast(value,
+                          "Must assign iterable to extended slice");
+                DANGER_END;
+                if (!seq)
+                        return _int(-1);
 
-        invariants(self, VALID_USER|VALID_DECREF);
+                n = PySequence_Fast_GET_SIZE(seq);
+                raws = PyMem_New(PyObject *, n ? n : 1);
+                if (raws == NULL) {
+                        DANGER_BEGIN;
+                        Py_DECREF(seq);
+                        DANGER_END;
+                        PyErr_NoMemory();
+                        return _int(-1);
+                }
+                for (i = 0; i < n; i++) {
+                        if (typed_pack(desc, PySequence_Fast_GET_ITEM(seq, i),
+                                       &raws[i]) < 0)
+                                break;
+                }
+                DANGER_BEGIN;
+                Py_DECREF(seq);
+                DANGER_END;
+                if (i < n) {
+                        PyMem_Free(raws);
+                        return _int(-1);
+                }
 
-        DANGER_BEGIN;
-        err = PyArg_ParseTuple(args, "O|O&O&:index", &v,
-                               _PyEval_SliceIndex, &start,
-                               _PyEval_SliceIndex, &stop);
-        DANGER_END;
-        if (!err)
-                return _ob(NULL);
-        if (start < 0) {
-                start += self->n;
-                if (start < 0)
-                        start = 0;
-        } else if (start > self->n)
-                start = self->n;
-        if (stop < 0) {
-                stop += self->n;
-                if (stop < 0)
-                        stop = 0;
-        } else if (stop > self->n)
-                stop = self->n;
+                /* Unboxing may have changed the length of self */
+#if PY_MAJOR_VERSION < 3 || PY_MAJOR_VERSION == 3 && PY_MINOR_VERSION < 2
+                if (PySlice_GetIndicesEx((PySliceObject*)item, self->n,
+#else
+                if (PySlice_GetIndicesEx(item, self->n,
+#endif
+                                         &start, &stop,&step,&slicelength)<0) {
+                        PyMem_Free(raws);
+                        return _int(-1);
+                }
 
-        fast_cmp_type = check_fast_cmp_type(v, Py_EQ);
-        i = start;
-        ITER2(self, item, start, stop, {
-                c = fast_eq(item, v, fast_cmp_type);
-                if (c > 0) {
-                        ITER_CLEANUP();
-                        decref_flush();
-                        return _ob(PyInt_FromSsize_t(i));
-                } else if (c < 0) {
-                        ITER_CLEANUP();
-                        decref_flush();
-                        return _ob(NULL);
+                if (n != slicelength) {
+                        PyErr_Format(PyExc_ValueError,
+                                     "attempt to assign sequence of size %zd to extended slice of size %zd",
+                                     n, slicelength);
+                        PyMem_Free(raws);
+                        return _int(-1);
                 }
-                i++;
-        })
 
-        decref_flush();
-        PyErr_SetString(PyExc_ValueError, "list.index(x): x not in list");
-        return _ob(NULL);
+                for (cur = start, i = 0; i < slicelength; cur += step, i++)
+                        typed_set(self, cur, raws[i]);
+
+                PyMem_Free(raws);
+                decref_flush();
+                return _int(0);
+        } else {
+                PyErr_SetString(PyExc_TypeError,
+                                "list indices must be integers");
+                return _int(-1);
+        }
 }
 
 BLIST_PYAPI(PyObject *)
-py_blist_remove(PyBList *self, PyObject *v)
+py_typed_append(PyBList *self, PyObject *v)
 {
-        Py_ssize_t i;
-        int c;
-        PyObject *item;
-        fast_compare_data_t fast_cmp_type;
+        PyObject *raw;
 
-        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
+        invariants(self, VALID_USER|VALID_RW);
 
-        fast_cmp_type = check_fast_cmp_type(v, Py_EQ);
-        i = 0;
-        ITER(self, item, {
-                c = fast_eq(item, v, fast_cmp_type);
-                if (c > 0) {
-                        ITER_CLEANUP();
-                        blist_delitem(self, i);
-                        decref_flush();
-                        ext_mark(self, 0, DIRTY);
-                        Py_RETURN_NONE;
-                } else if (c < 0) {
-                        ITER_CLEANUP();
-                        decref_flush();
-                        return _ob(NULL);
-                }
-                i++;
-        })
+        if (typed_pack(typed_desc(self->typecode), v, &raw) < 0
+            || blist_append(self, raw) < 0)
+                return _ob(NULL);
 
-        decref_flush();
-        PyErr_SetString(PyExc_ValueError, "list.remove(x): x not in list");
-        return _ob(NULL);
+        Py_RETURN_NONE;
 }
 
 BLIST_PYAPI(PyObject *)
-py_blist_pop(PyBList *self, PyObject *args)
+py_typed_insert(PyBList *self, PyObject *args)
 {
-        Py_ssize_t i = -1;
-        PyObject *v;
+        Py_ssize_t i;
+        PyObject *v, *raw;
         int err;
 
-        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
+        invariants(self, VALID_USER|VALID_RW);
 
         DANGER_BEGIN;
-        err = PyArg_ParseTuple(args, "|n:pop", &i);
+        err = PyArg_ParseTuple(args, "nO:insert", &i, &v);
         DANGER_END;
         if (!err)
                 return _ob(NULL);
 
-        if (self->n == 0) {
-                /* Special-case most common failure cause */
-                PyErr_SetString(PyExc_IndexError, "pop from empty list");
-                return _ob(NULL);
-        }
-
-        if (i == -1 || i == self->n-1) {
-                v = blist_pop_last_fast(self);
-                if (v)
-                        return _ob(v);
-        }
-
-        if (i < 0)
-                i += self->n;
-        if (i < 0 || i >= self->n) {
-                PyErr_SetString(PyExc_IndexError, "pop index out of range");
+        if (typed_pack(typed_desc(self->typecode), v, &raw) < 0
+            || blist_insert(self, i, raw) < 0)
                 return _ob(NULL);
-        }
-
-        v = blist_delitem_return(self, i);
-        ext_mark(self, 0, DIRTY);
-
-        decref_flush(); /* Remove any deleted BList nodes */
 
-        return _ob(v); /* the caller now owns the reference the list had */
+        Py_RETURN_NONE;
 }
 
 BLIST_PYAPI(PyObject *)
-py_blist_clear(PyBList *self)
+py_typed_extend(PyBList *self, PyObject *other)
 {
-        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
+        int err;
 
-        blist_forget_children(self);
-        self->n = 0;
-        self->leaf = 1;
-        ext_dealloc((PyBListRoot *) self);
+        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
 
+        err = typed_extend(self, other);
         decref_flush();
-        Py_RETURN_NONE;
-}
+        ext_mark(self, 0, DIRTY);
+        if (PyTypedBList_Check(other))
+                ext_mark_set_dirty_all((PyBList *) other);
 
-BLIST_PYAPI(PyObject *)
-py_blist_copy(PyBList *self)
-{
-        invariants(self, VALID_USER);
-        return (PyObject *) _blist(blist_root_copy(self));
+        if (err < 0)
+                return _ob(NULL);
+        Py_RETURN_NONE;
 }
 
 BLIST_PYAPI(PyObject *)
-py_blist_insert(PyBList *self, PyObject *args)
+py_typed_inplace_concat(PyObject *oself, PyObject *other)
 {
-        Py_ssize_t i;
-        PyObject *v;
-        PyBList *overflow;
         int err;
+        PyBList *self;
 
-        invariants(self, VALID_USER|VALID_RW);
-
-        DANGER_BEGIN;
-        err = PyArg_ParseTuple(args, "nO:insert", &i, &v);
-        DANGER_END;
-        if (!err)
-                return _ob(NULL);
-
-        if (self->n == PY_SSIZE_T_MAX) {
-                PyErr_SetString(PyExc_OverflowError,
-                                "cannot add more objects to list");
-                return _ob(NULL);
-        }
+        invariants(oself, VALID_RW|VALID_USER|VALID_DECREF);
 
-        if (i < 0) {
-                i += self->n;
-                if (i < 0)
-                        i = 0;
-        } else if (i > self->n)
-                i = self->n;
+        self = (PyBList *) oself;
 
-        /* Speed up the common case */
-        if (self->leaf && self->num_children < LIMIT) {
-                Py_INCREF(v);
+        err = typed_extend(self, other);
+        decref_flush();
+        ext_mark(self, 0, DIRTY);
+        if (PyTypedBList_Check(other))
+                ext_mark_set_dirty_all((PyBList*) other);
 
-                shift_right(self, i, 1);
-                self->num_children++;
-                self->n++;
-                self->children[i] = v;
-                Py_RETURN_NONE;
-        }
+        if (err < 0)
+                return _ob(NULL);
 
-        overflow = ins1(self, i, v);
-        if (overflow)
-                blist_overflow_root(self, overflow);
-        ext_mark(self, 0, DIRTY);
-        Py_RETURN_NONE;
+        Py_INCREF(self);
+        return _ob((PyObject *)self);
 }
 
 BLIST_PYAPI(PyObject *)
-py_blist_append(PyBList *self, PyObject *v)
+py_typed_concat(PyObject *oself, PyObject *other)
 {
+        PyBList *rv, *self;
         int err;
 
-        invariants(self, VALID_USER|VALID_RW);
+        if (!PyTypedBList_Check(other)) {
+                PyErr_Format(PyExc_TypeError,
+                             "can only concatenate typedblist (not \"%.200s\") to typedblist",
+                             Py_TYPE(other)->tp_name);
+                return NULL;
+        }
 
-        err = blist_append(self, v);
+        invariants(oself, VALID_USER|VALID_DECREF);
+        self = (PyBList *) oself;
 
-        if (err < 0)
+        rv = blist_root_copy(self);
+        if (rv == NULL)
                 return _ob(NULL);
+        err = typed_extend(rv, other);
+        ext_mark(rv, 0, DIRTY);
+        ext_mark_set_dirty_all((PyBList *) other);
+        if (err < 0) {
+                decref_later((PyObject *) rv);
+                rv = NULL;
+        }
 
-        Py_RETURN_NONE;
+        decref_flush();
+        return _ob((PyObject *) rv);
 }
 
-BLIST_PYAPI(PyObject *)
-py_blist_subscript(PyObject *oself, PyObject *item)
+BLIST_PYAPI(int)
+py_typed_contains(PyObject *oself, PyObject *el)
 {
+        Py_ssize_t i;
         PyBList *self;
 
-        invariants(oself, VALID_USER);
+        invariants(oself, VALID_USER | VALID_DECREF);
 
         self = (PyBList *) oself;
+        i = typed_find(self, el, 0, self->n, NULL);
 
-        if (PyIndex_Check(item)) {
-                Py_ssize_t i;
-                PyObject *ret;
-
-                if (PyLong_CheckExact(item)) {
-                        i = PyInt_AsSsize_t(item);
-                        if (i == -1 && PyErr_Occurred()) {
-                                PyErr_Clear();
-                                goto number;
-                        }
-                } else {
-                number:
-                        i = PyNumber_AsSsize_t(item, PyExc_IndexError);
-                        if (i == -1 && PyErr_Occurred())
-                                return _ob(NULL);
-                }
-
-                if (i < 0)
-                        i += self->n;
-
-                if (i < 0 || i >= self->n) {
-                        set_index_error();
-                        return _ob(NULL);
-                }
-
-                if (self->leaf)
-                        ret = self->children[i];
-                else
-                        ret = _PyBList_GET_ITEM_FAST2((PyBListRoot*)self, i);
-                Py_INCREF(ret);
-
-                return _ob(ret);
-        } else if (PySlice_Check(item)) {
-                Py_ssize_t start, stop, step, slicelength, cur, i;
-                PyBList* result;
-                PyObject* it;
-
-#if PY_MAJOR_VERSION < 3 || PY_MAJOR_VERSION == 3 && PY_MINOR_VERSION < 2
-                if (PySlice_GetIndicesEx((PySliceObject*)item, self->n,
-#else
-                if (PySlice_GetIndicesEx(item, self->n,
-#endif
-                                         &start, &stop,&step,&slicelength)<0) {
-                        return _ob(NULL);
-                }
-
-                if (step == 1)
-                        return _redir((PyObject *)
-                                      py_blist_get_slice((PyObject *) self, start, stop));
-
-                result = blist_root_new();
-
-                if (slicelength <= 0)
-                        return _ob((PyObject *) result);
+        decref_flush();
+        return _int(i == -2 ? -1 : i >= 0);
+}
 
-                /* This could be made slightly faster by using forests */
-                /* Also, by special-casing small trees */
-                for (cur = start, i = 0; i < slicelength; cur += step, i++) {
-                        int err;
+BLIST_PYAPI(PyObject *)
+py_typed_count(PyBList *self, PyObject *v)
+{
+        Py_ssize_t count;
 
-                        it = blist_get1(self, cur);
-                        err = blist_append(result, it);
-                        if (err < 0) {
-                                Py_DECREF(result);
-                                return _ob(NULL);
-                        }
-                }
+        invariants(self, VALID_USER | VALID_DECREF);
 
-                ext_mark(result, 0, DIRTY);
-                return _ob((PyObject *) result);
-        } else {
-                PyErr_SetString(PyExc_TypeError,
-                                "list indices must be integers");
+        if (typed_find(self, v, 0, self->n, &count) == -2) {
+                decref_flush();
                 return _ob(NULL);
         }
-}
 
-#if PY_MAJOR_VERSION == 2 && PY_MINOR_VERSION >= 6 || PY_MAJOR_VERSION >= 3
-static PyObject *
-py_blist_root_sizeof(PyBListRoot *root)
-{
-        Py_ssize_t res;
-        res = sizeof(PyBListRoot)
-                + LIMIT * sizeof(PyObject *)
-                + root->index_allocated * (sizeof (PyBList *) +sizeof(Py_ssize_t))
-                + root->dirty_length * sizeof(Py_ssize_t)
-                + (root->index_allocated ?
-                   SETCLEAN_LEN(root->index_allocated) * sizeof(unsigned): 0);
-        return PyLong_FromSsize_t(res);
+        decref_flush();
+        return _ob(PyInt_FromSsize_t(count));
 }
 
-static PyObject *
-py_blist_sizeof(PyBList *self)
+BLIST_PYAPI(PyObject *)
+py_typed_index(PyBList *self, PyObject *args)
 {
-        Py_ssize_t res;
-        res = sizeof(PyBList)
-                + LIMIT * sizeof(PyObject *);
-        return PyLong_FromSsize_t(res);
-}
+        Py_ssize_t i, start=0, stop=self->n;
+        PyObject *v;
+        int err;
 
-PyDoc_STRVAR(sizeof_doc,
-"L.__sizeof__() -- size of L in memory, in bytes");
-#endif
+        invariants(self, VALID_USER|VALID_DECREF);
 
-/************************************************************************
- * Routines for supporting pickling
- */
+        DANGER_BEGIN;
+        err = PyArg_ParseTuple(args, "O|O&O&:index", &v,
+                               _PyEval_SliceIndex, &start,
+                               _PyEval_SliceIndex, &stop);
+        DANGER_END;
+        if (!err)
+                return _ob(NULL);
+        if (start < 0) {
+                start += self->n;
+                if (start < 0)
+                        start = 0;
+        } else if (start > self->n)
+                start = self->n;
+        if (stop < 0) {
+                stop += self->n;
+                if (stop < 0)
+                        stop = 0;
+        } else if (stop > self->n)
+                stop = self->n;
+
+        i = typed_find(self, v, start, stop, NULL);
+        decref_flush();
+        if (i >= 0)
+                return _ob(PyInt_FromSsize_t(i));
+        if (i == -1)
+                PyErr_SetString(PyExc_ValueError,
+                                "typedblist.index(x): x not in list");
+        return _ob(NULL);
+}
 
-#ifndef BLIST_IN_PYTHON
 BLIST_PYAPI(PyObject *)
-blist_getstate(PyBList *self)
+py_typed_remove(PyBList *self, PyObject *v)
 {
-        PyObject *lst;
-        int i;
+        Py_ssize_t i;
 
-        invariants(self, VALID_PARENT);
+        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
 
-        lst = PyList_New(self->num_children);
-        for (i = 0; i < self->num_children; i++) {
-                PyList_SET_ITEM(lst, i, self->children[i]);
-                Py_INCREF(PyList_GET_ITEM(lst, i));
+        i = typed_find(self, v, 0, self->n, NULL);
+        if (i >= 0 && i < self->n) {
+                blist_delitem(self, i);
+                decref_flush();
+                ext_mark(self, 0, DIRTY);
+                Py_RETURN_NONE;
         }
 
-        if (PyRootBList_CheckExact(self))
-                ext_mark_set_dirty_all(self);
-
-        return _ob(lst);
+        decref_flush();
+        if (i != -2)
+                PyErr_SetString(PyExc_ValueError,
+                                "typedblist.remove(x): x not in list");
+        return _ob(NULL);
 }
 
 BLIST_PYAPI(PyObject *)
-py_blist_setstate(PyBList *self, PyObject *state)
+py_typed_pop(PyBList *self, PyObject *args)
 {
-        Py_ssize_t i;
+        Py_ssize_t i = -1;
+        PyObject *raw;
+        int err, kind = typed_kind(self);
 
-        invariants(self, VALID_PARENT);
+        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
 
-        if (!PyList_CheckExact(state) || PyList_GET_SIZE(state) > LIMIT) {
-                PyErr_SetString(PyExc_TypeError, "invalid state");
+        DANGER_BEGIN;
+        err = PyArg_ParseTuple(args, "|n:pop", &i);
+        DANGER_END;
+        if (!err)
                 return _ob(NULL);
-        }
 
-        for (self->n = i = 0; i < PyList_GET_SIZE(state); i++) {
-                PyObject *child = PyList_GET_ITEM(state, i);
-                if (Py_TYPE(child) == &PyBList_Type) {
-                        self->leaf = 0;
-                        self->n += ((PyBList*)child)->n;
-                } else
-                        self->n++;
-                self->children[i] = child;
-                Py_INCREF(child);
+        if (self->n == 0) {
+                /* Special-case most common failure cause */
+                PyErr_SetString(PyExc_IndexError, "pop from empty list");
+                return _ob(NULL);
         }
 
-        self->num_children = PyList_GET_SIZE(state);
-
-        if (PyRootBList_CheckExact(self))
-                ext_reindex_all((PyBListRoot*)self);
-
-        Py_RETURN_NONE;
-}
-
-BLIST_PYAPI(PyObject *)
-py_blist_reduce(PyBList *self)
-{
-        PyObject *rv, *args, *type;
+        if (i == -1 || i == self->n-1) {
+                if (blist_pop_last_fast(self, &raw) == 0)
+                        return _ob(typed_box(kind, raw));
+        }
 
-        invariants(self, VALID_PARENT);
+        if (i < 0)
+                i += self->n;
+        if (i < 0 || i >= self->n) {
+                PyErr_SetString(PyExc_IndexError, "pop index out of range");
+                return _ob(NULL);
+        }
 
-        type = (PyObject *) Py_TYPE(self);
-        args = PyTuple_New(0);
-        rv = PyTuple_New(3);
-        PyTuple_SET_ITEM(rv, 0, type);
-        Py_INCREF(type);
-        PyTuple_SET_ITEM(rv, 1, args);
-        PyTuple_SET_ITEM(rv, 2, blist_getstate(self));
+        raw = blist_get1(self, i);
+        blist_delitem(self, i);
+        ext_mark(self, 0, DIRTY);
 
-        return _ob(rv);
-}
-#endif
+        decref_flush(); /* Remove any deleted BList nodes */
 
-PyDoc_STRVAR(getitem_doc,
-             "x.__getitem__(y) <==> x[y]");
-PyDoc_STRVAR(reversed_doc,
-             "L.__reversed__() -- return a reverse iterator over the list");
-PyDoc_STRVAR(append_doc,
-"L.append(object) -- append object to end");
-PyDoc_STRVAR(extend_doc,
-"L.extend(iterable) -- extend list by appending elements from the iterable");
-PyDoc_STRVAR(insert_doc,
-"L.insert(index, object) -- insert object before index");
-PyDoc_STRVAR(pop_doc,
-"L.pop([index]) -> item -- remove and return item at index (default last)");
-PyDoc_STRVAR(remove_doc,
-"L.remove(value) -- remove first occurrence of value");
-PyDoc_STRVAR(index_doc,
-"L.index(value, [start, [stop]]) -> integer -- return first index of value");
-PyDoc_STRVAR(count_doc,
-"L.count(value) -> integer -- return number of occurrences of value");
-PyDoc_STRVAR(reverse_doc,
-"L.reverse() -- reverse *IN PLACE*");
-PyDoc_STRVAR(sort_doc,
-"L.sort(cmp=None, key=None, reverse=False) -- stable sort *IN PLACE*;\n\
-cmp(x, y) -> -1, 0, 1");
-PyDoc_STRVAR(clear_doc,
-"L.clear() -> None -- remove all items from L");
-PyDoc_STRVAR(copy_doc,
-"L.copy() -> list -- a shallow copy of L");
+        return _ob(typed_box(kind, raw));
+}
 
-static PyMethodDef blist_methods[] = {
-        {"__getitem__", (PyCFunction)py_blist_subscript, METH_O|METH_COEXIST, getitem_doc},
-        {"__reversed__",(PyCFunction)py_blist_reversed, METH_NOARGS, reversed_doc},
-#ifndef BLIST_IN_PYTHON
-        {"__reduce__",  (PyCFunction)py_blist_reduce, METH_NOARGS, NULL},
-        {"__setstate__",(PyCFunction)py_blist_setstate, METH_O, NULL},
-#endif
-        {"append",      (PyCFunction)py_blist_append,  METH_O, append_doc},
-        {"insert",      (PyCFunction)py_blist_insert,  METH_VARARGS, insert_doc},
-        {"extend",      (PyCFunction)py_blist_extend,  METH_O, extend_doc},
-        {"pop",         (PyCFunction)py_blist_pop,     METH_VARARGS, pop_doc},
-        {"remove",      (PyCFunction)py_blist_remove,  METH_O, remove_doc},
-        {"index",       (PyCFunction)py_blist_index,   METH_VARARGS, index_doc},
+BLIST_PYAPI(PyObject *)
+py_typed_sort(PyBListRoot *self, PyObject *args, PyObject *kwds)
+{
+        static char *kwlist[] = {"reverse", 0};
+        int reverse = 0;
+        int err;
+
+        invariants(self, VALID_USER|VALID_RW|VALID_DECREF);
+
+        DANGER_BEGIN;
+        err = PyArg_ParseTupleAndKeywords(args, kwds, "|i:sort", kwlist,
+                                          &reverse);
+        DANGER_END;
+        if (!err)
+                return _ob(NULL);
+
+        err = self->n < 2 ? 0 : typed_sort(self, reverse);
+        decref_flush();
+        if (err < 0)
+                return _ob(NULL);
+
+        /* Must come after the decref_flush(), like in py_blist_sort() */
+        ext_reindex_set_all(self);
+
+        Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(typed_sort_doc,
+"L.sort(reverse=False) -- sort *IN PLACE*");
+PyDoc_STRVAR(tolist_doc,
+"L.tolist() -> list -- a list of the same numbers");
+PyDoc_STRVAR(typecode_doc,
+"the typecode character used to create the typedblist");
+
+static PyMethodDef typed_methods[] = {
+        {"__getitem__", (PyCFunction)py_typed_subscript, METH_O|METH_COEXIST, getitem_doc},
+        {"__reduce__",  (PyCFunction)py_typed_reduce, METH_NOARGS, NULL},
+        {"append",      (PyCFunction)py_typed_append,  METH_O, append_doc},
+        {"insert",      (PyCFunction)py_typed_insert,  METH_VARARGS, insert_doc},
+        {"extend",      (PyCFunction)py_typed_extend,  METH_O, extend_doc},
+        {"pop",         (PyCFunction)py_typed_pop,     METH_VARARGS, pop_doc},
+        {"remove",      (PyCFunction)py_typed_remove,  METH_O, remove_doc},
+        {"index",       (PyCFunction)py_typed_index,   METH_VARARGS, index_doc},
         {"clear",       (PyCFunction)py_blist_clear,   METH_NOARGS, clear_doc},
         {"copy",       (PyCFunction)py_blist_copy,   METH_NOARGS, copy_doc},
 
-        {"count",       (PyCFunction)py_blist_count,   METH_O, count_doc},
+        {"count",       (PyCFunction)py_typed_count,   METH_O, count_doc},
         {"reverse",     (PyCFunction)py_blist_reverse, METH_NOARGS, reverse_doc},
-        {"sort",        (PyCFunction)py_blist_sort,    METH_VARARGS | METH_KEYWORDS, sort_doc},
-#if defined(Py_DEBUG) && !defined(BLIST_IN_PYTHON)
-        {"debug",       (PyCFunction)py_blist_debug,   METH_NOARGS, NULL},
-#endif
+        {"sort",        (PyCFunction)py_typed_sort,    METH_VARARGS | METH_KEYWORDS, typed_sort_doc},
+        {"tolist",      (PyCFunction)py_typed_tolist,  METH_NOARGS, tolist_doc},
 #if PY_MAJOR_VERSION == 2 && PY_MINOR_VERSION >= 6 || PY_MAJOR_VERSION >= 3
         {"__sizeof__",  (PyCFunction)py_blist_root_sizeof, METH_NOARGS, sizeof_doc},
 #endif
         {NULL,          NULL}           /* sentinel */
 };
 
-static PyMethodDef blist_internal_methods[] = {
-#ifndef BLIST_IN_PYTHON
-        {"__reduce__",  (PyCFunction)py_blist_reduce, METH_NOARGS, NULL},
-        {"__setstate__",(PyCFunction)py_blist_setstate, METH_O, NULL},
-#endif
-#if PY_MAJOR_VERSION == 2 && PY_MINOR_VERSION >= 6 || PY_MAJOR_VERSION >= 3
-        {"__sizeof__",  (PyCFunction)py_blist_sizeof, METH_NOARGS, sizeof_doc},
-#endif
-        {NULL,          NULL}           /* sentinel */
+static PyGetSetDef typed_getset[] = {
+        {"typecode", (getter)py_typed_get_typecode, NULL, typecode_doc},
+        {NULL}                          /* sentinel */
 };
 
-static PySequenceMethods blist_as_sequence = {
+static PySequenceMethods typed_as_sequence = {
         py_blist_length,                   /* sq_length */
-        0,                /* sq_concat */
+        py_typed_concat,                /* sq_concat */
         py_blist_repeat,              /* sq_repeat */
-        py_blist_get_item,            /* sq_item */
+        py_typed_get_item,            /* sq_item */
         py_blist_get_slice,      /* sq_slice */
-        py_blist_ass_item,         /* sq_ass_item */
-        py_blist_ass_slice,   /* sq_ass_slice */
-        py_blist_contains,              /* sq_contains */
-        0,        /* sq_inplace_concat */
+        py_typed_ass_item,         /* sq_ass_item */
+        py_typed_ass_slice,   /* sq_ass_slice */
+        py_typed_contains,              /* sq_contains */
+        py_typed_inplace_concat,        /* sq_inplace_concat */
         py_blist_inplace_repeat,      /* sq_inplace_repeat */
 };
 
-PyDoc_STRVAR(blist_doc,
-"blist() -> new list\n"
-"blist(iterable) -> new list initialized from iterable's items");
+PyDoc_STRVAR(typed_doc,
+"typedblist(typecode) -> new empty typed list\n"
+"typedblist(typecode, iterable) -> new typed list initialized from\n"
+"iterable's items\n"
+"\n"
+"Like blist, but holds numbers of one C type, given by an array module\n"
+"typecode: b, B, h, H, i, I, l, L, q or Q for integers and f or d for\n"
+"floating point numbers.  Each item takes 8 bytes.");
 
-static PyMappingMethods blist_as_mapping = {
+static PyMappingMethods typed_as_mapping = {
         py_blist_length,
-        py_blist_subscript,
-        py_blist_ass_subscript
-};
-
-/* All of this, just to get __radd__ to work */
-#if PY_MAJOR_VERSION < 3
-static PyNumberMethods blist_as_number = {
-        py_blist_concat,                    /* nb_add */
-        0,                                  /* nb_subtract */
-        0,                                  /* nb_multiply */
-        0,                                  /* nb_divide */
-        0,                                  /* nb_remainder */
-        0,                                  /* nb_divmod */
-        0,                                  /* nb_power */
-        0,                                  /* nb_negative */
-        0,                                  /* tp_positive */
-        0,                                  /* tp_absolute */
-        0,                                  /* tp_nonzero */
-        0,                                  /* nb_invert */
-        0,                                  /* nb_lshift */
-        0,                                  /* nb_rshift */
-        0,                                  /* nb_and */
-        0,                                  /* nb_xor */
-        0,                                  /* nb_or */
-        0,                                  /* nb_coerce */
-        0,                                  /* nb_int */
-        0,                                  /* nb_long */
-        0,                                  /* nb_float */
-        0,                                  /* nb_oct */
-        0,                                  /* nb_hex */
-        py_blist_inplace_concat,            /* nb_inplace_add */
-        0,                                  /* nb_inplace_subtract */
-        0,                                  /* nb_inplace_multiply */
-        0,                                  /* nb_inplace_divide */
-        0,                                  /* nb_inplace_remainder */
-        0,                                  /* nb_inplace_power */
-        0,                                  /* nb_inplace_lshift */
-        0,                                  /* nb_inplace_rshift */
-        0,                                  /* nb_inplace_and */
-        0,                                  /* nb_inplace_xor */
-        0,                                  /* nb_inplace_or */
-        0,                                  /* nb_floor_divide */
-        0,                                  /* nb_true_divide */
-        0,                                  /* nb_inplace_floor_divide */
-        0,                                  /* nb_inplace_true_divide */
-        0,                                  /* nb_index */
-};
-#else
-static PyNumberMethods blist_as_number = {
-        (binaryfunc) py_blist_concat,       /* nb_add */
-        0,                                  /* nb_subtract */
-        0,                                  /* nb_multiply */
-        0,                                  /* nb_remainder */
-        0,                                  /* nb_divmod */
-        0,                                  /* nb_power */
-        0,                                  /* nb_negative */
-        0,                                  /* tp_positive */
-        0,                                  /* tp_absolute */
-        0,                                  /* tp_bool */
-        0,                                  /* nb_invert */
-        0,                                  /* nb_lshift */
-        0,                                  /* nb_rshift */
-        0,                                  /* nb_and */
-        0,                                  /* nb_xor */
-        0,                                  /* nb_or */
-        0,                                  /* nb_int */
-        0,                                  /* nb_reserved */
-        0,                                  /* nb_float */
-        py_blist_inplace_concat,            /* nb_inplace_add */
-        0,                                  /* nb_inplace_subtract */
-        0,                                  /* nb_inplace_multiply */
-        0,                                  /* nb_inplace_remainder */
-        0,                                  /* nb_inplace_power */
-        0,                                  /* nb_inplace_lshift */
-        0,                                  /* nb_inplace_rshift */
-        0,                                  /* nb_inplace_and */
-        0,                                  /* nb_inplace_xor */
-        0,                                  /* nb_inplace_or */
-        0,                                  /* nb_floor_divide */
-        0,                                  /* nb_true_divide */
-        0,                                  /* nb_inplace_floor_divide */
-        0,                                  /* nb_inplace_true_divide */
-        0,                                  /* nb_index */
+        py_typed_subscript,
+        py_typed_ass_subscript
 };
-#endif
 
-PyTypeObject PyBList_Type = {
+PyTypeObject PyTypedBList_Type = {
         PyVarObject_HEAD_INIT(NULL, 0)
-#ifdef BLIST_IN_PYTHON
-        "__internal_blist",
-#else
-        "blist._blist.__internal_blist",
-#endif
-        sizeof(PyBList),
+        "blist.typedblist",
+        sizeof(PyBListRoot),
         0,
         py_blist_dealloc,                       /* tp_dealloc */
         0,                                      /* tp_print */
         0,                                      /* tp_getattr */
         0,                                      /* tp_setattr */
         0,                                      /* tp_compare */
-        0,                                      /* tp_repr */
+        py_typed_repr,                          /* tp_repr */
         0,                                      /* tp_as_number */
-        0,                                      /* tp_as_sequence */
-        0,                                      /* tp_as_mapping */
+        &typed_as_sequence,                     /* tp_as_sequence */
+        &typed_as_mapping,                      /* tp_as_mapping */
         py_blist_nohash,                        /* tp_hash */
         0,                                      /* tp_call */
         0,                                      /* tp_str */
@@ -7295,79 +13663,110 @@ PyTypeObject PyBList_Type = {
         0,                                      /* tp_as_buffer */
         Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC |
                 Py_TPFLAGS_BASETYPE,            /* tp_flags */
-        blist_doc,                              /* tp_doc */
-        py_blist_traverse,                      /* tp_traverse */
-        0,                                      /* tp_clear */
-        0,                                      /* tp_richcompare */
-        0,                                      /* tp_weaklistoffset */
-        0,                                      /* tp_iter */
-        0,                                      /* tp_iternext */
-        blist_internal_methods,                 /* tp_methods */
-        0,                                      /* tp_members */
-        0,                                      /* tp_getset */
-        0,                                      /* tp_base */
-        0,                                      /* tp_dict */
-        0,                                      /* tp_descr_get */
-        0,                                      /* tp_descr_set */
-        0,                                      /* tp_dictoffset */
-        py_blist_internal_init,                 /* tp_init */
-        0,                                      /* tp_alloc */
-        py_blist_internal_tp_new,               /* tp_new */
-        PyObject_GC_Del,                        /* tp_free */
-};
-
-PyTypeObject PyRootBList_Type = {
-        PyVarObject_HEAD_INIT(NULL, 0)
-#ifdef BLIST_IN_PYTHON
-        "list",
-#else
-        "blist.blist",
-#endif
-        sizeof(PyBListRoot),
-        0,
-        py_blist_dealloc,                       /* tp_dealloc */
-        0,                                      /* tp_print */
-        0,                                      /* tp_getattr */
-        0,                                      /* tp_setattr */
-        0,                                      /* tp_compare */
-        py_blist_repr,                          /* tp_repr */
-        &blist_as_number,                       /* tp_as_number */
-        &blist_as_sequence,                     /* tp_as_sequence */
-        &blist_as_mapping,                      /* tp_as_mapping */
-        py_blist_nohash,                        /* tp_hash */
-        0,                                      /* tp_call */
-        0,                                      /* tp_str */
-        PyObject_GenericGetAttr,                /* tp_getattro */
-        0,                                      /* tp_setattro */
-        0,                                      /* tp_as_buffer */
-        Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC |
-                Py_TPFLAGS_BASETYPE             /* tp_flags */
-#if (PY_MAJOR_VERSION == 2 && PY_MINOR_VERSION >= 6 || PY_MAJOR_VERSION >= 3) && defined(BLIST_IN_PYTHON)
-        | Py_TPFLAGS_LIST_SUBCLASS
-#endif
-        ,
-        blist_doc,                              /* tp_doc */
+        typed_doc,                              /* tp_doc */
         py_blist_traverse,                      /* tp_traverse */
         py_blist_tp_clear,                      /* tp_clear */
-        py_blist_richcompare,                   /* tp_richcompare */
+        py_typed_richcompare,                   /* tp_richcompare */
         0,                                      /* tp_weaklistoffset */
-        py_blist_iter,                          /* tp_iter */
+        py_typed_iter,                          /* tp_iter */
         0,                                      /* tp_iternext */
-        blist_methods,                          /* tp_methods */
+        typed_methods,                          /* tp_methods */
         0,                                      /* tp_members */
-        0,                                      /* tp_getset */
+        typed_getset,                           /* tp_getset */
         0,                                      /* tp_base */
         0,                                      /* tp_dict */
         0,                                      /* tp_descr_get */
         0,                                      /* tp_descr_set */
         0,                                      /* tp_dictoffset */
-        py_blist_init,                          /* tp_init */
+        py_typed_init,                          /* tp_init */
         PyType_GenericAlloc,                    /* tp_alloc */
-        py_blist_root_tp_new,                   /* tp_new */
+        py_typed_tp_new,                        /* tp_new */
         PyObject_GC_Del,                        /* tp_free */
 };
+#endif /* BLIST_TYPED */
+
+BLIST_PYAPI(PyObject *)
+py_reclaim(PyObject *module, PyObject *args)
+{
+        Py_ssize_t budget = -1;
+
+        if (!PyArg_ParseTuple(args, "|n:reclaim", &budget))
+                return NULL;
+
+        reclaim_some(budget);
+        return PyInt_FromSsize_t(reclaim_num);
+}
+
+BLIST_PYAPI(PyObject *)
+py_set_reclaim_threshold(PyObject *module, PyObject *args)
+{
+        Py_ssize_t threshold, old = reclaim_threshold;
+
+        if (!PyArg_ParseTuple(args, "n:set_reclaim_threshold", &threshold))
+                return NULL;
 
-static PyMethodDef module_methods[] = { { NULL } };
+        reclaim_threshold = threshold < 0 ? -1 : threshold;
+        return PyInt_FromSsize_t(old);
+}
+
+BLIST_PYAPI(PyObject *)
+py_set_sort_threads(PyObject *module, PyObject *args)
+{
+        int threads, old = sort_threads;
+
+        if (!PyArg_ParseTuple(args, "i:set_sort_threads", &threads))
+                return NULL;
+        if (threads < 1) {
+                PyErr_SetString(PyExc_ValueError,
+                                "set_sort_threads() needs at least 1 thread");
+                return NULL;
+        }
+
+#ifdef WITH_THREAD
+        sort_threads = threads < MAX_SORT_THREADS ? threads : MAX_SORT_THREADS;
+#endif
+        return PyInt_FromLong(old);
+}
+
+BLIST_PYAPI(PyObject *)
+py_set_sort_inplace_threshold(PyObject *module, PyObject *args)
+{
+        Py_ssize_t threshold, old = radix_inplace_min;
+
+        if (!PyArg_ParseTuple(args, "n:set_sort_inplace_threshold",
+                              &threshold))
+                return NULL;
+
+        radix_inplace_min = threshold < 0 ? -1 : threshold;
+        return PyInt_FromSsize_t(old);
+}
+
+PyDoc_STRVAR(reclaim_doc,
+"reclaim(budget=-1) -> integer -- release up to budget objects left\n\
+behind by discarded blists, or all of them if budget is negative;\n\
+return the number of nodes still queued");
+PyDoc_STRVAR(set_reclaim_threshold_doc,
+"set_reclaim_threshold(n) -> integer -- free blists with at least n\n\
+items incrementally; -1 disables; return the previous threshold");
+PyDoc_STRVAR(set_sort_threads_doc,
+"set_sort_threads(n) -> integer -- let sorts of large lists of ints or\n\
+floats use up to n threads; return the previous number");
+PyDoc_STRVAR(set_sort_inplace_threshold_doc,
+"set_sort_inplace_threshold(n) -> integer -- radix sort lists of at\n\
+least n ints or floats in place; -1 disables; return the previous\n\
+threshold");
+
+static PyMethodDef module_methods[] = {
+        {"reclaim",     (PyCFunction)py_reclaim, METH_VARARGS, reclaim_doc},
+        {"set_reclaim_threshold", (PyCFunction)py_set_reclaim_threshold,
+         METH_VARARGS, set_reclaim_threshold_doc},
+        {"set_sort_threads", (PyCFunction)py_set_sort_threads,
+         METH_VARARGS, set_sort_threads_doc},
+        {"set_sort_inplace_threshold",
+         (PyCFunction)py_set_sort_inplace_threshold,
+         METH_VARARGS, set_sort_inplace_threshold_doc},
+        { NULL }
+};
 
 BLIST_LOCAL(int)
 init_blist_types1(void)
@@ -7385,6 +13784,14 @@ init_blist_types1(void)
         Py_INCREF(&PyBListIter_Type);
         Py_INCREF(&PyBListReverseIter_Type);
 
+#ifdef BLIST_TYPED
+        Py_TYPE(&PyTypedBList_Type) = &PyType_Type;
+        Py_TYPE(&PyTypedBListIter_Type) = &PyType_Type;
+
+        Py_INCREF(&PyTypedBList_Type);
+        Py_INCREF(&PyTypedBListIter_Type);
+#endif
+
         return 0;
 }
 
@@ -7395,6 +13802,10 @@ init_blist_types2(void)
         if (PyType_Ready(&PyBList_Type) < 0) return -1;
         if (PyType_Ready(&PyBListIter_Type) < 0) return -1;
         if (PyType_Ready(&PyBListReverseIter_Type) < 0) return -1;
+#ifdef BLIST_TYPED
+        if (PyType_Ready(&PyTypedBList_Type) < 0) return -1;
+        if (PyType_Ready(&PyTypedBListIter_Type) < 0) return -1;
+#endif
 
         return 0;
 }
@@ -7420,6 +13831,9 @@ init_blist(void)
         PyModule_AddObject(m, "_limit", limit);
         PyModule_AddObject(m, "__internal_blist", (PyObject *)
                 &PyBList_Type);
+#ifdef BLIST_TYPED
+        PyModule_AddObject(m, "typedblist", (PyObject *) &PyTypedBList_Type);
+#endif
 
 #ifndef BLIST_IN_PYTHON
         gc_module = PyImport_ImportModule("gc");
@@ -7471,6 +13885,9 @@ PyInit__blist(void)
         PyModule_AddObject(m, "_limit", limit);
         PyModule_AddObject(m, "__internal_blist", (PyObject *)
                            &PyBList_Type);
+#ifdef BLIST_TYPED
+        PyModule_AddObject(m, "typedblist", (PyObject *) &PyTypedBList_Type);
+#endif
 
 #ifndef BLIST_IN_PYTHON
         gc_module = PyImport_ImportModule("gc");
@@ -7516,6 +13933,10 @@ PyObject *PyList_New(Py_ssize_t size)
                 return NULL;
 
         if (size <= LIMIT) {
+                if (blist_reserve(self, size) < 0) {
+                        Py_DECREF(self);
+                        return NULL;
+                }
                 self->n = size;
                 self->num_children = size;
                 memset(self->children, 0, sizeof(PyObject *) * size);
@@ -7523,6 +13944,10 @@ PyObject *PyList_New(Py_ssize_t size)
                 return (PyObject *) self;
         }
 
+        if (blist_reserve(self, 1) < 0) {
+                Py_DECREF(self);
+                return NULL;
+        }
         self->n = 1;
         self->num_children = 1;
         self->children[0] = NULL;
@@ -7589,6 +14014,7 @@ int PyList_SetItem(PyObject *ob, Py_ssize_t i, PyObject *item)
 int PyList_Insert(PyObject *ob, Py_ssize_t i, PyObject *v)
 {
         PyBList *overflow;
+        Py_ssize_t lo, hi;
         PyBList *self = (PyBList *) ob;
 
         if (ob == NULL || !PyList_Check(ob)) {
@@ -7612,19 +14038,25 @@ int PyList_Insert(PyObject *ob, Py_ssize_t i, PyObject *v)
                 i = self->n;
 
         if (self->leaf && self->num_children < LIMIT) {
+                if (blist_reserve(self, self->num_children + 1) < 0)
+                        return -1;
                 Py_INCREF(v);
 
                 shift_right(self, i, 1);
                 self->num_children++;
                 self->n++;
                 self->children[i] = v;
+                counts_update(self, v, NULL);
                 return _int(0);
         }
 
+        if (!ext_insert_range((PyBListRoot *) self, i, &lo, &hi))
+                lo = -1;
         overflow = ins1(self, i, v);
         if (overflow)
                 blist_overflow_root(self, overflow);
-        ext_mark(self, 0, DIRTY);
+        ext_mark_inserted(self, i, lo, hi);
+        counts_update(self, v, NULL);
 
         return _int(0);
 }
@@ -7636,7 +14068,10 @@ int PyList_Append(PyObject *ob, PyObject *item)
                 return -1;
         }
 
-        return blist_append((PyBList *) ob, item);
+        if (blist_append((PyBList *) ob, item) < 0)
+                return -1;
+        counts_update((PyBList *) ob, item, NULL);
+        return 0;
 }
 
 PyObject *PyList_GetSlice(PyObject *ob, Py_ssize_t i, Py_ssize_t j)
@@ -25,6 +25,11 @@ class ReprRecursion(object):
             del self.local.repr_count[self.ob_id]
         return False
 
+def _overrides(ob, name):
+    "Does ob's class replace _sortedbase's version of method name?"
+    f = getattr(type(ob), name)
+    return getattr(f, '__func__', f) is not _sortedbase.__dict__[name]
+
 class _sortedbase(collections.Sequence):
     def __init__(self, iterable=(), key=None):
         self._key = key
@@ -81,32 +86,18 @@ class _sortedbase(collections.Sequence):
         accept a user-object v and return a user-object value.
         """
 
-        key = self._u2key(v)
-        lo = 0
-        hi = len(self._blist)
-        while lo < hi:
-            mid = (lo+hi)//2
-            v = self._i2key(self._blist[mid])
-            if v < key: lo = mid + 1
-            else: hi = mid
-        if lo < len(self._blist):
-            return lo, self._i2u(self._blist[lo])
-        return lo, None
+        i = self._blist._bisect_left(self._u2key(v), self._key is not None)
+        if i < len(self._blist):
+            return i, self._i2u(self._blist[i])
+        return i, None
 
     def _bisect_right(self, v):
         """Same as _bisect_left, but go to the right of equal values"""
 
-        key = self._u2key(v)
-        lo = 0
-        hi = len(self._blist)
-        while lo < hi:
-            mid = (lo+hi)//2
-            v = self._i2key(self._blist[mid])
-            if key < v: hi = mid
-            else: lo = mid + 1
-        if lo < len(self._blist):
-            return lo, self._i2u(self._blist[lo])
-        return lo, None
+        i = self._blist._bisect_right(self._u2key(v), self._key is not None)
+        if i < len(self._blist):
+            return i, self._i2u(self._blist[i])
+        return i, None
 
     def bisect_left(self, v):
         """L.bisect_left(v) -> index
@@ -134,8 +125,11 @@ class _sortedbase(collections.Sequence):
         """Add an element."""
         # Will throw a TypeError when trying to add an object that
         # cannot be compared to objects already in the list.
-        i, _ = self._bisect_right(value)
-        self._blist.insert(i, self._u2i(value))
+        if _overrides(self, '_bisect_right'):
+            i, _ = self._bisect_right(value)
+            self._blist.insert(i, self._u2i(value))
+        else:
+            self._blist._insort(self._u2i(value), self._key is not None)
 
     def discard(self, value):
         """Remove an element if it is a member.
@@ -70,8 +70,12 @@ typedef struct PyBList {
         PyObject_HEAD
         Py_ssize_t n;              /* Total # of user-object descendents */
         int num_children;     /* Number of immediate children */
-        int leaf;                  /* Boolean value */
+        char leaf;                 /* Boolean value */
+        char typecode;             /* Typed blists only, see _blist.c */
         PyObject **children;       /* Immediate children */
+        Py_ssize_t *child_ends;    /* Running totals of the children's n */
+        int num_ends;              /* # of valid entries in child_ends */
+        int allocated;             /* # of slots in children */
 } PyBList;
 
 typedef struct PyBListRoot {
@@ -79,8 +83,14 @@ typedef struct PyBListRoot {
 #define BLIST_FIRST_FIELD n
         Py_ssize_t n;              /* Total # of user-object descendents */
         int num_children;     /* Number of immediate children */
-        int leaf;                  /* Boolean value */
+        char leaf;                 /* Boolean value */
+        char typecode;             /* Typed blists only, see _blist.c */
+        char counting;             /* Set by hash_values() */
         PyObject **children;       /* Immediate children */
+        Py_ssize_t *child_ends;    /* Running totals of the children's n */
+        int num_ends;              /* # of valid entries in child_ends */
+        int allocated;             /* # of slots in children */
+        PyBList *tail;             /* Detached last leaf, not counted in n */
 
         PyBList **index_list;
         Py_ssize_t *offset_list;
@@ -223,6 +233,10 @@ blist_ass_item_return2(PyBListRoot *root, Py_ssize_t i, PyObject *v)
         good:
 	  /* Py_REFCNT(p) == 1, generally, but see comment in
 	   * blist_ass_item_return_slow for caveats */
+                if (!_PyObject_GC_IS_TRACKED(p) && !root->typecode
+                    && v && PyObject_IS_GC(v))
+                        /* Untracked leaves only hold atomic objects */
+                        return blist_ass_item_return_slow(root, i, v);
                 rv = p->children[i - offset];
                 p->children[i - offset] = v;
         } else if (!GET_BIT(root->setclean_list, ioffset+1)) {
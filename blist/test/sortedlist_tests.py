@@ -302,6 +302,46 @@ class StrongSortedBase(SortedBase, seq_tests.CommonTest):
             self.assertRaises(ZeroDivisionError, self.type2test,
                               seq_tests.IterGenExc(s))
 
+    def test_bisect_large(self):
+        import bisect
+        items = [random.randrange(500) for i in range(3000)]
+        u = self.type2test(items)
+        v = sorted(set(items)) if isinstance(u, collections.Set) \
+            else sorted(items)
+        self.assertEqual(list(u), v)
+        for x in range(-1, 502):
+            self.assertEqual(u.bisect_left(x), bisect.bisect_left(v, x))
+            self.assertEqual(u.bisect_right(x), bisect.bisect_right(v, x))
+        u = self.type2test(items, key=lambda x: -x)
+        self.assertEqual(list(u), v[::-1])
+        for x in range(-1, 502):
+            self.assertEqual(u.bisect_right(x), len(v) - bisect.bisect_left(v, x))
+
+    def test_bisect_mutating(self):
+        u = self.type2test()
+        class Evil(object):
+            def __init__(self, x):
+                self.x = x
+            def __lt__(self, other):
+                del u._blist[:]
+                return self.x < other.x
+            __hash__ = object.__hash__
+        u._blist.extend(Evil(i) for i in range(1000))
+        i = u.bisect_left(Evil(500))
+        self.assertTrue(0 <= i <= 1000)
+        self.assertEqual(len(u), 0)
+
+    def test_bisect_override(self):
+        calls = []
+        class Recording(self.type2test):
+            def _bisect_right(self, v):
+                calls.append(v)
+                return super(Recording, self)._bisect_right(v)
+        u = Recording([3, 1, 2])
+        u.add(0)
+        self.assertEqual(calls[-1], 0)
+        self.assertEqual(list(u), [0, 1, 2, 3])
+
 class weak_int:
     def __init__(self, v):
         self.value = v
@@ -284,14 +284,83 @@ add_timing('LIFO', None, """\
 x.append(0)
 x.pop(-1)
 """)
+add_timing('LIFO getitem', 'x = TypeToTest(range(n // 64 * 64 + 64))\nm = len(x)//2', """\
+x.append(0)
+x[m]
+x.pop(-1)
+x[m]
+""")
+
+deque_setup = """\
+x = TypeToTest(range(n))
+appendleft = getattr(x, 'appendleft', lambda v: x.insert(0, v))
+popleft = getattr(x, 'popleft', lambda: x.pop(0))
+rotate = getattr(x, 'rotate', lambda k: x.__setitem__(slice(None), x[-k:] + x[:-k]))
+"""
+add_timing('appendleft popleft', deque_setup, """\
+appendleft(0)
+popleft()
+""")
+add_timing('rotate', deque_setup, "rotate(n // 3)")
+
+add_timing('split join', 'x = TypeToTest(range(n))\nm = n//3', """\
+if hasattr(x, 'split'):
+    y, z = x.split(m)
+    z.join(y)
+    x = z
+else:
+    x = x[m:] + x[:m]
+""")
+
+take_setup = """\
+x = TypeToTest(range(n))
+indices = [(i * 7919) % n for i in range(n // 4)]
+values = list(range(n // 4))
+take = getattr(x, 'take', lambda indices: [x[i] for i in indices])
+"""
+add_timing('take', take_setup, "take(indices)")
+add_timing('put', take_setup, """\
+if hasattr(x, 'put'):
+    x.put(indices, values)
+else:
+    for i, v in zip(indices, values):
+        x[i] = v
+""")
+add_timing('del_many', take_setup, """\
+y = x[:]
+if hasattr(y, 'del_many'):
+    y.del_many(indices)
+else:
+    for i in sorted(set(indices), reverse=True):
+        del y[i]
+""")
+add_timing('filter', None, """\
+y = x[:]
+if hasattr(y, 'filter'):
+    y.filter(bool)
+else:
+    y[:] = [v for v in y if v]
+""")
+hashed_setup = '''\
+x = TypeToTest(range(n))
+if hasattr(x, 'hash_values'):
+    x.hash_values()
+'''
+add_timing('contains hashed', hashed_setup, "-1 in x\nx.append(-2)\nx.pop()")
 
 add_timing('add', None, "x + x")
 add_timing('contains', None, "-1 in x")
 #add_timing('getitem1', None, "x[0]")
 #add_timing('getitem2', None, "x.__getitem__(0)")
 add_timing('getitem3', 'x = TypeToTest(range(n))\nm = n//2', "x[m]")
+add_timing('insert middle', 'x = TypeToTest(range(n))\nm = n//2', 'x.insert(m, 0)\ndel x[m]')
+add_timing('insert getitem', 'x = TypeToTest(range(n))\nm = n//2', 'x.insert(-100, 0)\nx[m]')
 add_timing('getslice', None, "x[1:-1]")
+add_timing('getslice step', None, "x[::3]")
+add_timing('setslice step', 'x = TypeToTest(range(n))\ny = list(range(0, n, 3))', "x[::3] = y")
+add_timing('delslice step', None, "y = x[:]\ndel y[::3]")
 add_timing('forloop', None, "for i in x:\n    pass")
+add_timing('forloop setitem', None, "for i, v in enumerate(x):\n    x[i] = v")
 add_timing('len', None, "len(x)")
 add_timing('eq', None, "x == x")
 add_timing('mul10', None, "x * 10")
@@ -308,8 +377,15 @@ add_timing('sort sorted', None, 'x.sort()')
 add_timing('sort sorted key', None, 'x.sort(key=int)')
 add_timing('sort reversed', 'x = list(range(n))\nx.reverse()', 'y = TypeToTest(x)\ny.sort()')
 add_timing('sort reversed key', 'x = list(range(n))\nx.reverse()', 'y = TypeToTest(x)\ny.sort(key=int)')
+add_timing('sort sorted halves', 'x = [str(i) for i in range(n)]\nx.sort()\nx = x[::2] + x[1::2]', 'y = TypeToTest(x)\ny.sort()')
+add_timing('sort sorted plus few', 'import random\nx = list(range(n)) + [random.randrange(n) for i in range(10)]', 'y = TypeToTest(x)\ny.sort()')
 
 add_timing('sort random tuples', 'import random\nx = [(random.random(), random.random()) for i in range(n)]', 'y = TypeToTest(x)\ny.sort()')
+add_timing('sort random int pairs', 'import random\nx = [(random.randrange(100), random.randrange(n)) for i in range(n)]', 'y = TypeToTest(x)\ny.sort()')
+add_timing('sort timestamp pairs', 'import random\nx = [(10**18 + random.randrange(n), i) for i in range(n)]', 'y = TypeToTest(x)\ny.sort()')
+add_timing('sort random pairs itemgetter', 'import random, operator\nkey = operator.itemgetter(0)\nx = [(random.randrange(n), i) for i in range(n)]', 'y = TypeToTest(x)\ny.sort(key=key)')
+add_timing('sort random strings', 'import random\nx = [str(random.random()) for i in range(n)]', 'y = TypeToTest(x)\ny.sort()')
+add_timing('sort random paths', 'import random\nx = ["/usr/lib/%d/%d.py" % (i % 7, random.randrange(n)) for i in range(n)]', 'y = TypeToTest(x)\ny.sort(key=str.lower)')
 
 ob_def = '''
 import random
@@ -35,6 +35,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 import sys
 import os
+import gc, weakref
 
 import unittest, operator
 import blist, pickle
@@ -144,6 +145,23 @@ class BListTest(list_tests.CommonTest):
         x = self.type2test(list(range(512)))
         del x[248:318]
 
+    def test_collapseuneven(self):
+        # The two ends of the deleted range collapse by different amounts
+        x = self.type2test(list(range(574))) * 2
+        y = list(range(574)) * 2
+        del x[258:1134]
+        del y[258:1134]
+        x.insert(1, -1)
+        y.insert(1, -1)
+        self.assertEqual(list(x), y)
+        self.assertEqual([x[i] for i in range(len(x))], y)
+
+    def test_getitem_after_del_front(self):
+        x = self.type2test(list(range(n)))
+        del x[0]
+        self.assertEqual(x[100], 101)
+        self.assertEqual(x[n - 2], n - 1)
+
     def test_badrepr(self):
         class BadExc(Exception):
             pass
@@ -224,6 +242,18 @@ class BListTest(list_tests.CommonTest):
         x.reverse()
         self.assertEqual(x, list(range(n-1,-1,-1)))
 
+    def test_reverse_empty(self):
+        x = self.type2test()
+        x.reverse()
+        self.assertEqual(x, [])
+        x.sort()
+        x.rotate(3)
+        self.assertEqual(x, [])
+        x = self.type2test([1, 2])
+        del x[:]
+        x.reverse()
+        self.assertEqual(x, [])
+
     def test_badconcat(self):
         x = self.type2test()
         y = 'foo'
@@ -270,6 +300,24 @@ class BListTest(list_tests.CommonTest):
         x = self.type2test([0]) * 65536
         self.assertEqual(len(x[256:512]), 256)
 
+    def test_big_extended_slices(self):
+        for step in (2, 3, -5, limit - 1, limit + 1, -n):
+            for size in (limit, n + limit):
+                expected = list(range(size))
+                x = self.type2test(expected)
+                y = x[:]
+                self.assertEqual(list(x[1::step]), expected[1::step])
+                self.assertEqual(list(x[-2:3:step]), expected[-2:3:step])
+                k = len(expected[::step])
+                x[::step] = ['a'] * k
+                expected[::step] = ['a'] * k
+                self.assertEqual(list(x), expected)
+                del x[limit::step]
+                del expected[limit::step]
+                self.assertEqual(list(x), expected)
+                self.assertEqual(x[len(x) // 2], expected[len(x) // 2])
+                self.assertEqual(list(y), list(range(size)))
+
     def test_modify_original(self):
         x = self.type2test(list(range(1024)))
         y = x[:]
@@ -288,6 +336,80 @@ class BListTest(list_tests.CommonTest):
         self.assertEqual(tuple(y[:5]), tuple(range(5)))
         self.assertEqual(tuple(y[6:]), tuple(range(6, 1024)))
 
+    def test_modify_snapshots(self):
+        x = self.type2test(list(range(n)))
+        expected = list(range(n))
+        for i in range(0, n, 7):
+            x[i]
+        copies = []
+        for step in range(8):
+            copies.append((x[:], list(expected)))
+            for i in range(step, n, 37):
+                x[i] = -i
+                expected[i] = -i
+            y, y_expected = copies[step // 2]
+            for i in range(step, len(y), 41):
+                y[i] = 'y'
+                y_expected[i] = 'y'
+            for i in range(0, n, 13):
+                self.assertEqual(x[i], expected[i])
+                self.assertEqual(y[i], y_expected[i])
+        for y, y_expected in copies:
+            self.assertEqual(list(y), y_expected)
+        self.assertEqual(list(x), expected)
+
+    def test_insert_getitem(self):
+        x = self.type2test(list(range(n)))
+        expected = list(range(n))
+        for i in range(0, n, 7):
+            x[i]
+        for step in range(4 * limit):
+            if step % limit == 3:
+                y = x[:]
+                x[step] = 'x'
+                expected[step] = 'x'
+            i = len(x) - (step * 5) % (3 * limit)
+            x.insert(i, -step)
+            expected.insert(i, -step)
+            x.append(step)
+            expected.append(step)
+            for j in range(len(x) - 4 * limit, len(x), 3):
+                self.assertEqual(x[j], expected[j])
+            self.assertEqual(x[step * 11 % len(x)],
+                             expected[step * 11 % len(x)])
+        self.assertEqual(list(x), expected)
+
+    def test_write_while_iterating(self):
+        def transform(x):
+            seen = []
+            for i, v in enumerate(x):
+                seen.append(v)
+                x[i] = 'y'
+                x[(i * 7) % n] = i
+                if i == n // 2:
+                    snapshot = x[:]
+            for i, v in zip(range(n - 1, -1, -1), reversed(x)):
+                seen.append(v)
+                x[i // 2] = -i
+            return seen, list(snapshot)
+
+        x = self.type2test(list(range(n)))
+        y = x[:]
+        expected = list(range(n))
+        self.assertEqual(transform(x), transform(expected))
+        self.assertEqual(list(x), expected)
+        self.assertEqual(list(y), list(range(n)))
+
+        x = self.type2test(list(range(n)))
+        it = iter(x)
+        for i in range(n // 2):
+            next(it)
+        self.assertEqual(it.__length_hint__(), n - n // 2)
+        del x[limit:]
+        self.assertEqual(list(it), [])
+        x.extend(range(n))
+        self.assertEqual(list(it), [])
+
     def test_bigsort(self):
         x = self.type2test(list(range(100000)))
         x.sort()
@@ -306,6 +428,331 @@ class BListTest(list_tests.CommonTest):
         for j in range(1000-1,-1,-1):
             self.assertEqual(x.pop(), j)
 
+    def test_LIFO_getitem(self):
+        x = self.type2test(range(n))
+        expected = list(range(n))
+        for step in range(4 * limit):
+            if step % limit == 5:
+                y = x[:]
+                x[-1] = 'x'
+                expected[-1] = 'x'
+            for i in range(step % 3):
+                x.append(-step)
+                expected.append(-step)
+            for i in range(step % 5):
+                self.assertEqual(x.pop(), expected.pop())
+            for j in range(len(x) - 3 * limit, len(x), 5):
+                self.assertEqual(x[j], expected[j])
+        self.assertEqual(list(x), expected)
+
+    def test_tail_leaf(self):
+        x = self.type2test(range(n))
+        expected = list(range(n))
+        for step in range(6 * limit):
+            for i in range(step % 4):
+                x.append(step)
+                expected.append(step)
+            if step % 7 == 1:
+                x[-1] = -step
+                expected[-1] = -step
+            if step % 5 == 2:
+                self.assertEqual(x.pop(), expected.pop())
+            if step % 11 == 3:
+                self.assertEqual(x.popleft(), expected.pop(0))
+            if step % limit == 4:
+                y = x[:]
+                self.assertEqual(y, self.type2test(expected))
+                self.assertEqual(list(x + y), expected * 2)
+                x.append('y')
+                expected.append('y')
+                self.assertEqual(list(y), expected[:-1])
+            self.assertEqual(len(x), len(expected))
+            self.assertEqual(x[-1], expected[-1])
+        self.assertEqual(list(x), expected)
+        self.assertEqual(list(reversed(x)), expected[::-1])
+        self.assertEqual(pickle.loads(pickle.dumps(x)), x)
+
+        seen = []
+        for item in x:
+            seen.append(item)
+            if len(x) < len(expected) + limit * 3:
+                x.append(len(seen))
+        expected.extend(range(1, limit * 3 + 1))
+        self.assertEqual(seen, expected)
+        self.assertEqual(list(x), expected)
+
+    def test_tail_stress(self):
+        import random
+        rand = random.Random(12)
+        for trial in range(8):
+            expected = list(range(rand.randrange(4 * limit)))
+            x = self.type2test(expected)
+            copies = []
+            for step in range(300):
+                op = rand.randrange(14)
+                i = rand.randrange(len(expected) + 1)
+                j = rand.randrange(len(expected) + 1)
+                i, j = min(i, j), max(i, j)
+                if op < 4:
+                    for k in range(rand.randrange(1, 2 * limit)):
+                        x.append(k)
+                        expected.append(k)
+                elif op < 6:
+                    for k in range(rand.randrange(1, 2 * limit)):
+                        if not expected:
+                            break
+                        self.assertEqual(x.pop(), expected.pop())
+                elif op == 6 and expected:
+                    k = rand.randrange(-len(expected), len(expected))
+                    x[k] = -step
+                    expected[k] = -step
+                elif op == 7 and expected:
+                    k = rand.randrange(-len(expected), len(expected))
+                    del x[k]
+                    del expected[k]
+                elif op == 8:
+                    copies.append((x[:], list(expected)))
+                elif op == 9:
+                    self.assertEqual(x[i:j], self.type2test(expected[i:j]))
+                elif op == 10:
+                    x.insert(i, step)
+                    expected.insert(i, step)
+                elif op == 11:
+                    x.extend(x[i:j])
+                    expected.extend(expected[i:j])
+                elif op == 12:
+                    self.assertEqual(pickle.loads(pickle.dumps(x)), x)
+                    self.assertEqual(list(reversed(x)), expected[::-1])
+                else:
+                    x.reverse()
+                    expected.reverse()
+                self.assertEqual(len(x), len(expected))
+                if expected:
+                    self.assertEqual(x[-1], expected[-1])
+                    self.assertEqual(x[0], expected[0])
+            self.assertEqual(list(x), expected)
+            for y, z in copies:
+                self.assertEqual(list(y), z)
+
+    def test_tail_sizeof(self):
+        if not hasattr(sys, 'getsizeof'): # pragma: no cover
+            return
+        import struct
+        x = self.type2test(range(n))
+        before = sys.getsizeof(x)
+        x.append(0)
+        self.assert_(sys.getsizeof(x) - before >=
+                     limit * struct.calcsize('P'))
+
+    def test_deque_ops(self):
+        x = self.type2test()
+        expected = []
+        for step in range(4 * limit):
+            if step % limit == 3:
+                y = x[:]
+                z = list(expected)
+            for i in range(step % 7):
+                x.appendleft(step * 10 + i)
+                expected.insert(0, step * 10 + i)
+            for i in range(step % 3):
+                self.assertEqual(x.popleft(), expected.pop(0))
+            x.extendleft(range(step % 11))
+            expected[0:0] = reversed(range(step % 11))
+            for j in range(0, min(len(x), 3 * limit), 5):
+                self.assertEqual(x[j], expected[j])
+        self.assertEqual(list(x), expected)
+        self.assertEqual(list(y), z)
+        self.assertRaises(IndexError, self.type2test().popleft)
+
+    def test_rotate(self):
+        for size in (0, 1, 2, limit, n):
+            for k in (0, 1, -1, 3, -limit, size - 1, size, 2 * size + 1):
+                x = self.type2test(range(size))
+                y = x[:]
+                x.rotate(k)
+                expected = list(range(size))
+                if size:
+                    k %= size
+                    expected = expected[-k:] + expected[:-k]
+                self.assertEqual(list(x), expected)
+                self.assertEqual(list(y), list(range(size)))
+                if size:
+                    self.assertEqual(x[size // 2], expected[size // 2])
+        x = self.type2test(range(n))
+        x.rotate()
+        self.assertEqual(x[0], n - 1)
+        self.assertRaises(TypeError, x.rotate, 'a')
+
+    def test_split(self):
+        for size in (0, 1, limit, limit + 1, n):
+            for i in (0, 1, -1, limit // 2, size // 2, size - 1, size,
+                      size + 5, -size - 5):
+                x = self.type2test(range(size))
+                y = x[:]
+                left, right = x.split(i)
+                j = min(max(i + size if i < 0 else i, 0), size)
+                self.assertEqual(len(x), 0)
+                self.assertEqual(list(left), list(range(j)))
+                self.assertEqual(list(right), list(range(j, size)))
+                self.assertEqual(list(y), list(range(size)))
+                if j < size:
+                    self.assertEqual(right[0], j)
+                    right[0] = 'x'
+                    self.assertEqual(y[j], j)
+                left.append('y')
+                self.assertEqual(left[-1], 'y')
+                self.assertEqual(len(x), 0)
+        self.assertRaises(TypeError, self.type2test().split)
+
+    def test_join(self):
+        for size1 in (0, 1, limit, n):
+            for size2 in (0, 1, limit + 1, n):
+                x = self.type2test(range(size1))
+                y = self.type2test(range(size1, size1 + size2))
+                z = y[:]
+                x.join(y)
+                self.assertEqual(list(x), list(range(size1 + size2)))
+                self.assertEqual(len(y), 0)
+                self.assertEqual(list(z), list(range(size1, size1+size2)))
+                if size1 + size2:
+                    m = (size1 + size2) // 2
+                    self.assertEqual(x[m], m)
+        x = self.type2test(range(n))
+        self.assertRaises(ValueError, x.join, x)
+        self.assertRaises(TypeError, x.join, list(range(n)))
+        self.assertEqual(list(x), list(range(n)))
+
+    def test_split_join(self):
+        x = self.type2test(range(n))
+        expected = list(range(n))
+        for step in range(3 * limit):
+            i = (step * 37) % (len(x) + 1)
+            left, right = x.split(i)
+            right.join(left)
+            x = right
+            expected = expected[i:] + expected[:i]
+            self.assertEqual(x[step % n], expected[step % n])
+        self.assertEqual(list(x), expected)
+
+    def test_take(self):
+        x = self.type2test(range(n))
+        for indices in ([], [0], [n-1, -1, 0], list(range(0, n, 7)),
+                        list(range(n-1, 0, -limit)),
+                        [(i * 7919) % n for i in range(3 * limit)]):
+            y = x.take(indices)
+            self.assertEqual(type(y), blist.blist)
+            self.assertEqual(list(y), [x[i] for i in indices])
+        self.assertEqual(list(self.type2test([5, 6]).take((1, 1, 0))), [6, 6, 5])
+        self.assertRaises(IndexError, x.take, [0, n])
+        self.assertRaises(IndexError, x.take, [-n-1])
+        self.assertRaises(TypeError, x.take, ['a'])
+        self.assertRaises(TypeError, x.take, 5)
+
+    def test_put(self):
+        for indices in ([], [3], list(range(0, n, 3)),
+                        list(range(n-1, 0, -limit)),
+                        [(i * 7919) % n for i in range(3 * limit)],
+                        [5, -1, 5]):
+            x = self.type2test(range(n))
+            y = x[:]
+            expected = list(range(n))
+            values = [('v', i) for i in range(len(indices))]
+            x.put(indices, values)
+            for i, v in zip(indices, values):
+                expected[i] = v
+            self.assertEqual(list(x), expected)
+            self.assertEqual(x[n // 2], expected[n // 2])
+            self.assertEqual(list(y), list(range(n)))
+        x = self.type2test(range(limit))
+        self.assertRaises(ValueError, x.put, [0, 1], [0])
+        self.assertRaises(IndexError, x.put, [limit], [0])
+        self.assertEqual(list(x), list(range(limit)))
+
+    def test_del_many(self):
+        for indices in ([], [3], [0, n-1], [5, -1, 5], list(range(0, n, 3)),
+                        list(range(n-1, 0, -limit)),
+                        [(i * 7919) % n for i in range(3 * limit)],
+                        list(range(n))):
+            x = self.type2test(range(n))
+            y = x[:]
+            x.del_many(indices)
+            dead = set(i % n for i in indices)
+            expected = [i for i in range(n) if i not in dead]
+            self.assertEqual(list(x), expected)
+            if expected:
+                self.assertEqual(x[len(x) // 2], expected[len(x) // 2])
+            self.assertEqual(list(y), list(range(n)))
+        x = self.type2test(range(limit))
+        x.del_many((1, 1, 0))
+        self.assertEqual(list(x), list(range(2, limit)))
+        self.assertRaises(IndexError, x.del_many, [0, limit])
+        self.assertRaises(TypeError, x.del_many, ['a'])
+        self.assertEqual(list(x), list(range(2, limit)))
+
+    def test_filter(self):
+        x = self.type2test(range(n))
+        y = x[:]
+        x.filter(lambda v: v % 3)
+        self.assertEqual(list(x), [i for i in range(n) if i % 3])
+        self.assertEqual(list(y), list(range(n)))
+        y.filter(None)
+        self.assertEqual(list(y), list(range(1, n)))
+
+        class Boom(Exception):
+            pass
+        def pred(v):
+            if v > n // 2:
+                raise Boom
+            return False
+        x = self.type2test(range(n))
+        self.assertRaises(Boom, x.filter, pred)
+        self.assertEqual(list(x), list(range(n)))
+
+        seen = []
+        def pred(v):
+            seen.append(len(x))
+            if v == 5:
+                x.append(v)
+            return True
+        self.assertRaises(ValueError, x.filter, pred)
+        self.assertEqual(seen[:6], [0] * 6)
+        self.assertEqual(list(x), list(range(n)))
+
+    def test_hash_values(self):
+        x = self.type2test(range(n))
+        x.hash_values()
+        y = x[:]
+        self.assert_(5 in x)
+        self.assertFalse(n in x)
+        self.assertEqual(x.count(5), 1)
+        x.append(5)
+        x.insert(0, 5)
+        self.assertEqual(x.count(5), 3)
+        x.remove(5)
+        del x[-1]
+        self.assertEqual(x.count(5), 1)
+        x[5] = n
+        self.assertFalse(5 in x)
+        self.assert_(n in x)
+        self.assertRaises(ValueError, x.index, 5)
+        self.assertRaises(ValueError, x.remove, 5)
+        x[10:20] = [5] * 4
+        self.assertEqual(x.count(5), 4)
+        x.sort()
+        self.assertEqual(x.count(5), 4)
+        self.assertEqual(y.count(5), 1)
+
+        x.append([])
+        self.assertEqual(x.count([]), 1)
+        self.assert_([] in x)
+        self.assertEqual(x.count(5), 4)
+
+        x.hash_values(False)
+        x.append(5)
+        self.assertEqual(x.count(5), 5)
+        x.hash_values()
+        self.assertEqual(x.count(5), 5)
+
     def pickle_test(self, pickler, x):
         y = pickler.dumps(x)
         z = pickler.loads(y)
@@ -342,10 +789,487 @@ class BListTest(list_tests.CommonTest):
             self.assertRaises(StopIteration, it.next)
         self.assertEqual(it.__length_hint__(), 0)
 
+    def test_small_sizeof(self):
+        if not hasattr(sys, 'getsizeof'): # pragma: no cover
+            return
+        small = blist.blist([1, 2, 3])
+        self.assert_(sys.getsizeof(small) <
+                     sys.getsizeof(blist.blist(list(range(limit)))))
+        self.assert_(sys.getsizeof(small) - sys.getsizeof([1, 2, 3]) < 128)
+        x = blist.blist()
+        for i in range(n):
+            x.append(i)
+            x.insert(0, i)
+        self.assertEqual(list(x), list(range(n-1, -1, -1)) + list(range(n)))
+
+    def test_edge_inserts(self):
+        x = blist.blist()
+        y = []
+        saved = []
+        for i in range(n * 4):
+            if i % 3:
+                x.append(i)
+                y.append(i)
+            else:
+                x.insert(0, i)
+                y.insert(0, i)
+            if i % (limit * 5) == 0:
+                saved.append((x[:], list(y)))
+        self.assertEqual(list(x), y)
+        for copy, expected in saved:
+            self.assertEqual(list(copy), expected)
+
+    def test_atomic_nodes_untracked(self):
+        def nodes(parent):
+            for node in gc.get_referents(parent):
+                if type(node).__name__ == '__internal_blist':
+                    yield node
+                    for child in nodes(node):
+                        yield child
+        x = blist.blist(range(n * 4))
+        tracked = [gc.is_tracked(node) for node in nodes(x)]
+        self.assert_(tracked)
+        self.assert_(tracked.count(True) * 10 < len(tracked))
+        self.assert_(gc.is_tracked(x))
+        x[n] = []
+        self.assert_(tracked.count(True) <
+                     [gc.is_tracked(node) for node in nodes(x)].count(True))
+
+    def test_cycle_through_atomic_nodes(self):
+        class Node(object):
+            pass
+        for how in range(6):
+            x = blist.blist(range(n * 4))
+            c = Node()
+            c.x = x
+            if how == 0:
+                x[n] = c
+            elif how == 1:
+                x.append(c)
+            elif how == 2:
+                x.insert(n, c)
+            elif how == 3:
+                x[n:n] = [c]
+            elif how == 4:
+                x[0] = c
+                x.reverse()
+            else:
+                x.extend(blist.blist([c]) * n)
+            ref = weakref.ref(c)
+            del x, c
+            gc.collect()
+            self.assertEqual(ref(), None, how)
+
+    def test_deferred_reclaim(self):
+        class Node(object):
+            def __del__(self):
+                other.append(len(other))
+        other = blist.blist()
+        old = blist.set_reclaim_threshold(n)
+        try:
+            blist.reclaim()
+            for how in range(2):
+                items = [Node() for i in range(n * 4)]
+                refs = list(map(weakref.ref, items))
+                x = blist.blist(items)
+                y = x[n:n*2]
+                del items
+                if how == 0:
+                    del x
+                else:
+                    x.clear()
+                self.assertTrue(blist.reclaim(limit) > 0)
+                self.assertNotEqual(refs[0](), None)
+                self.assertEqual(blist.reclaim(), 0)
+                alive = [r() is not None for r in refs]
+                self.assertEqual(alive, [n <= i < n*2 for i in range(n*4)])
+                del y
+                blist.reclaim()
+            self.assertEqual(list(other), list(range(n * 8)))
+        finally:
+            blist.set_reclaim_threshold(old)
+
     def test_sort_floats(self):
         x = blist.blist([0.1, 0.2, 0.3])
         x.sort()
 
+    def test_sort_strings(self):
+        import random
+        r = random.Random(3)
+        words = ['', 'a', 'a\0', 'a\0\0', 'ab', 'abc' * 10, 'abc' * 10 + 'a',
+                 '\xe9', '\u0100', '\U0001f600', 'a\U0001f600', 'a\xff']
+        for i in range(n):
+            words.append('x' * r.randrange(50) + str(r.randrange(100)))
+        pairs = [(r.choice(words), i) for i in range(n * 2)]
+        x = blist.blist(pairs)
+        x.sort(key=operator.itemgetter(0))
+        self.assertEqual(list(x), sorted(pairs))
+        x.sort(key=operator.itemgetter(0), reverse=True)
+        self.assertEqual(list(x), sorted(pairs, key=operator.itemgetter(0),
+                                         reverse=True))
+        x = blist.blist(words)
+        x.sort()
+        self.assertEqual(list(x), sorted(words))
+        if sys.version_info[0] >= 3:
+            b = [w.encode('utf-8') for w in words]
+            x = blist.blist(b)
+            x.sort()
+            self.assertEqual(list(x), sorted(b))
+            x = blist.blist(words + b)
+            self.assertRaises(TypeError, x.sort)
+
+    def test_sort_kernels(self):
+        import random
+        r = random.Random(4)
+        class Box(object):
+            def __init__(self, v):
+                self.v = v
+            def __eq__(self, other):
+                return self.v == other.v
+            def __lt__(self, other):
+                return self.v < other.v
+        keys = [
+            [(r.randrange(5), r.randrange(n)) for i in range(n)],
+            [(r.randrange(3), r.choice([1.5, 0.0, -2.0]), i % 7)
+             for i in range(n)],
+            [(r.randrange(3),) * r.randrange(4) for i in range(n)],
+            [(r.choice(['a', 'b']), Box(r.randrange(9))) for i in range(n)],
+            [(r.randrange(3), r.randrange(3) * 10 ** 30) for i in range(n)],
+            [r.randrange(-10 ** 30, 10 ** 30) for i in range(n)],
+        ]
+        for k in keys:
+            items = list(range(len(k)))
+            x = blist.blist(items)
+            x.sort(key=k.__getitem__)
+            y = sorted(items, key=k.__getitem__)
+            self.assertEqual(list(x), y)
+
+        # NaN has no total order; only check nothing is lost
+        nan = float('nan')
+        k = [(i % 3, r.choice([1.5, nan, -2.0])) for i in range(n)]
+        x = blist.blist(range(n))
+        x.sort(key=k.__getitem__)
+        self.assertEqual(sorted(x), list(range(n)))
+
+        class Boom(Exception):
+            pass
+        class Bad(object):
+            def __eq__(self, other):
+                raise Boom
+        x = blist.blist([(1, Bad()) for i in range(n)])
+        self.assertRaises(Boom, x.sort)
+        self.assertEqual(len(x), n)
+
+    def test_sort_words(self):
+        import random
+        r = random.Random(6)
+        big = 2 ** 127
+        ends = [0, -1, 2 ** 63, -2 ** 63 - 1, 2 ** 64, big - 1, -big + 1]
+        keys = [
+            [(10 ** 18 + r.randrange(50), r.randrange(5)) for i in range(n)],
+            [(r.choice([0.0, -0.0, 1.5, -1e300]), r.randrange(3), i % 4)
+             for i in range(n)],
+            [r.choice(ends) + r.randrange(-2, 3) for i in range(n)],
+            [(r.randrange(3), r.choice(ends), r.random()) for i in range(n)],
+            [() for i in range(n)],
+            # These do not fit the radix sort
+            [(r.randrange(3), r.choice([1, 2.5])) for i in range(n)],
+            [(r.randrange(3), str(r.randrange(3))) for i in range(n)],
+            [r.randrange(-big * 4, big * 4) for i in range(n)],
+            [(r.randrange(3),) * r.randrange(1, 3) for i in range(n)],
+            [(r.randrange(3), r.choice([True, False, 2]))
+             for i in range(n)],
+            [r.choice([(1, 2), 5]) for i in range(n)],
+        ]
+        for k in keys:
+            items = list(range(len(k)))
+            x = blist.blist(items)
+            try:
+                y = sorted(items, key=k.__getitem__)
+            except TypeError:
+                self.assertRaises(TypeError, x.sort, key=k.__getitem__)
+                continue
+            x.sort(key=k.__getitem__)
+            self.assertEqual(list(x), y)
+
+    def test_sort_runs(self):
+        import random
+        r = random.Random(7)
+        n = 2000
+        words = sorted(str(r.random()) for i in range(n))
+        cases = [list(range(n)), list(range(n, 0, -1)),
+                 list(range(n)) + [r.randrange(n) for i in range(10)],
+                 words[1::2] + words[::2], words[::3] + words[1::3] +
+                 words[2::3] + [str(r.random()) for i in range(50)]]
+        for items in cases:
+            for rev in (False, True):
+                x = blist.blist(items)
+                x.sort(reverse=rev)
+                self.assertEqual(list(x), sorted(items, reverse=rev))
+                x = blist.blist(items)
+                x.sort(key=lambda v: v, reverse=rev)
+                self.assertEqual(list(x), sorted(items, reverse=rev))
+
+        # Descending, but with ties that must keep their order
+        items = [v for i in range(n, 0, -1) for v in (i, float(i))]
+        x = blist.blist(items)
+        x.sort()
+        self.assertEqual([type(v) for v in x], [int, float] * n)
+        pairs = [(i // 2, i) for i in range(n, 0, -1)]
+        x = blist.blist(pairs)
+        x.sort(key=lambda p: p[0])
+        self.assertEqual(list(x), sorted(pairs, key=lambda p: p[0]))
+
+        class Bad(object):
+            def __lt__(self, other):
+                raise ValueError
+            __gt__ = __lt__
+        items = list(range(n))
+        items[n // 2] = Bad()
+        x = blist.blist(items)
+        self.assertRaises(ValueError, x.sort)
+        self.assertEqual(sorted(x, key=id), sorted(items, key=id))
+
+    def test_sort_getters(self):
+        import random
+        from operator import itemgetter, attrgetter
+        r = random.Random(3)
+        n = 1000
+        class Ob(object):
+            def __init__(self, i):
+                self.ts = r.randrange(100)
+                self.name = str(r.random())
+                self.i = i
+        class Negated(tuple):
+            def __getitem__(self, i):
+                return -tuple.__getitem__(self, i)
+        pairs = [(r.randrange(100), r.random(), i) for i in range(n)]
+        cases = [
+            (pairs, itemgetter(0)), (pairs, itemgetter(-1)),
+            (pairs, itemgetter(1, 0)), (pairs, itemgetter(slice(0, 2))),
+            ([list(p) for p in pairs], itemgetter(0)),
+            ([Negated(p) for p in pairs], itemgetter(0)),
+            ([{'k': p[0], 'i': i} for i, p in enumerate(pairs)],
+             itemgetter('k')),
+            ([Ob(i) for i in range(n)], attrgetter('ts')),
+            ([Ob(i) for i in range(n)], attrgetter('name', 'i')),
+            ([Ob(i) for i in range(n)], attrgetter('name.__class__', 'i')),
+        ]
+        for items, key in cases:
+            for rev in (False, True):
+                x = blist.blist(items)
+                x.sort(key=key, reverse=rev)
+                self.assertEqual(list(x), sorted(items, key=key, reverse=rev))
+
+        x = blist.blist(pairs)
+        self.assertRaises(IndexError, x.sort, key=itemgetter(3))
+        self.assertEqual(x, pairs)
+        x = blist.blist(pairs + [()])
+        self.assertRaises(IndexError, x.sort, key=itemgetter(0))
+        self.assertEqual(sorted(x), sorted(pairs + [()]))
+        x = blist.blist([Ob(i) for i in range(n)])
+        self.assertRaises(AttributeError, x.sort, key=attrgetter('nope'))
+        self.assertEqual(len(x), n)
+
+    def test_sort_inplace(self):
+        import random
+        r = random.Random(7)
+        self.assertEqual(blist.set_sort_inplace_threshold(-5), -1)
+        old = blist.set_sort_inplace_threshold(0)
+        try:
+            self.assertEqual(blist.set_sort_inplace_threshold(0), 0)
+            for size in (0, 1, 2, 5, 40, limit * 3, n, 5000):
+                ints = [r.randrange(-size - 1, size + 1) for i in range(size)]
+                floats = [r.uniform(-1, 1) for i in range(size)]
+                for items in (ints, floats):
+                    x = self.type2test(items)
+                    x.sort()
+                    self.assertEqual(list(x), sorted(items))
+                    x = self.type2test(items)
+                    x.sort(reverse=True)
+                    self.assertEqual(list(x), sorted(items, reverse=True))
+                x = self.type2test(range(size))
+                keys = [i % 7 for i in range(size)]
+                x.sort(key=keys.__getitem__)
+                self.assertEqual(x, [i for k in range(7)
+                                     for i in range(k, size, 7)])
+            x = self.type2test([2**64 - 1, 0, 2**63, 2**63 - 1, -2**63])
+            x.sort()
+            self.assertEqual(x, [-2**63, 0, 2**63 - 1, 2**63, 2**64 - 1])
+        finally:
+            blist.set_sort_inplace_threshold(old)
+
+    def test_sort_threads(self):
+        import random, threading
+        big = 1 << 17
+        r = random.Random(5)
+        ints = [r.randrange(-big, big) for i in range(big)]
+        floats = [r.uniform(-1, 1) for i in range(big)]
+        pairs = [(r.randrange(100), i) for i in range(big)]
+        self.assertRaises(ValueError, blist.set_sort_threads, 0)
+        old = blist.set_sort_threads(4)
+        try:
+            self.assertEqual(blist.set_sort_threads(4), 4)
+            for items in (ints, floats):
+                x = blist.blist(items)
+                x.sort()
+                self.assertEqual(list(x), sorted(items))
+                x = blist.blist(items)
+                x.sort(reverse=True)
+                self.assertEqual(list(x), sorted(items, reverse=True))
+            x = blist.blist(pairs)
+            x.sort(key=lambda p: p[0])
+            self.assertEqual(list(x), sorted(pairs))
+
+            results = []
+            def work():
+                y = blist.blist(ints)
+                y.sort()
+                results.append(list(y) == sorted(ints))
+            threads = [threading.Thread(target=work) for i in range(3)]
+            for t in threads:
+                t.start()
+            for t in threads:
+                t.join()
+            self.assertEqual(results, [True] * 3)
+        finally:
+            blist.set_sort_threads(old)
+
+class TypedBListTest(unittest.TestCase):
+    typecodes = 'bBhHiIlLqQfd'
+
+    def test_basic(self):
+        for typecode in self.typecodes:
+            data = [i % 100 for i in range(n)]
+            x = blist.typedblist(typecode, data)
+            self.assertEqual(x.typecode, typecode)
+            self.assertEqual(len(x), n)
+            self.assertEqual(list(x), data)
+            self.assertEqual(x.tolist(), data)
+            self.assertEqual(x[limit], data[limit])
+            self.assertEqual(x[-1], data[-1])
+            self.assertEqual(x[3:limit*3:7].tolist(), data[3:limit*3:7])
+            self.assertEqual(list(reversed(x)), data[::-1])
+
+    def test_mutate(self):
+        x = blist.typedblist('i')
+        y = []
+        for i in range(n):
+            x.insert(i // 2, i)
+            y.insert(i // 2, i)
+        x.append(-5)
+        y.append(-5)
+        x[7] = 9
+        y[7] = 9
+        del x[limit:limit*2]
+        del y[limit:limit*2]
+        x[1:5] = range(10)
+        y[1:5] = range(10)
+        x[::3] = [0] * len(y[::3])
+        y[::3] = [0] * len(y[::3])
+        del x[::5]
+        del y[::5]
+        self.assertEqual(x.pop(), y.pop())
+        self.assertEqual(x.pop(3), y.pop(3))
+        x.remove(9)
+        y.remove(9)
+        x.extend(x)
+        y.extend(y)
+        self.assertEqual(x.tolist(), y)
+
+    def test_zero_values(self):
+        x = blist.typedblist('d', [0.0] * n)
+        self.assertEqual(x.pop(), 0.0)
+        self.assertEqual(sum(x), 0.0)
+        self.assertEqual(x.count(0), n-1)
+        self.assertEqual(len(list(iter(x))), n-1)
+
+    def test_range(self):
+        self.assertEqual(blist.typedblist('b', [-128, 127]).tolist(),
+                         [-128, 127])
+        self.assertEqual(blist.typedblist('Q', [2**64-1])[0], 2**64-1)
+        for typecode, value in [('b', 128), ('b', -129), ('B', -1),
+                                ('H', 2**16), ('i', 2**31), ('q', 2**63),
+                                ('Q', -1), ('Q', 2**64)]:
+            self.assertRaises(OverflowError, blist.typedblist, typecode,
+                              [value])
+        x = blist.typedblist('B', [1, 2, 3])
+        self.assertRaises(OverflowError, x.append, 256)
+        self.assertRaises(TypeError, x.append, 'x')
+        self.assertRaises(TypeError, x.append, 1.0)
+        self.assertEqual(x.tolist(), [1, 2, 3])
+        self.assertRaises(ValueError, blist.typedblist, 'z')
+        self.assertEqual(blist.typedblist('f', [0.1])[0], 0.10000000149011612)
+
+    def test_search(self):
+        x = blist.typedblist('I', range(n))
+        self.assert_(5 in x)
+        self.assert_(5.0 in x)
+        self.assert_(5.5 not in x)
+        self.assert_(-1 not in x)
+        self.assert_(2**40 not in x)
+        self.assertEqual(x.index(n-1), n-1)
+        self.assertEqual(x.index(3, 2, 4), 3)
+        self.assertRaises(ValueError, x.index, 3, 4)
+        self.assertEqual(x.count(7), 1)
+        self.assert_(2**60 in blist.typedblist('Q', [2**60]))
+        self.assert_(float('nan') not in blist.typedblist('d', [float('nan')]))
+
+    def test_sort(self):
+        import random
+        for typecode, lo, hi in [('q', -2**63, 2**63-1), ('Q', 0, 2**64-1),
+                                 ('h', -2**15, 2**15-1)]:
+            for size in (10, n):
+                data = [random.randint(lo, hi) for i in range(size)]
+                x = blist.typedblist(typecode, data)
+                x.sort()
+                self.assertEqual(x.tolist(), sorted(data))
+                x.sort(reverse=True)
+                self.assertEqual(x.tolist(), sorted(data, reverse=True))
+        inf = float('inf')
+        data = [random.uniform(-1e9, 1e9) for i in range(n)]
+        data += [inf, -inf, 0.0, 1e-310, -1e-310]
+        x = blist.typedblist('d', data)
+        x.sort()
+        self.assertEqual(x.tolist(), sorted(data))
+
+    def test_copy(self):
+        x = blist.typedblist('d', range(n))
+        y = x[:]
+        y[5] = -1
+        self.assertEqual(x[5], 5)
+        self.assertEqual(blist.typedblist('d', x), x)
+        self.assertNotEqual(y, x)
+        self.assertEqual((x + y).tolist(), x.tolist() + y.tolist())
+        self.assertEqual((x * 2).tolist(), x.tolist() * 2)
+        self.assertRaises(TypeError, operator.add, x, [1])
+        if sys.version_info[0] >= 3:
+            # Python 2 adds a blist only to another blist
+            z = blist.blist(['a']) + x
+            self.assertEqual(type(z), blist.blist)
+            self.assertEqual(z, ['a'] + x.tolist())
+            self.assertEqual(blist.blist() + blist.typedblist('i'), [])
+        self.assert_(blist.typedblist('i', [1, 2]) <
+                     blist.typedblist('d', [1, 2.5]))
+
+    def test_pickle(self):
+        for typecode in self.typecodes:
+            x = blist.typedblist(typecode, [i % 100 for i in range(n)])
+            y = pickle.loads(pickle.dumps(x))
+            self.assertEqual(x, y)
+            self.assertEqual(y.typecode, typecode)
+            self.assertEqual(repr(x), repr(y))
+        self.assertEqual(repr(blist.typedblist('d')), "typedblist('d')")
+
+    def test_evil_index(self):
+        x = blist.typedblist('i', range(n))
+        class Evil(object):
+            def __index__(self):
+                del x[:]
+                return 1
+        self.assertRaises(IndexError, operator.setitem, x, n-1, Evil())
+        self.assertEqual(len(x), 0)
+
 tests = [BListTest,
          sortedlist_tests.SortedListTest,
          sortedlist_tests.WeakSortedListTest,
@@ -355,6 +1279,8 @@ tests = [BListTest,
          sorteddict_tests.sorteddict_test
          ]
 tests += test_set.test_classes
+if hasattr(blist, 'typedblist'):
+    tests.append(TypedBListTest)
 
 def test_suite():
     suite = unittest.TestSuite()